@@ -0,0 +1,328 @@
+﻿#include "Animation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ANIMATION_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    //四个float的向量运算，x86上是SSE，其他平台是等价的标量实现
+#if defined(ANIMATION_SSE)
+    typedef __m128 Vec4;
+
+    inline Vec4 load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+    inline Vec4 set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    inline Vec4 splat(float s) { return _mm_set1_ps(s); }
+    inline Vec4 add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+    inline Vec4 sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+    inline Vec4 mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+    inline Vec4 madd(Vec4 a, Vec4 b, Vec4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline Vec4 splatX(Vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)); }
+    inline Vec4 splatY(Vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)); }
+    inline Vec4 splatZ(Vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)); }
+    inline Vec4 splatW(Vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+    inline float first(Vec4 v) { return _mm_cvtss_f32(v); }
+
+    //四个分量的点积，结果在每个分量中
+    inline Vec4 dot4(Vec4 a, Vec4 b)
+    {
+        Vec4 m = _mm_mul_ps(a, b);
+        Vec4 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
+    //sign为负时取反v
+    inline Vec4 flipSign(Vec4 v, Vec4 sign)
+    {
+        return _mm_xor_ps(v, _mm_and_ps(sign, _mm_set1_ps(-0.0f)));
+    }
+
+    inline Vec4 normalize4(Vec4 v)
+    {
+        return _mm_div_ps(v, _mm_sqrt_ps(dot4(v, v)));
+    }
+#else
+    struct Vec4
+    {
+        float v[4];
+    };
+
+    inline Vec4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    inline void store(float* p, Vec4 a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+    inline Vec4 set(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+    inline Vec4 splat(float s) { return { { s, s, s, s } }; }
+    inline Vec4 add(Vec4 a, Vec4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+    inline Vec4 sub(Vec4 a, Vec4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+    inline Vec4 mul(Vec4 a, Vec4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+    inline Vec4 madd(Vec4 a, Vec4 b, Vec4 c) { return add(mul(a, b), c); }
+    inline Vec4 splatX(Vec4 a) { return splat(a.v[0]); }
+    inline Vec4 splatY(Vec4 a) { return splat(a.v[1]); }
+    inline Vec4 splatZ(Vec4 a) { return splat(a.v[2]); }
+    inline Vec4 splatW(Vec4 a) { return splat(a.v[3]); }
+    inline float first(Vec4 a) { return a.v[0]; }
+
+    inline Vec4 dot4(Vec4 a, Vec4 b)
+    {
+        return splat(a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] + a.v[3] * b.v[3]);
+    }
+
+    inline Vec4 flipSign(Vec4 a, Vec4 sign)
+    {
+        return sign.v[0] < 0.0f ? sub(splat(0.0f), a) : a;
+    }
+
+    inline Vec4 normalize4(Vec4 a)
+    {
+        return mul(a, splat(1.0f / std::sqrt(dot4(a, a).v[0])));
+    }
+#endif
+
+    //a * b，out可以与a或b相同
+    void multiply(const JointMatrix& a, const JointMatrix& b, JointMatrix& out)
+    {
+        Vec4 b0 = load(b.rows[0]);
+        Vec4 b1 = load(b.rows[1]);
+        Vec4 b2 = load(b.rows[2]);
+        Vec4 b3 = set(0.0f, 0.0f, 0.0f, 1.0f);
+        Vec4 a0 = load(a.rows[0]);
+        Vec4 a1 = load(a.rows[1]);
+        Vec4 a2 = load(a.rows[2]);
+
+        store(out.rows[0], madd(splatX(a0), b0, madd(splatY(a0), b1, madd(splatZ(a0), b2, mul(splatW(a0), b3)))));
+        store(out.rows[1], madd(splatX(a1), b0, madd(splatY(a1), b1, madd(splatZ(a1), b2, mul(splatW(a1), b3)))));
+        store(out.rows[2], madd(splatX(a2), b0, madd(splatY(a2), b1, madd(splatZ(a2), b2, mul(splatW(a2), b3)))));
+    }
+
+    //单位四元数和平移转为矩阵
+    void poseToMatrix(const JointPose& pose, JointMatrix& out)
+    {
+        float x = pose.rotation[0];
+        float y = pose.rotation[1];
+        float z = pose.rotation[2];
+        float w = pose.rotation[3];
+
+        out.rows[0][0] = 1.0f - 2.0f * (y * y + z * z);
+        out.rows[0][1] = 2.0f * (x * y - z * w);
+        out.rows[0][2] = 2.0f * (x * z + y * w);
+        out.rows[0][3] = pose.translation[0];
+        out.rows[1][0] = 2.0f * (x * y + z * w);
+        out.rows[1][1] = 1.0f - 2.0f * (x * x + z * z);
+        out.rows[1][2] = 2.0f * (y * z - x * w);
+        out.rows[1][3] = pose.translation[1];
+        out.rows[2][0] = 2.0f * (x * z - y * w);
+        out.rows[2][1] = 2.0f * (y * z + x * w);
+        out.rows[2][2] = 1.0f - 2.0f * (x * x + y * y);
+        out.rows[2][3] = pose.translation[2];
+    }
+}
+
+void Animation::samplePose(const Skeleton& skeleton, const AnimationClip& clip, float time, JointPose* out)
+{
+    uint32_t jointCount = skeleton.getJointCount();
+    if (clip.frameCount == 0 || clip.keys.size() != (size_t)clip.frameCount * jointCount)
+    {
+        throw std::runtime_error("animation clip does not match skeleton!");
+    }
+
+    float frame = std::fmod(time * clip.sampleRate, (float)clip.frameCount);
+    if (frame < 0.0f)
+    {
+        frame += (float)clip.frameCount;
+    }
+    uint32_t frame0 = std::min((uint32_t)frame, clip.frameCount - 1);
+    uint32_t frame1 = (frame0 + 1) % clip.frameCount;
+
+    blendPoses(&clip.keys[(size_t)frame0 * jointCount], &clip.keys[(size_t)frame1 * jointCount], frame - (float)frame0, jointCount, out);
+}
+
+void Animation::blendPoses(const JointPose* a, const JointPose* b, float weight, uint32_t jointCount, JointPose* out)
+{
+    Vec4 t = splat(weight);
+    for (uint32_t i = 0; i < jointCount; i++)
+    {
+        Vec4 ta = load(a[i].translation);
+        Vec4 tb = load(b[i].translation);
+        Vec4 qa = load(a[i].rotation);
+        Vec4 qb = load(b[i].rotation);
+
+        //q和-q是同一个旋转，点积为负时翻转b，插值走短弧
+        qb = flipSign(qb, dot4(qa, qb));
+
+        store(out[i].translation, madd(sub(tb, ta), t, ta));
+        store(out[i].rotation, normalize4(madd(sub(qb, qa), t, qa)));
+    }
+}
+
+void Animation::computeSkinningMatrices(const Skeleton& skeleton, const JointPose* local, const JointMatrix& root, JointMatrix* model, JointMatrix* out)
+{
+    uint32_t jointCount = skeleton.getJointCount();
+    for (uint32_t i = 0; i < jointCount; i++)
+    {
+        JointMatrix localMatrix;
+        poseToMatrix(local[i], localMatrix);
+
+        int32_t parent = skeleton.parents[i];
+        multiply(parent < 0 ? root : model[parent], localMatrix, model[i]);
+        multiply(model[i], skeleton.inverseBind[i], out[i]);
+    }
+}
+
+void Animation::skinVertices(const SkinnedVertex* vertices, uint32_t vertexCount, const JointMatrix* matrices, SkinnedOutputVertex* out)
+{
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        const SkinnedVertex& vertex = vertices[v];
+
+        //位置在平面上（z = 0），只需要混合矩阵的前两行
+        Vec4 row0 = splat(0.0f);
+        Vec4 row1 = splat(0.0f);
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            float weight = vertex.weights[k];
+            if (weight == 0.0f)
+            {
+                continue;
+            }
+            const JointMatrix& matrix = matrices[(vertex.joints >> (8 * k)) & 0xFF];
+            Vec4 w = splat(weight);
+            row0 = madd(load(matrix.rows[0]), w, row0);
+            row1 = madd(load(matrix.rows[1]), w, row1);
+        }
+
+        Vec4 position = set(vertex.pos[0], vertex.pos[1], 0.0f, 1.0f);
+        out[v].pos[0] = first(dot4(row0, position));
+        out[v].pos[1] = first(dot4(row1, position));
+        out[v].color[0] = vertex.color[0];
+        out[v].color[1] = vertex.color[1];
+        out[v].color[2] = vertex.color[2];
+    }
+}
+
+JointMatrix Animation::identity()
+{
+    return placement(0.0f, 0.0f, 1.0f, 1.0f);
+}
+
+JointMatrix Animation::placement(float x, float y, float scaleX, float scaleY)
+{
+    JointMatrix matrix = {};
+    matrix.rows[0][0] = scaleX;
+    matrix.rows[0][3] = x;
+    matrix.rows[1][1] = scaleY;
+    matrix.rows[1][3] = y;
+    matrix.rows[2][2] = 1.0f;
+    return matrix;
+}
+
+//------------------------------动画系统------------------------------
+
+AnimationSystem::AnimationSystem(uint32_t threadCount)
+    : nextCharacter(0)
+{
+    if (threadCount == 0)
+    {
+        threadCount = WorkerPool::shared().getThreadCount();
+    }
+    this->threadCount = threadCount;
+    updateTask = [this](uint32_t threadIndex) { updateCharacters(threadIndex); };
+}
+
+void AnimationSystem::init(const Skeleton& skeleton, const std::vector<AnimationClip>& clips, const std::vector<SkinnedVertex>& bindVertices, const std::vector<Character>& characters)
+{
+    uint32_t jointCount = skeleton.getJointCount();
+    if (jointCount == 0 || jointCount > Animation::MAX_JOINTS || skeleton.inverseBind.size() != jointCount)
+    {
+        throw std::runtime_error("invalid skeleton!");
+    }
+    for (const auto& character : characters)
+    {
+        if (character.clipA >= clips.size() || character.clipB >= clips.size())
+        {
+            throw std::runtime_error("animation character references a missing clip!");
+        }
+    }
+
+    this->skeleton = skeleton;
+    this->clips = clips;
+    this->bindVertices = bindVertices;
+    this->characters = characters;
+
+    threadScratch.resize(threadCount);
+    for (auto& scratch : threadScratch)
+    {
+        scratch.poseA.resize(jointCount);
+        scratch.poseB.resize(jointCount);
+        scratch.model.resize(jointCount);
+    }
+}
+
+void AnimationSystem::update(float time, JointMatrix* matrices, SkinnedOutputVertex* skinnedVertices)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    currentTime = time;
+    currentMatrices = matrices;
+    currentVertices = skinnedVertices;
+    nextCharacter.store(0);
+    parallelRun();
+
+    lastUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void AnimationSystem::updateCharacters(uint32_t threadIndex)
+{
+    ThreadScratch& scratch = threadScratch[threadIndex];
+    uint32_t characterCount = (uint32_t)characters.size();
+    for (;;)
+    {
+        uint32_t begin = nextCharacter.fetch_add(CHARACTERS_PER_TASK);
+        if (begin >= characterCount)
+        {
+            return;
+        }
+        uint32_t end = std::min(characterCount, begin + CHARACTERS_PER_TASK);
+        for (uint32_t i = begin; i < end; i++)
+        {
+            updateCharacter(i, scratch);
+        }
+    }
+}
+
+void AnimationSystem::updateCharacter(uint32_t index, ThreadScratch& scratch)
+{
+    const Character& character = characters[index];
+    uint32_t jointCount = skeleton.getJointCount();
+    float time = currentTime + character.timeOffset;
+
+    Animation::samplePose(skeleton, clips[character.clipA], time, scratch.poseA.data());
+    Animation::samplePose(skeleton, clips[character.clipB], time, scratch.poseB.data());
+    float weight = 0.5f + 0.5f * std::sin(time * character.blendRate);
+    Animation::blendPoses(scratch.poseA.data(), scratch.poseB.data(), weight, jointCount, scratch.poseA.data());
+
+    JointMatrix* matrices = currentMatrices + (size_t)index * jointCount;
+    Animation::computeSkinningMatrices(skeleton, scratch.poseA.data(), character.root, scratch.model.data(), matrices);
+
+    if (currentVertices != nullptr)
+    {
+        uint32_t vertexCount = (uint32_t)bindVertices.size();
+        Animation::skinVertices(bindVertices.data(), vertexCount, matrices, currentVertices + (size_t)index * vertexCount);
+    }
+}
+
+void AnimationSystem::parallelRun()
+{
+    //角色少的时候在调用线程上更新
+    if (characters.size() < 2 * CHARACTERS_PER_TASK)
+    {
+        updateCharacters(0);
+        return;
+    }
+    WorkerPool::shared().parallelFor(threadCount, updateTask);
+}
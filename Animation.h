@@ -0,0 +1,156 @@
+﻿#pragma once
+
+/*
+骨骼动画和蒙皮：
+
+1. 骨骼的关节按父节点在前的顺序存放，每个关节的局部姿势是平移和旋转四元数（不支持缩放）
+2. 动画片段按固定帧率存放关键帧并循环播放，采样时在相邻两帧之间插值：平移线性插值，旋转做nlerp（走短弧）；
+   两个片段的姿势按权重混合也用同样的方法。四元数和矩阵运算在x86上用SSE，一个四元数或矩阵的一行正好是一个__m128
+3. 姿势转为蒙皮矩阵：局部 -> 模型空间（沿父链相乘，根关节再乘以角色的放置矩阵）-> 乘以绑定姿势的逆矩阵，
+   输出3x4行主序矩阵，与SkinningShader.comp中的布局一致
+4. 蒙皮：每个顶点最多4个关节，先按权重混合矩阵再变换位置。GPU上由计算着色器完成，所有角色一次dispatch；
+   没有计算队列或指定使用CPU时，由skinVertices在工作线程上完成
+5. AnimationSystem在WorkerPool上并行计算所有角色的姿势和蒙皮矩阵（以及CPU蒙皮），update不分配内存
+*/
+
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//关节的局部姿势，平移的w和对齐无关
+struct alignas(16) JointPose
+{
+    float translation[4];
+    float rotation[4];//四元数xyzw
+};
+
+//3x4行主序仿射矩阵，第四行隐含为(0, 0, 0, 1)
+struct alignas(16) JointMatrix
+{
+    float rows[3][4];
+};
+
+//蒙皮前的顶点，与SkinningShader.comp中按10个float读取的布局一致
+struct SkinnedVertex
+{
+    float pos[2];
+    float color[3];
+    uint32_t joints;//4个关节下标，每个8位，低位是第0个
+    float weights[4];//和为1，不用的关节权重为0
+};
+
+//蒙皮后的顶点，与MyRender.cpp中的Vertex布局相同
+struct SkinnedOutputVertex
+{
+    float pos[2];
+    float color[3];
+};
+
+struct Skeleton
+{
+    std::vector<int32_t> parents;//父关节下标，根关节为-1，父关节总在子关节之前
+    std::vector<JointMatrix> inverseBind;//绑定姿势下模型空间到关节空间的变换
+
+    uint32_t getJointCount() const { return (uint32_t)parents.size(); }
+};
+
+struct AnimationClip
+{
+    std::string name;
+    float sampleRate = 30.0f;//每秒的关键帧数
+    uint32_t frameCount = 0;//循环播放，最后一帧之后回到第0帧
+    std::vector<JointPose> keys;//keys[帧 * 关节数 + 关节]
+};
+
+namespace Animation
+{
+    const uint32_t MAX_JOINTS = 256;//顶点的关节下标是8位
+
+    //在time（秒）时刻采样片段，out为每个关节的局部姿势
+    void samplePose(const Skeleton& skeleton, const AnimationClip& clip, float time, JointPose* out);
+
+    //out = a和b按weight混合（0为a，1为b），out可以与a或b相同
+    void blendPoses(const JointPose* a, const JointPose* b, float weight, uint32_t jointCount, JointPose* out);
+
+    //局部姿势转为蒙皮矩阵，root是角色的放置矩阵，model是关节数大小的临时空间
+    void computeSkinningMatrices(const Skeleton& skeleton, const JointPose* local, const JointMatrix& root, JointMatrix* model, JointMatrix* out);
+
+    //CPU蒙皮，与SkinningShader.comp的结果相同
+    void skinVertices(const SkinnedVertex* vertices, uint32_t vertexCount, const JointMatrix* matrices, SkinnedOutputVertex* out);
+
+    //单位矩阵和按平移、缩放构造的放置矩阵
+    JointMatrix identity();
+    JointMatrix placement(float x, float y, float scaleX, float scaleY);
+}
+
+class AnimationSystem
+{
+public:
+    //一个动画角色：两个片段按随时间变化的权重混合，播放时间各自错开
+    struct Character
+    {
+        JointMatrix root;
+        uint32_t clipA;
+        uint32_t clipB;
+        float timeOffset;//秒
+        float blendRate;//混合权重变化的角速度（弧度每秒）
+    };
+
+    //少于这个数量的角色在调用线程上更新
+    static const uint32_t CHARACTERS_PER_TASK = 32;
+
+    //threadCount是并行的份数，为0时与WorkerPool的线程数相同
+    explicit AnimationSystem(uint32_t threadCount = 0);
+
+    AnimationSystem(const AnimationSystem&) = delete;
+    AnimationSystem& operator=(const AnimationSystem&) = delete;
+
+    //所有角色共用骨骼、片段和绑定姿势的网格
+    void init(const Skeleton& skeleton, const std::vector<AnimationClip>& clips, const std::vector<SkinnedVertex>& bindVertices, const std::vector<Character>& characters);
+
+    //计算time时刻所有角色的蒙皮矩阵（每个角色关节数个，依次存放），
+    //skinnedVertices不为空时同时做CPU蒙皮（每个角色顶点数个，依次存放）
+    void update(float time, JointMatrix* matrices, SkinnedOutputVertex* skinnedVertices);
+
+    uint32_t getCharacterCount() const { return (uint32_t)characters.size(); }
+    uint32_t getJointCount() const { return skeleton.getJointCount(); }
+    uint32_t getVertexCount() const { return (uint32_t)bindVertices.size(); }
+    uint32_t getThreadCount() const { return threadCount; }
+    const std::vector<SkinnedVertex>& getBindVertices() const { return bindVertices; }
+
+    //最近一次update的耗时（毫秒）
+    double getLastUpdateMs() const { return lastUpdateMs; }
+
+private:
+    //每个线程的临时姿势，init时分配
+    struct ThreadScratch
+    {
+        std::vector<JointPose> poseA;
+        std::vector<JointPose> poseB;
+        std::vector<JointMatrix> model;
+    };
+
+    void updateCharacters(uint32_t threadIndex);
+    void updateCharacter(uint32_t character, ThreadScratch& scratch);
+
+    //在WorkerPool上把updateCharacters运行threadCount份，返回时都已完成
+    void parallelRun();
+
+    Skeleton skeleton;
+    std::vector<AnimationClip> clips;
+    std::vector<SkinnedVertex> bindVertices;
+    std::vector<Character> characters;
+    std::vector<ThreadScratch> threadScratch;
+    uint32_t threadCount;
+    double lastUpdateMs = 0.0;
+
+    //当前这次update的参数
+    float currentTime = 0.0f;
+    JointMatrix* currentMatrices = nullptr;
+    SkinnedOutputVertex* currentVertices = nullptr;
+    std::atomic<uint32_t> nextCharacter;
+    WorkerPool::Task updateTask;//构造时创建，每次update不再构造std::function
+};
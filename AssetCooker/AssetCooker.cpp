@@ -0,0 +1,96 @@
+﻿//离线网格烘焙工具：读入OBJ，优化三角形和顶点顺序，量化顶点属性，写出渲染器可以直接上传的.mesh文件
+//用法：AssetCooker <输入.obj> <输出.mesh> [--no-overdraw]
+
+#include "MeshCooker.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    //过度绘制优化允许ACMR变差的比例
+    const float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+
+    //未烘焙时按float顶点和32位索引计算的大小
+    size_t sourceBytes(const MeshCooker::SourceMesh& mesh)
+    {
+        return mesh.vertices.size() * sizeof(MeshCooker::SourceVertex) + mesh.indices.size() * sizeof(uint32_t);
+    }
+
+    size_t cookedBytes(const MeshCooker::CookedMesh& cooked)
+    {
+        return sizeof(CookedMeshHeader) + cooked.vertices.size() * sizeof(CookedVertex) + cooked.indices.size() * cooked.header.indexSize;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: AssetCooker <input.obj> <output.mesh> [--no-overdraw]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool optimizeOverdraw = true;
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--no-overdraw") == 0)
+        {
+            optimizeOverdraw = false;
+        }
+        else
+        {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MeshCooker::SourceMesh mesh;
+        MeshCooker::loadOBJ(argv[1], mesh);
+        size_t bytesBefore = sourceBytes(mesh);
+        float acmrBefore = MeshCooker::computeACMR(mesh.indices, MeshCooker::DEFAULT_CACHE_SIZE);
+
+        mesh.indices = MeshCooker::optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        float acmrCache = MeshCooker::computeACMR(mesh.indices, MeshCooker::DEFAULT_CACHE_SIZE);
+        if (optimizeOverdraw)
+        {
+            mesh.indices = MeshCooker::optimizeOverdraw(mesh.indices, mesh.vertices, OVERDRAW_ACMR_THRESHOLD);
+        }
+        float acmrAfter = MeshCooker::computeACMR(mesh.indices, MeshCooker::DEFAULT_CACHE_SIZE);
+        MeshCooker::optimizeVertexFetch(mesh);
+
+        MeshCooker::CookedMesh cooked = MeshCooker::quantizeMesh(mesh);
+        float positionError = MeshCooker::measurePositionError(mesh, cooked);
+        MeshCooker::writeCookedMesh(argv[2], cooked);
+
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t bytesAfter = cookedBytes(cooked);
+        float triangles = (float)(mesh.indices.size() / 3);
+
+        std::cout << argv[1] << " -> " << argv[2] << std::endl;
+        std::cout << "  vertices:  " << mesh.vertices.size() << ", triangles: " << mesh.indices.size() / 3 << ", " << cooked.header.indexSize * 8 << "-bit indices" << std::endl;
+        std::cout << "  ACMR:      " << acmrBefore << " -> " << acmrCache << " (cache)";
+        if (optimizeOverdraw)
+        {
+            std::cout << " -> " << acmrAfter << " (overdraw)";
+        }
+        std::cout << ", ATVR " << acmrAfter * triangles / (float)mesh.vertices.size() << std::endl;
+        std::cout << "  size:      " << bytesBefore << " -> " << bytesAfter << " bytes (" << 100.0 * bytesAfter / bytesBefore << "%)" << std::endl;
+        std::cout << "  max position error: " << positionError << std::endl;
+        std::cout << "  cooked in " << elapsedMs << " ms" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
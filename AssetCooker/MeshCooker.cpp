@@ -0,0 +1,687 @@
+﻿#include "MeshCooker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace MeshCooker
+{
+    namespace
+    {
+        //Forsyth算法的参数，与原文一致
+        const uint32_t FORSYTH_CACHE_SIZE = 32;
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        //cachePosition < 0 表示不在缓存中
+        float vertexScore(int cachePosition, uint32_t remainingTriangles)
+        {
+            if (remainingTriangles == 0)
+            {
+                return -1.0f;
+            }
+
+            float score = 0.0f;
+            if (cachePosition >= 0)
+            {
+                //最近的三个顶点属于刚加入的三角形，给固定分数，避免总是选择同一条带
+                if (cachePosition < 3)
+                {
+                    score = LAST_TRIANGLE_SCORE;
+                }
+                else
+                {
+                    float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+                }
+            }
+
+            //剩余三角形少的顶点优先处理完，避免留下孤立的三角形
+            score += VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+            return score;
+        }
+
+        void cross(const float a[3], const float b[3], float out[3])
+        {
+            out[0] = a[1] * b[2] - a[2] * b[1];
+            out[1] = a[2] * b[0] - a[0] * b[2];
+            out[2] = a[0] * b[1] - a[1] * b[0];
+        }
+
+        uint16_t quantizeUnorm16(float value)
+        {
+            return (uint16_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f);
+        }
+
+        int16_t quantizeSnorm16(float value)
+        {
+            return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+        }
+
+        //八面体编码：单位向量投影到八面体再展开到[-1,1]²
+        void encodeOctahedral(const float n[3], float out[2])
+        {
+            float length = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+            if (length <= 0.0f)
+            {
+                out[0] = 0.0f;
+                out[1] = 0.0f;
+                return;
+            }
+            float x = n[0] / length;
+            float y = n[1] / length;
+            if (n[2] < 0.0f)
+            {
+                float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+                float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+                x = foldedX;
+                y = foldedY;
+            }
+            out[0] = x;
+            out[1] = y;
+        }
+    }
+
+    //---------------------------读取OBJ----------------------------
+
+    void loadOBJ(const std::string& path, SourceMesh& mesh)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open " + path);
+        }
+
+        std::vector<float> positions;
+        std::vector<float> uvs;
+        std::vector<float> normals;
+        std::map<std::tuple<int, int, int>, uint32_t> vertexMap;//(位置, UV, 法线)的下标 -> 合并后的顶点
+        bool missingNormals = false;
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+
+        //OBJ的下标从1开始，负数表示从末尾倒数
+        auto resolve = [](int index, size_t count) -> int
+        {
+            if (index > 0)
+            {
+                return index - 1;
+            }
+            if (index < 0)
+            {
+                return (int)count + index;
+            }
+            return -1;
+        };
+
+        std::string line;
+        size_t lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            std::istringstream stream(line);
+            std::string keyword;
+            stream >> keyword;
+
+            if (keyword == "v")
+            {
+                float x = 0.0f, y = 0.0f, z = 0.0f;
+                stream >> x >> y >> z;
+                positions.insert(positions.end(), { x, y, z });
+            }
+            else if (keyword == "vt")
+            {
+                float u = 0.0f, v = 0.0f;
+                stream >> u >> v;
+                uvs.insert(uvs.end(), { u, v });
+            }
+            else if (keyword == "vn")
+            {
+                float x = 0.0f, y = 0.0f, z = 0.0f;
+                stream >> x >> y >> z;
+                normals.insert(normals.end(), { x, y, z });
+            }
+            else if (keyword == "f")
+            {
+                std::vector<uint32_t> face;
+                std::string token;
+                while (stream >> token)
+                {
+                    int v = 0, vt = 0, vn = 0;
+                    size_t firstSlash = token.find('/');
+                    v = std::atoi(token.substr(0, firstSlash).c_str());
+                    if (firstSlash != std::string::npos)
+                    {
+                        size_t secondSlash = token.find('/', firstSlash + 1);
+                        std::string uvToken = token.substr(firstSlash + 1, secondSlash == std::string::npos ? std::string::npos : secondSlash - firstSlash - 1);
+                        vt = uvToken.empty() ? 0 : std::atoi(uvToken.c_str());
+                        if (secondSlash != std::string::npos)
+                        {
+                            vn = std::atoi(token.substr(secondSlash + 1).c_str());
+                        }
+                    }
+
+                    int positionIndex = resolve(v, positions.size() / 3);
+                    int uvIndex = resolve(vt, uvs.size() / 2);
+                    int normalIndex = resolve(vn, normals.size() / 3);
+                    if (positionIndex < 0 || positionIndex >= (int)(positions.size() / 3) || uvIndex >= (int)(uvs.size() / 2) || normalIndex >= (int)(normals.size() / 3))
+                    {
+                        throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid face index");
+                    }
+
+                    auto key = std::make_tuple(positionIndex, uvIndex, normalIndex);
+                    auto found = vertexMap.find(key);
+                    if (found != vertexMap.end())
+                    {
+                        face.push_back(found->second);
+                        continue;
+                    }
+
+                    SourceVertex vertex = {};
+                    std::copy(&positions[positionIndex * 3], &positions[positionIndex * 3] + 3, vertex.position);
+                    if (uvIndex >= 0)
+                    {
+                        vertex.uv[0] = uvs[uvIndex * 2];
+                        vertex.uv[1] = uvs[uvIndex * 2 + 1];
+                    }
+                    if (normalIndex >= 0)
+                    {
+                        std::copy(&normals[normalIndex * 3], &normals[normalIndex * 3] + 3, vertex.normal);
+                    }
+                    else
+                    {
+                        missingNormals = true;
+                    }
+
+                    uint32_t index = (uint32_t)mesh.vertices.size();
+                    mesh.vertices.push_back(vertex);
+                    vertexMap[key] = index;
+                    face.push_back(index);
+                }
+
+                //多边形按扇形拆成三角形
+                for (size_t i = 2; i < face.size(); i++)
+                {
+                    mesh.indices.insert(mesh.indices.end(), { face[0], face[i - 1], face[i] });
+                }
+            }
+        }
+
+        if (mesh.indices.empty())
+        {
+            throw std::runtime_error(path + " contains no faces");
+        }
+
+        //缺少法线的顶点用相邻面的法线按面积加权平均（叉积的长度就是面积的两倍）
+        if (missingNormals)
+        {
+            std::vector<float> accumulated(mesh.vertices.size() * 3, 0.0f);
+            for (size_t i = 0; i < mesh.indices.size(); i += 3)
+            {
+                const float* p0 = mesh.vertices[mesh.indices[i]].position;
+                const float* p1 = mesh.vertices[mesh.indices[i + 1]].position;
+                const float* p2 = mesh.vertices[mesh.indices[i + 2]].position;
+                float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                float faceNormal[3];
+                cross(e1, e2, faceNormal);
+                for (size_t k = 0; k < 3; k++)
+                {
+                    float* sum = &accumulated[mesh.indices[i + k] * 3];
+                    sum[0] += faceNormal[0];
+                    sum[1] += faceNormal[1];
+                    sum[2] += faceNormal[2];
+                }
+            }
+
+            for (size_t i = 0; i < mesh.vertices.size(); i++)
+            {
+                float* normal = mesh.vertices[i].normal;
+                if (normal[0] != 0.0f || normal[1] != 0.0f || normal[2] != 0.0f)
+                {
+                    continue;
+                }
+                const float* sum = &accumulated[i * 3];
+                float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                if (length > 0.0f)
+                {
+                    normal[0] = sum[0] / length;
+                    normal[1] = sum[1] / length;
+                    normal[2] = sum[2] / length;
+                }
+            }
+        }
+    }
+
+    //---------------------------顶点缓存优化----------------------------
+
+    std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+
+        //每个顶点相邻的三角形列表，压缩存储
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (uint32_t index : indices)
+        {
+            remaining[index]++;
+        }
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            for (size_t k = 0; k < 3; k++)
+            {
+                adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+            }
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> score(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            score[v] = vertexScore(-1, remaining[v]);
+        }
+
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+        }
+
+        //相邻列表中前remaining[v]个是还没输出的三角形
+        auto removeAdjacency = [&](uint32_t v, uint32_t triangle)
+        {
+            uint32_t begin = adjacencyOffset[v];
+            uint32_t end = begin + remaining[v];
+            for (uint32_t i = begin; i < end; i++)
+            {
+                if (adjacency[i] == triangle)
+                {
+                    std::swap(adjacency[i], adjacency[end - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        };
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        std::vector<uint32_t> cache;
+        cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+        //缓存中没有可选三角形时，从这里开始找分数最高的未输出三角形
+        int bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (triangleScore[t] > bestScore)
+            {
+                bestScore = triangleScore[t];
+                bestTriangle = (int)t;
+            }
+        }
+
+        size_t scanCursor = 0;
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            if (bestTriangle < 0)
+            {
+                while (scanCursor < triangleCount && emitted[scanCursor])
+                {
+                    scanCursor++;
+                }
+                bestTriangle = (int)scanCursor;
+            }
+
+            uint32_t triangle = (uint32_t)bestTriangle;
+            const uint32_t* tri = &indices[triangle * 3];
+            result.insert(result.end(), { tri[0], tri[1], tri[2] });
+            emitted[triangle] = true;
+
+            //三个顶点移到缓存最前面
+            std::vector<uint32_t> newCache = { tri[0], tri[1], tri[2] };
+            for (uint32_t v : cache)
+            {
+                if (v != tri[0] && v != tri[1] && v != tri[2])
+                {
+                    newCache.push_back(v);
+                }
+            }
+            for (size_t k = 0; k < 3; k++)
+            {
+                removeAdjacency(tri[k], triangle);
+            }
+
+            //被挤出缓存的顶点也要更新分数
+            for (size_t i = FORSYTH_CACHE_SIZE; i < newCache.size(); i++)
+            {
+                cachePosition[newCache[i]] = -1;
+                score[newCache[i]] = vertexScore(-1, remaining[newCache[i]]);
+            }
+            if (newCache.size() > FORSYTH_CACHE_SIZE)
+            {
+                newCache.resize(FORSYTH_CACHE_SIZE);
+            }
+            cache.swap(newCache);
+
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePosition[cache[i]] = (int)i;
+                score[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+            }
+
+            //只有缓存中顶点相邻的三角形分数会变化，从中选出下一个
+            bestTriangle = -1;
+            bestScore = -1.0f;
+            for (uint32_t v : cache)
+            {
+                uint32_t begin = adjacencyOffset[v];
+                for (uint32_t i = begin; i < begin + remaining[v]; i++)
+                {
+                    uint32_t t = adjacency[i];
+                    float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                    triangleScore[t] = s;
+                    if (s > bestScore)
+                    {
+                        bestScore = s;
+                        bestTriangle = (int)t;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    //---------------------------过度绘制优化----------------------------
+
+    std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<SourceVertex>& vertices, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        float originalACMR = computeACMR(indices, DEFAULT_CACHE_SIZE);
+
+        //模拟缓存切分簇：三个顶点都未命中的三角形是缓存重启点，在这里切开不损失命中；
+        //另外在至少两个顶点未命中、且当前簇的ACMR已经不高于整体的threshold倍时也切开，这样簇足够多才有重排的余地
+        std::vector<uint32_t> clusterStart;
+        std::vector<uint32_t> fifo(DEFAULT_CACHE_SIZE, UINT32_MAX);
+        size_t fifoHead = 0;
+        size_t clusterMisses = 0;
+        const size_t MIN_CLUSTER_TRIANGLES = 16;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            uint32_t misses = 0;
+            for (size_t k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+                if (std::find(fifo.begin(), fifo.end(), v) == fifo.end())
+                {
+                    fifo[fifoHead] = v;
+                    fifoHead = (fifoHead + 1) % fifo.size();
+                    misses++;
+                }
+            }
+
+            bool split = t == 0;
+            if (!split && t - clusterStart.back() >= MIN_CLUSTER_TRIANGLES)
+            {
+                float clusterACMR = (float)clusterMisses / (float)(t - clusterStart.back());
+                split = misses == 3 || (misses >= 2 && clusterACMR <= originalACMR * threshold);
+            }
+            if (split)
+            {
+                clusterStart.push_back((uint32_t)t);
+                clusterMisses = 0;
+            }
+            clusterMisses += misses;
+        }
+        clusterStart.push_back((uint32_t)triangleCount);
+        size_t clusterCount = clusterStart.size() - 1;
+        if (clusterCount < 2)
+        {
+            return indices;
+        }
+
+        //网格中心
+        float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+        for (const auto& vertex : vertices)
+        {
+            meshCenter[0] += vertex.position[0];
+            meshCenter[1] += vertex.position[1];
+            meshCenter[2] += vertex.position[2];
+        }
+        for (size_t k = 0; k < 3; k++)
+        {
+            meshCenter[k] /= (float)std::max<size_t>(vertices.size(), 1);
+        }
+
+        //簇的中心和平均法线（面积加权），朝外程度 = dot(中心 - 网格中心, 法线)，越朝外越容易遮挡其他簇
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            float center[3] = { 0.0f, 0.0f, 0.0f };
+            float normal[3] = { 0.0f, 0.0f, 0.0f };
+            float totalArea = 0.0f;
+            for (uint32_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+            {
+                const float* p0 = vertices[indices[t * 3]].position;
+                const float* p1 = vertices[indices[t * 3 + 1]].position;
+                const float* p2 = vertices[indices[t * 3 + 2]].position;
+                float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                float faceNormal[3];
+                cross(e1, e2, faceNormal);
+                float area = std::sqrt(faceNormal[0] * faceNormal[0] + faceNormal[1] * faceNormal[1] + faceNormal[2] * faceNormal[2]);
+                for (size_t k = 0; k < 3; k++)
+                {
+                    center[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * area;
+                    normal[k] += faceNormal[k];
+                }
+                totalArea += area;
+            }
+
+            float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (totalArea <= 0.0f || normalLength <= 0.0f)
+            {
+                sortKey[c] = 0.0f;
+                continue;
+            }
+            float key = 0.0f;
+            for (size_t k = 0; k < 3; k++)
+            {
+                key += (center[k] / totalArea - meshCenter[k]) * normal[k] / normalLength;
+            }
+            sortKey[c] = key;
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            order[c] = (uint32_t)c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return sortKey[a] > sortKey[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (uint32_t c : order)
+        {
+            result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+        }
+
+        //簇边界处的缓存命中会损失一些，超过阈值时保留缓存优化的顺序
+        if (computeACMR(result, DEFAULT_CACHE_SIZE) > originalACMR * threshold)
+        {
+            return indices;
+        }
+        return result;
+    }
+
+    //---------------------------顶点读取优化----------------------------
+
+    void optimizeVertexFetch(SourceMesh& mesh)
+    {
+        std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+        std::vector<SourceVertex> reordered;
+        reordered.reserve(mesh.vertices.size());
+        for (uint32_t& index : mesh.indices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = (uint32_t)reordered.size();
+                reordered.push_back(mesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+        mesh.vertices.swap(reordered);
+    }
+
+    float computeACMR(const std::vector<uint32_t>& indices, uint32_t cacheSize)
+    {
+        if (indices.size() < 3)
+        {
+            return 0.0f;
+        }
+
+        std::vector<uint32_t> fifo(cacheSize, UINT32_MAX);
+        size_t head = 0;
+        size_t misses = 0;
+        for (uint32_t v : indices)
+        {
+            if (std::find(fifo.begin(), fifo.end(), v) == fifo.end())
+            {
+                fifo[head] = v;
+                head = (head + 1) % cacheSize;
+                misses++;
+            }
+        }
+        return (float)misses / (float)(indices.size() / 3);
+    }
+
+    //---------------------------量化----------------------------
+
+    CookedMesh quantizeMesh(const SourceMesh& mesh)
+    {
+        CookedMesh cooked;
+        CookedMeshHeader& header = cooked.header;
+        header = {};
+        header.magic = CookedMeshHeader::MAGIC;
+        header.version = CookedMeshHeader::VERSION;
+        header.vertexCount = (uint32_t)mesh.vertices.size();
+        header.indexCount = (uint32_t)mesh.indices.size();
+        header.indexSize = mesh.vertices.size() <= 65536 ? 2 : 4;
+        header.vertexStride = sizeof(CookedVertex);
+
+        //位置和UV的范围
+        float positionMin[3] = { INFINITY, INFINITY, INFINITY };
+        float positionMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+        float uvMin[2] = { INFINITY, INFINITY };
+        float uvMax[2] = { -INFINITY, -INFINITY };
+        for (const auto& vertex : mesh.vertices)
+        {
+            for (size_t k = 0; k < 3; k++)
+            {
+                positionMin[k] = std::min(positionMin[k], vertex.position[k]);
+                positionMax[k] = std::max(positionMax[k], vertex.position[k]);
+            }
+            for (size_t k = 0; k < 2; k++)
+            {
+                uvMin[k] = std::min(uvMin[k], vertex.uv[k]);
+                uvMax[k] = std::max(uvMax[k], vertex.uv[k]);
+            }
+        }
+        for (size_t k = 0; k < 3; k++)
+        {
+            header.positionOffset[k] = positionMin[k];
+            header.positionScale[k] = positionMax[k] - positionMin[k];
+        }
+        for (size_t k = 0; k < 2; k++)
+        {
+            header.uvOffset[k] = uvMin[k];
+            header.uvScale[k] = uvMax[k] - uvMin[k];
+        }
+
+        cooked.vertices.resize(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            const SourceVertex& source = mesh.vertices[i];
+            CookedVertex& vertex = cooked.vertices[i];
+            for (size_t k = 0; k < 3; k++)
+            {
+                float extent = header.positionScale[k];
+                vertex.position[k] = quantizeUnorm16(extent > 0.0f ? (source.position[k] - header.positionOffset[k]) / extent : 0.0f);
+            }
+            vertex.position[3] = 0;
+
+            float octahedral[2];
+            encodeOctahedral(source.normal, octahedral);
+            vertex.normal[0] = quantizeSnorm16(octahedral[0]);
+            vertex.normal[1] = quantizeSnorm16(octahedral[1]);
+
+            for (size_t k = 0; k < 2; k++)
+            {
+                float extent = header.uvScale[k];
+                vertex.uv[k] = quantizeUnorm16(extent > 0.0f ? (source.uv[k] - header.uvOffset[k]) / extent : 0.0f);
+            }
+        }
+
+        cooked.indices = mesh.indices;
+        return cooked;
+    }
+
+    float measurePositionError(const SourceMesh& mesh, const CookedMesh& cooked)
+    {
+        float maxError = 0.0f;
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            float errorSquared = 0.0f;
+            for (size_t k = 0; k < 3; k++)
+            {
+                float decoded = cooked.header.positionOffset[k] + cooked.vertices[i].position[k] / 65535.0f * cooked.header.positionScale[k];
+                float difference = decoded - mesh.vertices[i].position[k];
+                errorSquared += difference * difference;
+            }
+            maxError = std::max(maxError, std::sqrt(errorSquared));
+        }
+        return maxError;
+    }
+
+    void writeCookedMesh(const std::string& path, const CookedMesh& cooked)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to create " + path);
+        }
+
+        file.write((const char*)&cooked.header, sizeof(CookedMeshHeader));
+        file.write((const char*)cooked.vertices.data(), cooked.vertices.size() * sizeof(CookedVertex));
+        if (cooked.header.indexSize == 2)
+        {
+            std::vector<uint16_t> narrow(cooked.indices.begin(), cooked.indices.end());
+            file.write((const char*)narrow.data(), narrow.size() * sizeof(uint16_t));
+        }
+        else
+        {
+            file.write((const char*)cooked.indices.data(), cooked.indices.size() * sizeof(uint32_t));
+        }
+
+        if (!file.good())
+        {
+            throw std::runtime_error("failed to write " + path);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+/*
+网格烘焙的各个步骤：
+
+1. loadOBJ：读入OBJ，多边形拆成三角形，相同的（位置, UV, 法线）组合合并为一个顶点，没有法线时按面积加权计算
+2. optimizeVertexCache：Forsyth的线性顶点缓存优化，重排三角形使相邻三角形尽量复用变换后的顶点
+3. optimizeOverdraw：把缓存优化后的三角形按缓存重启点切成簇，朝外的簇先画，减少过度绘制，
+   簇内顺序不变，ACMR变差超过阈值时放弃
+4. optimizeVertexFetch：按第一次被索引的顺序重排顶点，取顶点时内存访问连续
+5. quantizeMesh：位置和UV量化为16位定点数，法线八面体编码为两个16位定点数
+*/
+
+#include "../CookedMesh.h"
+
+#include <string>
+#include <vector>
+
+namespace MeshCooker
+{
+    //烘焙前的顶点
+    struct SourceVertex
+    {
+        float position[3];
+        float normal[3];
+        float uv[2];
+    };
+
+    struct SourceMesh
+    {
+        std::vector<SourceVertex> vertices;
+        std::vector<uint32_t> indices;//每三个一个三角形
+    };
+
+    //量化后的网格，索引在写文件时按indexSize收窄
+    struct CookedMesh
+    {
+        CookedMeshHeader header;
+        std::vector<CookedVertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    //变换后顶点缓存的模拟大小，接近常见GPU的实际行为
+    const uint32_t DEFAULT_CACHE_SIZE = 16;
+
+    //读取OBJ，失败时抛出异常
+    void loadOBJ(const std::string& path, SourceMesh& mesh);
+
+    //重排三角形，返回新的索引
+    std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+    //在缓存优化的结果上重排三角形簇，ACMR最多变差到原来的threshold倍
+    std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<SourceVertex>& vertices, float threshold);
+
+    //按第一次使用的顺序重排顶点并改写索引，没被使用的顶点被去掉
+    void optimizeVertexFetch(SourceMesh& mesh);
+
+    //平均每个三角形的缓存未命中数（FIFO缓存）
+    float computeACMR(const std::vector<uint32_t>& indices, uint32_t cacheSize);
+
+    //量化顶点属性
+    CookedMesh quantizeMesh(const SourceMesh& mesh);
+
+    //量化引入的最大位置误差（与原始位置的距离）
+    float measurePositionError(const SourceMesh& mesh, const CookedMesh& cooked);
+
+    //写出.mesh文件，失败时抛出异常
+    void writeCookedMesh(const std::string& path, const CookedMesh& cooked);
+}
@@ -0,0 +1,265 @@
+﻿#include "CommandCapture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    //每个记录补齐到8字节，记录中的内容在内存中也是对齐的，回放时可以直接引用
+    const uint64_t RECORD_ALIGNMENT = 8;
+
+    uint64_t recordPadding(uint64_t size)
+    {
+        return (RECORD_ALIGNMENT - size % RECORD_ALIGNMENT) % RECORD_ALIGNMENT;
+    }
+
+    struct RecordHeader
+    {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    struct ResourceRecord
+    {
+        uint32_t resource;
+        uint32_t reserved;
+    };
+
+    struct FrameBeginRecord
+    {
+        uint32_t renderWidth;
+        uint32_t renderHeight;
+    };
+
+    struct UploadRecord
+    {
+        uint32_t resource;
+        uint32_t reserved;
+        uint64_t offset;
+    };
+
+    struct DrawStreamRecord
+    {
+        uint32_t bucket;
+        uint32_t count;
+    };
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+void CaptureWriter::open(const std::string& path, const CaptureHeader& header)
+{
+    close();
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to create capture file " + path);
+    }
+    frameCount = 0;
+    bytesWritten = 0;
+    writeRecord(CaptureRecordType::Header, &header, sizeof(header));
+}
+
+void CaptureWriter::close()
+{
+    if (file.is_open())
+    {
+        file.close();
+    }
+}
+
+void CaptureWriter::writeResource(CaptureResource resource, const void* data, uint64_t size)
+{
+    ResourceRecord record = { (uint32_t)resource, 0 };
+    writeRecord(CaptureRecordType::Resource, &record, sizeof(record), data, size);
+}
+
+void CaptureWriter::beginFrame(uint32_t renderWidth, uint32_t renderHeight)
+{
+    FrameBeginRecord record = { renderWidth, renderHeight };
+    writeRecord(CaptureRecordType::FrameBegin, &record, sizeof(record));
+}
+
+void CaptureWriter::writeUpload(CaptureResource resource, uint64_t offset, const void* data, uint64_t size)
+{
+    UploadRecord record = { (uint32_t)resource, 0, offset };
+    writeRecord(CaptureRecordType::Upload, &record, sizeof(record), data, size);
+}
+
+void CaptureWriter::writeDrawStream(uint32_t bucket, const CapturedDraw* draws, uint32_t count)
+{
+    DrawStreamRecord record = { bucket, count };
+    writeRecord(CaptureRecordType::DrawStream, &record, sizeof(record), draws, sizeof(CapturedDraw) * count);
+}
+
+void CaptureWriter::writeParticles(const void* pushConstants, uint32_t size)
+{
+    writeRecord(CaptureRecordType::Particles, pushConstants, size);
+}
+
+void CaptureWriter::endFrame()
+{
+    writeRecord(CaptureRecordType::FrameEnd, nullptr, 0);
+    frameCount++;
+}
+
+void CaptureWriter::writeRecord(CaptureRecordType type, const void* first, uint64_t firstSize, const void* second, uint64_t secondSize)
+{
+    if (!file.is_open())
+    {
+        return;
+    }
+    if (firstSize + secondSize > UINT32_MAX)
+    {
+        throw std::runtime_error("capture record too large");
+    }
+
+    RecordHeader header = { (uint32_t)type, (uint32_t)(firstSize + secondSize) };
+    file.write((const char*)&header, sizeof(header));
+    if (firstSize > 0)
+    {
+        file.write((const char*)first, (std::streamsize)firstSize);
+    }
+    if (secondSize > 0)
+    {
+        file.write((const char*)second, (std::streamsize)secondSize);
+    }
+    const char zeros[RECORD_ALIGNMENT] = {};
+    uint64_t padding = recordPadding(firstSize + secondSize);
+    file.write(zeros, (std::streamsize)padding);
+    bytesWritten += sizeof(header) + firstSize + secondSize + padding;
+}
+
+void CaptureReader::open(const std::string& path)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("failed to open capture file " + path);
+    }
+    size_t fileSize = (size_t)file.tellg();
+    data.resize(fileSize);
+    file.seekg(0);
+    file.read((char*)data.data(), fileSize);
+
+    resources.clear();
+    frames.clear();
+
+    bool headerRead = false;
+    CapturedFrame* frame = nullptr;
+    size_t position = 0;
+    while (position < data.size())
+    {
+        RecordHeader record;
+        if (data.size() - position < sizeof(record))
+        {
+            throw std::runtime_error("truncated capture record");
+        }
+        memcpy(&record, &data[position], sizeof(record));
+        position += sizeof(record);
+        if (data.size() - position < record.size)
+        {
+            throw std::runtime_error("truncated capture record");
+        }
+        const uint8_t* payload = &data[position];
+        position += std::min<uint64_t>(record.size + recordPadding(record.size), data.size() - position);
+
+        CaptureRecordType type = (CaptureRecordType)record.type;
+        if (!headerRead)
+        {
+            if (type != CaptureRecordType::Header || record.size != sizeof(header))
+            {
+                throw std::runtime_error("capture file has no header");
+            }
+            memcpy(&header, payload, sizeof(header));
+            if (header.magic != CaptureHeader::MAGIC || header.version != CaptureHeader::VERSION)
+            {
+                throw std::runtime_error("unsupported capture file version");
+            }
+            headerRead = true;
+            continue;
+        }
+
+        switch (type)
+        {
+        case CaptureRecordType::Resource:
+        {
+            ResourceRecord resource;
+            if (record.size < sizeof(resource))
+            {
+                throw std::runtime_error("malformed capture resource");
+            }
+            memcpy(&resource, payload, sizeof(resource));
+            resources.push_back({ (CaptureResource)resource.resource, 0, payload + sizeof(resource), record.size - sizeof(resource) });
+            break;
+        }
+        case CaptureRecordType::FrameBegin:
+        {
+            FrameBeginRecord begin;
+            if (frame != nullptr || record.size != sizeof(begin))
+            {
+                throw std::runtime_error("malformed capture frame");
+            }
+            memcpy(&begin, payload, sizeof(begin));
+            frames.emplace_back();
+            frame = &frames.back();
+            frame->renderWidth = begin.renderWidth;
+            frame->renderHeight = begin.renderHeight;
+            break;
+        }
+        case CaptureRecordType::Upload:
+        {
+            UploadRecord upload;
+            if (frame == nullptr || record.size < sizeof(upload))
+            {
+                throw std::runtime_error("malformed capture upload");
+            }
+            memcpy(&upload, payload, sizeof(upload));
+            frame->uploads.push_back({ (CaptureResource)upload.resource, upload.offset, payload + sizeof(upload), record.size - sizeof(upload) });
+            break;
+        }
+        case CaptureRecordType::DrawStream:
+        {
+            DrawStreamRecord stream;
+            if (frame == nullptr || record.size < sizeof(stream))
+            {
+                throw std::runtime_error("malformed capture draw stream");
+            }
+            memcpy(&stream, payload, sizeof(stream));
+            if (record.size != sizeof(stream) + sizeof(CapturedDraw) * (uint64_t)stream.count)
+            {
+                throw std::runtime_error("malformed capture draw stream");
+            }
+            frame->drawStreams.push_back({ stream.bucket, (const CapturedDraw*)(payload + sizeof(stream)), stream.count });
+            break;
+        }
+        case CaptureRecordType::Particles:
+            if (frame == nullptr)
+            {
+                throw std::runtime_error("malformed capture particles");
+            }
+            frame->particles = payload;
+            frame->particlesSize = record.size;
+            break;
+        case CaptureRecordType::FrameEnd:
+            if (frame == nullptr)
+            {
+                throw std::runtime_error("malformed capture frame");
+            }
+            frame = nullptr;
+            break;
+        default:
+            throw std::runtime_error("unknown capture record type");
+        }
+    }
+
+    //捕获中途退出时最后一帧不完整，丢弃
+    if (frame != nullptr)
+    {
+        frames.pop_back();
+    }
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+/*
+命令流捕获和回放：把线上变慢的一帧带回来离线复现
+
+1. 捕获记录渲染器交给GPU的全部输入：启动时的渲染配置和资源内容（场景顶点、绑定姿势、相机），
+   每一帧的渲染区域、上传（蒙皮矩阵或CPU蒙皮后的顶点）、粒子模拟的参数和绘制流，
+   回放时不需要动画系统、计时、动态分辨率或命令行等应用状态
+2. 日志是一串记录，每个记录是类型(u32) + 内容长度(u32) + 内容，第一个记录是文件头（魔数、版本和渲染配置）；
+   一帧从FrameBegin开始到FrameEnd结束，中间是这一帧的上传、绘制流和粒子参数
+3. 绘制流按静态桶记录，只在桶的内容变化时写入，回放时沿用上一次的；绘制中的管线、材质和网格记录为渲染器表中的下标，
+   不记录Vulkan句柄，间接绘制的参数缓冲记录为资源编号
+4. 每个记录补齐到8字节。回放前整个日志读入内存，帧循环中不读文件，上传和绘制直接引用日志中的字节；
+   写入时只调用ofstream::write，不分配内存
+*/
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+enum class CaptureRecordType : uint32_t
+{
+    Header = 1,
+    Resource,//启动时的资源内容
+    FrameBegin,
+    Upload,//这一帧写入资源的字节
+    DrawStream,//一个静态桶的绘制
+    Particles,//粒子模拟的push constant
+    FrameEnd,
+};
+
+//日志中引用的资源
+enum class CaptureResource : uint32_t
+{
+    SceneVertices,
+    BindPose,
+    Camera,
+    JointMatrices,//GPU蒙皮：这一帧的蒙皮矩阵
+    SkinnedVertices,//CPU蒙皮：这一帧蒙皮后的顶点
+    ParticleState,//粒子的计数和间接参数
+    None = 0xffffffff,
+};
+
+//文件头：回放时按它配置渲染器，保证管线、缓冲和绘制表与捕获时相同
+struct CaptureHeader
+{
+    static const uint32_t MAGIC = 0x5043524d;//"MRCP"
+    static const uint32_t VERSION = 3;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t viewCount = 1;
+    uint32_t characterCount = 0;
+    uint32_t particleCapacity = 0;
+    uint32_t gpuSkinning = 0;
+    uint32_t debugView = 0;
+    uint32_t shadows = 0;//级联阴影和地面
+    uint32_t postProcessing = 0;//泛光、曝光和色调映射
+};
+
+//绘制流中的一次绘制，与渲染器的DrawItem对应
+struct CapturedDraw
+{
+    uint64_t sortKey;
+    uint32_t pipeline;//渲染器管线表中的下标
+    uint32_t material;
+    uint32_t mesh;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+    uint32_t indirectBuffer;//CaptureResource，None为直接绘制
+    uint64_t indirectOffset;
+};
+
+class CaptureWriter
+{
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    //创建日志并写入文件头，失败时抛出异常
+    void open(const std::string& path, const CaptureHeader& header);
+    void close();
+    bool isOpen() const { return file.is_open(); }
+
+    void writeResource(CaptureResource resource, const void* data, uint64_t size);
+
+    void beginFrame(uint32_t renderWidth, uint32_t renderHeight);
+    void writeUpload(CaptureResource resource, uint64_t offset, const void* data, uint64_t size);
+    void writeDrawStream(uint32_t bucket, const CapturedDraw* draws, uint32_t count);
+    void writeParticles(const void* pushConstants, uint32_t size);
+    void endFrame();
+
+    uint32_t getFrameCount() const { return frameCount; }
+    uint64_t getBytesWritten() const { return bytesWritten; }
+
+private:
+    //记录头之后依次写入两段内容
+    void writeRecord(CaptureRecordType type, const void* first, uint64_t firstSize, const void* second = nullptr, uint64_t secondSize = 0);
+
+    std::ofstream file;
+    uint32_t frameCount = 0;
+    uint64_t bytesWritten = 0;
+};
+
+//回放时的一次上传，data指向日志中的字节
+struct CapturedUpload
+{
+    CaptureResource resource;
+    uint64_t offset;
+    const uint8_t* data;
+    uint64_t size;
+};
+
+struct CapturedDrawStream
+{
+    uint32_t bucket;
+    const CapturedDraw* draws;
+    uint32_t count;
+};
+
+struct CapturedFrame
+{
+    uint32_t renderWidth = 0;
+    uint32_t renderHeight = 0;
+    std::vector<CapturedUpload> uploads;
+    std::vector<CapturedDrawStream> drawStreams;//内容变化了的桶
+    const uint8_t* particles = nullptr;//粒子模拟的push constant，没有粒子时为空
+    uint32_t particlesSize = 0;
+};
+
+class CaptureReader
+{
+public:
+    //读入整个日志并解析，格式错误时抛出异常
+    void open(const std::string& path);
+
+    const CaptureHeader& getHeader() const { return header; }
+    const std::vector<CapturedUpload>& getResources() const { return resources; }//offset为0
+    const std::vector<CapturedFrame>& getFrames() const { return frames; }
+
+private:
+    std::vector<uint8_t> data;
+    CaptureHeader header;
+    std::vector<CapturedUpload> resources;
+    std::vector<CapturedFrame> frames;
+};
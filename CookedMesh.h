@@ -0,0 +1,42 @@
+﻿#pragma once
+
+/*
+烘焙后的网格文件（.mesh），由AssetCooker生成，格式与GPU上的布局相同，读入后可以直接上传到顶点和索引缓冲：
+
+    CookedMeshHeader
+    CookedVertex[vertexCount]
+    uint16_t或uint32_t[indexCount]（由indexSize决定，对应VK_INDEX_TYPE_UINT16/UINT32）
+
+顶点属性都是量化后的值，顶点着色器中按头里的范围还原：
+    位置：R16G16B16A16_UNORM，position = positionOffset + q * positionScale（w不使用）
+    法线：R16G16_SNORM，八面体编码
+    UV：  R16G16_UNORM，uv = uvOffset + q * uvScale
+*/
+
+#include <cstdint>
+
+struct CookedMeshHeader
+{
+    static const uint32_t MAGIC = 0x4853454d;//"MESH"
+    static const uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;//每个索引的字节数：2或4
+    uint32_t vertexStride;//sizeof(CookedVertex)
+    float positionOffset[3];//包围盒的最小点
+    float positionScale[3];//包围盒的边长
+    float uvOffset[2];
+    float uvScale[2];
+};
+
+struct CookedVertex
+{
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+static_assert(sizeof(CookedVertex) == 16, "cooked vertex layout must match the vertex input description");
@@ -0,0 +1,207 @@
+﻿#include "DrawList.h"
+
+#include <algorithm>
+
+namespace
+{
+    const uint32_t RADIX_BITS = 8;
+    const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+    const uint32_t PASS_COUNT = 64 / RADIX_BITS;
+
+    uint64_t quantizeDepth(float depth)
+    {
+        float clamped = std::min(std::max(depth, 0.0f), 1.0f);
+        return (uint64_t)(clamped * (float)((1u << DrawSortKey::DEPTH_BITS) - 1));
+    }
+
+    uint64_t field(uint32_t value, uint32_t bits)
+    {
+        return (uint64_t)(value & ((1u << bits) - 1));
+    }
+
+    uint32_t digit(uint64_t key, uint32_t pass)
+    {
+        return (uint32_t)(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1);
+    }
+}
+
+uint64_t DrawSortKey::opaque(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    uint64_t key = 0;
+    key |= field(pipeline, PIPELINE_BITS) << 52;
+    key |= field(material, MATERIAL_BITS) << 40;
+    key |= field(mesh, MESH_BITS) << 28;
+    key |= quantizeDepth(depth) << 4;
+    return key;
+}
+
+uint64_t DrawSortKey::transparent(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+    uint64_t invertedDepth = ((1u << DEPTH_BITS) - 1) - quantizeDepth(depth);
+    uint64_t key = 1ull << 63;
+    key |= invertedDepth << 39;
+    key |= field(pipeline, PIPELINE_BITS) << 28;
+    key |= field(material, MATERIAL_BITS) << 16;
+    key |= field(mesh, MESH_BITS) << 4;
+    return key;
+}
+
+DrawListSorter::DrawListSorter(uint32_t threadCount)
+{
+    this->threadCount = threadCount > 0 ? threadCount : WorkerPool::shared().getThreadCount();
+    histograms.resize(PASS_COUNT * RADIX_SIZE);
+    threadHistograms.resize(this->threadCount * RADIX_SIZE);
+    localTotals.resize(this->threadCount * PASS_COUNT * RADIX_SIZE);
+    totalsTask = [this](uint32_t chunk) { countChunkTotals(chunk); };
+    passTask = [this](uint32_t chunk) { countChunkPass(chunk); };
+    scatterTask = [this](uint32_t chunk) { scatterChunk(chunk); };
+}
+
+void DrawListSorter::sort(const uint64_t* keys, uint32_t count, std::vector<uint32_t>& order)
+{
+    entries.resize(count);
+    scratch.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        entries[i] = { keys[i], i };
+    }
+
+    lastPassCount = 0;
+    if (count > 1)
+    {
+        if (threadCount > 1 && count >= PARALLEL_THRESHOLD)
+        {
+            sortParallel(count);
+        }
+        else
+        {
+            sortSerial(count);
+        }
+    }
+
+    order.resize(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        order[i] = entries[i].index;
+    }
+}
+
+void DrawListSorter::sortSerial(uint32_t count)
+{
+    //一次遍历统计全部8趟的直方图，直方图与顺序无关
+    std::fill(histograms.begin(), histograms.end(), 0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+        {
+            histograms[pass * RADIX_SIZE + digit(entries[i].key, pass)]++;
+        }
+    }
+
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+    {
+        uint32_t* histogram = &histograms[pass * RADIX_SIZE];
+        if (histogram[digit(entries[0].key, pass)] == count)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < RADIX_SIZE; d++)
+        {
+            uint32_t bucketSize = histogram[d];
+            histogram[d] = offset;
+            offset += bucketSize;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            scratch[histogram[digit(entries[i].key, pass)]++] = entries[i];
+        }
+        entries.swap(scratch);
+        lastPassCount++;
+    }
+}
+
+void DrawListSorter::sortParallel(uint32_t count)
+{
+    WorkerPool& pool = WorkerPool::shared();
+    activeWorkers = std::min(threadCount, count / (PARALLEL_THRESHOLD / 4));
+    activeWorkers = std::max(activeWorkers, 2u);
+    chunkSize = (count + activeWorkers - 1) / activeWorkers;
+    currentCount = count;
+
+    //全部8趟的总直方图决定哪些趟可以跳过，先各块统计再由调用线程合并
+    std::fill(localTotals.begin(), localTotals.begin() + activeWorkers * PASS_COUNT * RADIX_SIZE, 0);
+    pool.parallelFor(activeWorkers, totalsTask);
+    std::fill(histograms.begin(), histograms.end(), 0);
+    for (uint32_t w = 0; w < activeWorkers; w++)
+    {
+        for (uint32_t i = 0; i < PASS_COUNT * RADIX_SIZE; i++)
+        {
+            histograms[i] += localTotals[w * PASS_COUNT * RADIX_SIZE + i];
+        }
+    }
+
+    for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+    {
+        if (histograms[pass * RADIX_SIZE + digit(entries[0].key, pass)] == count)
+        {
+            continue;
+        }
+        currentPass = pass;
+        pool.parallelFor(activeWorkers, passTask);
+
+        //桶优先、块其次的前缀和，保证稳定
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < RADIX_SIZE; d++)
+        {
+            for (uint32_t w = 0; w < activeWorkers; w++)
+            {
+                uint32_t bucketSize = threadHistograms[w * RADIX_SIZE + d];
+                threadHistograms[w * RADIX_SIZE + d] = offset;
+                offset += bucketSize;
+            }
+        }
+
+        pool.parallelFor(activeWorkers, scatterTask);
+        entries.swap(scratch);
+        lastPassCount++;
+    }
+}
+
+void DrawListSorter::countChunkTotals(uint32_t chunk)
+{
+    uint32_t begin = std::min(currentCount, chunk * chunkSize);
+    uint32_t end = std::min(currentCount, begin + chunkSize);
+    uint32_t* local = &localTotals[chunk * PASS_COUNT * RADIX_SIZE];
+    for (uint32_t i = begin; i < end; i++)
+    {
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+        {
+            local[pass * RADIX_SIZE + digit(entries[i].key, pass)]++;
+        }
+    }
+}
+
+void DrawListSorter::countChunkPass(uint32_t chunk)
+{
+    uint32_t begin = std::min(currentCount, chunk * chunkSize);
+    uint32_t end = std::min(currentCount, begin + chunkSize);
+    uint32_t* histogram = &threadHistograms[chunk * RADIX_SIZE];
+    std::fill(histogram, histogram + RADIX_SIZE, 0);
+    for (uint32_t i = begin; i < end; i++)
+    {
+        histogram[digit(entries[i].key, currentPass)]++;
+    }
+}
+
+void DrawListSorter::scatterChunk(uint32_t chunk)
+{
+    uint32_t begin = std::min(currentCount, chunk * chunkSize);
+    uint32_t end = std::min(currentCount, begin + chunkSize);
+    uint32_t* histogram = &threadHistograms[chunk * RADIX_SIZE];
+    for (uint32_t i = begin; i < end; i++)
+    {
+        scratch[histogram[digit(entries[i].key, currentPass)]++] = entries[i];
+    }
+}
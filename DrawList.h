@@ -0,0 +1,84 @@
+﻿#pragma once
+
+/*
+绘制列表排序：
+
+1. 每个绘制打包成一个64位排序键，按键排序后相邻的绘制尽量共用管线、材质（描述符集）和网格（顶点缓冲），
+   录制时只在状态变化时调用vkCmdBind*，状态切换次数与不同状态的数量相关，而不是与绘制数量相关
+2. 键的布局（高位优先）：
+   不透明：   [63]=0 | 管线(11) | 材质(12) | 网格(12) | 深度(24，近的在前) | 保留(4)
+   半透明：   [63]=1 | 反转深度(24，远的在前) | 管线(11) | 材质(12) | 网格(12) | 保留(4)
+   不透明的先画，状态优先，同一状态内从前往后画，利用提前深度测试；半透明的必须从后往前画，深度优先
+3. 排序是LSD基数排序，每次8位，共8趟，所有键在某一位上都相同的那一趟直接跳过（状态少时大部分趟都会跳过）。
+   绘制数量多时每一趟按块分给WorkerPool：各块统计自己的直方图，调用线程合并前缀和之后各块分散写入，结果是稳定的
+4. 每一步都是一次parallelFor，步与步之间由调用线程衔接，不需要所有块同时运行，直方图等临时数据在构造时分配
+*/
+
+#include "WorkerPool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace DrawSortKey
+{
+    const uint32_t PIPELINE_BITS = 11;
+    const uint32_t MATERIAL_BITS = 12;
+    const uint32_t MESH_BITS = 12;
+    const uint32_t DEPTH_BITS = 24;
+
+    //depth为归一化的观察深度，0为最近，1为最远，超出范围时截断
+    uint64_t opaque(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+    uint64_t transparent(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+}
+
+class DrawListSorter
+{
+public:
+    //少于这个数量的列表在调用线程上排序，多线程的开销不划算
+    static const uint32_t PARALLEL_THRESHOLD = 16384;
+
+    //threadCount是最多分成的块数，为0时与WorkerPool的线程数相同
+    explicit DrawListSorter(uint32_t threadCount = 0);
+
+    DrawListSorter(const DrawListSorter&) = delete;
+    DrawListSorter& operator=(const DrawListSorter&) = delete;
+
+    //按键从小到大稳定排序，order输出排序后每个位置对应的原始下标
+    void sort(const uint64_t* keys, uint32_t count, std::vector<uint32_t>& order);
+
+    //最近一次排序实际执行的趟数（0~8）
+    uint32_t getLastPassCount() const { return lastPassCount; }
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    void sortSerial(uint32_t count);
+    void sortParallel(uint32_t count);
+    //以下三步各由一次parallelFor在每一块上运行
+    void countChunkTotals(uint32_t chunk);
+    void countChunkPass(uint32_t chunk);
+    void scatterChunk(uint32_t chunk);
+
+    uint32_t threadCount;
+    uint32_t lastPassCount = 0;
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+    std::vector<uint32_t> histograms;//全部8趟的直方图，构造时分配；多线程时是合并后的总直方图
+    std::vector<uint32_t> threadHistograms;//多线程时每一块一趟的直方图
+    std::vector<uint32_t> localTotals;//多线程时每一块全部8趟的直方图
+
+    //当前这次多线程排序的参数
+    uint32_t currentCount = 0;
+    uint32_t activeWorkers = 0;
+    uint32_t chunkSize = 0;
+    uint32_t currentPass = 0;
+
+    //构造时创建，每次排序不再构造std::function
+    WorkerPool::Task totalsTask;
+    WorkerPool::Task passTask;
+    WorkerPool::Task scatterTask;
+};
@@ -0,0 +1,249 @@
+﻿#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace
+{
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* alignedAlloc(size_t size, size_t alignment)
+    {
+#if defined(_WIN32)
+        return _aligned_malloc(size, alignment);
+#else
+        void* pointer = nullptr;
+        if (posix_memalign(&pointer, std::max(alignment, sizeof(void*)), size) != 0)
+        {
+            return nullptr;
+        }
+        return pointer;
+#endif
+    }
+
+    void alignedFree(void* pointer)
+    {
+#if defined(_WIN32)
+        _aligned_free(pointer);
+#else
+        free(pointer);
+#endif
+    }
+
+    //帧内存的块按缓存行对齐
+    const size_t BLOCK_ALIGNMENT = 64;
+}
+
+FrameArena::~FrameArena()
+{
+    destroy();
+}
+
+void FrameArena::init(size_t capacity)
+{
+    destroy();
+    base = static_cast<uint8_t*>(alignedAlloc(capacity, BLOCK_ALIGNMENT));
+    if (base == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    this->capacity = capacity;
+    offset = 0;
+}
+
+void FrameArena::destroy()
+{
+    for (void* block : overflowBlocks)
+    {
+        alignedFree(block);
+    }
+    overflowBlocks.clear();
+    overflowBytes = 0;
+    alignedFree(base);
+    base = nullptr;
+    capacity = 0;
+    offset = 0;
+}
+
+void FrameArena::reset()
+{
+    highWater = std::max(highWater, getUsed());
+
+    if (!overflowBlocks.empty())
+    {
+        for (void* block : overflowBlocks)
+        {
+            alignedFree(block);
+        }
+        overflowBlocks.clear();
+        overflowBytes = 0;
+
+        //按用到的最大值扩大主块，留一些余量，只在溢出之后的下一帧发生一次
+        size_t newCapacity = alignUp(highWater + highWater / 4, BLOCK_ALIGNMENT);
+        init(newCapacity);
+    }
+    offset = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    size_t start = alignUp(offset, alignment);
+    if (start + size <= capacity)
+    {
+        offset = start + size;
+        return base + start;
+    }
+
+    //主块放不下：这一帧先从堆上申请，计入溢出
+    void* block = alignedAlloc(std::max<size_t>(size, 1), std::max(alignment, BLOCK_ALIGNMENT));
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    overflowBlocks.push_back(block);
+    overflowBytes += size;
+    overflowCount++;
+    return block;
+}
+
+void FrameArena::rewind(size_t marker)
+{
+    //溢出块只在reset时释放
+    highWater = std::max(highWater, getUsed());
+    offset = std::min(marker, offset);
+}
+
+//------------------------------堆分配计数------------------------------
+
+#if !defined(NDEBUG)
+
+namespace
+{
+    thread_local uint64_t threadAllocationCount = 0;
+
+    void* countedAlloc(size_t size)
+    {
+        threadAllocationCount++;
+        void* pointer = malloc(size == 0 ? 1 : size);
+        if (pointer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return pointer;
+    }
+
+    void* countedAlignedAlloc(size_t size, std::align_val_t alignment)
+    {
+        threadAllocationCount++;
+        void* pointer = alignedAlloc(size == 0 ? 1 : size, (size_t)alignment);
+        if (pointer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return pointer;
+    }
+}
+
+bool AllocationCounter::isEnabled()
+{
+    return true;
+}
+
+uint64_t AllocationCounter::getThreadCount()
+{
+    return threadAllocationCount;
+}
+
+void* operator new(size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    threadAllocationCount++;
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    threadAllocationCount++;
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAlloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAlloc(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    alignedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    alignedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    alignedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    alignedFree(pointer);
+}
+
+#else
+
+bool AllocationCounter::isEnabled()
+{
+    return false;
+}
+
+uint64_t AllocationCounter::getThreadCount()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,111 @@
+﻿#pragma once
+
+/*
+帧内存：
+
+1. FrameArena是线性分配器，每帧开始时reset，帧内的临时数据从同一块内存中顺序分配，不逐个释放
+2. 容量不够时临时向堆申请溢出块，下一次reset时把主块扩大到这一帧用到的最大值，之后的帧不再溢出
+3. FrameVector是使用帧内存的std::vector，帧内的临时列表用它代替std::vector，reserve之后的push_back不会碰堆
+4. 初始化阶段的辅助函数也可以借用帧内存：用ArenaScope包住，离开作用域时退回到进入时的位置
+5. 调试版本替换全局operator new，按线程统计堆分配次数，渲染循环用它检查稳定状态下的帧是否还在分配
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FrameArena
+{
+public:
+    FrameArena() = default;
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void init(size_t capacity);
+    void destroy();
+
+    //开始新的一帧，之前分配的内存全部作废
+    void reset();
+
+    //分配失败时抛出std::bad_alloc
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(size_t count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    //当前位置，用于ArenaScope退回
+    size_t getMarker() const { return offset; }
+    void rewind(size_t marker);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return offset + overflowBytes; }
+    size_t getHighWater() const { return highWater; }
+    uint64_t getOverflowCount() const { return overflowCount; }
+
+private:
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    size_t offset = 0;
+
+    std::vector<void*> overflowBlocks;//这一帧主块放不下的分配
+    size_t overflowBytes = 0;
+    size_t highWater = 0;//单帧用量的最大值
+    uint64_t overflowCount = 0;
+};
+
+//离开作用域时把帧内存退回到进入时的位置
+class ArenaScope
+{
+public:
+    explicit ArenaScope(FrameArena& arena) : arena(arena), marker(arena.getMarker()) {}
+    ~ArenaScope() { arena.rewind(marker); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    FrameArena& arena;
+    size_t marker;
+};
+
+//从帧内存分配的STL分配器，释放是空操作
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    FrameArena* arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+//堆分配计数，只在调试版本中统计（发布版本中始终为0）
+namespace AllocationCounter
+{
+    bool isEnabled();
+    //当前线程累计的operator new次数
+    uint64_t getThreadCount();
+}
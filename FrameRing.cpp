@@ -0,0 +1,339 @@
+﻿#include "FrameRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    //像素槽按页对齐，消费者可以直接把槽交给需要对齐内存的接口
+    const uint64_t SLOT_ALIGNMENT = 4096;
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+//---------------------------共享内存----------------------------
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+void SharedMemoryRegion::create(const std::string& name, size_t size)
+{
+    close();
+    systemName = "Local\\" + name;
+    uint64_t size64 = size;
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)(size64 >> 32), (DWORD)size64, systemName.c_str());
+    if (mapping == nullptr)
+    {
+        throw std::runtime_error("failed to create shared memory!");
+    }
+    //同名映射已存在时CreateFileMappingA会直接打开它，大小和内容都是旧的，不能当作新建的使用
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        close();
+        throw std::runtime_error("shared memory with the same name already exists!");
+    }
+
+    base = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (base == nullptr)
+    {
+        close();
+        throw std::runtime_error("failed to map shared memory!");
+    }
+    this->size = size;
+    owner = true;
+}
+
+void SharedMemoryRegion::open(const std::string& name)
+{
+    close();
+    systemName = "Local\\" + name;
+    mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, systemName.c_str());
+    if (mapping == nullptr)
+    {
+        throw std::runtime_error("failed to open shared memory!");
+    }
+
+    base = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info = {};
+    if (base == nullptr || VirtualQuery(base, &info, sizeof(info)) == 0)
+    {
+        close();
+        throw std::runtime_error("failed to map shared memory!");
+    }
+    size = info.RegionSize;
+    owner = false;
+}
+
+void SharedMemoryRegion::close()
+{
+    if (base != nullptr)
+    {
+        UnmapViewOfFile(base);
+    }
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+    }
+    base = nullptr;
+    mapping = nullptr;
+    size = 0;
+    owner = false;
+}
+
+#else
+
+void SharedMemoryRegion::create(const std::string& name, size_t size)
+{
+    close();
+    systemName = "/" + name;
+    shm_unlink(systemName.c_str());
+    int fd = shm_open(systemName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to create shared memory!");
+    }
+    if (ftruncate(fd, (off_t)size) != 0)
+    {
+        ::close(fd);
+        shm_unlink(systemName.c_str());
+        throw std::runtime_error("failed to resize shared memory!");
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        shm_unlink(systemName.c_str());
+        throw std::runtime_error("failed to map shared memory!");
+    }
+    base = (uint8_t*)mapped;
+    this->size = size;
+    owner = true;
+}
+
+void SharedMemoryRegion::open(const std::string& name)
+{
+    close();
+    systemName = "/" + name;
+    int fd = shm_open(systemName.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("failed to open shared memory!");
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("failed to open shared memory!");
+    }
+
+    void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::runtime_error("failed to map shared memory!");
+    }
+    base = (uint8_t*)mapped;
+    size = (size_t)info.st_size;
+    owner = false;
+}
+
+void SharedMemoryRegion::close()
+{
+    if (base != nullptr)
+    {
+        munmap(base, size);
+        //只有创建者删除名字，已经映射的消费者不受影响
+        if (owner)
+        {
+            shm_unlink(systemName.c_str());
+        }
+    }
+    base = nullptr;
+    size = 0;
+    owner = false;
+}
+
+#endif
+
+//---------------------------生产者----------------------------
+
+void FrameRingWriter::create(const std::string& name, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t format, uint32_t slotCount, uint64_t slotAlignment)
+{
+    if (slotCount == 0 || rowPitch == 0 || height == 0)
+    {
+        throw std::runtime_error("invalid frame ring layout!");
+    }
+
+    slotAlignment = std::max(slotAlignment, SLOT_ALIGNMENT);
+    uint64_t slotInfoOffset = alignUp(sizeof(FrameRingHeader), 64);
+    uint64_t slotOffset = alignUp(slotInfoOffset + sizeof(FrameSlotInfo) * slotCount, slotAlignment);
+    uint64_t slotStride = alignUp((uint64_t)rowPitch * height, slotAlignment);
+    region.create(name, (size_t)(slotOffset + slotStride * slotCount));
+
+    //先初始化布局再写magic，消费者看到magic时其他字段都已有效
+    header = new (region.data()) FrameRingHeader();
+    header->version = FrameRingHeader::VERSION;
+    header->slotCount = slotCount;
+    header->width = width;
+    header->height = height;
+    header->rowPitch = rowPitch;
+    header->format = format;
+    header->slotInfoOffset = slotInfoOffset;
+    header->slotOffset = slotOffset;
+    header->slotStride = slotStride;
+    header->writeIndex.store(0, std::memory_order_relaxed);
+    header->readIndex.store(0, std::memory_order_relaxed);
+    header->droppedFrames.store(0, std::memory_order_relaxed);
+    header->maxOccupancy.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = FrameRingHeader::MAGIC;
+
+    publishedFrames = 0;
+    reservedIndex = 0;
+}
+
+void FrameRingWriter::destroy()
+{
+    region.close();
+    header = nullptr;
+}
+
+uint8_t* FrameRingWriter::beginWrite(uint32_t* slotIndex)
+{
+    //预留但还没发布的槽也算作占用，消费者不会读到它们
+    uint64_t readIndex = header->readIndex.load(std::memory_order_acquire);
+    if (reservedIndex - readIndex >= header->slotCount)
+    {
+        header->droppedFrames.store(header->droppedFrames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint32_t slot = (uint32_t)(reservedIndex % header->slotCount);
+    reservedIndex++;
+    if (slotIndex != nullptr)
+    {
+        *slotIndex = slot;
+    }
+    return getSlot(slot);
+}
+
+void FrameRingWriter::endWrite(uint64_t frameNumber)
+{
+    uint64_t writeIndex = header->writeIndex.load(std::memory_order_relaxed);
+    if (writeIndex == reservedIndex)
+    {
+        return;
+    }
+
+    FrameSlotInfo* slotInfos = (FrameSlotInfo*)(region.data() + header->slotInfoOffset);
+    FrameSlotInfo& info = slotInfos[writeIndex % header->slotCount];
+    info.frameNumber = frameNumber;
+    info.timestampNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    //release保证槽中的像素和info先于新的writeIndex对消费者可见
+    header->writeIndex.store(writeIndex + 1, std::memory_order_release);
+    publishedFrames++;
+
+    uint64_t occupancy = writeIndex + 1 - header->readIndex.load(std::memory_order_relaxed);
+    if (occupancy > header->maxOccupancy.load(std::memory_order_relaxed))
+    {
+        header->maxOccupancy.store(occupancy, std::memory_order_relaxed);
+    }
+}
+
+uint8_t* FrameRingWriter::getSlot(uint32_t slotIndex) const
+{
+    return region.data() + header->slotOffset + header->slotStride * slotIndex;
+}
+
+FrameRingStats FrameRingWriter::getStats() const
+{
+    FrameRingStats stats;
+    if (header == nullptr)
+    {
+        return stats;
+    }
+    stats.publishedFrames = publishedFrames;
+    stats.droppedFrames = header->droppedFrames.load(std::memory_order_relaxed);
+    stats.maxOccupancy = header->maxOccupancy.load(std::memory_order_relaxed);
+    stats.consumerLag = header->writeIndex.load(std::memory_order_relaxed) - header->readIndex.load(std::memory_order_acquire);
+    return stats;
+}
+
+//---------------------------消费者----------------------------
+
+void FrameRingReader::open(const std::string& name)
+{
+    region.open(name);
+    FrameRingHeader* mapped = (FrameRingHeader*)region.data();
+    if (region.getSize() < sizeof(FrameRingHeader) || mapped->magic != FrameRingHeader::MAGIC || mapped->version != FrameRingHeader::VERSION)
+    {
+        region.close();
+        throw std::runtime_error("shared memory is not a compatible frame ring!");
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (region.getSize() < mapped->slotOffset + mapped->slotStride * mapped->slotCount)
+    {
+        region.close();
+        throw std::runtime_error("frame ring is truncated!");
+    }
+    header = mapped;
+    reading = false;
+}
+
+void FrameRingReader::close()
+{
+    region.close();
+    header = nullptr;
+}
+
+const uint8_t* FrameRingReader::beginRead(FrameSlotInfo& info)
+{
+    uint64_t readIndex = header->readIndex.load(std::memory_order_relaxed);
+    uint64_t writeIndex = header->writeIndex.load(std::memory_order_acquire);
+    if (readIndex == writeIndex)
+    {
+        return nullptr;
+    }
+
+    uint64_t slot = readIndex % header->slotCount;
+    const FrameSlotInfo* slotInfos = (const FrameSlotInfo*)(region.data() + header->slotInfoOffset);
+    info = slotInfos[slot];
+    reading = true;
+    return region.data() + header->slotOffset + header->slotStride * slot;
+}
+
+void FrameRingReader::endRead()
+{
+    if (!reading)
+    {
+        return;
+    }
+    reading = false;
+
+    //release保证对槽的读取先于归还完成，生产者不会提前覆盖
+    header->readIndex.store(header->readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,141 @@
+﻿#pragma once
+
+/*
+共享内存帧环：把渲染完成的帧交给同一台机器上的其他进程（编码器、合成器、测试检查程序）
+
+1. 一块命名共享内存（Windows为文件映射，其他平台为POSIX共享内存），开头是FrameRingHeader，
+   之后是每个槽的FrameSlotInfo，最后是slotCount个按页对齐的像素槽
+2. 单生产者单消费者：writeIndex只由生产者写，readIndex只由消费者写，都是单调递增的帧计数，
+   槽号为计数对slotCount取模。数据先写入槽，再用release发布writeIndex；消费者用acquire读取
+   writeIndex后即可直接读共享内存中的像素，读完后发布readIndex把槽还给生产者，整个过程没有锁
+3. 消费者跟不上时（环满）生产者直接丢弃这一帧并计数，不会等待消费者，也不会覆盖正在读的槽
+4. 槽的地址在环的生命周期内不变，生产者可以把每个槽导入为GPU拷贝的目标（渲染器用VK_EXT_external_memory_host），
+   帧直接写入共享内存，不经过回读缓冲和memcpy。这时每个在途帧要预留一个槽，可以连续预留多个，按预留的顺序发布
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//共享内存开头的环形缓冲头，两个进程看到的是同一份
+struct FrameRingHeader
+{
+    static const uint32_t MAGIC = 0x474e5246;//"FRNG"
+    static const uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;//每行的字节数
+    uint32_t format;//像素格式，VkFormat的值
+    uint32_t reserved;
+    uint64_t slotInfoOffset;//FrameSlotInfo数组相对映射起点的偏移
+    uint64_t slotOffset;//第一个像素槽相对映射起点的偏移
+    uint64_t slotStride;//相邻像素槽的间隔
+
+    //生产者和消费者各自的计数放在不同的缓存行，避免互相干扰
+    alignas(64) std::atomic<uint64_t> writeIndex;//已发布的帧数，只由生产者写
+    alignas(64) std::atomic<uint64_t> readIndex;//已读完的帧数，只由消费者写
+
+    //背压统计，只由生产者写
+    alignas(64) std::atomic<uint64_t> droppedFrames;//环满时丢弃的帧数
+    std::atomic<uint64_t> maxOccupancy;//发布时环中未读帧数的最大值
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "frame ring requires lock-free 64-bit atomics");
+
+//每个槽的附加信息，在发布writeIndex之前写入
+struct FrameSlotInfo
+{
+    uint64_t frameNumber;//渲染器的帧号，不连续说明中间有丢帧
+    uint64_t timestampNs;//发布时间（steady_clock）
+};
+
+//生产者一侧的统计
+struct FrameRingStats
+{
+    uint64_t publishedFrames = 0;
+    uint64_t droppedFrames = 0;
+    uint64_t maxOccupancy = 0;
+    uint64_t consumerLag = 0;//当前还没被读走的帧数
+};
+
+//平台相关的命名共享内存
+class SharedMemoryRegion
+{
+public:
+    SharedMemoryRegion() = default;
+    ~SharedMemoryRegion();
+
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+    SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+    //创建新的共享内存。POSIX上已存在同名的会被替换；Windows上其他进程还持有同名映射时无法替换，抛出异常
+    void create(const std::string& name, size_t size);
+    //打开已存在的共享内存，映射全部大小
+    void open(const std::string& name);
+    void close();
+
+    uint8_t* data() const { return base; }
+    size_t getSize() const { return size; }
+
+private:
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    bool owner = false;
+    std::string systemName;
+#if defined(_WIN32)
+    void* mapping = nullptr;
+#endif
+};
+
+//生产者：渲染器
+class FrameRingWriter
+{
+public:
+    //创建共享内存并初始化环，失败时抛出异常。slotAlignment是像素槽起点和大小的对齐，不足一页时按页对齐
+    void create(const std::string& name, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t format, uint32_t slotCount, uint64_t slotAlignment = 0);
+    void destroy();
+    bool isOpen() const { return header != nullptr; }
+
+    //预留下一个可写的槽，环满时返回nullptr并计入丢帧。slotIndex返回槽号
+    uint8_t* beginWrite(uint32_t* slotIndex = nullptr);
+    //发布最早一个预留的槽
+    void endWrite(uint64_t frameNumber);
+
+    uint32_t getRowPitch() const { return header->rowPitch; }
+    uint32_t getSlotCount() const { return header->slotCount; }
+    uint64_t getSlotStride() const { return header->slotStride; }
+    uint8_t* getSlot(uint32_t slotIndex) const;
+    FrameRingStats getStats() const;
+
+private:
+    SharedMemoryRegion region;
+    FrameRingHeader* header = nullptr;
+    uint64_t publishedFrames = 0;
+    uint64_t reservedIndex = 0;//已预留的帧数，不小于writeIndex
+};
+
+//消费者：其他进程包含这个头文件即可读取
+class FrameRingReader
+{
+public:
+    //打开生产者创建的共享内存，失败时抛出异常
+    void open(const std::string& name);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    const FrameRingHeader& getHeader() const { return *header; }
+
+    //最早一个未读的帧，没有新帧时返回nullptr。像素直接指向共享内存，在endRead之前有效
+    const uint8_t* beginRead(FrameSlotInfo& info);
+    //读完后把槽还给生产者
+    void endRead();
+
+private:
+    SharedMemoryRegion region;
+    FrameRingHeader* header = nullptr;
+    bool reading = false;
+};
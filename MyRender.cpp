@@ -41,6 +41,25 @@ input assembler -> vertex shader -> tessellation shader -> geometry shader -> ra
 #include <optional>
 #include <set>
 #include <fstream>
+#include <cmath>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <random>
+
+#include "SoftRasterizer.h"
+#include "FrameRing.h"
+#include "RenderJobServer.h"
+#include "ResidencyManager.h"
+#include "FrameArena.h"
+#include "DrawList.h"
+#include "ShaderVariant.h"
+#include "Animation.h"
+#include "CommandCapture.h"
+#include "SceneBvh.h"
+#include "PerfHud.h"
+#include "WorkerPool.h"
 
 //用于获取编译好的着色器文件
 static std::vector<char> readFile(const std::string& filename)
@@ -59,10 +78,324 @@ static std::vector<char> readFile(const std::string& filename)
     return buffer;
 }
 
+//把B8G8R8A8格式、紧密排列的像素保存为PPM图片
+static bool writeImagePPM(const std::string& filename, const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(width * 3);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t* src = pixels + (size_t)y * width * 4;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = (char)src[x * 4 + 2];
+            row[x * 3 + 1] = (char)src[x * 4 + 1];
+            row[x * 3 + 2] = (char)src[x * 4 + 0];
+        }
+        file.write(row.data(), row.size());
+    }
+    return file.good();
+}
+
 //窗口长宽
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+//同时在GPU上处理的最大帧数
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
+//动态分辨率：渲染缩放比例的范围，以及希望保持的GPU帧时间（毫秒）
+//大于1时超采样，GPU有余量时渲染到比交换链更大的目标再缩小
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.5f;
+const float TARGET_GPU_FRAME_MS = 1000.0f / 60.0f;
+
+//放大到交换链时的锐化强度，0为只做双线性放大
+const float UPSCALE_SHARPNESS = 0.4f;
+
+//帧导出环的槽数，消费者最多可以落后这么多帧，再落后时丢帧
+const uint32_t FRAME_EXPORT_SLOTS = 4;
+
+//一个pass中最多同时渲染的相机数，与VertexShader.vert中的MAX_VIEWS一致
+const uint32_t MAX_CAMERA_VIEWS = 8;
+
+//渲染任务服务中同时执行的任务数，每个任务一个渲染上下文
+const uint32_t MAX_RENDER_CONTEXTS = 4;
+
+//每帧临时数据的线性内存大小，不够时会自动扩大一次
+const size_t FRAME_ARENA_SIZE = 64 * 1024;
+
+//调试版本中，前这么多帧之后的帧不应再有堆分配（交换链、管线和指令片段都已经准备好）
+const uint64_t ALLOCATION_CHECK_WARMUP_FRAMES = 2 * MAX_FRAMES_IN_FLIGHT + 4;
+
+//管线缓存文件，启动时读取，退出时写回
+const std::string PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+//启动时读取并创建模块的着色器，模块在所有管线创建之后销毁
+enum StartupShader
+{
+    SHADER_SCENE_VERT,
+    SHADER_SCENE_FRAG,
+    SHADER_UPSCALE_VERT,
+    SHADER_UPSCALE_FRAG,
+    SHADER_SKINNING_COMP,
+    SHADER_PARTICLE_COMP,
+    SHADER_PARTICLE_VERT,
+    SHADER_PARTICLE_FRAG,
+    SHADER_SHADOW_VERT,
+    SHADER_GROUND_VERT,
+    SHADER_GROUND_FRAG,
+    SHADER_POST_COMP,
+    SHADER_HUD_VERT,
+    SHADER_HUD_FRAG,
+    STARTUP_SHADER_COUNT,
+};
+const char* const STARTUP_SHADER_FILES[STARTUP_SHADER_COUNT] =
+{
+    "shaders/vert.spv",
+    "shaders/frag.spv",
+    "shaders/upscale_vert.spv",
+    "shaders/upscale_frag.spv",
+    "shaders/skinning_comp.spv",
+    "shaders/particle_comp.spv",
+    "shaders/particle_vert.spv",
+    "shaders/particle_frag.spv",
+    "shaders/shadow_vert.spv",
+    "shaders/ground_vert.spv",
+    "shaders/ground_frag.spv",
+    "shaders/post_comp.spv",
+    "shaders/hud_vert.spv",
+    "shaders/hud_frag.spv",
+};
+
+//动画角色的默认数量，按网格排列在场景中，0为关闭动画
+const uint32_t DEFAULT_ANIMATED_CHARACTERS = 64;
+//所有角色在一次dispatch中蒙皮，角色数受y方向工作组数的最小保证值限制
+const uint32_t MAX_ANIMATED_CHARACTERS = 65535;
+//角色骨骼的关节数，以及网格上每个关节的段数
+const uint32_t CHARACTER_JOINTS = 6;
+const uint32_t CHARACTER_SEGMENTS_PER_JOINT = 2;
+//蒙皮计算着色器一个工作组的线程数，与SkinningShader.comp中的local_size_x一致
+const uint32_t SKINNING_GROUP_SIZE = 64;
+
+//GPU粒子的默认容量，0为关闭粒子
+const uint32_t DEFAULT_PARTICLES = 16384;
+//粒子计算着色器一个工作组的线程数，与ParticleShader.comp中的local_size_x一致
+const uint32_t PARTICLE_GROUP_SIZE = 256;
+//一次dispatch最多的工作组数是65535的最小保证值
+const uint32_t MAX_PARTICLES = 65535 * PARTICLE_GROUP_SIZE;
+//粒子的最长寿命（秒，与ParticleShader.comp的spawn一致），每秒发射容量除以它，稳定时粒子缓冲接近装满
+const float PARTICLE_MAX_LIFE = 3.0f;
+
+//场景片段着色器的功能位，与FragmentShader.frag中的FEATURE_*一致
+const uint32_t SCENE_FEATURE_VERTEX_COLOR = 1u << 0;//关闭时输出纯白，用于调试几何
+const uint32_t SCENE_FEATURE_OVERDRAW = 1u << 1;//每个片段输出固定的增量，配合相加混合统计每个像素被画了几次
+
+//调试视图
+enum class DebugView
+{
+    Normal,
+    Overdraw,//场景管线换成相加混合的变体，放大pass按每个像素的片段数显示热力图
+};
+
+//管线统计：每个pass统计的计数，结果按位从低到高依次存放
+const VkQueryPipelineStatisticFlags PIPELINE_STATISTICS_FLAGS = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+const uint32_t PIPELINE_STATISTICS_COUNT = 3;
+//统计的pass：场景pass和放大pass
+const uint32_t STATISTICS_SCENE_PASS = 0;
+const uint32_t STATISTICS_UPSCALE_PASS = 1;
+const uint32_t STATISTICS_PASS_COUNT = 2;
+
+//场景的清除颜色，GPU和软件光栅化后端共用
+const float SCENE_CLEAR_COLOR[4] = { 0.0f, 0.0f, 0.0f, 0.1f };
+
+//离屏场景目标的格式：HDR，超过1的亮度留给泛光和色调映射。存储图像和混合都是必须支持的，不需要查询
+const VkFormat SCENE_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+//计算后处理：泛光的级数（第0级是半分辨率）和一个工作组处理的块，与PostProcess.comp一致
+const uint32_t BLOOM_LEVELS = 4;
+const uint32_t POST_TILE_SIZE = 16;
+const VkFormat BLOOM_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+const VkFormat POST_OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;//色调映射之后的结果，放大pass采样它
+
+//性能HUD每帧最多的四边形数，超出的丢弃（见PerfHud.h）
+const uint32_t HUD_MAX_QUADS = 1024;
+
+//顶点结构，GPU管线和软件光栅化后端共用
+struct Vertex
+{
+    float pos[2];//裁剪空间坐标
+    float color[3];
+
+    //顶点缓冲的绑定方式
+    static VkVertexInputBindingDescription getBindingDescription()
+    {
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Vertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+    //顶点属性，对应VertexShader.vert中的location
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions()
+    {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Vertex, color);
+        return attributeDescriptions;
+    }
+};
+
+//CPU蒙皮直接写出Vertex
+static_assert(sizeof(Vertex) == sizeof(SkinnedOutputVertex), "skinned vertex layout must match Vertex");
+
+//场景的顶点数据
+const std::vector<Vertex> vertices =
+{
+    { { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+    { { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+    { { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } },
+};
+
+//场景的绘制列表，参数与vkCmdDraw相同，bucket是所属静态桶的编号
+//pipeline、material、mesh是管线、材质（描述符集）和网格（顶点缓冲）表中的下标，用于排序和去掉重复的绑定
+struct SceneDraw
+{
+    uint32_t bucket;
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+    float depth;//归一化的观察深度，0为最近
+    bool transparent;
+};
+
+const std::vector<SceneDraw> sceneDraws =
+{
+    { 0, 3, 1, 0, 0, 0, 0, 0, 0.5f, false },
+};
+
+//动画角色的绘制：所有角色蒙皮后的顶点在同一个缓冲里，一次绘制，顶点数在创建时确定
+const uint32_t ANIMATION_BUCKET = 1;
+const uint32_t ANIMATION_MESH = 1;
+
+//GPU粒子的绘制是间接绘制，单独一个桶
+const uint32_t PARTICLE_BUCKET = 2;
+
+//级联阴影：俯视的场景中地面在z=0，投影物按所在的桶放在不同的高度上，平行光斜照在地面上
+const uint32_t SHADOW_CASCADES = 3;//与ShadowShader.vert和GroundShader.frag一致
+const uint32_t SHADOW_MAP_SIZE = 1024;
+const VkFormat SHADOW_MAP_FORMAT = VK_FORMAT_D16_UNORM;
+//每个级联覆盖的地面半径占相机可见范围的比例（以相机看到的地面的中心为圆心），从近到远
+const float SHADOW_CASCADE_SPLITS[SHADOW_CASCADES] = { 0.2f, 0.45f, 1.0f };
+const float SHADOW_LIGHT_ELEVATION = 0.87f;//光线与地面的夹角（弧度，约50度）
+const float SHADOW_LIGHT_AZIMUTH = 0.6f;//光源的初始方位角（弧度）
+//桶0是场景的静态几何，它的阴影缓存在深度图的静态层中
+const uint32_t SHADOW_STATIC_BUCKET = 0;
+const float SHADOW_STATIC_HEIGHT = 0.3f;//静态几何离地面的高度
+const float SHADOW_CHARACTER_HEIGHT = 0.15f;//动画角色离地面的高度
+const float SHADOW_MAX_HEIGHT = 0.5f;//投影物的最大高度，决定光源视角的深度范围
+//有阴影时场景先画地面，地面代替清除颜色
+const float SHADOW_GROUND_COLOR[4] = { 0.16f, 0.18f, 0.22f, 0.1f };
+
+//动画角色：一条竖直的触手，CHARACTER_JOINTS个关节串成一条链，总高度为1。
+//网格是逐渐变细的条带，每个关节分成CHARACTER_SEGMENTS_PER_JOINT段，关节下半部分与父关节混合权重，弯曲处不会断开。
+//两个循环片段：摆动（各关节相位错开，像波一样向上传）和卷曲，角色在两者之间混合
+static void buildCharacterAssets(Skeleton& skeleton, std::vector<AnimationClip>& clips, std::vector<SkinnedVertex>& mesh)
+{
+    const float jointLength = 1.0f / (float)CHARACTER_JOINTS;
+
+    skeleton.parents.clear();
+    skeleton.inverseBind.clear();
+    for (uint32_t joint = 0; joint < CHARACTER_JOINTS; joint++)
+    {
+        skeleton.parents.push_back((int32_t)joint - 1);
+        //绑定姿势下关节在(0, joint * jointLength)，没有旋转
+        skeleton.inverseBind.push_back(Animation::placement(0.0f, -(float)joint * jointLength, 1.0f, 1.0f));
+    }
+
+    //条带第row行左侧（side = -1）或右侧（side = 1）的顶点
+    const uint32_t rowCount = CHARACTER_JOINTS * CHARACTER_SEGMENTS_PER_JOINT + 1;
+    auto makeVertex = [&](uint32_t row, float side)
+    {
+        float height = (float)row / (float)(rowCount - 1);
+        uint32_t joint = std::min(row / CHARACTER_SEGMENTS_PER_JOINT, CHARACTER_JOINTS - 1);
+        float local = (float)row / (float)CHARACTER_SEGMENTS_PER_JOINT - (float)joint;
+
+        SkinnedVertex vertex = {};
+        vertex.pos[0] = side * 0.12f * (1.0f - 0.8f * height);
+        vertex.pos[1] = height;
+        vertex.color[0] = 0.9f + 0.1f * height;
+        vertex.color[1] = 0.4f + 0.5f * height;
+        vertex.color[2] = 0.1f + 0.2f * height;
+        vertex.joints = joint;
+        vertex.weights[0] = 1.0f;
+        if (joint > 0 && local < 0.5f)
+        {
+            float parentWeight = 0.5f - local;
+            vertex.joints |= (joint - 1) << 8;
+            vertex.weights[0] = 1.0f - parentWeight;
+            vertex.weights[1] = parentWeight;
+        }
+        return vertex;
+    };
+
+    //模型空间y向上，放置矩阵翻转y之后在屏幕上仍是顺时针
+    mesh.clear();
+    for (uint32_t row = 0; row + 1 < rowCount; row++)
+    {
+        mesh.push_back(makeVertex(row, -1.0f));
+        mesh.push_back(makeVertex(row + 1, -1.0f));
+        mesh.push_back(makeVertex(row, 1.0f));
+        mesh.push_back(makeVertex(row, 1.0f));
+        mesh.push_back(makeVertex(row + 1, -1.0f));
+        mesh.push_back(makeVertex(row + 1, 1.0f));
+    }
+
+    const uint32_t frameCount = 30;
+    clips.clear();
+    for (uint32_t c = 0; c < 2; c++)
+    {
+        AnimationClip clip;
+        clip.name = c == 0 ? "sway" : "curl";
+        clip.sampleRate = 30.0f;
+        clip.frameCount = frameCount;
+        for (uint32_t frame = 0; frame < frameCount; frame++)
+        {
+            float phase = 2.0f * 3.14159265f * (float)frame / (float)frameCount;
+            for (uint32_t joint = 0; joint < CHARACTER_JOINTS; joint++)
+            {
+                float angle = c == 0 ? 0.35f * std::sin(phase - 0.6f * (float)joint) : 0.25f * (0.6f + 0.4f * std::sin(phase));
+
+                //绕z轴旋转
+                JointPose pose = {};
+                pose.translation[1] = joint == 0 ? 0.0f : jointLength;
+                pose.rotation[2] = std::sin(angle * 0.5f);
+                pose.rotation[3] = std::cos(angle * 0.5f);
+                clip.keys.push_back(pose);
+            }
+        }
+        clips.push_back(clip);
+    }
+}
+
 //校验层名称 
 const std::vector<const char*> validationLayers =
 {
@@ -75,6 +408,15 @@ const std::vector<const char*> deviceExtenstions =
     VK_KHR_SWAPCHAIN_EXTENSION_NAME //交换链扩展
 };
 
+//可选扩展：动态渲染路径，都支持时才使用（dynamic_rendering在1.1上依赖depth_stencil_resolve和create_renderpass2）
+const std::vector<const char*> dynamicRenderingExtensions =
+{
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+    VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME
+};
+
 //判断是否在debug状态,如果在则打开校验层
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -127,8 +469,17 @@ public:
     //运行函数
     void run()
     {
+        startupBegin = std::chrono::steady_clock::now();
+
+        //回放时渲染配置来自日志
+        if (!replayPath.empty())
+        {
+            loadReplay();
+        }
+
         //创建窗口
         initWindow();
+        markStartup("window");
 
         //创建vk实例
         initVulkan();
@@ -141,6 +492,109 @@ public:
 
     }
 
+    //基准测试模式：渲染指定帧数后退出并输出耗时，渲染分辨率固定，不等待垂直同步
+    void setBenchmarkFrames(uint32_t frames)
+    {
+        benchmarkFrames = frames;
+    }
+
+    //帧导出模式：每帧除了显示，还写入指定名字的共享内存环，供其他进程读取
+    void setFrameExport(const std::string& name)
+    {
+        frameExportName = name;
+    }
+
+    //多视图模式：用multiview在一个pass中从多个相机渲染场景，每个相机写入离屏目标的一层
+    void setViewCount(uint32_t count)
+    {
+        viewCount = std::clamp(count, 1u, MAX_CAMERA_VIEWS);
+    }
+
+    //渲染任务服务模式：在本地套接字上接收渲染任务（协议见RenderJobServer.h），和窗口渲染共用设备，图片只写到outputDirectory下
+    void setJobServer(const std::string& socketPath, const std::string& outputDirectory)
+    {
+        jobServerPath = socketPath;
+        jobOutputDirectory = outputDirectory;
+    }
+
+    //显存报告：每隔指定秒数输出一次各个堆的预算、用量和逐出统计，0为不输出
+    void setMemoryReportInterval(float seconds)
+    {
+        memoryReportSeconds = seconds;
+    }
+
+    //骨骼动画：场景中的动画角色数，0为关闭
+    void setAnimatedCharacters(uint32_t count)
+    {
+        characterCount = std::min(count, MAX_ANIMATED_CHARACTERS);
+    }
+
+    //强制使用CPU蒙皮（否则图形队列支持计算时用计算着色器）
+    void setCpuSkinning(bool enabled)
+    {
+        forceCpuSkinning = enabled;
+    }
+
+    //按相机剔除动画角色（场景BVH），关闭时所有角色一次绘制
+    void setCharacterCulling(bool enabled)
+    {
+        characterCulling = enabled;
+    }
+
+    //调试视图：Overdraw时显示每个像素的片段数
+    void setDebugView(DebugView view)
+    {
+        debugView = view;
+    }
+
+    //命令流捕获：把每一帧交给GPU的输入写入日志，见CommandCapture.h
+    void setCapture(const std::string& path)
+    {
+        capturePath = path;
+    }
+
+    //回放捕获的日志：窗口不显示，按日志配置渲染器，尽快执行所有帧并输出每一帧的耗时
+    void setReplay(const std::string& path)
+    {
+        replayPath = path;
+    }
+
+    //GPU粒子：粒子缓冲的容量，0为关闭
+    void setParticleCapacity(uint32_t capacity)
+    {
+        particleCapacity = std::min(capacity, MAX_PARTICLES);
+    }
+
+    //级联阴影：场景画在带阴影的地面上，关闭时与之前的画面相同
+    void setShadows(bool enabled)
+    {
+        shadowsEnabled = enabled;
+    }
+
+    //光源绕竖直轴旋转的速度（度每秒），旋转时静态阴影的缓存每帧失效，0为静止
+    void setLightRotation(float degreesPerSecond)
+    {
+        lightRotationSpeed = degreesPerSecond;
+    }
+
+    //计算后处理（泛光、自动曝光、色调映射），关闭时离屏目标直接放大，超过1的部分被截断
+    void setPostProcessing(bool enabled)
+    {
+        postProcessing = enabled;
+    }
+
+    //设备支持时使用动态渲染（不创建pass和帧缓存），false时总是使用VkRenderPass
+    void setDynamicRendering(bool enabled)
+    {
+        preferDynamicRendering = enabled;
+    }
+
+    //启动时是否显示性能HUD，运行中按F1切换
+    void setHudVisible(bool visible)
+    {
+        hudVisible = visible;
+    }
+
 private:
 
     //--------------成员变量-----------------
@@ -171,19 +625,472 @@ private:
     VkShaderModule vertShaderModule;//着色器模块
     VkShaderModule fragShaderModule;//着色器模块
 
-    VkRenderPass renderPass;//渲染的pass
+    VkRenderPass renderPass;//场景渲染的pass，输出到离屏目标
+    VkRenderPass jobRenderPass;//渲染任务的单视图场景pass，单视图时就是renderPass
+
+    //动态渲染：设备支持VK_KHR_dynamic_rendering和VK_KHR_synchronization2时不创建pass和帧缓存，管线按附件格式创建，
+    //pass隐含的布局转换和外部依赖写成synchronization2的图像屏障（64位的阶段和访问成对给出）；否则使用pass和帧缓存
+    bool preferDynamicRendering = true;
+    bool dynamicRendering = false;
+    PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+    PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+    PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2 = nullptr;
     VkPipelineLayout pipelineLayout;//用于提供shader的数据
     VkPipeline graphicsPipeline;//图形管线
+    VkPipeline jobPipeline;//渲染任务的单视图场景管线，单视图时就是graphicsPipeline
+
+    VkBuffer vertexBuffer;//顶点缓冲
+    VkDeviceMemory vertexBufferMemory;
+
+    //相机：每个视图一个变换矩阵，顶点着色器用gl_ViewIndex选择
+    struct CameraBufferObject
+    {
+        float viewProj[MAX_CAMERA_VIEWS][16];//列主序
+    };
+
+    uint32_t viewCount = 1;//同时渲染的相机数，离屏目标的层数
+    VkDescriptorSetLayout sceneDescriptorSetLayout;
+    VkDescriptorSet sceneDescriptorSet;
+    VkBuffer cameraBuffer;
+    VkDeviceMemory cameraBufferMemory;
+
+    VkPipelineCache pipelineCache;//所有管线共用，跨进程保存到PIPELINE_CACHE_FILE
+
+    //渲染任务的上下文：各自的目标、相机、回读缓冲和指令，共享设备、管线、管线缓存、描述符池和指令池
+    struct RenderContext
+    {
+        VkImage colorImage;
+        VkDeviceMemory colorImageMemory;
+        VkImageView colorImageView;
+        VkImage readbackImage;//HDR的第0层转换成交换链格式，再拷贝到回读缓冲
+        VkDeviceMemory readbackImageMemory;
+        VkFramebuffer framebuffer;
+        VkBuffer cameraBuffer;
+        VkDeviceMemory cameraBufferMemory;
+        void* cameraMapped;
+        VkDescriptorSet descriptorSet;
+        VkBuffer readbackBuffer;
+        VkDeviceMemory readbackBufferMemory;
+        void* readbackMapped;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        bool busy;
+        RenderJob job;
+        bool resident;//目标、相机和回读缓冲是否存在，空闲时可能被驻留管理逐出
+        uint32_t residencyGroup;
+    };
+
+    std::string jobServerPath;//为空表示不启动服务
+    std::string jobOutputDirectory;
+    RenderJobServer jobServer;
+    std::vector<RenderContext> renderContexts;
+
+    //显存预算和驻留管理，所有显存分配都经过它
+    ResidencyManager residency;
+    float memoryReportSeconds = 0.0f;
 
     VkCommandPool commandPool;//指令池
 
-    std::vector<VkCommandBuffer> commandBuffers;//指令缓存
+    std::vector<VkCommandBuffer> commandBuffers;//主指令缓存，每个同时处理的帧一个，每帧重新录制
+
+    //场景中的一次绘制
+    struct DrawItem
+    {
+        uint32_t bucket;//所属的静态桶，同一个桶的绘制录制在同一个片段里
+        uint64_t sortKey;//见DrawList.h，片段中的绘制按它排序
+        VkPipeline pipeline;
+        VkDescriptorSet descriptorSet;
+        VkBuffer vertexBuffer;
+        uint32_t vertexCount;
+        uint32_t instanceCount;
+        uint32_t firstVertex;
+        uint32_t firstInstance;
+        VkBuffer indirectBuffer = VK_NULL_HANDLE;//不为空时用vkCmdDrawIndirect，参数在GPU上生成，上面的绘制参数不使用
+        VkDeviceSize indirectOffset = 0;
+    };
+
+    //可缓存的指令片段：一个静态桶的绘制录制成二级指令缓存，只有输入变化时才重新录制
+    struct CommandSegment
+    {
+        std::vector<DrawItem> draws;//该桶里的绘制
+        uint64_t version = 0;//绘制内容每变化一次加一
+        std::vector<VkCommandBuffer> buffers;//每个帧槽一份，避免改写GPU上还在执行的指令
+        std::vector<uint64_t> recordedVersion;//每个帧槽录制时的版本
+        std::vector<VkExtent2D> recordedExtent;//每个帧槽录制时的视口大小（二级指令缓存不继承动态视口）
+        uint32_t stateChanges = 0;//最近一次录制中vkCmdBind*的次数
+    };
+
+    //绘制引用的管线、材质和网格，SceneDraw中的下标指向这里
+    std::vector<VkPipeline> scenePipelines;
+    std::vector<VkDescriptorSet> sceneMaterials;
+    std::vector<VkBuffer> sceneMeshes;
+
+    DrawListSorter drawSorter;
+    std::vector<uint64_t> sortKeys;//排序时的临时数据，保留容量
+    std::vector<uint32_t> sortOrder;
+
+    std::vector<DrawItem> sceneDrawItems;//场景的绘制列表
+    std::vector<CommandSegment> sceneSegments;//按静态桶划分的指令片段
+    uint32_t segmentsRecordedLastFrame = 0;//上一帧重新录制的片段数
+
+    std::vector<VkFramebuffer> swapChainFramebuffers;//帧缓存（放大pass写入交换链图像）
+
+    //离屏场景目标，按最大缩放比例分配，每帧只渲染左上角renderExtent大小的区域
+    VkImage sceneColorImage;
+    VkDeviceMemory sceneColorImageMemory;
+    VkImageView sceneColorImageView;
+    VkFramebuffer sceneFramebuffer;
+    VkExtent2D sceneExtent;//离屏目标的完整大小
+    VkExtent2D renderExtent;//当前帧实际渲染的大小
+    float renderScale = 1.0f;//当前渲染缩放比例，从原生分辨率开始
+    float maxRenderScale = MAX_RENDER_SCALE;//受设备最大图像尺寸限制后的上限
+
+    //把离屏目标放大锐化到交换链的pass
+    VkRenderPass upscaleRenderPass;
+    VkDescriptorSetLayout upscaleDescriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet upscaleDescriptorSet;
+    VkSampler upscaleSampler;
+    VkPipelineLayout upscalePipelineLayout;
+    VkPipeline upscalePipeline;
+
+    //骨骼动画：姿势和蒙皮矩阵在工作线程上计算，蒙皮在计算着色器中完成（或在CPU上蒙皮后拷贝），
+    //结果写入skinnedVertexBuffer，场景管线把它当作普通的顶点缓冲使用
+    uint32_t characterCount = DEFAULT_ANIMATED_CHARACTERS;
+    bool forceCpuSkinning = false;
+    bool computeSupported = false;//图形队列支持计算
+    bool gpuSkinning = false;//图形队列支持计算且没有强制CPU蒙皮
+    AnimationSystem animation;
+    std::chrono::steady_clock::time_point animationStart;
+    VkBuffer skinnedVertexBuffer = VK_NULL_HANDLE;//所有角色蒙皮后的顶点
+    VkDeviceMemory skinnedVertexBufferMemory;
+    VkBuffer bindPoseBuffer;//GPU蒙皮：绑定姿势的顶点
+    VkDeviceMemory bindPoseBufferMemory;
+    VkBuffer jointMatrixBuffer;//GPU蒙皮：每个帧槽一段蒙皮矩阵
+    VkDeviceMemory jointMatrixBufferMemory;
+    JointMatrix* jointMatrixMapped;
+    VkDeviceSize jointMatrixStride;
+    VkBuffer skinningUploadBuffer;//CPU蒙皮：每个帧槽一段蒙皮后的顶点，拷贝到skinnedVertexBuffer
+    VkDeviceMemory skinningUploadBufferMemory;
+    SkinnedOutputVertex* skinningUploadMapped;
+    std::vector<JointMatrix> cpuJointMatrices;//CPU蒙皮和角色剔除用的蒙皮矩阵
+    VkDescriptorSetLayout skinningDescriptorSetLayout;
+    VkPipelineLayout skinningPipelineLayout;
+    VkPipeline skinningPipeline;
+    std::vector<VkDescriptorSet> skinningDescriptorSets;//每个帧槽一个，指向该帧槽的蒙皮矩阵
+
+    //场景BVH：每个动画角色一个物体，包围盒每帧由蒙皮矩阵算出并refit，按所有相机剔除，
+    //可见的角色中连续的一段合成一次绘制，可见集合变化时才替换动画桶的绘制
+    bool characterCulling = true;
+    SceneBvh sceneBvh;
+    Aabb characterBindBounds;//绑定姿势网格的包围盒
+    CameraBufferObject sceneCameras;//剔除用的相机矩阵，与相机缓冲相同
+    DrawItem characterDrawTemplate;//所有角色一次绘制
+    std::vector<DrawItem> characterDraws;//动画桶当前的绘制
+    std::vector<DrawItem> nextCharacterDraws;
+    std::vector<uint32_t> visibleObjects;
+    std::vector<uint8_t> characterVisible;
+    uint32_t visibleCharacterCount = 0;
+    double lastCullMs = 0.0;
+
+    //蒙皮管线的特化常量，成员顺序即constant_id，与SkinningShader.comp一致
+    struct SkinningShaderVariant
+    {
+        uint32_t vertexCount;//每个角色的顶点数
+        uint32_t jointCount;//每个角色的关节数
+    };
+
+    //GPU粒子：发射、积分和压缩在计算着色器中完成（见ParticleShader.comp），存活数只在GPU上，
+    //绘制是实例化的间接绘制，实例数由模拟写入particleStateBuffer
+    struct Particle
+    {
+        float positionVelocity[4];//xy位置，zw速度
+        float colorLife[4];//rgb颜色，a剩余寿命（秒）
+    };
+
+    //与ParticleShader.comp中的State一致
+    struct ParticleState
+    {
+        uint32_t aliveCount;
+        uint32_t emitCount;
+        uint32_t outputCount;
+        uint32_t reserved;
+        VkDispatchIndirectCommand simulateDispatch;
+        uint32_t simulatePadding;
+        VkDispatchIndirectCommand copyDispatch;
+        uint32_t copyPadding;
+        VkDrawIndirectCommand draw;
+    };
+    static_assert(offsetof(ParticleState, simulateDispatch) == 16 && offsetof(ParticleState, copyDispatch) == 32 && offsetof(ParticleState, draw) == 48, "particle state layout must match ParticleShader.comp");
+
+    //与ParticleShader.comp中的ParticleParams一致
+    struct ParticlePushConstants
+    {
+        float deltaTime;
+        float time;
+        uint32_t emitRequest;
+        uint32_t seed;
+    };
+
+    //粒子计算管线的特化常量，成员顺序即constant_id，与ParticleShader.comp一致
+    struct ParticleShaderVariant
+    {
+        uint32_t pass;//0准备、1模拟、2完成、3拷回
+        uint32_t capacity;
+    };
+
+    static const uint32_t PARTICLE_PASS_COUNT = 4;
+
+    uint32_t particleCapacity = DEFAULT_PARTICLES;
+    VkBuffer particleBuffer;//存活的粒子，也是绘制的实例顶点缓冲
+    VkDeviceMemory particleBufferMemory;
+    VkBuffer particleCompactBuffer;//模拟的输出，压缩后拷回particleBuffer
+    VkDeviceMemory particleCompactBufferMemory;
+    VkBuffer particleStateBuffer;//计数和间接参数
+    VkDeviceMemory particleStateBufferMemory;
+    bool particleStateCleared = false;//第一帧之前清零计数
+    VkDescriptorSetLayout particleDescriptorSetLayout;
+    VkDescriptorSet particleDescriptorSet;
+    VkPipelineLayout particleComputeLayout;
+    VkPipeline particleComputePipelines[PARTICLE_PASS_COUNT];
+    VkPipeline particlePipeline;//绘制粒子的图形管线，与场景管线共用布局
+    std::chrono::steady_clock::time_point lastParticleUpdate;
+    float particleEmitCarry = 0.0f;//发射数量的小数部分，留到下一帧
+    uint32_t particleFrame = 0;
+
+    //级联阴影：光源视角的深度图数组，每个级联两层。前SHADOW_CASCADES层缓存静态几何的阴影，只在光源或静态桶变化时重画，
+    //后SHADOW_CASCADES层每帧清除并重画动态物体（动画角色）；地面着色时两层分别比较，取遮挡多的一个
+    struct ShadowBufferObject
+    {
+        float lightViewProj[SHADOW_CASCADES][16];//列主序
+        float cascadeRadius[4];
+        float groundColor[4];
+        float focus[4];//级联的中心
+    };
+
+    //与ShadowShader.vert中的ShadowPushConstants一致
+    struct ShadowPushConstants
+    {
+        uint32_t cascade;
+        float height;//投影物离地面的高度
+    };
+
+    bool shadowsEnabled = true;
+    float lightRotationSpeed = 0.0f;
+    VkRenderPass shadowRenderPass;
+    VkPipeline shadowPipeline;//只写深度的管线变体，没有片段着色器
+    VkPipeline groundPipeline;//画地面并采样阴影
+    VkImage shadowMapImage;
+    VkDeviceMemory shadowMapImageMemory;
+    VkImageView shadowMapView;//所有层的数组视图，给地面采样
+    std::vector<VkImageView> shadowLayerViews;//每层一个，作为深度附件
+    std::vector<VkFramebuffer> shadowFramebuffers;
+    VkSampler shadowSampler;//深度比较采样器
+    VkBuffer shadowBuffer;//光源矩阵，只在光源变化时写入
+    VkDeviceMemory shadowBufferMemory;
+    ShadowBufferObject shadowData;
+    uint64_t lightVersion = 0;//光源每变化一次加一
+    uint64_t uploadedLightVersion = 0;//已经写入shadowBuffer的版本
+    uint64_t cachedLightVersion = 0;//静态层重画时的光源版本
+    uint64_t cachedStaticVersion = 0;//静态层重画时静态桶的版本
+    bool dynamicLayersEmpty = false;//动态层已经清空，没有动态物体时不用再清除
+    uint32_t staticShadowRedraws = 0;
+    uint32_t dynamicShadowDraws = 0;//最近一帧动态层的绘制数
+    //动态层的投影物按每个级联在光源视角下的范围剔除，与相机的剔除无关：画面外的角色也可能把影子投进画面
+    std::vector<DrawItem> cascadeCasterDraws[SHADOW_CASCADES];
+    std::vector<uint8_t> casterVisible;
+    bool cascadeCastersCulled = false;//没有剔除（关闭剔除或回放）时动态层画动画桶的全部绘制
+    CommandSegment groundSegment;//地面的指令片段，在场景的其他片段之前执行
+
+    //计算后处理：两次dispatch完成整个后处理（见PostProcess.comp）。降采样读一次场景，在共享内存中写出泛光的所有级并测光，
+    //合成读一次场景和泛光，完成泛光放大、曝光、色调映射和抖动，8位的结果交给放大pass
+    struct PostState
+    {
+        uint32_t luminanceSum[2];//按帧的奇偶交替
+        float exposure[2];
+    };
+
+    //与PostProcess.comp中的PostParams一致
+    struct PostPushConstants
+    {
+        int32_t renderSize[2];
+        uint32_t parity;
+        uint32_t luminanceCount;
+        float deltaTime;
+    };
+
+    //后处理管线的特化常量，与PostProcess.comp一致
+    struct PostShaderVariant
+    {
+        uint32_t pass;//0降采样、1合成
+    };
+
+    static const uint32_t POST_PASS_COUNT = 2;
+
+    bool postProcessing = true;
+    VkImage bloomImage;
+    VkDeviceMemory bloomImageMemory;
+    VkImageView bloomView;//所有级，合成时采样
+    VkImageView bloomLevelViews[BLOOM_LEVELS];//每级一个，降采样时写入
+    VkImage postOutputImage;
+    VkDeviceMemory postOutputImageMemory;
+    VkImageView postOutputView;
+    VkSampler postSampler;
+    VkBuffer postStateBuffer;//测光的累加值和曝光，只在GPU上
+    VkDeviceMemory postStateBufferMemory;
+    VkDescriptorSetLayout postDescriptorSetLayout;
+    VkDescriptorSet postDescriptorSet;
+    VkPipelineLayout postPipelineLayout;
+    VkPipeline postPipelines[POST_PASS_COUNT];
+    bool postImagesInitialized = false;//第一次使用前转换布局、清零状态
+    std::chrono::steady_clock::time_point lastPostUpdate;
+    uint32_t postFrame = 0;
+
+    //性能HUD：放大pass的最后一次绘制，文字和曲线在每个帧槽一个持久映射的顶点缓冲中（见PerfHud.h）。
+    //管线和缓冲总是创建，隐藏时不生成顶点也不绘制；显示时放大pass的管线统计包括HUD的绘制
+    struct HudPushConstants
+    {
+        float pixelToClip[2];
+    };
+
+    bool hudVisible = false;
+    PerfHud hud;
+    std::vector<VkBuffer> hudVertexBuffers;
+    std::vector<VkDeviceMemory> hudVertexBuffersMemory;
+    std::vector<HudVertex*> hudVerticesMapped;
+    VkPipelineLayout hudPipelineLayout;
+    VkPipeline hudPipeline;
+    std::chrono::steady_clock::time_point lastFrameStart;
+    float lastCpuFrameMs = 0.0f;//上一帧录制和提交的时间，不包括等待栅栏
+    float lastGpuFrameMs = -1.0f;//最近读到的GPU帧时间
+    float lastHudMs = 0.0f;//上一次生成HUD顶点的时间
+
+    //命令流捕获和回放
+    std::string capturePath;
+    CaptureWriter captureWriter;
+    std::vector<uint64_t> capturedSegmentVersion;//每个桶最近一次写入日志的绘制版本
+    std::string replayPath;
+    CaptureReader replayReader;
+    std::vector<std::vector<DrawItem>> replayDrawStreams;//日志中所有绘制流按出现顺序转换成的绘制
+    size_t replayFrameIndex = 0;//下一个回放的帧
+    size_t replayStreamIndex = 0;//下一个应用的绘制流
+    const uint8_t* replayParticles = nullptr;//这一帧的粒子参数
+    std::vector<size_t> frameReplayIndex;//每个帧槽最近一次回放的帧
+    std::vector<float> replayCpuMs;//每一帧的CPU时间
+    std::vector<float> replayGpuMs;//每一帧的GPU时间，读不到时为负数
+
+    //放大pass的push constant，与UpscaleShader.frag中的布局一致
+    struct UpscalePushConstants
+    {
+        float uvScale[2];//离屏目标中有效区域占整张图的比例
+        float texelSize[2];//离屏目标一个像素的uv大小
+        float footprint[2];//输出的一个像素覆盖离屏目标的像素数，渲染比例大于1时超采样
+        float sharpness;//锐化强度
+    };
+
+    //场景管线的特化常量，成员顺序即constant_id，与VertexShader.vert和FragmentShader.frag一致
+    struct SceneShaderVariant
+    {
+        uint32_t viewCount;//multiview的视图数，为1时不读gl_ViewIndex
+        uint32_t featureBits;//SCENE_FEATURE_*
+    };
+
+    //Overdraw视图下场景的所有管线都只输出增量，片段数用相加混合累加
+    static constexpr uint32_t sceneFeatureBits(DebugView view)
+    {
+        return view == DebugView::Overdraw ? SCENE_FEATURE_OVERDRAW : SCENE_FEATURE_VERTEX_COLOR;
+    }
+
+    //放大管线的特化常量，成员顺序即constant_id，与UpscaleShader.frag一致
+    struct UpscaleShaderVariant
+    {
+        int32_t viewCount;//离屏目标的层数，多视图时按网格排列显示，为1时去掉网格计算
+        int32_t gridColumns;
+        int32_t gridRows;
+        VkBool32 sharpen;//锐化强度为0时只做双线性放大，每个像素只采样一次
+        VkBool32 overdrawHeatmap;//离屏目标中是片段数，按热力图着色
+    };
+
+    static constexpr SceneShaderVariant makeSceneShaderVariant(uint32_t viewCount, DebugView view)
+    {
+        return { viewCount, sceneFeatureBits(view) };
+    }
+
+    static constexpr UpscaleShaderVariant makeUpscaleShaderVariant(uint32_t viewCount, float sharpness, DebugView view)
+    {
+        //网格尽量接近正方形
+        int32_t columns = 1;
+        while (columns * columns < (int32_t)viewCount)
+        {
+            columns++;
+        }
+        bool heatmap = view == DebugView::Overdraw;
+        return { (int32_t)viewCount, columns, ((int32_t)viewCount + columns - 1) / columns, sharpness > 0.0f && !heatmap ? VK_TRUE : VK_FALSE, heatmap ? VK_TRUE : VK_FALSE };
+    }
 
-    std::vector<VkFramebuffer> swapChainFramebuffers;//帧缓存
+    //GPU计时：每个同时处理的帧两个时间戳（开始、结束）
+    VkQueryPool timestampQueryPool;
+    bool gpuTimingSupported = false;
+    float timestampPeriod = 1.0f;//每个时间戳单位对应的纳秒数
+    std::vector<bool> frameTimestampsWritten;//该帧槽是否已经写过时间戳
+    float smoothedGpuFrameMs = 0.0f;//平滑后的GPU帧时间
 
-    //用于同步的信号量
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
+    //管线统计：每个同时处理的帧每个pass一个查询，用来判断场景是顶点受限还是填充受限
+    struct PassStatistics
+    {
+        uint64_t vertexInvocations;
+        uint64_t clippingPrimitives;
+        uint64_t fragmentInvocations;
+    };
+    VkQueryPool statisticsQueryPool;
+    bool pipelineStatisticsSupported = false;//需要pipelineStatisticsQuery和inheritedQueries（场景pass在二级指令缓存里）
+    std::vector<bool> frameStatisticsWritten;//该帧槽是否已经写过统计
+    PassStatistics lastPassStatistics[STATISTICS_PASS_COUNT] = {};//最近读到的一帧
+    DebugView debugView = DebugView::Normal;
+
+    //基准测试
+    uint32_t benchmarkFrames = 0;//0表示正常运行
+    double benchmarkGpuMsTotal = 0.0;
+    uint32_t benchmarkGpuSamples = 0;
+    PassStatistics benchmarkStatistics[STATISTICS_PASS_COUNT] = {};//所有帧的累计
+    uint64_t benchmarkStatisticsPixels = 0;//累计的场景像素数（每个视图分别计）
+    uint32_t benchmarkStatisticsSamples = 0;
+
+    //帧导出：设备支持VK_EXT_external_memory_host时，环的每个槽导入为拷贝目标，交换链图像直接拷贝进共享内存，
+    //帧槽的栅栏触发后只发布；否则拷贝到每个帧槽的回读缓冲，栅栏触发后再memcpy到环中
+    std::string frameExportName;//为空表示不导出
+    FrameRingWriter frameRing;
+    bool exportHostMemorySupported = false;
+    VkDeviceSize exportImportAlignment = 0;//导入的主机指针和大小的对齐
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties = nullptr;
+    bool exportZeroCopy = false;
+    std::vector<VkBuffer> exportBuffers;//直接写入时每个环槽一个，否则每个帧槽一个回读缓冲
+    std::vector<VkDeviceMemory> exportBuffersMemory;
+    std::vector<void*> exportBuffersMapped;
+    std::vector<bool> exportPending;//帧槽中有还没写入环的帧
+    std::vector<uint64_t> exportFrameNumbers;
+    uint64_t frameNumber = 0;
+
+    //启动：读文件、创建着色器模块和编译管线是WorkerPool上的依赖图（见initVulkan），非必需的资源在第一帧显示之后再创建
+    std::vector<char> startupShaderCode[STARTUP_SHADER_COUNT];
+    VkShaderModule startupShaderModules[STARTUP_SHADER_COUNT] = {};
+    std::vector<char> pipelineCacheData;//管线缓存文件不存在时为空
+    bool deferredResourcesCreated = false;
+
+    //启动过程中各个阶段完成的时间，工作线程也会写入
+    std::chrono::steady_clock::time_point startupBegin;
+    std::vector<std::pair<std::string, double>> startupMilestones;
+    std::mutex startupMutex;
+
+    //每帧的临时内存，drawFrame开始时重置
+    FrameArena frameArena;
+    uint64_t framesWithHeapAllocations = 0;//稳定状态下仍有堆分配的帧数（调试版本）
+
+    //用于同步的信号量和栅栏
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    size_t currentFrame = 0;//当前使用的帧槽
 
     //用于检测交换链的结构体
     struct SwapChainSupportDetails
@@ -247,49 +1154,454 @@ private:
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
 
+        //回放不需要看到画面
+        glfwWindowHint(GLFW_VISIBLE, replayPath.empty() ? GLFW_TRUE : GLFW_FALSE);
+
         //窗口实例化
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+        //点击拾取动画角色
+        glfwSetWindowUserPointer(window, this);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+
+        //F1切换性能HUD
+        glfwSetKeyCallback(window, keyCallback);
     }
 
     //vk应用初始化
+    //依赖关系：实例 -> 设备 -> 交换链 -> pass（动态渲染时没有）和描述符布局 -> 管线；离屏目标、缓冲、描述符、指令池等只依赖设备和pass，
+    //与管线编译同时进行；指令片段引用场景管线，最后创建。帧导出和任务服务在第一帧显示之后创建（createDeferredResources）
     void initVulkan()
     {
+        //帧内存，初始化阶段的辅助函数也借用它存放临时列表
+        frameArena.init(FRAME_ARENA_SIZE);
+
+        //Overdraw视图只统计场景几何的片段，不画地面和阴影
+        shadowsEnabled = shadowsEnabled && debugView == DebugView::Normal;
+
+        //启动的依赖图：文件 -> 着色器模块（还依赖设备） -> 管线（还依赖管线缓存和布局）；缓存文件和设备 -> 管线缓存。
+        //设备和布局在主线程上创建，作为外部事件；文件读取不依赖设备，从一开始就在工作线程上进行
+        TaskGraph startup(WorkerPool::shared());
+        TaskGraph::Node deviceReady = startup.addEvent();
+        TaskGraph::Node layoutsReady = startup.addEvent();//交换链、pass、描述符布局和动画数据，管线的视口、布局和特化常量来自它们
+
+        TaskGraph::Node cacheFileRead = startup.add([this]()
+        {
+            readPipelineCacheFile();
+        });
+        TaskGraph::Node cacheReady = startup.add([this]()
+        {
+            createPipelineCache();//管线缓存
+        }, { deviceReady, cacheFileRead });
+
+        TaskGraph::Node shaderModules[STARTUP_SHADER_COUNT];
+        for (uint32_t i = 0; i < STARTUP_SHADER_COUNT; i++)
+        {
+            TaskGraph::Node fileRead = startup.add([this, i]()
+            {
+                startupShaderCode[i] = readFile(STARTUP_SHADER_FILES[i]);
+            });
+            shaderModules[i] = startup.add([this, i]()
+            {
+                startupShaderModules[i] = createShaderModule(startupShaderCode[i]);
+                startupShaderCode[i].clear();
+                startupShaderCode[i].shrink_to_fit();
+            }, { deviceReady, fileRead });
+        }
+
+        //管线分组编译（同一个设备上的创建函数和管线缓存都可以多线程使用）
+        startup.add([this]()
+        {
+            createGraphicsPipline();//创建管线
+            if (particleCapacity > 0)
+            {
+                createParticlePipeline();//粒子的绘制管线使用场景管线的布局
+            }
+            if (shadowsEnabled)
+            {
+                createShadowPipelines();//深度管线和地面管线也使用场景管线的布局
+            }
+            markStartup("scene pipeline compiled");
+        }, { layoutsReady, cacheReady, shaderModules[SHADER_SCENE_VERT], shaderModules[SHADER_SCENE_FRAG], shaderModules[SHADER_PARTICLE_VERT], shaderModules[SHADER_PARTICLE_FRAG],
+             shaderModules[SHADER_SHADOW_VERT], shaderModules[SHADER_GROUND_VERT], shaderModules[SHADER_GROUND_FRAG] });
+        startup.add([this]()
+        {
+            createUpscalePipeline();//创建放大锐化管线
+            createHudPipeline();//性能HUD画在放大的结果上
+            markStartup("upscale pipeline compiled");
+        }, { layoutsReady, cacheReady, shaderModules[SHADER_UPSCALE_VERT], shaderModules[SHADER_UPSCALE_FRAG], shaderModules[SHADER_HUD_VERT], shaderModules[SHADER_HUD_FRAG] });
+        startup.add([this]()
+        {
+            if (characterCount > 0 && gpuSkinning)
+            {
+                createSkinningPipeline();//创建蒙皮计算管线
+                markStartup("skinning pipeline compiled");
+            }
+        }, { layoutsReady, cacheReady, shaderModules[SHADER_SKINNING_COMP] });
+        startup.add([this]()
+        {
+            if (particleCapacity > 0)
+            {
+                createParticleComputePipelines();//创建粒子模拟的计算管线
+                markStartup("particle pipelines compiled");
+            }
+        }, { layoutsReady, cacheReady, shaderModules[SHADER_PARTICLE_COMP] });
+        startup.add([this]()
+        {
+            if (postProcessing)
+            {
+                createPostPipelines();//创建后处理的计算管线
+                markStartup("post pipelines compiled");
+            }
+        }, { layoutsReady, cacheReady, shaderModules[SHADER_POST_COMP] });
+        startup.start();
+
         //创建实例
         createInstance();//应用实例
         setupDebugMessenger();//校验实例
         creatSurface();//创建显示对象
+        markStartup("instance");
         pickPhysicalDevice();//物理对象
         createLogicalDevice();//物理对象对应的逻辑设备实例
+        markStartup("device");
+        startup.complete(deviceReady);
+
+        //后处理在图形队列上用计算着色器完成；Overdraw视图直接显示片段数，不做后处理
+        postProcessing = postProcessing && computeSupported && debugView == DebugView::Normal;
         createSwapChain();//创建交换链
         createImageViews();//创建显示图片画面的对象
-        createRenderPass();//创建一个pass
-        createGraphicsPipline();//创建管线
-        createFramebuffers();//创建缓冲帧
+        markStartup("swapchain");
+        if (!dynamicRendering)
+        {
+            createRenderPass();//创建场景pass
+            createUpscaleRenderPass();//创建放大到交换链的pass
+            createShadowRenderPass();//阴影深度图的pass
+        }
+        createDescriptorSetLayout();//放大pass的描述符布局
+        initAnimation();//动画角色的骨骼、片段和网格
+        startup.complete(layoutsReady);
+
+        createSceneColorResources();//创建离屏场景目标
+        if (!dynamicRendering)
+        {
+            createFramebuffers();//创建缓冲帧
+        }
+        createUpscaleSampler();//放大时使用的采样器
+        createCameraBuffer();//每个视图的相机矩阵
+        createShadowResources();//阴影深度图、比较采样器和光源矩阵
+        createDescriptorPool();//描述符池
+        createPostResources();//泛光、后处理的输出和描述符集
+        createDescriptorSets();//把离屏目标（或后处理的输出）绑定给放大pass
         createCommandPool();//创建指令池
+        createVertexBuffer();//顶点缓冲
+        createSkinningResources();//蒙皮的输入输出缓冲和描述符集
+        createParticleResources();//粒子缓冲、计数缓冲和描述符集
+        createHudResources();//性能HUD的顶点缓冲
+        createQueryPool();//GPU计时用的查询池
         createCommandBuffers();//创建指令缓存
-        createSemaphores();//配置信号量
+        createSyncObjects();//配置信号量和栅栏
+        markStartup("resources");
+
+        //读取、编译失败时异常在这里重新抛出
+        startup.wait();
+        destroyStartupShaderModules();
+        markStartup("pipelines ready");
+        createSceneSegments();//按静态桶创建可缓存的指令片段
+
+        if (!replayPath.empty())
+        {
+            startReplay();//用日志中的资源内容代替启动时生成的
+        }
+        if (!capturePath.empty())
+        {
+            startCapture();//写入文件头和启动时的资源
+        }
     }
 
-    //主循环（每一帧）
-    void mainLoop()
+    //管线缓存文件不存在时数据为空
+    void readPipelineCacheFile()
     {
-        while (!glfwWindowShouldClose(window))
+        std::ifstream file(PIPELINE_CACHE_FILE, std::ios::binary);
+        if (file.is_open())
         {
-            glfwPollEvents();
-            drawFrame();
+            pipelineCacheData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
         }
-        vkDeviceWaitIdle(device);
     }
 
-    //绘制每一帧
-    void drawFrame()
+    //所有管线都创建之后，启动时的着色器模块不再需要
+    void destroyStartupShaderModules()
     {
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-        VkSubmitInfo submitInfo = {};
+        for (VkShaderModule& module : startupShaderModules)
+        {
+            if (module != VK_NULL_HANDLE)
+            {
+                vkDestroyShaderModule(device, module, nullptr);
+                module = VK_NULL_HANDLE;
+            }
+        }
+    }
+
+    //第一帧显示之后才创建的资源：帧导出（从第二帧开始导出）和渲染任务服务
+    void createDeferredResources()
+    {
+        createExportResources();//帧导出
+        createRenderContexts();//渲染任务服务
+        deferredResourcesCreated = true;
+    }
+
+    //记录一个启动阶段完成的时间
+    void markStartup(const std::string& milestone)
+    {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+        std::lock_guard<std::mutex> lock(startupMutex);
+        startupMilestones.push_back({ milestone, ms });
+    }
+
+    //按时间顺序输出启动的各个阶段
+    void printStartupTrace()
+    {
+        std::lock_guard<std::mutex> lock(startupMutex);
+        std::stable_sort(startupMilestones.begin(), startupMilestones.end(), [](const auto& a, const auto& b)
+        {
+            return a.second < b.second;
+        });
+
+        std::cout << "startup trace:" << std::endl;
+        double previous = 0.0;
+        for (const auto& milestone : startupMilestones)
+        {
+            std::cout << "  " << milestone.first << ": " << milestone.second << " ms (+" << milestone.second - previous << ")" << std::endl;
+            previous = milestone.second;
+        }
+    }
+
+    //主循环（每一帧）
+    void mainLoop()
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        auto lastMemoryReport = startTime;
+        uint32_t frameCount = 0;
+        while (!glfwWindowShouldClose(window))
+        {
+            glfwPollEvents();
+
+            //帧循环本身不应该分配堆内存。任务服务按请求创建任务，不计入
+            uint64_t allocationsBefore = AllocationCounter::getThreadCount();
+            drawFrame();
+
+            //接近预算时逐出最久未使用的资源
+            residency.update(frameNumber);
+            checkFrameAllocations(AllocationCounter::getThreadCount() - allocationsBefore);
+
+            if (!deferredResourcesCreated)
+            {
+                markStartup("first frame presented");
+                createDeferredResources();
+                markStartup("deferred resources");
+                printStartupTrace();
+            }
+
+            if (jobServer.isRunning())
+            {
+                serviceRenderJobs();
+            }
+            if (memoryReportSeconds > 0.0f && std::chrono::steady_clock::now() - lastMemoryReport >= std::chrono::duration<float>(memoryReportSeconds))
+            {
+                residency.printReport(std::cout);
+                lastMemoryReport = std::chrono::steady_clock::now();
+            }
+            frameCount++;
+            if (benchmarkFrames > 0 && frameCount >= benchmarkFrames)
+            {
+                break;
+            }
+        }
+        vkDeviceWaitIdle(device);
+
+        if (benchmarkFrames > 0)
+        {
+            double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            printBenchmarkResult(frameCount, totalMs);
+        }
+        if (!replayPath.empty())
+        {
+            printReplayResult();
+        }
+        if (captureWriter.isOpen())
+        {
+            std::cout << "capture: " << captureWriter.getFrameCount() << " frames, " << captureWriter.getBytesWritten() << " bytes written to " << capturePath << std::endl;
+            captureWriter.close();
+        }
+
+        //已经提交的渲染任务也都执行完了，回复结果
+        for (auto& context : renderContexts)
+        {
+            if (context.busy)
+            {
+                finishRenderJob(context);
+            }
+        }
+
+        //最后几帧已经执行完，从最早的帧槽开始依次写入环
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            publishExportedFrame((currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+        }
+        if (frameRing.isOpen())
+        {
+            FrameRingStats stats = frameRing.getStats();
+            std::cout << "frame export" << (exportZeroCopy ? " (zero copy)" : " (readback buffers)") << ": " << stats.publishedFrames << " published, " << stats.droppedFrames << " dropped, max occupancy " << stats.maxOccupancy << "/" << FRAME_EXPORT_SLOTS << ", consumer lag " << stats.consumerLag << std::endl;
+        }
+    }
+
+    //稳定状态下的帧有堆分配时报告，只报告第一次和之后每1000次
+    void checkFrameAllocations(uint64_t allocations)
+    {
+        if (allocations == 0 || frameNumber <= ALLOCATION_CHECK_WARMUP_FRAMES)
+        {
+            return;
+        }
+        if (framesWithHeapAllocations++ % 1000 == 0)
+        {
+            std::cerr << "frame " << frameNumber << ": " << allocations << " heap allocations in the frame loop (" << framesWithHeapAllocations << " frames so far)" << std::endl;
+        }
+    }
+
+    //输出基准测试结果
+    void printBenchmarkResult(uint32_t frameCount, double totalMs)
+    {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+        std::cout << "vulkan benchmark: " << deviceProperties.deviceName << ", " << renderExtent.width << "x" << renderExtent.height << ", " << frameCount << " frames" << std::endl;
+        //软件光栅化后端只画基础场景的顶点列表，其他功能打开时两个后端的结果不可比
+        std::cout << "  features: " << viewCount << " views, " << characterCount << " characters, " << particleCapacity << " particles, shadows " << (shadowsEnabled ? "on" : "off") << ", post " << (postProcessing ? "on" : "off") << ", hud " << (hudVisible ? "on" : "off") << std::endl;
+        bool baseSceneOnly = viewCount == 1 && characterCount == 0 && particleCapacity == 0 && !shadowsEnabled && !postProcessing && !hudVisible;
+        if (!baseSceneOnly)
+        {
+            std::cout << "  not comparable with --soft-bench (base scene only), run with --views 1 --characters 0 --particles 0 --shadows off --post off --hud off" << std::endl;
+        }
+        std::cout << "  cpu frame time: " << totalMs / std::max(1u, frameCount) << " ms" << std::endl;
+        if (benchmarkGpuSamples > 0)
+        {
+            std::cout << "  gpu frame time: " << benchmarkGpuMsTotal / benchmarkGpuSamples << " ms" << std::endl;
+        }
+        if (benchmarkStatisticsSamples > 0)
+        {
+            const char* passNames[STATISTICS_PASS_COUNT] = { "scene pass", "upscale pass" };
+            for (uint32_t pass = 0; pass < STATISTICS_PASS_COUNT; pass++)
+            {
+                const PassStatistics& statistics = benchmarkStatistics[pass];
+                std::cout << "  " << passNames[pass] << ": " << statistics.vertexInvocations / benchmarkStatisticsSamples << " vertex invocations, " << statistics.clippingPrimitives / benchmarkStatisticsSamples << " clipping primitives, " << statistics.fragmentInvocations / benchmarkStatisticsSamples << " fragment invocations per frame" << std::endl;
+            }
+            //每个像素平均的片段数接近1说明几乎没有重复着色，远大于1时是填充受限
+            std::cout << "  scene overdraw: " << (double)benchmarkStatistics[STATISTICS_SCENE_PASS].fragmentInvocations / (double)std::max<uint64_t>(1, benchmarkStatisticsPixels) << " fragments per pixel" << std::endl;
+        }
+        uint32_t drawCount = 0;
+        uint32_t stateChanges = 0;
+        for (const auto& segment : sceneSegments)
+        {
+            drawCount += (uint32_t)segment.draws.size();
+            stateChanges += segment.stateChanges;
+        }
+        std::cout << "  scene draws: " << drawCount << ", state changes: " << stateChanges << std::endl;
+        if (characterCount > 0)
+        {
+            std::cout << "  animation: " << characterCount << " characters, " << (gpuSkinning ? "gpu" : "cpu") << " skinning, pose update " << animation.getLastUpdateMs() << " ms on " << animation.getThreadCount() << " threads" << std::endl;
+            if (characterCulling)
+            {
+                std::cout << "  culling: " << visibleCharacterCount << " / " << characterCount << " characters visible in " << characterDraws.size() << " draws, bvh refit and cull " << lastCullMs << " ms" << std::endl;
+            }
+        }
+        if (particleCapacity > 0)
+        {
+            std::cout << "  particles: capacity " << particleCapacity << std::endl;
+        }
+        if (shadowsEnabled)
+        {
+            std::cout << "  shadows: " << SHADOW_CASCADES << " cascades of " << SHADOW_MAP_SIZE << "x" << SHADOW_MAP_SIZE << ", static layers redrawn " << staticShadowRedraws << " times in " << frameCount << " frames, " << dynamicShadowDraws << " dynamic shadow draws per frame" << std::endl;
+        }
+        if (hudVisible)
+        {
+            std::cout << "  hud: " << lastHudMs << " ms cpu to build the last frame" << std::endl;
+        }
+        std::cout << "  render path: " << (dynamicRendering ? "dynamic rendering + synchronization2" : "render passes") << std::endl;
+        if (postProcessing)
+        {
+            std::cout << "  post processing: " << BLOOM_LEVELS << " bloom levels, 2 dispatches per frame" << std::endl;
+        }
+        std::cout << "  frame arena: " << frameArena.getHighWater() << " / " << frameArena.getCapacity() << " bytes peak, " << frameArena.getOverflowCount() << " overflows" << std::endl;
+        if (AllocationCounter::isEnabled())
+        {
+            std::cout << "  frames with heap allocations: " << framesWithHeapAllocations << std::endl;
+        }
+    }
+
+    //绘制每一帧
+    void drawFrame()
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+
+        //等待这个帧槽上一次提交的指令执行完，之后才能重新录制它的指令缓存
+        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+        auto cpuStart = std::chrono::steady_clock::now();
+
+        //上一帧的临时数据已经不再需要（录制好的指令不引用它们）
+        frameArena.reset();
+
+        //光源旋转时每帧更新光源矩阵，静态阴影的缓存随之失效；在动画之前更新，阴影的投影物按这一帧的光源剔除
+        if (shadowsEnabled && lightRotationSpeed != 0.0f)
+        {
+            float seconds = std::chrono::duration<float>(frameStart - startupBegin).count();
+            updateShadowLight(SHADOW_LIGHT_AZIMUTH + lightRotationSpeed * seconds * 3.14159265f / 180.0f);
+        }
+
+        //这个帧槽的蒙皮矩阵和上传缓冲已经不再被GPU使用，回放时由日志中的上传代替
+        if (replayPath.empty())
+        {
+            updateAnimation(currentFrame);
+        }
+
+        //上一次使用这个帧槽的管线统计已经可以读取，要在调整分辨率之前读，像素数才对应
+        readPipelineStatistics();
+
+        //上一次使用这个帧槽的GPU时间已经可以读取，用它调整这一帧的渲染分辨率
+        updateRenderScale();
+
+        //帧间隔包括等待栅栏和垂直同步，与GPU时间一起记入HUD的曲线，HUD隐藏时也记录
+        if (frameNumber > 0)
+        {
+            hud.addFrame(std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count(), lastGpuFrameMs);
+        }
+        lastFrameStart = frameStart;
+
+        //回放：这一帧的渲染区域、上传、绘制流和粒子参数都来自日志
+        size_t replayIndex = replayFrameIndex;
+        if (!replayPath.empty())
+        {
+            applyReplayFrame(currentFrame);
+        }
+
+        //捕获：记录这一帧交给GPU的输入，粒子参数在录制时写入
+        if (captureWriter.isOpen())
+        {
+            captureFrame(currentFrame);
+        }
+
+        //这个帧槽上一次渲染的帧已经拷贝到回读缓冲
+        publishExportedFrame(currentFrame);
+
+        uint32_t imageIndex;
+        vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+
+        VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
         VkPipelineStageFlags waitStates[] =
         {
             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
@@ -298,13 +1610,13 @@ private:
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStates;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
@@ -322,32 +1634,129 @@ private:
 
         vkQueuePresentKHR(presentQueue, &presentInfo);
 
+        if (captureWriter.isOpen())
+        {
+            captureWriter.endFrame();
+        }
+        if (!replayPath.empty())
+        {
+            replayCpuMs[replayIndex] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        }
+
+        lastCpuFrameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameNumber++;
     }
 
     //结束时的销毁
     void cleanup()
     {
-        //销毁信号量
-        vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-        vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+        //销毁信号量和栅栏
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            vkDestroyFence(device, inFlightFences[i], nullptr);
+        }
+
+        //销毁查询池
+        if (gpuTimingSupported)
+        {
+            vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+        }
+        if (pipelineStatisticsSupported)
+        {
+            vkDestroyQueryPool(device, statisticsQueryPool, nullptr);
+        }
+
+        //销毁渲染任务的上下文，关闭服务
+        for (auto& context : renderContexts)
+        {
+            vkDestroyFence(device, context.fence, nullptr);
+            destroyRenderContextTargets(context);
+            residency.removeGroup(context.residencyGroup);
+        }
+        renderContexts.clear();
+        jobServer.stop();
+
+        //销毁帧导出的缓冲和共享内存，导入的内存要在共享内存取消映射之前释放
+        destroyExportBuffers();
+        frameRing.destroy();
+
+        //销毁顶点缓冲
+        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        residency.free(vertexBufferMemory);
+
+        //销毁蒙皮的缓冲和管线
+        destroySkinningResources();
+
+        //销毁粒子的缓冲和管线
+        destroyParticleResources();
+
+        //销毁阴影的深度图、缓冲、管线和pass
+        destroyShadowResources();
+
+        //销毁后处理的图像、缓冲和管线
+        destroyPostResources();
+
+        //销毁性能HUD的顶点缓冲和管线
+        destroyHudResources();
 
         //销毁指令池
         vkDestroyCommandPool(device, commandPool, nullptr);
 
         //销毁帧缓存
-        for (auto framebuffer : swapChainFramebuffers)
+        if (!dynamicRendering)
         {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+            for (auto framebuffer : swapChainFramebuffers)
+            {
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+            vkDestroyFramebuffer(device, sceneFramebuffer, nullptr);
         }
 
-        //销毁图形管线
+        //销毁离屏场景目标
+        vkDestroyImageView(device, sceneColorImageView, nullptr);
+        vkDestroyImage(device, sceneColorImage, nullptr);
+        residency.free(sceneColorImageMemory);
+
+        //销毁相机缓冲
+        vkDestroyBuffer(device, cameraBuffer, nullptr);
+        residency.free(cameraBufferMemory);
+
+        //销毁描述符和采样器
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroySampler(device, upscaleSampler, nullptr);
+
+        //销毁图形管线，管线缓存写回文件，下次启动时复用
+        vkDestroyPipeline(device, upscalePipeline, nullptr);
+        if (jobPipeline != graphicsPipeline)
+        {
+            vkDestroyPipeline(device, jobPipeline, nullptr);
+        }
         vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
         //销毁传递层
+        vkDestroyPipelineLayout(device, upscalePipelineLayout, nullptr);
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, upscaleDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, sceneDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, skinningDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, particleDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, postDescriptorSetLayout, nullptr);
 
         //销毁pass
-        vkDestroyRenderPass(device, renderPass, nullptr);
+        if (!dynamicRendering)
+        {
+            vkDestroyRenderPass(device, upscaleRenderPass, nullptr);
+            if (jobRenderPass != renderPass)
+            {
+                vkDestroyRenderPass(device, jobRenderPass, nullptr);
+            }
+            vkDestroyRenderPass(device, renderPass, nullptr);
+        }
 
         //销毁窗口显示的图像
         for (auto imageView : swapChainImageViews)
@@ -401,7 +1810,7 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);//构造api的版本号
         appInfo.pEngineName = "No Engine";//使用引擎名
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);//没有对应的引擎名就用api版本号
-        appInfo.apiVersion = VK_API_VERSION_1_0;//api的版本号
+        appInfo.apiVersion = VK_API_VERSION_1_1;//api的版本号，multiview从1.1开始是核心功能
 
         //创建的vk实例配置信息的结构体
         VkInstanceCreateInfo createInfo{};
@@ -516,13 +1925,100 @@ private:
         //物理设备的特性
         VkPhysicalDeviceFeatures deviceFeatures = {};
 
+        //顶点着色器读取gl_ViewIndex，即使只有一个相机也要打开multiview
+        VkPhysicalDeviceMultiviewFeatures supportedMultiview = {};
+        supportedMultiview.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures = {};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &supportedMultiview;
+
+        //动态渲染的扩展都存在时才查询它们的特性
+        bool dynamicRenderingExtensionsSupported = preferDynamicRendering;
+        for (const char* extension : dynamicRenderingExtensions)
+        {
+            dynamicRenderingExtensionsSupported = dynamicRenderingExtensionsSupported && checkOptionalDeviceExtension(physicalDevice, extension);
+        }
+        VkPhysicalDeviceSynchronization2FeaturesKHR supportedSynchronization2 = {};
+        supportedSynchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR supportedDynamicRendering = {};
+        supportedDynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        supportedDynamicRendering.pNext = &supportedSynchronization2;
+        if (dynamicRenderingExtensionsSupported)
+        {
+            supportedMultiview.pNext = &supportedDynamicRendering;
+        }
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+        //导出帧时才需要导入主机内存，同样只在扩展存在时查询它的属性
+        exportHostMemorySupported = !frameExportName.empty() && checkOptionalDeviceExtension(physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties = {};
+        externalMemoryHostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+        VkPhysicalDeviceMultiviewProperties multiviewProperties = {};
+        multiviewProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+        if (exportHostMemorySupported)
+        {
+            multiviewProperties.pNext = &externalMemoryHostProperties;
+        }
+        VkPhysicalDeviceProperties2 deviceProperties = {};
+        deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        deviceProperties.pNext = &multiviewProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperties);
+        exportImportAlignment = externalMemoryHostProperties.minImportedHostPointerAlignment;
+
+        if (!supportedMultiview.multiview || viewCount > multiviewProperties.maxMultiviewViewCount)
+        {
+            throw std::runtime_error("failed to find multiview support for the requested camera count!");
+        }
+
+        VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+        multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+        multiviewFeatures.multiview = VK_TRUE;
+
+        //可选特性：管线统计，场景pass的绘制在二级指令缓存里，还需要二级指令缓存继承查询
+        pipelineStatisticsSupported = supportedFeatures.features.pipelineStatisticsQuery && supportedFeatures.features.inheritedQueries;
+        if (pipelineStatisticsSupported)
+        {
+            deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+            deviceFeatures.inheritedQueries = VK_TRUE;
+        }
+
+        //可选扩展：显存预算，没有时驻留管理按堆大小估计预算
+        std::vector<const char*> enabledExtensions(deviceExtenstions.begin(), deviceExtenstions.end());
+        bool memoryBudgetSupported = checkOptionalDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetSupported)
+        {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        //可选扩展：导入主机内存，帧导出时GPU直接写入共享内存环，不支持时经过回读缓冲
+        if (exportHostMemorySupported)
+        {
+            enabledExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        }
+
+        //可选扩展：动态渲染和synchronization2，不支持时使用pass和帧缓存
+        dynamicRendering = dynamicRenderingExtensionsSupported && supportedDynamicRendering.dynamicRendering && supportedSynchronization2.synchronization2;
+        VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = {};
+        synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+        synchronization2Features.synchronization2 = VK_TRUE;
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        dynamicRenderingFeatures.pNext = &synchronization2Features;
+        if (dynamicRendering)
+        {
+            enabledExtensions.insert(enabledExtensions.end(), dynamicRenderingExtensions.begin(), dynamicRenderingExtensions.end());
+            multiviewFeatures.pNext = &dynamicRenderingFeatures;
+        }
+
         VkDeviceCreateInfo deviceCreateInfo = {};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceCreateInfo.pNext = &multiviewFeatures;
         deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtenstions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = deviceExtenstions.data();
+        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
         //与vk实例共用校验层
         if (enableValidationLayers)
@@ -541,10 +2037,42 @@ private:
             throw std::runtime_error("failed to create logical device!");
         }
 
+        //蒙皮和粒子在图形队列上用计算着色器完成，队列不支持计算时蒙皮退回CPU，粒子关闭
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        computeSupported = (queueFamilies[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+        gpuSkinning = !forceCpuSkinning && computeSupported;
+        if (!computeSupported && particleCapacity > 0)
+        {
+            std::cerr << "graphics queue has no compute support, particles disabled" << std::endl;
+            particleCapacity = 0;
+        }
+
+        //扩展的指令不在加载器导出的符号中，从设备获取
+        if (dynamicRendering)
+        {
+            cmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+            cmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+            cmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR");
+            if (cmdBeginRendering == nullptr || cmdEndRendering == nullptr || cmdPipelineBarrier2 == nullptr)
+            {
+                throw std::runtime_error("failed to load dynamic rendering functions!");
+            }
+        }
+        if (exportHostMemorySupported)
+        {
+            getMemoryHostPointerProperties = (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+            exportHostMemorySupported = getMemoryHostPointerProperties != nullptr;
+        }
+
         //获取随之创建的队列
         vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
 
+        //之后所有的显存分配都经过驻留管理
+        residency.init(physicalDevice, device, memoryBudgetSupported);
     }
 
         //创建交换链
@@ -570,6 +2098,16 @@ private:
         createInfo.imageArrayLayers = 1;
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+        //导出帧时需要从交换链图像拷贝
+        if (!frameExportName.empty())
+        {
+            if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+            {
+                throw std::runtime_error("swap chain does not support frame export!");
+            }
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
         uint32_t queueFamilyIndices[] = { (uint32_t)indices.graphicsFamily, (uint32_t)indices.presentFamily };
 
@@ -605,45 +2143,70 @@ private:
     //--------------功能函数-----------------
 
         //找到本机中满足要求的物理设备
+    //优先使用集成显卡，没有时再使用其他满足要求的设备（包括lavapipe这类CPU实现，便于和软件光栅化后端对比）
     VkPhysicalDevice isDeviceSuitable(std::vector<VkPhysicalDevice> devices)
     {
+        VkPhysicalDevice fallbackDevice = VK_NULL_HANDLE;
         VkPhysicalDeviceProperties deviceProperties;
         for (const auto& device : devices)
         {
             vkGetPhysicalDeviceProperties(device, &deviceProperties);
 
+            QueueFamilyIndices indices = findQueueFamilies(device);
+            bool extenstionSupport = checkDeviceExtenstionSupport(device);
+            bool swapChainAdequate = false;
+            if (extenstionSupport)
+            {
+                SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+                swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+            }
+            //相机视图用到multiview，需要1.1
+            if (!indices.isComplete() || !extenstionSupport || !swapChainAdequate || deviceProperties.apiVersion < VK_API_VERSION_1_1)
+            {
+                continue;
+            }
+
             if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU)
             {
-                QueueFamilyIndices indices = findQueueFamilies(device);
-                bool extenstionSupport = checkDeviceExtenstionSupport(device);
-                bool swapChainAdequate = false;
-                if (extenstionSupport)
-                {
-                    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-                    swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-                }
-                if (indices.isComplete() && extenstionSupport && swapChainAdequate)
-                {
-                    return device;
-                }
+                return device;
+            }
+            if (fallbackDevice == VK_NULL_HANDLE)
+            {
+                fallbackDevice = device;
             }
         }
-        return VK_NULL_HANDLE;
+        return fallbackDevice;
     }
 
         //检查物理设备是否支持显示
     bool checkDeviceExtenstionSupport(VkPhysicalDevice device)
     {
-        uint32_t extenstionsCount;
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extenstionsCount, nullptr);
-        std::vector<VkExtensionProperties> availableExtenstions(extenstionsCount);
-        vkEnumerateDeviceExtensionProperties(device, nullptr, &extenstionsCount, availableExtenstions.data());
-        std::set<std::string> requiredExtenstions(deviceExtenstions.begin(), deviceExtenstions.end());
-        for (const auto& extenstion : availableExtenstions)
+        for (const char* extenstion : deviceExtenstions)
+        {
+            if (!checkOptionalDeviceExtension(device, extenstion))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //检查物理设备是否支持某个可选扩展
+    bool checkOptionalDeviceExtension(VkPhysicalDevice device, const char* extensionName)
+    {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        ArenaScope scope(frameArena);
+        FrameVector<VkExtensionProperties> availableExtensions(extensionCount, ArenaAllocator<VkExtensionProperties>(frameArena));
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions)
         {
-            requiredExtenstions.erase(extenstion.extensionName);
+            if (strcmp(extension.extensionName, extensionName) == 0)
+            {
+                return true;
+            }
         }
-        return requiredExtenstions.empty();
+        return false;
     }
 
     //--------------功能函数-----------------
@@ -651,11 +2214,12 @@ private:
     //创建渲染管线
     void createGraphicsPipline()
     {
-        auto vertShaderCode = readFile("shaders/vert.spv");
-        auto fragShaderCode = readFile("shaders/frag.spv");
+        //模块由启动的依赖图创建，管线都创建之后统一销毁
+        vertShaderModule = startupShaderModules[SHADER_SCENE_VERT];
+        fragShaderModule = startupShaderModules[SHADER_SCENE_FRAG];
 
-        vertShaderModule = createShaderModule(vertShaderCode);
-        fragShaderModule = createShaderModule(fragShaderCode);
+        //两个阶段共用同一份特化常量
+        SpecializationConstants<SceneShaderVariant> specialization(makeSceneShaderVariant(viewCount, debugView));
 
         VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo = {};
@@ -663,23 +2227,27 @@ private:
         vertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
         vertShaderStageCreateInfo.module = vertShaderModule;
         vertShaderStageCreateInfo.pName = "main";
+        vertShaderStageCreateInfo.pSpecializationInfo = specialization.get();
 
         VkPipelineShaderStageCreateInfo fragShaderStageCreateInfo = {};
         fragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageCreateInfo.module = fragShaderModule;
         fragShaderStageCreateInfo.pName = "main";
+        fragShaderStageCreateInfo.pSpecializationInfo = specialization.get();
 
         VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageCreateInfo , fragShaderStageCreateInfo };
 
         //顶点的输入
         VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr;
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
 
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
         //图元的类型
         VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -687,27 +2255,13 @@ private:
         inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
         inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-        //视口设置
-        VkViewport viewPort = {};
-        viewPort.x = 0.0f;
-        viewPort.y = 0.0f;
-        viewPort.width = (float)swapChainExtent.width;
-        viewPort.height = (float)swapChainExtent.height;
-        viewPort.minDepth = 0.0f;
-        viewPort.maxDepth = 1.0f;
-
-        //视口裁剪范围设置
-        VkRect2D scissor = {};
-        scissor.offset = { 0,0 };
-        scissor.extent = swapChainExtent;
-
-        //结合视口和裁剪范围
+        //视口和裁剪范围是动态状态，录制指令时按当前的渲染分辨率设置
         VkPipelineViewportStateCreateInfo viewportState = {};
         viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewPort;
+        viewportState.pViewports = nullptr;
         viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
+        viewportState.pScissors = nullptr;
 
         //光栅化
         VkPipelineRasterizationStateCreateInfo rasterize = {};
@@ -733,15 +2287,16 @@ private:
         multisampling.alphaToCoverageEnable = VK_FALSE;
         multisampling.alphaToOneEnable = VK_FALSE;
 
-        //颜色混合
+        //颜色混合，Overdraw视图下是相加混合，片段着色器输出的增量累加成片段数
+        bool overdraw = debugView == DebugView::Overdraw;
         VkPipelineColorBlendAttachmentState colorBlendAttachmen = {};
         colorBlendAttachmen.colorWriteMask = VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_R_BIT;
-        colorBlendAttachmen.blendEnable = VK_FALSE;
+        colorBlendAttachmen.blendEnable = overdraw ? VK_TRUE : VK_FALSE;
         colorBlendAttachmen.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-        colorBlendAttachmen.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachmen.dstColorBlendFactor = overdraw ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ZERO;
         colorBlendAttachmen.colorBlendOp = VK_BLEND_OP_ADD;
-        colorBlendAttachmen.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-        colorBlendAttachmen.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachmen.srcAlphaBlendFactor = overdraw ? VK_BLEND_FACTOR_ZERO : VK_BLEND_FACTOR_ONE;
+        colorBlendAttachmen.dstAlphaBlendFactor = overdraw ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ZERO;
         colorBlendAttachmen.alphaBlendOp = VK_BLEND_OP_ADD;
 
         VkPipelineColorBlendStateCreateInfo colorBlend = {};
@@ -758,19 +2313,25 @@ private:
         VkDynamicState dynamicStates[] =
         {
             VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_LINE_WIDTH,
+            VK_DYNAMIC_STATE_SCISSOR,
         };
         VkPipelineDynamicStateCreateInfo  dynamicState = {};
         dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         dynamicState.dynamicStateCount = 2;
         dynamicState.pDynamicStates = dynamicStates;
 
+        //阴影的深度管线用push constant选择级联和投影物的高度
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(ShadowPushConstants);
+
         VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0;
-        pipelineLayoutInfo.pSetLayouts = nullptr;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &sceneDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
         if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
         {
@@ -789,23 +2350,33 @@ private:
         pipelineInfo.pMultisampleState = &multisampling;
         pipelineInfo.pDepthStencilState = nullptr;
         pipelineInfo.pColorBlendState = &colorBlend;
-        pipelineInfo.pDynamicState = nullptr;
+        pipelineInfo.pDynamicState = &dynamicState;
 
         pipelineInfo.layout = pipelineLayout;
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        VkPipelineRenderingCreateInfoKHR renderingInfo;
+        setPipelineTarget(pipelineInfo, renderingInfo, renderPass, &SCENE_COLOR_FORMAT, VK_FORMAT_UNDEFINED, sceneViewMask());
 
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
         {
             throw std::runtime_error("filed to create graphics pipeline!");
         }
 
-
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+        //渲染任务只读回一个视图，多视图时为任务另建单视图的管线，不渲染用不到的视图
+        jobPipeline = graphicsPipeline;
+        if (!jobServerPath.empty() && viewCount > 1)
+        {
+            SpecializationConstants<SceneShaderVariant> jobSpecialization(makeSceneShaderVariant(1, debugView));
+            shaderStages[0].pSpecializationInfo = jobSpecialization.get();
+            shaderStages[1].pSpecializationInfo = jobSpecialization.get();
+            setPipelineTarget(pipelineInfo, renderingInfo, jobRenderPass, &SCENE_COLOR_FORMAT, VK_FORMAT_UNDEFINED, 0);
+            if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &jobPipeline) != VK_SUCCESS)
+            {
+                throw std::runtime_error("filed to create graphics pipeline!");
+            }
+        }
     }
 
     //创建视图存储数组
@@ -814,28 +2385,7 @@ private:
         swapChainImageViews.resize(swapChainImages.size());
         for (size_t i = 0; i < swapChainImages.size(); i++)
         {
-            VkImageViewCreateInfo createInfo = {};
-            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            createInfo.image = swapChainImages[i];
-            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-            createInfo.format = swapChainImageFormat;
-
-            createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-            createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-
-            createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
-
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
-            {
-                throw std::runtime_error("failed to create image view!");
-            }
-
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
         }
     }
 
@@ -847,7 +2397,8 @@ private:
         uint32_t queueFamilyCount = 0;
 
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        ArenaScope scope(frameArena);
+        FrameVector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount, ArenaAllocator<VkQueueFamilyProperties>(frameArena));
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
         int i = 0;
         for (const auto& queueFamily : queueFamilies)
@@ -944,9 +2495,20 @@ private:
     //获取缓存方式
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& avaliablePresentMode)
     {
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
-
+        //基准测试时不等待垂直同步
+        if (benchmarkFrames > 0)
+        {
+            for (const auto& presentMode : avaliablePresentMode)
+            {
+                if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+                {
+                    return presentMode;
+                }
+            }
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
     //交换链分辨率
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
     {
@@ -972,16 +2534,29 @@ private:
 
     //创建pass
     void createRenderPass()
+    {
+        createSceneRenderPass(viewCount, renderPass);
+
+        //渲染任务只读回一个视图，多视图时另建单视图的pass
+        jobRenderPass = renderPass;
+        if (!jobServerPath.empty() && viewCount > 1)
+        {
+            createSceneRenderPass(1, jobRenderPass);
+        }
+    }
+
+    //场景pass，views个相机各写入一层
+    void createSceneRenderPass(uint32_t views, VkRenderPass& pass)
     {
         VkAttachmentDescription colorAttachment = {};
-        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.format = SCENE_COLOR_FORMAT;
         colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
         colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;//渲染完给后处理或放大pass采样
 
         VkAttachmentReference colorAttachmentRef = {};
         colorAttachmentRef.attachment = 0;
@@ -999,6 +2574,74 @@ private:
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpass;
 
+        //离屏目标只有一张，写入前要等上一帧的放大pass（或后处理）读完，写完后它们才能读
+        VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        if (postProcessing)
+        {
+            readStages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
+
+        VkSubpassDependency dependencies[2] = {};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = readStages;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = readStages;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.pDependencies = dependencies;
+
+        //每个相机渲染到离屏目标的一层，所有视图共用同一组绘制指令
+        uint32_t viewMask = (1u << views) - 1;
+        uint32_t correlationMask = viewMask;//相机位置接近，告诉驱动可以一起处理
+        VkRenderPassMultiviewCreateInfo multiviewInfo = {};
+        multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+        multiviewInfo.subpassCount = 1;
+        multiviewInfo.pViewMasks = &viewMask;
+        multiviewInfo.correlationMaskCount = 1;
+        multiviewInfo.pCorrelationMasks = &correlationMask;
+        if (views > 1)
+        {
+            renderPassInfo.pNext = &multiviewInfo;
+        }
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render pass!");
+        }
+
+    }
+
+    //创建放大到交换链的pass
+    void createUpscaleRenderPass()
+    {
+        VkAttachmentDescription colorAttachment = {};
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;//全屏三角形会覆盖每个像素
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference colorAttachmentRef = {};
+        colorAttachmentRef.attachment = 0;
+        colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorAttachmentRef;
+
         VkSubpassDependency dependency = {};
         dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
         dependency.dstSubpass = 0;
@@ -1007,26 +2650,48 @@ private:
         dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &colorAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
         renderPassInfo.dependencyCount = 1;
         renderPassInfo.pDependencies = &dependency;
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &upscaleRenderPass) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to create render pass!");
+            throw std::runtime_error("failed to create upscale render pass!");
         }
-
     }
 
     //创建缓冲帧
     void createFramebuffers()
     {
+        //离屏场景目标的帧缓存，大小是最大渲染分辨率
+        VkImageView sceneAttachments[] = { sceneColorImageView };
+        VkFramebufferCreateInfo sceneFramebufferInfo = {};
+        sceneFramebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        sceneFramebufferInfo.renderPass = renderPass;
+        sceneFramebufferInfo.attachmentCount = 1;
+        sceneFramebufferInfo.pAttachments = sceneAttachments;
+        sceneFramebufferInfo.width = sceneExtent.width;
+        sceneFramebufferInfo.height = sceneExtent.height;
+        sceneFramebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(device, &sceneFramebufferInfo, nullptr, &sceneFramebuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create scene framebuffer!");
+        }
+
+        //交换链图像的帧缓存，给放大pass使用
         swapChainFramebuffers.resize(swapChainImageViews.size());
         for (size_t i = 0; i < swapChainImageViews.size(); i++)
         {
             VkImageView attachments[] = { swapChainImageViews[i] };
             VkFramebufferCreateInfo framebufferInfo = {};
             framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.renderPass = upscaleRenderPass;
             framebufferInfo.attachmentCount = 1;
             framebufferInfo.pAttachments = attachments;
             framebufferInfo.width = swapChainExtent.width;
@@ -1048,7 +2713,7 @@ private:
         VkCommandPoolCreateInfo poolInfo = {};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-        poolInfo.flags = 0;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;//每帧重新录制，需要单独重置指令缓存
 
         if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
         {
@@ -1061,7 +2726,8 @@ private:
     //创建指令缓存
     void createCommandBuffers()
     {
-        commandBuffers.resize(swapChainFramebuffers.size());
+        //主指令缓存每帧重新录制，只负责pass、计时和执行缓存的场景片段，录制成本很低
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
         VkCommandBufferAllocateInfo allocInfo = {};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.commandPool = commandPool;
@@ -1072,89 +2738,4272 @@ private:
         {
             throw std::runtime_error("failed to allocate command buffers!");
         }
+    }
+
+    //录制一帧的指令：场景按renderExtent渲染到离屏目标，再放大锐化到交换链图像
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = nullptr;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        uint32_t firstQuery = (uint32_t)currentFrame * 2;
+        if (gpuTimingSupported)
+        {
+            vkCmdResetQueryPool(commandBuffer, timestampQueryPool, firstQuery, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, firstQuery);
+        }
+
+        uint32_t firstStatisticsQuery = (uint32_t)currentFrame * STATISTICS_PASS_COUNT;
+        if (pipelineStatisticsSupported)
+        {
+            vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, firstStatisticsQuery, STATISTICS_PASS_COUNT);
+        }
+
+        //场景pass之前把动画角色蒙皮到顶点缓冲
+        if (characterCount > 0)
+        {
+            recordSkinning(commandBuffer, currentFrame);
+        }
+
+        //粒子模拟，结果和间接绘制参数都留在GPU上
+        if (particleCapacity > 0)
+        {
+            recordParticles(commandBuffer);
+        }
 
-        for (size_t i = 0; i < commandBuffers.size(); i++)
+        //阴影深度图：静态层按需重画，动态层每帧重画
+        if (shadowsEnabled)
         {
-            VkCommandBufferBeginInfo beginInfo = {};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-            beginInfo.pInheritanceInfo = nullptr;
+            recordShadows(commandBuffer);
+        }
 
-            if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS)
+        //场景的绘制都在缓存的二级指令缓存里，只重新录制输入变化了的片段
+        segmentsRecordedLastFrame = 0;
+        FrameVector<VkCommandBuffer> frameSegmentBuffers{ ArenaAllocator<VkCommandBuffer>(frameArena) };
+        frameSegmentBuffers.reserve(sceneSegments.size() + 1);
+        auto addSegment = [&](CommandSegment& segment)
+        {
+            if (segment.draws.empty())
+            {
+                return;
+            }
+            if (segment.recordedVersion[currentFrame] != segment.version || segment.recordedExtent[currentFrame].width != renderExtent.width || segment.recordedExtent[currentFrame].height != renderExtent.height)
             {
-                throw std::runtime_error("failed to begin recording command buffer!");
+                recordSceneSegment(segment, currentFrame);
+                segmentsRecordedLastFrame++;
             }
+            frameSegmentBuffers.push_back(segment.buffers[currentFrame]);
+        };
 
-            VkRenderPassBeginInfo renderPassInfo = {};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = renderPass;
-            renderPassInfo.framebuffer = swapChainFramebuffers[i];
-            renderPassInfo.renderArea.offset = { 0,0 };
-            renderPassInfo.renderArea.extent = swapChainExtent;
+        //地面在最前面，场景的几何画在它上面
+        if (shadowsEnabled)
+        {
+            addSegment(groundSegment);
+        }
+        for (auto& segment : sceneSegments)
+        {
+            addSegment(segment);
+        }
 
-            VkClearValue clearColor = { 0.0f,0.0f,0.0f,0.1f };
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
+        //查询在pass之外开始和结束，multiview时也只占一个查询
+        if (pipelineStatisticsSupported)
+        {
+            vkCmdBeginQuery(commandBuffer, statisticsQueryPool, firstStatisticsQuery + STATISTICS_SCENE_PASS, 0);
+        }
+        //场景pass，只清除和渲染离屏目标中renderExtent大小的区域
+        beginSceneRendering(commandBuffer, sceneColorImage, sceneColorImageView, sceneFramebuffer, renderExtent, true, viewCount);
+        if (!frameSegmentBuffers.empty())
+        {
+            vkCmdExecuteCommands(commandBuffer, (uint32_t)frameSegmentBuffers.size(), frameSegmentBuffers.data());
+        }
+        endSceneRendering(commandBuffer, sceneColorImage, viewCount);
+        if (pipelineStatisticsSupported)
+        {
+            vkCmdEndQuery(commandBuffer, statisticsQueryPool, firstStatisticsQuery + STATISTICS_SCENE_PASS);
+        }
+
+        //HDR的场景经过泛光、曝光和色调映射，写到同样大小的8位输出
+        if (postProcessing)
+        {
+            recordPostProcessing(commandBuffer);
+        }
+
+        //放大pass，全屏三角形采样离屏目标（或后处理的输出）的有效区域
+        if (pipelineStatisticsSupported)
+        {
+            vkCmdBeginQuery(commandBuffer, statisticsQueryPool, firstStatisticsQuery + STATISTICS_UPSCALE_PASS, 0);
+        }
+        beginUpscaleRendering(commandBuffer, imageIndex);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &upscaleDescriptorSet, 0, nullptr);
+
+        UpscalePushConstants pushConstants = {};
+        pushConstants.uvScale[0] = (float)renderExtent.width / (float)sceneExtent.width;
+        pushConstants.uvScale[1] = (float)renderExtent.height / (float)sceneExtent.height;
+        pushConstants.texelSize[0] = 1.0f / (float)sceneExtent.width;
+        pushConstants.texelSize[1] = 1.0f / (float)sceneExtent.height;
+        //多视图时每个视图只占网格中的一格
+        UpscaleShaderVariant variant = makeUpscaleShaderVariant(viewCount, UPSCALE_SHARPNESS, debugView);
+        pushConstants.footprint[0] = (float)(renderExtent.width * variant.gridColumns) / (float)swapChainExtent.width;
+        pushConstants.footprint[1] = (float)(renderExtent.height * variant.gridRows) / (float)swapChainExtent.height;
+        pushConstants.sharpness = UPSCALE_SHARPNESS;
+        vkCmdPushConstants(commandBuffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscalePushConstants), &pushConstants);
+
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+        //性能HUD画在放大的结果上，一次绘制
+        if (hudVisible)
+        {
+            recordHud(commandBuffer);
+        }
+        endUpscaleRendering(commandBuffer, imageIndex);
+        if (pipelineStatisticsSupported)
+        {
+            vkCmdEndQuery(commandBuffer, statisticsQueryPool, firstStatisticsQuery + STATISTICS_UPSCALE_PASS);
+            frameStatisticsWritten[currentFrame] = true;
+        }
+
+        if (frameRing.isOpen())
+        {
+            recordFrameExport(commandBuffer, imageIndex);
+        }
+
+        if (gpuTimingSupported)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, firstQuery + 1);
+            frameTimestampsWritten[currentFrame] = true;
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    //按静态桶把绘制列表分成指令片段，并为每个帧槽分配二级指令缓存
+    void createSceneSegments()
+    {
+        scenePipelines = { graphicsPipeline };
+        sceneMaterials = { sceneDescriptorSet };
+        sceneMeshes = { vertexBuffer };
+
+        //所有动画角色一次绘制
+        std::vector<SceneDraw> draws = sceneDraws;
+        if (characterCount > 0)
+        {
+            sceneMeshes.push_back(skinnedVertexBuffer);
+            draws.push_back({ ANIMATION_BUCKET, animation.getVertexCount() * characterCount, 1, 0, 0, 0, 0, ANIMATION_MESH, 0.5f, false });
+        }
+
+        sceneDrawItems.clear();
+        for (const auto& draw : draws)
+        {
+            uint64_t sortKey = draw.transparent ? DrawSortKey::transparent(draw.pipeline, draw.material, draw.mesh, draw.depth) : DrawSortKey::opaque(draw.pipeline, draw.material, draw.mesh, draw.depth);
+            sceneDrawItems.push_back({ draw.bucket, sortKey, scenePipelines[draw.pipeline], sceneMaterials[draw.material], sceneMeshes[draw.mesh], draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance });
+        }
+        if (characterCount > 0)
+        {
+            characterDrawTemplate = sceneDrawItems.back();
+            characterDraws.assign(1, characterDrawTemplate);
+        }
+
+        //粒子：每个粒子一个实例，实例数由模拟写入间接参数，相加混合，放在不透明的绘制之后
+        if (particleCapacity > 0)
+        {
+            uint32_t pipelineIndex = (uint32_t)scenePipelines.size();
+            uint32_t meshIndex = (uint32_t)sceneMeshes.size();
+            scenePipelines.push_back(particlePipeline);
+            sceneMeshes.push_back(particleBuffer);
+
+            DrawItem particleDraw = { PARTICLE_BUCKET, DrawSortKey::transparent(pipelineIndex, 0, meshIndex, 0.5f), particlePipeline, sceneDescriptorSet, particleBuffer, 6, 0, 0, 0 };
+            particleDraw.indirectBuffer = particleStateBuffer;
+            particleDraw.indirectOffset = offsetof(ParticleState, draw);
+            sceneDrawItems.push_back(particleDraw);
+        }
+
+        uint32_t bucketCount = 0;
+        for (const auto& draw : sceneDrawItems)
+        {
+            bucketCount = std::max(bucketCount, draw.bucket + 1);
+        }
+
+        sceneSegments.resize(bucketCount);
+        for (auto& segment : sceneSegments)
+        {
+            allocateSegmentBuffers(segment);
+        }
+
+        std::vector<std::vector<DrawItem>> bucketDraws(bucketCount);
+        for (const auto& draw : sceneDrawItems)
+        {
+            bucketDraws[draw.bucket].push_back(draw);
+        }
+        for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+        {
+            sortDraws(bucketDraws[bucket], sceneSegments[bucket].draws);
+        }
+
+        //地面是一个全屏三角形，不属于任何静态桶，也不写入捕获的日志
+        if (shadowsEnabled)
+        {
+            allocateSegmentBuffers(groundSegment);
+            groundSegment.draws = { { 0, 0, groundPipeline, sceneDescriptorSet, vertexBuffer, 3, 1, 0, 0 } };
+        }
+
+    }
+
+    //为片段的每个帧槽分配二级指令缓存
+    void allocateSegmentBuffers(CommandSegment& segment)
+    {
+        segment.buffers.resize(MAX_FRAMES_IN_FLIGHT);
+        segment.recordedVersion.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        segment.recordedExtent.assign(MAX_FRAMES_IN_FLIGHT, VkExtent2D{ 0, 0 });
+        segment.version = 1;//版本从1开始，保证每个帧槽第一次使用时都会录制
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = (uint32_t)segment.buffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, segment.buffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate secondary command buffers!");
+        }
+    }
+
+    //替换一个静态桶的绘制内容，下一次使用各个帧槽时会重新录制这个片段
+    void updateSceneSegment(uint32_t bucket, const std::vector<DrawItem>& draws)
+    {
+        //排序结果直接写进片段自己的数组，容量留在片段中，绘制数不超过以前的最大值时不重新分配
+        sortDraws(draws, sceneSegments[bucket].draws);
+        sceneSegments[bucket].version++;
+    }
+
+    //按排序键把draws重排到sorted中：不透明的先画、相同状态相邻，半透明的从后往前。两者不能是同一个数组
+    void sortDraws(const std::vector<DrawItem>& draws, std::vector<DrawItem>& sorted)
+    {
+        sortKeys.resize(draws.size());
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            sortKeys[i] = draws[i].sortKey;
+        }
+        drawSorter.sort(sortKeys.data(), (uint32_t)draws.size(), sortOrder);
+
+        sorted.resize(draws.size());
+        for (size_t i = 0; i < draws.size(); i++)
+        {
+            sorted[i] = draws[sortOrder[i]];
+        }
+    }
+
+    //把一个片段录制到指定帧槽的二级指令缓存中
+    void recordSceneSegment(CommandSegment& segment, size_t frame)
+    {
+        VkCommandBuffer commandBuffer = segment.buffers[frame];
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = sceneFramebuffer;
+        inheritanceInfo.pipelineStatistics = pipelineStatisticsSupported ? PIPELINE_STATISTICS_FLAGS : 0;//在主指令缓存的统计查询中执行
+
+        //动态渲染时继承附件格式和视图掩码，不引用pass和帧缓存
+        VkCommandBufferInheritanceRenderingInfoKHR inheritanceRendering = {};
+        inheritanceRendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+        inheritanceRendering.viewMask = sceneViewMask();
+        inheritanceRendering.colorAttachmentCount = 1;
+        inheritanceRendering.pColorAttachmentFormats = &SCENE_COLOR_FORMAT;
+        inheritanceRendering.depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+        inheritanceRendering.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+        inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        if (dynamicRendering)
+        {
+            inheritanceInfo.pNext = &inheritanceRendering;
+            inheritanceInfo.renderPass = VK_NULL_HANDLE;
+            inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
 
-            vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-            vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
 
-            vkCmdEndRenderPass(commandBuffers[i]);
+        VkViewport viewPort = {};
+        viewPort.x = 0.0f;
+        viewPort.y = 0.0f;
+        viewPort.width = (float)renderExtent.width;
+        viewPort.height = (float)renderExtent.height;
+        viewPort.minDepth = 0.0f;
+        viewPort.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewPort);
 
-            if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+        VkRect2D scissor = {};
+        scissor.offset = { 0,0 };
+        scissor.extent = renderExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        //绘制已经按状态排好序，只在状态变化时绑定
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+        VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+        segment.stateChanges = 0;
+        for (const auto& draw : segment.draws)
+        {
+            if (draw.pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+                boundPipeline = draw.pipeline;
+                segment.stateChanges++;
+            }
+            if (draw.descriptorSet != boundDescriptorSet)
             {
-                throw std::runtime_error("failed to record command buffer!");
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &draw.descriptorSet, 0, nullptr);
+                boundDescriptorSet = draw.descriptorSet;
+                segment.stateChanges++;
             }
+            if (draw.vertexBuffer != boundVertexBuffer)
+            {
+                VkDeviceSize offset = 0;
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &offset);
+                boundVertexBuffer = draw.vertexBuffer;
+                segment.stateChanges++;
+            }
+            if (draw.indirectBuffer != VK_NULL_HANDLE)
+            {
+                vkCmdDrawIndirect(commandBuffer, draw.indirectBuffer, draw.indirectOffset, 1, sizeof(VkDrawIndirectCommand));
+            }
+            else
+            {
+                vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+            }
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record secondary command buffer!");
         }
+
+        segment.recordedVersion[frame] = segment.version;
+        segment.recordedExtent[frame] = renderExtent;
     }
 
-    //配置信号量
-    void createSemaphores()
+    //配置信号量和栅栏
+    void createSyncObjects()
     {
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
         VkSemaphoreCreateInfo semaphoreInfo = {};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS || vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
+        //栅栏创建时就是触发状态，第一帧不用等待
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            throw std::runtime_error("failed to create semaphores!");
+            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS || vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS || vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
         }
     }
 
-    //--------------着色器部分代码-------------
+    //--------------动态渲染---------------
+    //多视图时场景的视图掩码，单视图为0
+    uint32_t sceneViewMask()
+    {
+        return viewCount > 1 ? (1u << viewCount) - 1 : 0;
+    }
 
-    //创建着色器模块
-    VkShaderModule createShaderModule(const std::vector<char>& code)
+    //管线的输出目标：pass路径引用pass的第0个subpass；动态渲染时pass为空，附件格式和视图掩码在renderingInfo中给出
+    //colorFormat为空时没有颜色附件，renderingInfo要活到vkCreateGraphicsPipelines之后
+    void setPipelineTarget(VkGraphicsPipelineCreateInfo& pipelineInfo, VkPipelineRenderingCreateInfoKHR& renderingInfo, VkRenderPass pass, const VkFormat* colorFormat, VkFormat depthFormat, uint32_t viewMask)
     {
-        VkShaderModuleCreateInfo creatInfo = {};
-        creatInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        creatInfo.codeSize = code.size();
-        creatInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        pipelineInfo.subpass = 0;
+        if (!dynamicRendering)
+        {
+            pipelineInfo.renderPass = pass;
+            return;
+        }
 
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &creatInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+        renderingInfo.viewMask = viewMask;
+        renderingInfo.colorAttachmentCount = colorFormat != nullptr ? 1 : 0;
+        renderingInfo.pColorAttachmentFormats = colorFormat;
+        renderingInfo.depthAttachmentFormat = depthFormat;
+        renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+    }
+
+    //synchronization2的图像屏障，代替pass的布局转换和外部依赖
+    void imageBarrier2(VkCommandBuffer commandBuffer, VkImage image, VkImageAspectFlags aspect, uint32_t baseLayer, uint32_t layerCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags2KHR srcStage, VkAccessFlags2KHR srcAccess, VkPipelineStageFlags2KHR dstStage, VkAccessFlags2KHR dstAccess)
+    {
+        VkImageMemoryBarrier2KHR barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        barrier.srcStageMask = srcStage;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstStageMask = dstStage;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = aspect;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = baseLayer;
+        barrier.subresourceRange.layerCount = layerCount;
+
+        VkDependencyInfoKHR dependencyInfo = {};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependencyInfo.imageMemoryBarrierCount = 1;
+        dependencyInfo.pImageMemoryBarriers = &barrier;
+        cmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    //场景颜色目标：清除extent大小的区域，结束后转为着色器只读，供放大pass（和后处理）采样
+    //secondary为true时内容在二级指令缓存中；views为目标的层数，与viewCount不同时是渲染任务的单视图目标
+    void beginSceneRendering(VkCommandBuffer commandBuffer, VkImage image, VkImageView view, VkFramebuffer framebuffer, VkExtent2D extent, bool secondary, uint32_t views)
+    {
+        VkClearValue clearColor = { SCENE_CLEAR_COLOR[0], SCENE_CLEAR_COLOR[1], SCENE_CLEAR_COLOR[2], SCENE_CLEAR_COLOR[3] };
+        if (!dynamicRendering)
         {
-            throw std::runtime_error("failed to create shader module!");
+            VkRenderPassBeginInfo renderPassInfo = {};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = views == viewCount ? renderPass : jobRenderPass;
+            renderPassInfo.framebuffer = framebuffer;
+            renderPassInfo.renderArea.offset = { 0,0 };
+            renderPassInfo.renderArea.extent = extent;
+            renderPassInfo.clearValueCount = 1;
+            renderPassInfo.pClearValues = &clearColor;
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+            return;
         }
-        return shaderModule;
+
+        //上一帧的采样（片元或计算）结束后才能覆盖，内容不需要保留
+        imageBarrier2(commandBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT, 0, views, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR);
+
+        VkRenderingAttachmentInfoKHR colorAttachment = {};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+        colorAttachment.imageView = view;
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue = clearColor;
+
+        VkRenderingInfoKHR renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.flags = secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR : 0;
+        renderingInfo.renderArea.offset = { 0,0 };
+        renderingInfo.renderArea.extent = extent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.viewMask = views > 1 ? (1u << views) - 1 : 0;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        cmdBeginRendering(commandBuffer, &renderingInfo);
     }
 
-    //--------------着色器部分代码-------------
-};
+    void endSceneRendering(VkCommandBuffer commandBuffer, VkImage image, uint32_t views)
+    {
+        if (!dynamicRendering)
+        {
+            vkCmdEndRenderPass(commandBuffer);
+            return;
+        }
 
+        cmdEndRendering(commandBuffer);
+        VkPipelineStageFlags2KHR readStages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR;
+        if (postProcessing)
+        {
+            readStages |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+        }
+        imageBarrier2(commandBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT, 0, views, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+            readStages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR);
+    }
 
-int main()
-{
-    //整体工作对象
-    HelloTriangleApplication app;
-    try
+    //交换链图像：全屏三角形覆盖整个图像，不加载旧内容，结束后转为呈现布局
+    void beginUpscaleRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
     {
-        app.run();
+        if (!dynamicRendering)
+        {
+            VkRenderPassBeginInfo upscalePassInfo = {};
+            upscalePassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            upscalePassInfo.renderPass = upscaleRenderPass;
+            upscalePassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            upscalePassInfo.renderArea.offset = { 0,0 };
+            upscalePassInfo.renderArea.extent = swapChainExtent;
+            upscalePassInfo.clearValueCount = 0;
+            upscalePassInfo.pClearValues = nullptr;
+            vkCmdBeginRenderPass(commandBuffer, &upscalePassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            return;
+        }
+
+        //与获取图像的信号量在颜色输出阶段衔接
+        imageBarrier2(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_NONE_KHR,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR);
+
+        VkRenderingAttachmentInfoKHR colorAttachment = {};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+        colorAttachment.imageView = swapChainImageViews[imageIndex];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+        VkRenderingInfoKHR renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.renderArea.offset = { 0,0 };
+        renderingInfo.renderArea.extent = swapChainExtent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        cmdBeginRendering(commandBuffer, &renderingInfo);
     }
-    catch (const std::exception& e)
+
+    void endUpscaleRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex)
     {
-        std::cerr << e.what() << std::endl;
-        return EXIT_FAILURE;
+        if (!dynamicRendering)
+        {
+            vkCmdEndRenderPass(commandBuffer);
+            return;
+        }
+
+        //导出帧时后面还有拷贝，屏障在颜色输出阶段与它衔接；否则只等待呈现
+        cmdEndRendering(commandBuffer);
+        imageBarrier2(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+            frameRing.isOpen() ? VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR : VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR);
     }
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+
+    //阴影深度图的一层：清除为1，结束后转为着色器只读
+    void beginShadowRendering(VkCommandBuffer commandBuffer, uint32_t layer)
+    {
+        VkClearValue clearDepth = {};
+        clearDepth.depthStencil = { 1.0f, 0 };
+        if (!dynamicRendering)
+        {
+            VkRenderPassBeginInfo passInfo = {};
+            passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            passInfo.renderPass = shadowRenderPass;
+            passInfo.framebuffer = shadowFramebuffers[layer];
+            passInfo.renderArea.offset = { 0,0 };
+            passInfo.renderArea.extent = { SHADOW_MAP_SIZE, SHADOW_MAP_SIZE };
+            passInfo.clearValueCount = 1;
+            passInfo.pClearValues = &clearDepth;
+            vkCmdBeginRenderPass(commandBuffer, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+            return;
+        }
+
+        //之前场景对这一层的采样结束后才能覆盖
+        imageBarrier2(commandBuffer, shadowMapImage, VK_IMAGE_ASPECT_DEPTH_BIT, layer, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_NONE_KHR,
+            VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR);
+
+        VkRenderingAttachmentInfoKHR depthAttachment = {};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+        depthAttachment.imageView = shadowLayerViews[layer];
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depthAttachment.clearValue = clearDepth;
+
+        VkRenderingInfoKHR renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.renderArea.offset = { 0,0 };
+        renderingInfo.renderArea.extent = { SHADOW_MAP_SIZE, SHADOW_MAP_SIZE };
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 0;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+        cmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    void endShadowRendering(VkCommandBuffer commandBuffer, uint32_t layer)
+    {
+        if (!dynamicRendering)
+        {
+            vkCmdEndRenderPass(commandBuffer);
+            return;
+        }
+
+        cmdEndRendering(commandBuffer);
+        imageBarrier2(commandBuffer, shadowMapImage, VK_IMAGE_ASPECT_DEPTH_BIT, layer, 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+            VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR);
+    }
+    //--------------动态渲染---------------
+
+    //--------------动态分辨率---------------
+
+    //创建离屏场景目标，按最大缩放比例分配，之后调整分辨率不需要重新创建
+    void createSceneColorResources()
+    {
+        //超采样的上限受设备支持的最大二维图像尺寸限制，但不低于原生分辨率
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        uint32_t maxDimension = deviceProperties.limits.maxImageDimension2D;
+        maxRenderScale = std::min(MAX_RENDER_SCALE, (float)maxDimension / (float)std::max(swapChainExtent.width, swapChainExtent.height));
+        maxRenderScale = std::max(maxRenderScale, 1.0f);
+
+        sceneExtent.width = std::max(swapChainExtent.width, std::min((uint32_t)std::ceil(swapChainExtent.width * maxRenderScale), maxDimension));
+        sceneExtent.height = std::max(swapChainExtent.height, std::min((uint32_t)std::ceil(swapChainExtent.height * maxRenderScale), maxDimension));
+
+        //每个相机一层，单相机时也使用数组视图，放大pass的着色器不需要区分
+        createImage(sceneExtent.width, sceneExtent.height, SCENE_COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, sceneColorImage, sceneColorImageMemory, viewCount);
+        sceneColorImageView = createImageView(sceneColorImage, SCENE_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, viewCount);
+
+        applyRenderScale(renderScale);
+    }
+
+    //按缩放比例计算当前帧的渲染区域
+    void applyRenderScale(float scale)
+    {
+        renderScale = std::clamp(scale, MIN_RENDER_SCALE, maxRenderScale);
+        renderExtent.width = std::clamp((uint32_t)std::lround(swapChainExtent.width * renderScale), 1u, sceneExtent.width);
+        renderExtent.height = std::clamp((uint32_t)std::lround(swapChainExtent.height * renderScale), 1u, sceneExtent.height);
+    }
+
+    //读取这个帧槽上一次的GPU时间，按目标帧时间调整渲染缩放比例
+    void updateRenderScale()
+    {
+        float gpuFrameMs;
+        if (!readGpuFrameMs(currentFrame, gpuFrameMs))
+        {
+            return;
+        }
+        lastGpuFrameMs = gpuFrameMs;
+
+        //基准测试时固定渲染分辨率，只记录时间
+        if (benchmarkFrames > 0)
+        {
+            benchmarkGpuMsTotal += gpuFrameMs;
+            benchmarkGpuSamples++;
+            if (!replayPath.empty())
+            {
+                replayGpuMs[frameReplayIndex[currentFrame]] = gpuFrameMs;
+            }
+            return;
+        }
+
+        //超出预算时快速响应突发负载，低于预算时缓慢恢复，避免分辨率来回跳
+        float weight = gpuFrameMs > smoothedGpuFrameMs ? 0.5f : 0.1f;
+        smoothedGpuFrameMs = smoothedGpuFrameMs <= 0.0f ? gpuFrameMs : smoothedGpuFrameMs + (gpuFrameMs - smoothedGpuFrameMs) * weight;
+
+        //在目标的85%~100%之间不调整
+        if (smoothedGpuFrameMs <= 0.0f || (smoothedGpuFrameMs > TARGET_GPU_FRAME_MS * 0.85f && smoothedGpuFrameMs <= TARGET_GPU_FRAME_MS))
+        {
+            return;
+        }
+
+        //像素数与缩放比例的平方成正比，按平方根修正，瞄准预算的90%留出余量
+        float correction = std::sqrt(TARGET_GPU_FRAME_MS * 0.9f / smoothedGpuFrameMs);
+        correction = std::min(correction, 1.05f);//每帧最多放大5%
+        applyRenderScale(renderScale * correction);
+    }
+
+    //读取帧槽上一次的GPU时间，还没有写过或读取失败时返回false
+    bool readGpuFrameMs(size_t frame, float& gpuFrameMs)
+    {
+        if (!gpuTimingSupported || !frameTimestampsWritten[frame])
+        {
+            return false;
+        }
+
+        uint64_t timestamps[2] = {};
+        VkResult result = vkGetQueryPoolResults(device, timestampQueryPool, (uint32_t)frame * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        gpuFrameMs = (float)(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0f;
+        return true;
+    }
+
+    //读取这个帧槽上一次的管线统计
+    void readPipelineStatistics()
+    {
+        if (!pipelineStatisticsSupported || !frameStatisticsWritten[currentFrame])
+        {
+            return;
+        }
+
+        uint64_t results[STATISTICS_PASS_COUNT][PIPELINE_STATISTICS_COUNT] = {};
+        VkResult result = vkGetQueryPoolResults(device, statisticsQueryPool, (uint32_t)currentFrame * STATISTICS_PASS_COUNT, STATISTICS_PASS_COUNT, sizeof(results), results, sizeof(results[0]), VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS)
+        {
+            return;
+        }
+
+        for (uint32_t pass = 0; pass < STATISTICS_PASS_COUNT; pass++)
+        {
+            lastPassStatistics[pass] = { results[pass][0], results[pass][1], results[pass][2] };
+            if (benchmarkFrames > 0)
+            {
+                benchmarkStatistics[pass].vertexInvocations += results[pass][0];
+                benchmarkStatistics[pass].clippingPrimitives += results[pass][1];
+                benchmarkStatistics[pass].fragmentInvocations += results[pass][2];
+            }
+        }
+        if (benchmarkFrames > 0)
+        {
+            benchmarkStatisticsPixels += (uint64_t)renderExtent.width * renderExtent.height * viewCount;
+            benchmarkStatisticsSamples++;
+        }
+    }
+
+    //创建GPU计时用的查询池
+    void createQueryPool()
+    {
+        //管线统计的查询池，与时间戳无关
+        if (pipelineStatisticsSupported)
+        {
+            frameStatisticsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+            VkQueryPoolCreateInfo statisticsPoolInfo = {};
+            statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            statisticsPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * STATISTICS_PASS_COUNT;
+            statisticsPoolInfo.pipelineStatistics = PIPELINE_STATISTICS_FLAGS;
+
+            if (vkCreateQueryPool(device, &statisticsPoolInfo, nullptr, &statisticsQueryPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create pipeline statistics query pool!");
+            }
+        }
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+        //设备不支持图形队列上的时间戳时，保持最大分辨率
+        gpuTimingSupported = deviceProperties.limits.timestampComputeAndGraphics == VK_TRUE;
+        if (!gpuTimingSupported)
+        {
+            return;
+        }
+        timestampPeriod = deviceProperties.limits.timestampPeriod;
+        frameTimestampsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+
+        if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+    }
+
+    //描述符布局：放大pass采样离屏目标的组合图像采样器，场景管线的相机缓冲
+    void createDescriptorSetLayout()
+    {
+        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
+        samplerLayoutBinding.binding = 0;
+        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBinding.descriptorCount = 1;
+        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        samplerLayoutBinding.pImmutableSamplers = nullptr;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &samplerLayoutBinding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &upscaleDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        //场景管线的描述符布局：顶点着色器中的相机矩阵，阴影的光源矩阵和深度图（ShadowShader.vert、GroundShader.frag）
+        VkDescriptorSetLayoutBinding sceneBindings[3] = {};
+        sceneBindings[0].binding = 0;
+        sceneBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        sceneBindings[0].descriptorCount = 1;
+        sceneBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        sceneBindings[0].pImmutableSamplers = nullptr;
+        sceneBindings[1].binding = 1;
+        sceneBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        sceneBindings[1].descriptorCount = 1;
+        sceneBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        sceneBindings[1].pImmutableSamplers = nullptr;
+        sceneBindings[2].binding = 2;
+        sceneBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        sceneBindings[2].descriptorCount = 1;
+        sceneBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        sceneBindings[2].pImmutableSamplers = nullptr;
+
+        layoutInfo.bindingCount = 3;
+        layoutInfo.pBindings = sceneBindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &sceneDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        //蒙皮计算管线的描述符布局：绑定姿势、蒙皮矩阵、输出顶点，与SkinningShader.comp一致
+        VkDescriptorSetLayoutBinding skinningBindings[3] = {};
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            skinningBindings[i].binding = i;
+            skinningBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            skinningBindings[i].descriptorCount = 1;
+            skinningBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            skinningBindings[i].pImmutableSamplers = nullptr;
+        }
+
+        layoutInfo.bindingCount = 3;
+        layoutInfo.pBindings = skinningBindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &skinningDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        //粒子计算管线的描述符布局：粒子、压缩输出、计数，与ParticleShader.comp一致，绑定方式与蒙皮相同
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &particleDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        //后处理的描述符布局：场景、泛光的每一级（写）、泛光（采样）、输出、状态，与PostProcess.comp一致
+        const VkDescriptorType postTypes[5] = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+        VkDescriptorSetLayoutBinding postBindings[5] = {};
+        for (uint32_t i = 0; i < 5; i++)
+        {
+            postBindings[i].binding = i;
+            postBindings[i].descriptorType = postTypes[i];
+            postBindings[i].descriptorCount = i == 1 ? BLOOM_LEVELS : 1;
+            postBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            postBindings[i].pImmutableSamplers = nullptr;
+        }
+
+        layoutInfo.bindingCount = 5;
+        layoutInfo.pBindings = postBindings;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &postDescriptorSetLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+    }
+
+    //放大时使用的双线性采样器
+    void createUpscaleSampler()
+    {
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = 0.0f;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &upscaleSampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upscale sampler!");
+        }
+    }
+
+    //描述符池
+    void createDescriptorPool()
+    {
+        VkDescriptorPoolSize poolSizes[4] = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = 1 + (1 + MAX_RENDER_CONTEXTS) + 2;//离屏目标，窗口和每个渲染上下文的阴影深度图，后处理的场景和泛光
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSizes[1].descriptorCount = 2 * (1 + MAX_RENDER_CONTEXTS);//窗口和每个渲染上下文的相机和光源
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = 3 * MAX_FRAMES_IN_FLIGHT + 3 + 1;//每个帧槽的蒙皮描述符集、粒子和后处理的描述符集
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[3].descriptorCount = BLOOM_LEVELS + 1;//泛光的每一级和后处理的输出
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 4;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = 4 + MAX_RENDER_CONTEXTS + MAX_FRAMES_IN_FLIGHT;
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor pool!");
+        }
+    }
+
+    //分配放大pass的描述符集，指向离屏目标或后处理的输出
+    void createDescriptorSets()
+    {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &upscaleDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &upscaleDescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        //后处理打开时放大pass采样它的输出，输出一直处于GENERAL布局
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = postProcessing ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = postProcessing ? postOutputView : sceneColorImageView;
+        imageInfo.sampler = upscaleSampler;
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = upscaleDescriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+        //场景管线的描述符集，指向相机缓冲
+        allocInfo.pSetLayouts = &sceneDescriptorSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &sceneDescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = cameraBuffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(CameraBufferObject);
+
+        descriptorWrite.dstSet = sceneDescriptorSet;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.pImageInfo = nullptr;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+        //阴影的光源矩阵和深度图，只有深度管线和地面管线使用
+        if (shadowsEnabled)
+        {
+            VkDescriptorBufferInfo shadowBufferInfo = {};
+            shadowBufferInfo.buffer = shadowBuffer;
+            shadowBufferInfo.offset = 0;
+            shadowBufferInfo.range = sizeof(ShadowBufferObject);
+
+            VkDescriptorImageInfo shadowImageInfo = {};
+            shadowImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            shadowImageInfo.imageView = shadowMapView;
+            shadowImageInfo.sampler = shadowSampler;
+
+            VkWriteDescriptorSet shadowWrites[2] = { descriptorWrite, descriptorWrite };
+            shadowWrites[0].dstBinding = 1;
+            shadowWrites[0].pBufferInfo = &shadowBufferInfo;
+            shadowWrites[1].dstBinding = 2;
+            shadowWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            shadowWrites[1].pBufferInfo = nullptr;
+            shadowWrites[1].pImageInfo = &shadowImageInfo;
+
+            vkUpdateDescriptorSets(device, 2, shadowWrites, 0, nullptr);
+        }
+    }
+
+    //绕场景中心旋转、缩放的相机矩阵，列主序
+    static void buildCameraMatrix(float angle, float zoom, float m[16])
+    {
+        float c = std::cos(angle) * zoom;
+        float s = std::sin(angle) * zoom;
+        m[0] = c;   m[1] = s;   m[2] = 0.0f;  m[3] = 0.0f;
+        m[4] = -s;  m[5] = c;   m[6] = 0.0f;  m[7] = 0.0f;
+        m[8] = 0.0f; m[9] = 0.0f; m[10] = 1.0f; m[11] = 0.0f;
+        m[12] = 0.0f; m[13] = 0.0f; m[14] = 0.0f; m[15] = 1.0f;
+    }
+
+    //创建相机缓冲。第0个相机不做变换，与单视图时的画面相同；
+    //其余相机绕场景中心依次旋转并逐渐拉近，作为数据集的不同视角
+    void createCameraBuffer()
+    {
+        CameraBufferObject cameras = {};
+        for (uint32_t view = 0; view < MAX_CAMERA_VIEWS; view++)
+        {
+            float angle = 2.0f * 3.14159265f * (float)view / (float)viewCount;
+            buildCameraMatrix(angle, 1.0f + 0.1f * (float)view, cameras.viewProj[view]);
+        }
+        sceneCameras = cameras;
+
+        createBuffer(sizeof(CameraBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Uniform, cameraBuffer, cameraBufferMemory);
+
+        void* data;
+        vkMapMemory(device, cameraBufferMemory, 0, sizeof(CameraBufferObject), 0, &data);
+        memcpy(data, &cameras, sizeof(CameraBufferObject));
+        vkUnmapMemory(device, cameraBufferMemory);
+    }
+
+    //创建放大锐化管线：全屏三角形，视口固定为交换链大小
+    void createUpscalePipeline()
+    {
+        VkShaderModule upscaleVertModule = startupShaderModules[SHADER_UPSCALE_VERT];
+        VkShaderModule upscaleFragModule = startupShaderModules[SHADER_UPSCALE_FRAG];
+
+        //视图数和是否锐化在运行期间不变，作为特化常量让驱动去掉不需要的采样和网格计算
+        SpecializationConstants<UpscaleShaderVariant> specialization(makeUpscaleShaderVariant(viewCount, UPSCALE_SHARPNESS, debugView));
+
+        VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo = {};
+        vertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageCreateInfo.module = upscaleVertModule;
+        vertShaderStageCreateInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageCreateInfo = {};
+        fragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageCreateInfo.module = upscaleFragModule;
+        fragShaderStageCreateInfo.pName = "main";
+        fragShaderStageCreateInfo.pSpecializationInfo = specialization.get();
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageCreateInfo , fragShaderStageCreateInfo };
+
+        //顶点位置在着色器中由gl_VertexIndex生成
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkViewport viewPort = {};
+        viewPort.x = 0.0f;
+        viewPort.y = 0.0f;
+        viewPort.width = (float)swapChainExtent.width;
+        viewPort.height = (float)swapChainExtent.height;
+        viewPort.minDepth = 0.0f;
+        viewPort.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0,0 };
+        scissor.extent = swapChainExtent;
+
+        VkPipelineViewportStateCreateInfo viewportState = {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewPort;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterize = {};
+        rasterize.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterize.depthClampEnable = VK_FALSE;
+        rasterize.rasterizerDiscardEnable = VK_FALSE;
+        rasterize.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterize.lineWidth = 1.0f;
+        rasterize.cullMode = VK_CULL_MODE_NONE;
+        rasterize.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterize.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachmen = {};
+        colorBlendAttachmen.colorWriteMask = VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_R_BIT;
+        colorBlendAttachmen.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlend = {};
+        colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlend.logicOpEnable = VK_FALSE;
+        colorBlend.logicOp = VK_LOGIC_OP_COPY;
+        colorBlend.attachmentCount = 1;
+        colorBlend.pAttachments = &colorBlendAttachmen;
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(UpscalePushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &upscaleDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("filed to create upscale pipline layout!");
+        }
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterize;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = nullptr;
+        pipelineInfo.pColorBlendState = &colorBlend;
+        pipelineInfo.pDynamicState = nullptr;
+        pipelineInfo.layout = upscalePipelineLayout;
+        VkPipelineRenderingCreateInfoKHR renderingInfo;
+        setPipelineTarget(pipelineInfo, renderingInfo, upscaleRenderPass, &swapChainImageFormat, VK_FORMAT_UNDEFINED, 0);
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &upscalePipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("filed to create upscale pipeline!");
+        }
+    }
+
+    //--------------动态分辨率---------------
+
+    //--------------骨骼动画---------------
+
+    //创建动画角色，按网格排列在场景中，每个角色的播放时间和混合速度不同
+    void initAnimation()
+    {
+        if (characterCount == 0)
+        {
+            return;
+        }
+
+        Skeleton skeleton;
+        std::vector<AnimationClip> clips;
+        std::vector<SkinnedVertex> mesh;
+        buildCharacterAssets(skeleton, clips, mesh);
+
+        uint32_t columns = (uint32_t)std::ceil(std::sqrt((float)characterCount));
+        float cellSize = 1.8f / (float)columns;
+        std::vector<AnimationSystem::Character> characters(characterCount);
+        for (uint32_t i = 0; i < characterCount; i++)
+        {
+            float x = -0.9f + ((float)(i % columns) + 0.5f) * cellSize;
+            float y = -0.9f + ((float)(i / columns) + 0.9f) * cellSize;
+
+            //裁剪空间y向下，放置矩阵翻转y让角色向上
+            characters[i].root = Animation::placement(x, y, 0.8f * cellSize, -0.8f * cellSize);
+            characters[i].clipA = 0;
+            characters[i].clipB = 1;
+            characters[i].timeOffset = std::fmod((float)i * 0.618034f, 1.0f) * 2.0f;
+            characters[i].blendRate = 0.5f + 0.1f * (float)(i % 7);
+        }
+
+        animation.init(skeleton, clips, mesh, characters);
+        animationStart = std::chrono::steady_clock::now();
+
+        //绑定姿势下蒙皮矩阵就是放置矩阵，用它构建BVH
+        characterBindBounds = { { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), 0.0f }, { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 0.0f } };
+        for (const auto& vertex : mesh)
+        {
+            for (int axis = 0; axis < 2; axis++)
+            {
+                characterBindBounds.min[axis] = std::min(characterBindBounds.min[axis], vertex.pos[axis]);
+                characterBindBounds.max[axis] = std::max(characterBindBounds.max[axis], vertex.pos[axis]);
+            }
+        }
+        std::vector<Aabb> bounds(characterCount);
+        for (uint32_t i = 0; i < characterCount; i++)
+        {
+            bounds[i] = skinnedBounds(&characters[i].root, 1);
+        }
+        sceneBvh.build(bounds);
+        characterVisible.assign(characterCount, 1);
+        casterVisible.assign(characterCount, 1);
+    }
+
+    //创建蒙皮的输出顶点缓冲，以及GPU蒙皮的输入缓冲和描述符集或CPU蒙皮的上传缓冲
+    void createSkinningResources()
+    {
+        if (characterCount == 0)
+        {
+            return;
+        }
+
+        uint32_t jointCount = animation.getJointCount();
+        uint32_t vertexCount = animation.getVertexCount();
+        VkDeviceSize skinnedSize = sizeof(SkinnedOutputVertex) * vertexCount * characterCount;
+        createBuffer(skinnedSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, skinnedVertexBuffer, skinnedVertexBufferMemory);
+        cpuJointMatrices.resize((size_t)jointCount * characterCount);
+
+        if (!gpuSkinning)
+        {
+            createBuffer(skinnedSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Geometry, skinningUploadBuffer, skinningUploadBufferMemory);
+            vkMapMemory(device, skinningUploadBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&skinningUploadMapped);
+            return;
+        }
+
+        //绑定姿势不变，数据量小，直接放在主机可见的内存里
+        VkDeviceSize bindPoseSize = sizeof(SkinnedVertex) * vertexCount;
+        createBuffer(bindPoseSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Geometry, bindPoseBuffer, bindPoseBufferMemory);
+        void* data;
+        vkMapMemory(device, bindPoseBufferMemory, 0, bindPoseSize, 0, &data);
+        memcpy(data, animation.getBindVertices().data(), (size_t)bindPoseSize);
+        vkUnmapMemory(device, bindPoseBufferMemory);
+
+        //蒙皮矩阵每帧由工作线程直接写入映射的内存，每个帧槽的一段按存储缓冲的偏移对齐
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        VkDeviceSize alignment = deviceProperties.limits.minStorageBufferOffsetAlignment;
+        VkDeviceSize matrixSize = sizeof(JointMatrix) * jointCount * characterCount;
+        VkDeviceSize matrixStride = (matrixSize + alignment - 1) / alignment * alignment;
+        createBuffer(matrixStride * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Uniform, jointMatrixBuffer, jointMatrixBufferMemory);
+        vkMapMemory(device, jointMatrixBufferMemory, 0, VK_WHOLE_SIZE, 0, (void**)&jointMatrixMapped);
+        jointMatrixStride = matrixStride;
+
+        skinningDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, skinningDescriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        allocInfo.pSetLayouts = layouts.data();
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, skinningDescriptorSets.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate skinning descriptor sets!");
+        }
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            VkDescriptorBufferInfo bufferInfos[3] = {};
+            bufferInfos[0].buffer = bindPoseBuffer;
+            bufferInfos[0].offset = 0;
+            bufferInfos[0].range = bindPoseSize;
+            bufferInfos[1].buffer = jointMatrixBuffer;
+            bufferInfos[1].offset = matrixStride * i;
+            bufferInfos[1].range = matrixSize;
+            bufferInfos[2].buffer = skinnedVertexBuffer;
+            bufferInfos[2].offset = 0;
+            bufferInfos[2].range = skinnedSize;
+
+            VkWriteDescriptorSet descriptorWrites[3] = {};
+            for (uint32_t binding = 0; binding < 3; binding++)
+            {
+                descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet = skinningDescriptorSets[i];
+                descriptorWrites[binding].dstBinding = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+            }
+            vkUpdateDescriptorSets(device, 3, descriptorWrites, 0, nullptr);
+        }
+    }
+
+    void destroySkinningResources()
+    {
+        if (characterCount == 0)
+        {
+            return;
+        }
+
+        vkDestroyBuffer(device, skinnedVertexBuffer, nullptr);
+        residency.free(skinnedVertexBufferMemory);
+        if (!gpuSkinning)
+        {
+            vkDestroyBuffer(device, skinningUploadBuffer, nullptr);
+            residency.free(skinningUploadBufferMemory);
+            return;
+        }
+
+        vkDestroyBuffer(device, bindPoseBuffer, nullptr);
+        residency.free(bindPoseBufferMemory);
+        vkDestroyBuffer(device, jointMatrixBuffer, nullptr);
+        residency.free(jointMatrixBufferMemory);
+        vkDestroyPipeline(device, skinningPipeline, nullptr);
+        vkDestroyPipelineLayout(device, skinningPipelineLayout, nullptr);
+    }
+
+    //创建蒙皮计算管线，顶点数和关节数作为特化常量
+    void createSkinningPipeline()
+    {
+        VkShaderModule computeModule = startupShaderModules[SHADER_SKINNING_COMP];
+
+        SpecializationConstants<SkinningShaderVariant> specialization({ animation.getVertexCount(), animation.getJointCount() });
+
+        VkPipelineShaderStageCreateInfo computeShaderStageCreateInfo = {};
+        computeShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        computeShaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        computeShaderStageCreateInfo.module = computeModule;
+        computeShaderStageCreateInfo.pName = "main";
+        computeShaderStageCreateInfo.pSpecializationInfo = specialization.get();
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &skinningDescriptorSetLayout;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &skinningPipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create skinning pipeline layout!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = computeShaderStageCreateInfo;
+        pipelineInfo.layout = skinningPipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &skinningPipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create skinning pipeline!");
+        }
+    }
+
+    //在工作线程上计算这一帧所有角色的姿势，写入帧槽的蒙皮矩阵（GPU蒙皮）或蒙皮后的顶点（CPU蒙皮）
+    void updateAnimation(size_t frame)
+    {
+        if (characterCount == 0)
+        {
+            return;
+        }
+
+        float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - animationStart).count();
+        if (gpuSkinning && !characterCulling)
+        {
+            JointMatrix* matrices = (JointMatrix*)((char*)jointMatrixMapped + jointMatrixStride * frame);
+            animation.update(time, matrices, nullptr);
+        }
+        else if (gpuSkinning)
+        {
+            //剔除要读蒙皮矩阵，先写在主机内存里再拷贝，不从上传缓冲读回
+            animation.update(time, cpuJointMatrices.data(), nullptr);
+            memcpy((char*)jointMatrixMapped + jointMatrixStride * frame, cpuJointMatrices.data(), sizeof(JointMatrix) * cpuJointMatrices.size());
+        }
+        else
+        {
+            animation.update(time, cpuJointMatrices.data(), skinningUploadMapped + (size_t)frame * animation.getVertexCount() * characterCount);
+        }
+
+        if (characterCulling)
+        {
+            cullCharacters();
+        }
+    }
+
+    //把这一帧的蒙皮结果写入skinnedVertexBuffer：GPU蒙皮一次dispatch，CPU蒙皮从上传缓冲拷贝
+    void recordSkinning(VkCommandBuffer commandBuffer, size_t frame)
+    {
+        VkDeviceSize skinnedSize = sizeof(SkinnedOutputVertex) * animation.getVertexCount() * characterCount;
+        VkPipelineStageFlags writeStage = gpuSkinning ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        //上一帧的场景pass读完顶点之后才能覆盖
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, writeStage, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        if (gpuSkinning)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skinningPipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, skinningPipelineLayout, 0, 1, &skinningDescriptorSets[frame], 0, nullptr);
+            vkCmdDispatch(commandBuffer, (animation.getVertexCount() + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, characterCount, 1);
+        }
+        else
+        {
+            VkBufferCopy copyRegion = {};
+            copyRegion.srcOffset = skinnedSize * frame;
+            copyRegion.dstOffset = 0;
+            copyRegion.size = skinnedSize;
+            vkCmdCopyBuffer(commandBuffer, skinningUploadBuffer, skinnedVertexBuffer, 1, &copyRegion);
+        }
+
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = gpuSkinning ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = skinnedVertexBuffer;
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = skinnedSize;
+        vkCmdPipelineBarrier(commandBuffer, writeStage, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+    }
+
+    //--------------骨骼动画---------------
+
+    //--------------场景BVH---------------
+
+    //蒙皮后的顶点是各关节矩阵作用于绑定姿势顶点的加权平均，
+    //落在绑定网格的包围盒经各个关节矩阵变换后的并集内
+    Aabb skinnedBounds(const JointMatrix* matrices, uint32_t jointCount) const
+    {
+        Aabb bounds = { { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() }, { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() } };
+        for (uint32_t joint = 0; joint < jointCount; joint++)
+        {
+            const JointMatrix& m = matrices[joint];
+            for (uint32_t corner = 0; corner < 4; corner++)
+            {
+                float x = (corner & 1) ? characterBindBounds.max[0] : characterBindBounds.min[0];
+                float y = (corner & 2) ? characterBindBounds.max[1] : characterBindBounds.min[1];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    float p = m.rows[axis][0] * x + m.rows[axis][1] * y + m.rows[axis][3];
+                    bounds.min[axis] = std::min(bounds.min[axis], p);
+                    bounds.max[axis] = std::max(bounds.max[axis], p);
+                }
+            }
+        }
+        return bounds;
+    }
+
+    //refit这一帧角色的包围盒，按所有相机剔除，可见集合变化时替换动画桶的绘制
+    void cullCharacters()
+    {
+        auto startTime = std::chrono::steady_clock::now();
+
+        uint32_t jointCount = animation.getJointCount();
+        for (uint32_t i = 0; i < characterCount; i++)
+        {
+            sceneBvh.setBounds(i, skinnedBounds(cpuJointMatrices.data() + (size_t)i * jointCount, jointCount));
+        }
+        sceneBvh.update();
+
+        std::fill(characterVisible.begin(), characterVisible.end(), (uint8_t)0);
+        for (uint32_t view = 0; view < viewCount; view++)
+        {
+            sceneBvh.cullFrustum(sceneCameras.viewProj[view], visibleObjects);
+            for (uint32_t object : visibleObjects)
+            {
+                characterVisible[object] = 1;
+            }
+        }
+
+        visibleCharacterCount = buildCharacterDraws(characterVisible, nextCharacterDraws);
+
+        bool changed = nextCharacterDraws.size() != characterDraws.size();
+        for (size_t i = 0; !changed && i < nextCharacterDraws.size(); i++)
+        {
+            changed = nextCharacterDraws[i].firstVertex != characterDraws[i].firstVertex || nextCharacterDraws[i].vertexCount != characterDraws[i].vertexCount;
+        }
+        if (changed)
+        {
+            characterDraws.swap(nextCharacterDraws);
+            updateSceneSegment(ANIMATION_BUCKET, characterDraws);
+        }
+
+        if (shadowsEnabled)
+        {
+            cullShadowCasters();
+        }
+
+        lastCullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    //角色的顶点按编号依次存放，visible中连续可见的一段是一次绘制，返回可见的角色数
+    uint32_t buildCharacterDraws(const std::vector<uint8_t>& visible, std::vector<DrawItem>& draws)
+    {
+        uint32_t vertexCount = animation.getVertexCount();
+        uint32_t visibleCount = 0;
+        draws.clear();
+        for (uint32_t i = 0; i < characterCount;)
+        {
+            if (visible[i] == 0)
+            {
+                i++;
+                continue;
+            }
+            uint32_t first = i;
+            while (i < characterCount && visible[i] != 0)
+            {
+                i++;
+            }
+            DrawItem draw = characterDrawTemplate;
+            draw.firstVertex = first * vertexCount;
+            draw.vertexCount = (i - first) * vertexCount;
+            draws.push_back(draw);
+            visibleCount += i - first;
+        }
+        return visibleCount;
+    }
+
+    //按每个级联的光源矩阵剔除角色，得到各级联动态层的绘制
+    void cullShadowCasters()
+    {
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+        {
+            //投影物在ShadowShader.vert中抬高到SHADOW_CHARACTER_HEIGHT，剔除用的矩阵先做同样的平移
+            float cullMatrix[16];
+            memcpy(cullMatrix, shadowData.lightViewProj[cascade], sizeof(cullMatrix));
+            for (int row = 0; row < 3; row++)
+            {
+                cullMatrix[12 + row] += SHADOW_CHARACTER_HEIGHT * cullMatrix[8 + row];
+            }
+            sceneBvh.cullFrustum(cullMatrix, visibleObjects);
+
+            std::fill(casterVisible.begin(), casterVisible.end(), (uint8_t)0);
+            for (uint32_t object : visibleObjects)
+            {
+                casterVisible[object] = 1;
+            }
+            buildCharacterDraws(casterVisible, cascadeCasterDraws[cascade]);
+        }
+        cascadeCastersCulled = true;
+    }
+
+    //点击拾取：单视图时把光标反投影到场景平面，沿z方向找最近的角色，并列出附近的角色
+    static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+    {
+        HelloTriangleApplication* app = (HelloTriangleApplication*)glfwGetWindowUserPointer(window);
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && app->characterCount > 0 && app->viewCount == 1 && app->replayPath.empty())
+        {
+            app->pickCharacter();
+        }
+    }
+
+    void pickCharacter()
+    {
+        double cursorX, cursorY;
+        int width, height;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &width, &height);
+        float clipX = 2.0f * (float)cursorX / (float)std::max(width, 1) - 1.0f;
+        float clipY = 2.0f * (float)cursorY / (float)std::max(height, 1) - 1.0f;
+
+        //相机只有旋转和缩放，逆矩阵是转置除以行列式
+        const float* m = sceneCameras.viewProj[0];
+        float determinant = m[0] * m[5] - m[4] * m[1];
+        float origin[3] = { (m[0] * clipX + m[1] * clipY) / determinant, (m[4] * clipX + m[5] * clipY) / determinant, -1.0f };
+        float direction[3] = { 0.0f, 0.0f, 1.0f };
+
+        uint32_t object;
+        float distance;
+        if (!sceneBvh.pick(origin, direction, 2.0f, object, distance))
+        {
+            std::cout << "pick: nothing at (" << origin[0] << ", " << origin[1] << ")" << std::endl;
+            return;
+        }
+        const float radius = 0.2f;
+        float center[3] = { origin[0], origin[1], 0.0f };
+        sceneBvh.queryProximity(center, radius, visibleObjects);
+        std::cout << "pick: character " << object << " at (" << origin[0] << ", " << origin[1] << "), " << visibleObjects.size() << " characters within " << radius << std::endl;
+    }
+
+    //--------------场景BVH---------------
+
+    //--------------级联阴影---------------
+
+    //只有深度附件的pass，深度图的每一层一个帧缓存
+    void createShadowRenderPass()
+    {
+        if (!shadowsEnabled)
+        {
+            return;
+        }
+
+        VkAttachmentDescription depthAttachment = {};
+        depthAttachment.format = SHADOW_MAP_FORMAT;
+        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;//给地面采样
+
+        VkAttachmentReference depthAttachmentRef = {};
+        depthAttachmentRef.attachment = 0;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 0;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+        //重画一层之前要等之前的帧的地面读完，写完后地面才能读
+        VkSubpassDependency dependencies[2] = {};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[0].srcAccessMask = 0;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &depthAttachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.pDependencies = dependencies;
+
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &shadowRenderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shadow render pass!");
+        }
+    }
+
+    //创建深度图数组（每个级联一个静态层和一个动态层）、每层的帧缓存、比较采样器和光源缓冲
+    void createShadowResources()
+    {
+        if (!shadowsEnabled)
+        {
+            return;
+        }
+
+        const uint32_t layerCount = 2 * SHADOW_CASCADES;
+        createImage(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_MAP_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, shadowMapImage, shadowMapImageMemory, layerCount);
+        shadowMapView = createImageView(shadowMapImage, SHADOW_MAP_FORMAT, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, layerCount);
+
+        shadowLayerViews.resize(layerCount);
+        shadowFramebuffers.resize(dynamicRendering ? 0 : layerCount);
+        for (uint32_t layer = 0; layer < layerCount; layer++)
+        {
+            shadowLayerViews[layer] = createImageView(shadowMapImage, SHADOW_MAP_FORMAT, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_VIEW_TYPE_2D, 1, layer);
+            if (dynamicRendering)
+            {
+                continue;
+            }
+
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = shadowRenderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &shadowLayerViews[layer];
+            framebufferInfo.width = SHADOW_MAP_SIZE;
+            framebufferInfo.height = SHADOW_MAP_SIZE;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &shadowFramebuffers[layer]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create shadow framebuffer!");
+            }
+        }
+
+        //深度比较采样器，texture()直接返回比较结果；深度图之外是白色边界，视为照亮
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.compareEnable = VK_TRUE;
+        samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = 0.0f;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &shadowSampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shadow sampler!");
+        }
+
+        //光源矩阵只在光源变化时由主指令缓存中的vkCmdUpdateBuffer写入，放在设备本地的显存中
+        createBuffer(sizeof(ShadowBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Uniform, shadowBuffer, shadowBufferMemory);
+        updateShadowLight(SHADOW_LIGHT_AZIMUTH);
+    }
+
+    void destroyShadowResources()
+    {
+        if (!shadowsEnabled)
+        {
+            return;
+        }
+
+        for (auto framebuffer : shadowFramebuffers)
+        {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for (auto view : shadowLayerViews)
+        {
+            vkDestroyImageView(device, view, nullptr);
+        }
+        vkDestroyImageView(device, shadowMapView, nullptr);
+        vkDestroyImage(device, shadowMapImage, nullptr);
+        residency.free(shadowMapImageMemory);
+        vkDestroySampler(device, shadowSampler, nullptr);
+        vkDestroyBuffer(device, shadowBuffer, nullptr);
+        residency.free(shadowBufferMemory);
+        vkDestroyPipeline(device, shadowPipeline, nullptr);
+        vkDestroyPipeline(device, groundPipeline, nullptr);
+        if (!dynamicRendering)
+        {
+            vkDestroyRenderPass(device, shadowRenderPass, nullptr);
+        }
+    }
+
+    //相机看到的地面：所有视图中心的平均作为级联的中心，从中心到所有视图四个角最远的距离作为可见半径。
+    //相机是地面上的正交投影（见buildCameraMatrix），裁剪空间的点解回地面只需要2x2矩阵的逆
+    void computeShadowFocus(float focus[2], float& visibleRadius) const
+    {
+        auto toGround = [](const float* m, float clipX, float clipY, float ground[2])
+        {
+            float a = clipX - m[12];
+            float b = clipY - m[13];
+            float determinant = m[0] * m[5] - m[4] * m[1];
+            ground[0] = (m[5] * a - m[4] * b) / determinant;
+            ground[1] = (m[0] * b - m[1] * a) / determinant;
+        };
+
+        focus[0] = 0.0f;
+        focus[1] = 0.0f;
+        for (uint32_t view = 0; view < viewCount; view++)
+        {
+            float center[2];
+            toGround(sceneCameras.viewProj[view], 0.0f, 0.0f, center);
+            focus[0] += center[0] / (float)viewCount;
+            focus[1] += center[1] / (float)viewCount;
+        }
+
+        visibleRadius = 0.0f;
+        for (uint32_t view = 0; view < viewCount; view++)
+        {
+            for (uint32_t corner = 0; corner < 4; corner++)
+            {
+                float point[2];
+                toGround(sceneCameras.viewProj[view], (corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, point);
+                visibleRadius = std::max(visibleRadius, std::hypot(point[0] - focus[0], point[1] - focus[1]));
+            }
+        }
+    }
+
+    //光源转到azimuth时每个级联的正交投影，列主序。级联是以相机看到的地面的中心为圆心的圆，半径按SHADOW_CASCADE_SPLITS划分可见半径；
+    //投影的中心对齐到深度图的像素，相机平移时阴影的边缘不会闪烁。相机变化时也要重新调用
+    void updateShadowLight(float azimuth)
+    {
+        float cosElevation = std::cos(SHADOW_LIGHT_ELEVATION);
+        float sinElevation = std::sin(SHADOW_LIGHT_ELEVATION);
+        //光线前进的方向，以及光源视角的右方和上方（右方是水平的）
+        float forward[3] = { -std::cos(azimuth) * cosElevation, -std::sin(azimuth) * cosElevation, -sinElevation };
+        float right[3] = { forward[1] / cosElevation, -forward[0] / cosElevation, 0.0f };
+        float up[3] = { right[1] * forward[2] - right[2] * forward[1], right[2] * forward[0] - right[0] * forward[2], right[0] * forward[1] - right[1] * forward[0] };
+
+        float focus[2];
+        float visibleRadius;
+        computeShadowFocus(focus, visibleRadius);
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+        {
+            //对齐之后覆盖的范围最多偏移一个像素，投影的范围比级联多留两个像素
+            float coverRadius = SHADOW_CASCADE_SPLITS[cascade] * visibleRadius;
+            float texel = 2.0f * coverRadius / (float)(SHADOW_MAP_SIZE - 4);
+            float radius = coverRadius + 2.0f * texel;
+            float centerU = std::floor((focus[0] * right[0] + focus[1] * right[1]) / texel) * texel;
+            float centerV = std::floor((focus[0] * up[0] + focus[1] * up[1]) / texel) * texel;
+            float centerDepth = focus[0] * forward[0] + focus[1] * forward[1];
+            //覆盖半径内的地面和它上方最高的投影物
+            float halfDepth = (radius + SHADOW_MAX_HEIGHT) / sinElevation;
+
+            float* m = shadowData.lightViewProj[cascade];
+            m[0] = right[0] / radius;   m[1] = up[0] / radius;   m[2] = forward[0] / (2.0f * halfDepth);   m[3] = 0.0f;
+            m[4] = right[1] / radius;   m[5] = up[1] / radius;   m[6] = forward[1] / (2.0f * halfDepth);   m[7] = 0.0f;
+            m[8] = right[2] / radius;   m[9] = up[2] / radius;   m[10] = forward[2] / (2.0f * halfDepth);  m[11] = 0.0f;
+            m[12] = -centerU / radius;  m[13] = -centerV / radius;  m[14] = (halfDepth - centerDepth) / (2.0f * halfDepth);  m[15] = 1.0f;
+
+            shadowData.cascadeRadius[cascade] = coverRadius;
+        }
+        for (uint32_t i = SHADOW_CASCADES; i < 4; i++)
+        {
+            shadowData.cascadeRadius[i] = 0.0f;
+        }
+        memcpy(shadowData.groundColor, SHADOW_GROUND_COLOR, sizeof(shadowData.groundColor));
+        shadowData.focus[0] = focus[0];
+        shadowData.focus[1] = focus[1];
+        shadowData.focus[2] = 0.0f;
+        shadowData.focus[3] = 0.0f;
+        lightVersion++;
+    }
+
+    //阴影的两条管线：只写深度的变体（场景的顶点格式，只读位置）和画地面的全屏三角形，都使用场景管线的布局
+    void createShadowPipelines()
+    {
+        VkShaderModule shadowVertModule = startupShaderModules[SHADER_SHADOW_VERT];
+        VkShaderModule groundVertModule = startupShaderModules[SHADER_GROUND_VERT];
+        VkShaderModule groundFragModule = startupShaderModules[SHADER_GROUND_FRAG];
+
+        //地面与场景在同一个pass中，特化常量相同
+        SpecializationConstants<SceneShaderVariant> specialization(makeSceneShaderVariant(viewCount, debugView));
+
+        VkPipelineShaderStageCreateInfo shadowStage = {};
+        shadowStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shadowStage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shadowStage.module = shadowVertModule;
+        shadowStage.pName = "main";
+
+        VkPipelineShaderStageCreateInfo groundStages[2] = {};
+        groundStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        groundStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        groundStages[0].module = groundVertModule;
+        groundStages[0].pName = "main";
+        groundStages[0].pSpecializationInfo = specialization.get();
+        groundStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        groundStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        groundStages[1].module = groundFragModule;
+        groundStages[1].pName = "main";
+        groundStages[1].pSpecializationInfo = specialization.get();
+
+        //深度管线只读顶点的位置
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        VkPipelineVertexInputStateCreateInfo shadowVertexInput = {};
+        shadowVertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        shadowVertexInput.vertexBindingDescriptionCount = 1;
+        shadowVertexInput.pVertexBindingDescriptions = &bindingDescription;
+        shadowVertexInput.vertexAttributeDescriptionCount = 1;
+        shadowVertexInput.pVertexAttributeDescriptions = &attributeDescriptions[0];
+
+        //地面的顶点由gl_VertexIndex生成
+        VkPipelineVertexInputStateCreateInfo groundVertexInput = {};
+        groundVertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        //深度图的大小固定，视口是静态的；地面与场景一样按渲染分辨率动态设置
+        VkViewport shadowViewport = {};
+        shadowViewport.width = (float)SHADOW_MAP_SIZE;
+        shadowViewport.height = (float)SHADOW_MAP_SIZE;
+        shadowViewport.minDepth = 0.0f;
+        shadowViewport.maxDepth = 1.0f;
+        VkRect2D shadowScissor = {};
+        shadowScissor.extent = { SHADOW_MAP_SIZE, SHADOW_MAP_SIZE };
+
+        VkPipelineViewportStateCreateInfo shadowViewportState = {};
+        shadowViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        shadowViewportState.viewportCount = 1;
+        shadowViewportState.pViewports = &shadowViewport;
+        shadowViewportState.scissorCount = 1;
+        shadowViewportState.pScissors = &shadowScissor;
+
+        VkPipelineViewportStateCreateInfo groundViewportState = {};
+        groundViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        groundViewportState.viewportCount = 1;
+        groundViewportState.scissorCount = 1;
+
+        //光源视角下三角形的朝向会翻转，两面都画
+        VkPipelineRasterizationStateCreateInfo rasterize = {};
+        rasterize.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterize.depthClampEnable = VK_FALSE;
+        rasterize.rasterizerDiscardEnable = VK_FALSE;
+        rasterize.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterize.lineWidth = 1.0f;
+        rasterize.cullMode = VK_CULL_MODE_NONE;
+        rasterize.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterize.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        //深度管线：深度测试和写入，没有颜色附件
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo shadowColorBlend = {};
+        shadowColorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        shadowColorBlend.attachmentCount = 0;
+
+        //地面覆盖整个渲染区域，不混合
+        VkPipelineColorBlendAttachmentState groundBlendAttachment = {};
+        groundBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_R_BIT;
+        groundBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo groundColorBlend = {};
+        groundColorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        groundColorBlend.logicOpEnable = VK_FALSE;
+        groundColorBlend.logicOp = VK_LOGIC_OP_COPY;
+        groundColorBlend.attachmentCount = 1;
+        groundColorBlend.pAttachments = &groundBlendAttachment;
+
+        VkDynamicState dynamicStates[] =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+        };
+        VkPipelineDynamicStateCreateInfo dynamicState = {};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfos[2] = {};
+        pipelineInfos[0].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfos[0].stageCount = 1;
+        pipelineInfos[0].pStages = &shadowStage;
+        pipelineInfos[0].pVertexInputState = &shadowVertexInput;
+        pipelineInfos[0].pInputAssemblyState = &inputAssembly;
+        pipelineInfos[0].pViewportState = &shadowViewportState;
+        pipelineInfos[0].pRasterizationState = &rasterize;
+        pipelineInfos[0].pMultisampleState = &multisampling;
+        pipelineInfos[0].pDepthStencilState = &depthStencil;
+        pipelineInfos[0].pColorBlendState = &shadowColorBlend;
+        pipelineInfos[0].pDynamicState = nullptr;
+        pipelineInfos[0].layout = pipelineLayout;
+        VkPipelineRenderingCreateInfoKHR renderingInfos[2];
+        setPipelineTarget(pipelineInfos[0], renderingInfos[0], shadowRenderPass, nullptr, SHADOW_MAP_FORMAT, 0);
+        pipelineInfos[0].basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfos[0].basePipelineIndex = -1;
+
+        pipelineInfos[1].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfos[1].stageCount = 2;
+        pipelineInfos[1].pStages = groundStages;
+        pipelineInfos[1].pVertexInputState = &groundVertexInput;
+        pipelineInfos[1].pInputAssemblyState = &inputAssembly;
+        pipelineInfos[1].pViewportState = &groundViewportState;
+        pipelineInfos[1].pRasterizationState = &rasterize;
+        pipelineInfos[1].pMultisampleState = &multisampling;
+        pipelineInfos[1].pDepthStencilState = nullptr;
+        pipelineInfos[1].pColorBlendState = &groundColorBlend;
+        pipelineInfos[1].pDynamicState = &dynamicState;
+        pipelineInfos[1].layout = pipelineLayout;
+        setPipelineTarget(pipelineInfos[1], renderingInfos[1], renderPass, &SCENE_COLOR_FORMAT, VK_FORMAT_UNDEFINED, sceneViewMask());
+        pipelineInfos[1].basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfos[1].basePipelineIndex = -1;
+
+        VkPipeline pipelines[2];
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 2, pipelineInfos, nullptr, pipelines) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shadow pipelines!");
+        }
+        shadowPipeline = pipelines[0];
+        groundPipeline = pipelines[1];
+    }
+
+    //录制这一帧的阴影：光源变化时写入光源矩阵，按需重画静态层，重画动态层
+    void recordShadows(VkCommandBuffer commandBuffer)
+    {
+        auto barrier = [commandBuffer](VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+        {
+            VkMemoryBarrier memoryBarrier = {};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = srcAccess;
+            memoryBarrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        };
+        const VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+        //之前的帧读完光源矩阵之后才能覆盖
+        if (uploadedLightVersion != lightVersion)
+        {
+            barrier(shaderStages, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            vkCmdUpdateBuffer(commandBuffer, shadowBuffer, 0, sizeof(ShadowBufferObject), &shadowData);
+            barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, shaderStages, VK_ACCESS_UNIFORM_READ_BIT);
+            uploadedLightVersion = lightVersion;
+        }
+
+        //静态层：光源或静态桶的绘制变化之后才重画，其余的帧直接采样缓存
+        const CommandSegment& staticSegment = sceneSegments[SHADOW_STATIC_BUCKET];
+        bool staticDirty = cachedLightVersion != lightVersion || cachedStaticVersion != staticSegment.version;
+
+        //动态层：动画角色每帧都在动，清除后重画；没有角色时清空一次之后不再处理。
+        //角色按每个级联的光源范围剔除（cullShadowCasters），没有剔除时每个级联都画动画桶的全部绘制
+        const DrawItem* dynamicCasters[SHADOW_CASCADES] = {};
+        size_t dynamicCounts[SHADOW_CASCADES] = {};
+        size_t dynamicCount = 0;
+        if (characterCount > 0 && ANIMATION_BUCKET < sceneSegments.size())
+        {
+            for (uint32_t cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+            {
+                const std::vector<DrawItem>& casters = cascadeCastersCulled ? cascadeCasterDraws[cascade] : sceneSegments[ANIMATION_BUCKET].draws;
+                dynamicCasters[cascade] = casters.data();
+                dynamicCounts[cascade] = casters.size();
+                dynamicCount += casters.size();
+            }
+        }
+        bool dynamicDirty = dynamicCount > 0 || !dynamicLayersEmpty;
+
+        for (uint32_t cascade = 0; cascade < SHADOW_CASCADES; cascade++)
+        {
+            if (staticDirty)
+            {
+                recordShadowLayer(commandBuffer, cascade, cascade, staticSegment.draws.data(), staticSegment.draws.size(), SHADOW_STATIC_HEIGHT);
+            }
+            if (dynamicDirty)
+            {
+                recordShadowLayer(commandBuffer, cascade, SHADOW_CASCADES + cascade, dynamicCasters[cascade], dynamicCounts[cascade], SHADOW_CHARACTER_HEIGHT);
+            }
+        }
+
+        if (staticDirty)
+        {
+            cachedLightVersion = lightVersion;
+            cachedStaticVersion = staticSegment.version;
+            staticShadowRedraws++;
+        }
+        dynamicLayersEmpty = dynamicCount == 0;
+        dynamicShadowDraws = (uint32_t)dynamicCount;
+    }
+
+    //把投影物按给定的高度画进深度图的一层，没有投影物时只清除
+    void recordShadowLayer(VkCommandBuffer commandBuffer, uint32_t cascade, uint32_t layer, const DrawItem* casters, size_t casterCount, float height)
+    {
+        beginShadowRendering(commandBuffer, layer);
+        if (casterCount > 0)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &sceneDescriptorSet, 0, nullptr);
+
+            ShadowPushConstants pushConstants = { cascade, height };
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &pushConstants);
+
+            VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+            for (size_t i = 0; i < casterCount; i++)
+            {
+                const DrawItem& draw = casters[i];
+                //间接绘制的是粒子，不投影
+                if (draw.indirectBuffer != VK_NULL_HANDLE)
+                {
+                    continue;
+                }
+                if (draw.vertexBuffer != boundVertexBuffer)
+                {
+                    VkDeviceSize offset = 0;
+                    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &offset);
+                    boundVertexBuffer = draw.vertexBuffer;
+                }
+                vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+            }
+        }
+        endShadowRendering(commandBuffer, layer);
+    }
+
+    //--------------级联阴影---------------
+
+    //--------------后处理---------------
+
+    //泛光的图像、后处理的输出、状态缓冲和描述符集。泛光按离屏目标分配，之后调整分辨率不需要重新创建
+    void createPostResources()
+    {
+        if (!postProcessing)
+        {
+            return;
+        }
+
+        //第0级是半分辨率；宽高先对齐到最后一级的2x2块，每一级都放得下降采样写出的有效区域
+        uint32_t alignment = 1u << BLOOM_LEVELS;
+        uint32_t bloomWidth = (sceneExtent.width + alignment - 1) / alignment * alignment / 2;
+        uint32_t bloomHeight = (sceneExtent.height + alignment - 1) / alignment * alignment / 2;
+        createImage(bloomWidth, bloomHeight, BLOOM_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, bloomImage, bloomImageMemory, viewCount, ResidencyManager::NOT_EVICTABLE, BLOOM_LEVELS);
+        bloomView = createImageView(bloomImage, BLOOM_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, viewCount, 0, 0, BLOOM_LEVELS);
+        for (uint32_t level = 0; level < BLOOM_LEVELS; level++)
+        {
+            bloomLevelViews[level] = createImageView(bloomImage, BLOOM_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, viewCount, 0, level);
+        }
+
+        createImage(sceneExtent.width, sceneExtent.height, POST_OUTPUT_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, postOutputImage, postOutputImageMemory, viewCount);
+        postOutputView = createImageView(postOutputImage, POST_OUTPUT_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, viewCount);
+
+        createBuffer(sizeof(PostState), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, postStateBuffer, postStateBufferMemory);
+
+        //合成时在泛光的各级之间双线性采样
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = (float)BLOOM_LEVELS;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &postSampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create post sampler!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &postDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &postDescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate post descriptor set!");
+        }
+
+        //存储图像都保持GENERAL布局；场景在pass结束时已经是SHADER_READ_ONLY
+        VkDescriptorImageInfo sceneInfo = {};
+        sceneInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        sceneInfo.imageView = sceneColorImageView;
+        sceneInfo.sampler = postSampler;
+
+        VkDescriptorImageInfo levelInfos[BLOOM_LEVELS] = {};
+        for (uint32_t level = 0; level < BLOOM_LEVELS; level++)
+        {
+            levelInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            levelInfos[level].imageView = bloomLevelViews[level];
+        }
+
+        VkDescriptorImageInfo bloomInfo = {};
+        bloomInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        bloomInfo.imageView = bloomView;
+        bloomInfo.sampler = postSampler;
+
+        VkDescriptorImageInfo outputInfo = {};
+        outputInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        outputInfo.imageView = postOutputView;
+
+        VkDescriptorBufferInfo stateInfo = {};
+        stateInfo.buffer = postStateBuffer;
+        stateInfo.offset = 0;
+        stateInfo.range = sizeof(PostState);
+
+        VkWriteDescriptorSet descriptorWrites[5] = {};
+        for (uint32_t binding = 0; binding < 5; binding++)
+        {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = postDescriptorSet;
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorCount = 1;
+        }
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].pImageInfo = &sceneInfo;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[1].descriptorCount = BLOOM_LEVELS;
+        descriptorWrites[1].pImageInfo = levelInfos;
+        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[2].pImageInfo = &bloomInfo;
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[3].pImageInfo = &outputInfo;
+        descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[4].pBufferInfo = &stateInfo;
+        vkUpdateDescriptorSets(device, 5, descriptorWrites, 0, nullptr);
+
+        lastPostUpdate = std::chrono::steady_clock::now();
+    }
+
+    void destroyPostResources()
+    {
+        if (!postProcessing)
+        {
+            return;
+        }
+
+        for (uint32_t pass = 0; pass < POST_PASS_COUNT; pass++)
+        {
+            vkDestroyPipeline(device, postPipelines[pass], nullptr);
+        }
+        vkDestroyPipelineLayout(device, postPipelineLayout, nullptr);
+        vkDestroySampler(device, postSampler, nullptr);
+        vkDestroyBuffer(device, postStateBuffer, nullptr);
+        residency.free(postStateBufferMemory);
+        vkDestroyImageView(device, postOutputView, nullptr);
+        vkDestroyImage(device, postOutputImage, nullptr);
+        residency.free(postOutputImageMemory);
+        for (uint32_t level = 0; level < BLOOM_LEVELS; level++)
+        {
+            vkDestroyImageView(device, bloomLevelViews[level], nullptr);
+        }
+        vkDestroyImageView(device, bloomView, nullptr);
+        vkDestroyImage(device, bloomImage, nullptr);
+        residency.free(bloomImageMemory);
+    }
+
+    //降采样和合成来自同一个着色器模块，按特化常量编译成两条管线
+    void createPostPipelines()
+    {
+        VkShaderModule computeModule = startupShaderModules[SHADER_POST_COMP];
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PostPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &postDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &postPipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create post pipeline layout!");
+        }
+
+        SpecializationConstants<PostShaderVariant> downsampleSpecialization({ 0 });
+        SpecializationConstants<PostShaderVariant> compositeSpecialization({ 1 });
+        const VkSpecializationInfo* specializations[POST_PASS_COUNT] = { downsampleSpecialization.get(), compositeSpecialization.get() };
+
+        VkComputePipelineCreateInfo computePipelineInfos[POST_PASS_COUNT] = {};
+        for (uint32_t pass = 0; pass < POST_PASS_COUNT; pass++)
+        {
+            computePipelineInfos[pass].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            computePipelineInfos[pass].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            computePipelineInfos[pass].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            computePipelineInfos[pass].stage.module = computeModule;
+            computePipelineInfos[pass].stage.pName = "main";
+            computePipelineInfos[pass].stage.pSpecializationInfo = specializations[pass];
+            computePipelineInfos[pass].layout = postPipelineLayout;
+            computePipelineInfos[pass].basePipelineHandle = VK_NULL_HANDLE;
+            computePipelineInfos[pass].basePipelineIndex = -1;
+        }
+
+        if (vkCreateComputePipelines(device, pipelineCache, POST_PASS_COUNT, computePipelineInfos, nullptr, postPipelines) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create post compute pipelines!");
+        }
+    }
+
+    //录制这一帧的后处理：降采样 -> 合成。只处理离屏目标中renderExtent大小的区域，
+    //测光的累加值按帧的奇偶交替，清零这一帧的那一个时上一帧的合成可能还在读另一个
+    void recordPostProcessing(VkCommandBuffer commandBuffer)
+    {
+        auto now = std::chrono::steady_clock::now();
+        float deltaTime = std::min(std::chrono::duration<float>(now - lastPostUpdate).count(), 0.1f);
+        lastPostUpdate = now;
+
+        uint32_t parity = postFrame++ & 1;
+        uint32_t levelWidth = (renderExtent.width + 1) / 2;
+        uint32_t levelHeight = (renderExtent.height + 1) / 2;
+
+        PostPushConstants pushConstants = {};
+        pushConstants.renderSize[0] = (int32_t)renderExtent.width;
+        pushConstants.renderSize[1] = (int32_t)renderExtent.height;
+        pushConstants.parity = parity;
+        pushConstants.luminanceCount = levelWidth * levelHeight * viewCount;
+        pushConstants.deltaTime = deltaTime;
+
+        auto barrier = [commandBuffer](VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+        {
+            VkMemoryBarrier memoryBarrier = {};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = srcAccess;
+            memoryBarrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        };
+        const VkAccessFlags computeAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        //第一次使用前把泛光和输出转换到GENERAL（之后一直保持），清零曝光和累加值
+        if (!postImagesInitialized)
+        {
+            VkImageMemoryBarrier imageBarriers[2] = {};
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                imageBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageBarriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                imageBarriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+                imageBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                imageBarriers[i].subresourceRange.baseMipLevel = 0;
+                imageBarriers[i].subresourceRange.baseArrayLayer = 0;
+                imageBarriers[i].subresourceRange.layerCount = viewCount;
+                imageBarriers[i].srcAccessMask = 0;
+                imageBarriers[i].dstAccessMask = computeAccess;
+            }
+            imageBarriers[0].image = bloomImage;
+            imageBarriers[0].subresourceRange.levelCount = BLOOM_LEVELS;
+            imageBarriers[1].image = postOutputImage;
+            imageBarriers[1].subresourceRange.levelCount = 1;
+
+            vkCmdFillBuffer(commandBuffer, postStateBuffer, 0, VK_WHOLE_SIZE, 0);
+
+            VkMemoryBarrier fillBarrier = {};
+            fillBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            fillBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            fillBarrier.dstAccessMask = computeAccess;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fillBarrier, 0, nullptr, 2, imageBarriers);
+            postImagesInitialized = true;
+        }
+
+        //这一帧的累加值：上一次用它的合成读完之后清零
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+        vkCmdFillBuffer(commandBuffer, postStateBuffer, offsetof(PostState, luminanceSum) + parity * sizeof(uint32_t), sizeof(uint32_t), 0);
+
+        //清零完成之后才能累加；上一帧的合成和放大pass读完泛光和输出之后才能覆盖
+        barrier(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeAccess);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postPipelineLayout, 0, 1, &postDescriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, postPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostPushConstants), &pushConstants);
+
+        //降采样：一个工作组覆盖第0级的一个块，即全分辨率的两倍块大小
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postPipelines[0]);
+        vkCmdDispatch(commandBuffer, (levelWidth + POST_TILE_SIZE - 1) / POST_TILE_SIZE, (levelHeight + POST_TILE_SIZE - 1) / POST_TILE_SIZE, viewCount);
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeAccess);
+
+        //合成：每个线程一个全分辨率像素
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postPipelines[1]);
+        vkCmdDispatch(commandBuffer, (renderExtent.width + POST_TILE_SIZE - 1) / POST_TILE_SIZE, (renderExtent.height + POST_TILE_SIZE - 1) / POST_TILE_SIZE, viewCount);
+
+        //放大pass采样输出
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    //--------------后处理---------------
+
+    //--------------性能HUD---------------
+
+    //每个帧槽一个主机可见的顶点缓冲，一直映射，HUD直接把顶点写进去
+    void createHudResources()
+    {
+        VkDeviceSize bufferSize = sizeof(HudVertex) * PerfHud::VERTICES_PER_QUAD * HUD_MAX_QUADS;
+        hudVertexBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        hudVertexBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        hudVerticesMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Geometry, hudVertexBuffers[i], hudVertexBuffersMemory[i]);
+            void* mapped;
+            vkMapMemory(device, hudVertexBuffersMemory[i], 0, bufferSize, 0, &mapped);
+            hudVerticesMapped[i] = (HudVertex*)mapped;
+        }
+    }
+
+    void destroyHudResources()
+    {
+        for (size_t i = 0; i < hudVertexBuffers.size(); i++)
+        {
+            vkDestroyBuffer(device, hudVertexBuffers[i], nullptr);
+            residency.free(hudVertexBuffersMemory[i]);
+        }
+        vkDestroyPipeline(device, hudPipeline, nullptr);
+        vkDestroyPipelineLayout(device, hudPipelineLayout, nullptr);
+    }
+
+    //文字和矩形的管线：按alpha混合到交换链图像，视口固定为交换链大小
+    void createHudPipeline()
+    {
+        VkShaderModule hudVertModule = startupShaderModules[SHADER_HUD_VERT];
+        VkShaderModule hudFragModule = startupShaderModules[SHADER_HUD_FRAG];
+
+        VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo = {};
+        vertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageCreateInfo.module = hudVertModule;
+        vertShaderStageCreateInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragShaderStageCreateInfo = {};
+        fragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageCreateInfo.module = hudFragModule;
+        fragShaderStageCreateInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageCreateInfo , fragShaderStageCreateInfo };
+
+        //顶点属性，对应HudShader.vert中的location
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(HudVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkVertexInputAttributeDescription attributeDescriptions[4] = {};
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(HudVertex, position);
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(HudVertex, cell);
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[2].offset = offsetof(HudVertex, glyph);
+        attributeDescriptions[3].location = 3;
+        attributeDescriptions[3].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[3].offset = offsetof(HudVertex, color);
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = 4;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        VkViewport viewPort = {};
+        viewPort.x = 0.0f;
+        viewPort.y = 0.0f;
+        viewPort.width = (float)swapChainExtent.width;
+        viewPort.height = (float)swapChainExtent.height;
+        viewPort.minDepth = 0.0f;
+        viewPort.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0,0 };
+        scissor.extent = swapChainExtent;
+
+        VkPipelineViewportStateCreateInfo viewportState = {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewPort;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterize = {};
+        rasterize.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterize.depthClampEnable = VK_FALSE;
+        rasterize.rasterizerDiscardEnable = VK_FALSE;
+        rasterize.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterize.lineWidth = 1.0f;
+        rasterize.cullMode = VK_CULL_MODE_NONE;
+        rasterize.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterize.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        //面板半透明，字形点阵外的片段alpha为0
+        VkPipelineColorBlendAttachmentState colorBlendAttachmen = {};
+        colorBlendAttachmen.colorWriteMask = VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_R_BIT;
+        colorBlendAttachmen.blendEnable = VK_TRUE;
+        colorBlendAttachmen.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        colorBlendAttachmen.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colorBlendAttachmen.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachmen.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachmen.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachmen.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colorBlend = {};
+        colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlend.logicOpEnable = VK_FALSE;
+        colorBlend.logicOp = VK_LOGIC_OP_COPY;
+        colorBlend.attachmentCount = 1;
+        colorBlend.pAttachments = &colorBlendAttachmen;
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(HudPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 0;
+        pipelineLayoutInfo.pSetLayouts = nullptr;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &hudPipelineLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create hud pipeline layout!");
+        }
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterize;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = nullptr;
+        pipelineInfo.pColorBlendState = &colorBlend;
+        pipelineInfo.pDynamicState = nullptr;
+        pipelineInfo.layout = hudPipelineLayout;
+        VkPipelineRenderingCreateInfoKHR renderingInfo;
+        setPipelineTarget(pipelineInfo, renderingInfo, upscaleRenderPass, &swapChainImageFormat, VK_FORMAT_UNDEFINED, 0);
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &hudPipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create hud pipeline!");
+        }
+    }
+
+    //收集这一帧的统计，生成HUD的顶点并绘制，在放大pass中调用
+    void recordHud(VkCommandBuffer commandBuffer)
+    {
+        auto hudStart = std::chrono::steady_clock::now();
+
+        HudStats stats = {};
+        stats.cpuMs = lastCpuFrameMs;
+        stats.hudMs = lastHudMs;
+        stats.renderWidth = renderExtent.width;
+        stats.renderHeight = renderExtent.height;
+        stats.renderScale = renderScale;
+        stats.segmentsRecorded = segmentsRecordedLastFrame;
+        stats.segmentCount = (uint32_t)sceneSegments.size();
+
+        //没有管线统计时按直接绘制的顶点数估计三角形数，间接绘制（粒子）的数量只在GPU上
+        uint64_t directTriangles = 0;
+        for (const auto& segment : sceneSegments)
+        {
+            stats.drawCount += (uint32_t)segment.draws.size();
+            stats.stateChanges += segment.stateChanges;
+            for (const auto& draw : segment.draws)
+            {
+                if (draw.indirectBuffer == VK_NULL_HANDLE)
+                {
+                    directTriangles += (uint64_t)draw.vertexCount / 3 * draw.instanceCount;
+                }
+            }
+        }
+        stats.trianglesMeasured = pipelineStatisticsSupported;
+        stats.triangles = pipelineStatisticsSupported ? lastPassStatistics[STATISTICS_SCENE_PASS].clippingPrimitives : directTriangles * viewCount;
+        residency.getDeviceLocalUsage(stats.memoryUsage, stats.memoryBudget);
+
+        uint32_t vertexCount = hud.build(stats, TARGET_GPU_FRAME_MS, hudVerticesMapped[currentFrame], PerfHud::VERTICES_PER_QUAD * HUD_MAX_QUADS);
+
+        HudPushConstants pushConstants = {};
+        pushConstants.pixelToClip[0] = 2.0f / (float)swapChainExtent.width;
+        pushConstants.pixelToClip[1] = 2.0f / (float)swapChainExtent.height;
+
+        VkDeviceSize offset = 0;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, hudPipeline);
+        vkCmdPushConstants(commandBuffer, hudPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(HudPushConstants), &pushConstants);
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &hudVertexBuffers[currentFrame], &offset);
+        vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+
+        lastHudMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - hudStart).count();
+    }
+
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+    {
+        HelloTriangleApplication* app = (HelloTriangleApplication*)glfwGetWindowUserPointer(window);
+        if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+        {
+            app->hudVisible = !app->hudVisible;
+        }
+    }
+    //--------------性能HUD---------------
+
+    //--------------GPU粒子---------------
+
+    //创建粒子缓冲、压缩输出缓冲和计数缓冲，都只在GPU上使用
+    void createParticleResources()
+    {
+        if (particleCapacity == 0)
+        {
+            return;
+        }
+
+        VkDeviceSize particleSize = sizeof(Particle) * particleCapacity;
+        createBuffer(particleSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, particleBuffer, particleBufferMemory);
+        createBuffer(particleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, particleCompactBuffer, particleCompactBufferMemory);
+        createBuffer(sizeof(ParticleState), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, particleStateBuffer, particleStateBufferMemory);
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &particleDescriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &particleDescriptorSet) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate particle descriptor set!");
+        }
+
+        VkDescriptorBufferInfo bufferInfos[3] = {};
+        bufferInfos[0].buffer = particleBuffer;
+        bufferInfos[0].offset = 0;
+        bufferInfos[0].range = particleSize;
+        bufferInfos[1].buffer = particleCompactBuffer;
+        bufferInfos[1].offset = 0;
+        bufferInfos[1].range = particleSize;
+        bufferInfos[2].buffer = particleStateBuffer;
+        bufferInfos[2].offset = 0;
+        bufferInfos[2].range = sizeof(ParticleState);
+
+        VkWriteDescriptorSet descriptorWrites[3] = {};
+        for (uint32_t binding = 0; binding < 3; binding++)
+        {
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = particleDescriptorSet;
+            descriptorWrites[binding].dstBinding = binding;
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(device, 3, descriptorWrites, 0, nullptr);
+
+        lastParticleUpdate = std::chrono::steady_clock::now();
+    }
+
+    void destroyParticleResources()
+    {
+        if (particleCapacity == 0)
+        {
+            return;
+        }
+
+        vkDestroyBuffer(device, particleBuffer, nullptr);
+        residency.free(particleBufferMemory);
+        vkDestroyBuffer(device, particleCompactBuffer, nullptr);
+        residency.free(particleCompactBufferMemory);
+        vkDestroyBuffer(device, particleStateBuffer, nullptr);
+        residency.free(particleStateBufferMemory);
+        for (uint32_t pass = 0; pass < PARTICLE_PASS_COUNT; pass++)
+        {
+            vkDestroyPipeline(device, particleComputePipelines[pass], nullptr);
+        }
+        vkDestroyPipeline(device, particlePipeline, nullptr);
+        vkDestroyPipelineLayout(device, particleComputeLayout, nullptr);
+    }
+
+    //四个计算阶段来自同一个着色器模块，按特化常量编译成四条管线
+    void createParticleComputePipelines()
+    {
+        VkShaderModule computeModule = startupShaderModules[SHADER_PARTICLE_COMP];
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(ParticlePushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &particleDescriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &particleComputeLayout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create particle pipeline layout!");
+        }
+
+        SpecializationConstants<ParticleShaderVariant> prepareSpecialization({ 0, particleCapacity });
+        SpecializationConstants<ParticleShaderVariant> simulateSpecialization({ 1, particleCapacity });
+        SpecializationConstants<ParticleShaderVariant> finishSpecialization({ 2, particleCapacity });
+        SpecializationConstants<ParticleShaderVariant> copySpecialization({ 3, particleCapacity });
+        const VkSpecializationInfo* specializations[PARTICLE_PASS_COUNT] = { prepareSpecialization.get(), simulateSpecialization.get(), finishSpecialization.get(), copySpecialization.get() };
+
+        VkComputePipelineCreateInfo computePipelineInfos[PARTICLE_PASS_COUNT] = {};
+        for (uint32_t pass = 0; pass < PARTICLE_PASS_COUNT; pass++)
+        {
+            computePipelineInfos[pass].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            computePipelineInfos[pass].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            computePipelineInfos[pass].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            computePipelineInfos[pass].stage.module = computeModule;
+            computePipelineInfos[pass].stage.pName = "main";
+            computePipelineInfos[pass].stage.pSpecializationInfo = specializations[pass];
+            computePipelineInfos[pass].layout = particleComputeLayout;
+            computePipelineInfos[pass].basePipelineHandle = VK_NULL_HANDLE;
+            computePipelineInfos[pass].basePipelineIndex = -1;
+        }
+
+        if (vkCreateComputePipelines(device, pipelineCache, PARTICLE_PASS_COUNT, computePipelineInfos, nullptr, particleComputePipelines) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create particle compute pipelines!");
+        }
+    }
+
+    //绘制粒子的图形管线，与场景管线共用布局、pass和特化常量，在场景管线之后创建
+    void createParticlePipeline()
+    {
+        VkShaderModule particleVertModule = startupShaderModules[SHADER_PARTICLE_VERT];
+        VkShaderModule particleFragModule = startupShaderModules[SHADER_PARTICLE_FRAG];
+
+        SpecializationConstants<SceneShaderVariant> specialization(makeSceneShaderVariant(viewCount, debugView));
+
+        VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo = {};
+        vertShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageCreateInfo.module = particleVertModule;
+        vertShaderStageCreateInfo.pName = "main";
+        vertShaderStageCreateInfo.pSpecializationInfo = specialization.get();
+
+        VkPipelineShaderStageCreateInfo fragShaderStageCreateInfo = {};
+        fragShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageCreateInfo.module = particleFragModule;
+        fragShaderStageCreateInfo.pName = "main";
+        fragShaderStageCreateInfo.pSpecializationInfo = specialization.get();
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageCreateInfo , fragShaderStageCreateInfo };
+
+        //每个实例一个粒子，方块的顶点由gl_VertexIndex生成
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(Particle);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        VkVertexInputAttributeDescription attributeDescriptions[2] = {};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[0].offset = offsetof(Particle, positionVelocity);
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(Particle, colorLife);
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = 2;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        //视口和裁剪与场景管线一样是动态的
+        VkPipelineViewportStateCreateInfo viewportState = {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        //方块两面都画
+        VkPipelineRasterizationStateCreateInfo rasterize = {};
+        rasterize.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterize.depthClampEnable = VK_FALSE;
+        rasterize.rasterizerDiscardEnable = VK_FALSE;
+        rasterize.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterize.lineWidth = 1.0f;
+        rasterize.cullMode = VK_CULL_MODE_NONE;
+        rasterize.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterize.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        //相加混合，粒子的顺序不影响结果，alpha保持不变
+        VkPipelineColorBlendAttachmentState colorBlendAttachmen = {};
+        colorBlendAttachmen.colorWriteMask = VK_COLOR_COMPONENT_A_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_R_BIT;
+        colorBlendAttachmen.blendEnable = VK_TRUE;
+        colorBlendAttachmen.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachmen.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachmen.colorBlendOp = VK_BLEND_OP_ADD;
+        colorBlendAttachmen.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colorBlendAttachmen.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colorBlendAttachmen.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colorBlend = {};
+        colorBlend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlend.logicOpEnable = VK_FALSE;
+        colorBlend.logicOp = VK_LOGIC_OP_COPY;
+        colorBlend.attachmentCount = 1;
+        colorBlend.pAttachments = &colorBlendAttachmen;
+
+        VkDynamicState dynamicStates[] =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR,
+        };
+        VkPipelineDynamicStateCreateInfo dynamicState = {};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterize;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = nullptr;
+        pipelineInfo.pColorBlendState = &colorBlend;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        VkPipelineRenderingCreateInfoKHR renderingInfo;
+        setPipelineTarget(pipelineInfo, renderingInfo, renderPass, &SCENE_COLOR_FORMAT, VK_FORMAT_UNDEFINED, sceneViewMask());
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &particlePipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create particle pipeline!");
+        }
+    }
+
+    //录制这一帧的粒子模拟：准备 -> 模拟 -> 完成 -> 拷回，之间用屏障保证前一个阶段的写入可见，
+    //模拟和拷回的工作组数、绘制的实例数都是前一个阶段在GPU上写好的间接参数
+    void recordParticles(VkCommandBuffer commandBuffer)
+    {
+        auto now = std::chrono::steady_clock::now();
+        float deltaTime = std::min(std::chrono::duration<float>(now - lastParticleUpdate).count(), 0.1f);
+        lastParticleUpdate = now;
+
+        //每秒发射容量 / 最长寿命，稳定时接近装满，装满之后GPU上少发射
+        float emit = (float)particleCapacity / PARTICLE_MAX_LIFE * deltaTime + particleEmitCarry;
+        uint32_t emitRequest = (uint32_t)emit;
+        particleEmitCarry = emit - (float)emitRequest;
+
+        ParticlePushConstants pushConstants = {};
+        pushConstants.deltaTime = deltaTime;
+        pushConstants.time = std::chrono::duration<float>(now - startupBegin).count();
+        pushConstants.emitRequest = emitRequest;
+        pushConstants.seed = particleFrame++;
+
+        //回放时用日志中的参数，模拟与捕获时的那一帧相同
+        if (replayParticles != nullptr)
+        {
+            memcpy(&pushConstants, replayParticles, sizeof(pushConstants));
+        }
+        if (captureWriter.isOpen())
+        {
+            captureWriter.writeParticles(&pushConstants, sizeof(pushConstants));
+        }
+
+        auto barrier = [commandBuffer](VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+        {
+            VkMemoryBarrier memoryBarrier = {};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = srcAccess;
+            memoryBarrier.dstAccessMask = dstAccess;
+            vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        };
+        const VkAccessFlags computeAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        //第一次使用前清零计数
+        if (!particleStateCleared)
+        {
+            vkCmdFillBuffer(commandBuffer, particleStateBuffer, 0, VK_WHOLE_SIZE, 0);
+            barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeAccess);
+            particleStateCleared = true;
+        }
+
+        //上一帧的绘制读完粒子和间接参数之后才能覆盖
+        barrier(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputeLayout, 0, 1, &particleDescriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, particleComputeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlePushConstants), &pushConstants);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputePipelines[0]);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | computeAccess);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputePipelines[1]);
+        vkCmdDispatchIndirect(commandBuffer, particleStateBuffer, offsetof(ParticleState, simulateDispatch));
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeAccess);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputePipelines[2]);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | computeAccess);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputePipelines[3]);
+        vkCmdDispatchIndirect(commandBuffer, particleStateBuffer, offsetof(ParticleState, copyDispatch));
+
+        //场景pass中的间接绘制读取实例数和粒子
+        barrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    }
+
+    //--------------GPU粒子---------------
+
+    //--------------命令流捕获和回放---------------
+
+    //写入文件头和启动时的资源内容。相机缓冲在创建之后不再变化，直接从映射的内存读出
+    void startCapture()
+    {
+        CaptureHeader header;
+        header.viewCount = viewCount;
+        header.characterCount = characterCount;
+        header.particleCapacity = particleCapacity;
+        header.gpuSkinning = gpuSkinning ? 1 : 0;
+        header.debugView = (uint32_t)debugView;
+        header.shadows = shadowsEnabled ? 1 : 0;
+        header.postProcessing = postProcessing ? 1 : 0;
+        captureWriter.open(capturePath, header);
+
+        captureWriter.writeResource(CaptureResource::SceneVertices, vertices.data(), sizeof(Vertex) * vertices.size());
+        if (characterCount > 0)
+        {
+            captureWriter.writeResource(CaptureResource::BindPose, animation.getBindVertices().data(), sizeof(SkinnedVertex) * animation.getVertexCount());
+        }
+
+        void* data;
+        vkMapMemory(device, cameraBufferMemory, 0, sizeof(CameraBufferObject), 0, &data);
+        captureWriter.writeResource(CaptureResource::Camera, data, sizeof(CameraBufferObject));
+        vkUnmapMemory(device, cameraBufferMemory);
+
+        capturedSegmentVersion.assign(sceneSegments.size(), 0);
+    }
+
+    //记录这一帧的渲染区域、上传和内容变化了的绘制流
+    void captureFrame(size_t frame)
+    {
+        captureWriter.beginFrame(renderExtent.width, renderExtent.height);
+
+        if (characterCount > 0)
+        {
+            if (gpuSkinning)
+            {
+                captureWriter.writeUpload(CaptureResource::JointMatrices, 0, (char*)jointMatrixMapped + jointMatrixStride * frame, sizeof(JointMatrix) * animation.getJointCount() * characterCount);
+            }
+            else
+            {
+                size_t vertexCount = (size_t)animation.getVertexCount() * characterCount;
+                captureWriter.writeUpload(CaptureResource::SkinnedVertices, 0, skinningUploadMapped + vertexCount * frame, sizeof(SkinnedOutputVertex) * vertexCount);
+            }
+        }
+
+        //绘制中的句柄换成表中的下标
+        auto indexOf = [](const auto& table, const auto& value)
+        {
+            return (uint32_t)(std::find(table.begin(), table.end(), value) - table.begin());
+        };
+        for (uint32_t bucket = 0; bucket < (uint32_t)sceneSegments.size(); bucket++)
+        {
+            const CommandSegment& segment = sceneSegments[bucket];
+            if (capturedSegmentVersion[bucket] == segment.version)
+            {
+                continue;
+            }
+
+            FrameVector<CapturedDraw> draws{ ArenaAllocator<CapturedDraw>(frameArena) };
+            draws.reserve(segment.draws.size());
+            for (const auto& draw : segment.draws)
+            {
+                CapturedDraw captured = {};
+                captured.sortKey = draw.sortKey;
+                captured.pipeline = indexOf(scenePipelines, draw.pipeline);
+                captured.material = indexOf(sceneMaterials, draw.descriptorSet);
+                captured.mesh = indexOf(sceneMeshes, draw.vertexBuffer);
+                captured.vertexCount = draw.vertexCount;
+                captured.instanceCount = draw.instanceCount;
+                captured.firstVertex = draw.firstVertex;
+                captured.firstInstance = draw.firstInstance;
+                captured.indirectBuffer = (uint32_t)(draw.indirectBuffer == VK_NULL_HANDLE ? CaptureResource::None : CaptureResource::ParticleState);
+                captured.indirectOffset = draw.indirectOffset;
+                draws.push_back(captured);
+            }
+            captureWriter.writeDrawStream(bucket, draws.data(), (uint32_t)draws.size());
+            capturedSegmentVersion[bucket] = segment.version;
+        }
+    }
+
+    //读入日志，按文件头配置渲染器；固定分辨率、不等待垂直同步，与基准测试相同
+    void loadReplay()
+    {
+        replayReader.open(replayPath);
+        const CaptureHeader& header = replayReader.getHeader();
+        if (replayReader.getFrames().empty())
+        {
+            throw std::runtime_error("capture file has no frames!");
+        }
+
+        viewCount = header.viewCount;
+        characterCount = header.characterCount;
+        particleCapacity = header.particleCapacity;
+        forceCpuSkinning = header.gpuSkinning == 0;
+        debugView = (DebugView)header.debugView;
+        shadowsEnabled = header.shadows != 0;
+        postProcessing = header.postProcessing != 0;
+        lightRotationSpeed = 0.0f;//旋转的光源取决于帧的时刻，回放时固定光源
+        benchmarkFrames = (uint32_t)replayReader.getFrames().size();
+    }
+
+    //设备创建之后：检查设备能否执行日志，上传启动时的资源内容，把绘制流转换成绘制
+    void startReplay()
+    {
+        const CaptureHeader& header = replayReader.getHeader();
+        if ((header.gpuSkinning != 0) != gpuSkinning || header.particleCapacity != particleCapacity)
+        {
+            throw std::runtime_error("capture needs compute support on the graphics queue!");
+        }
+
+        auto upload = [this](VkDeviceMemory memory, VkDeviceSize size, const CapturedUpload& resource)
+        {
+            if (resource.size != size)
+            {
+                throw std::runtime_error("capture resource size mismatch!");
+            }
+            void* data;
+            vkMapMemory(device, memory, 0, size, 0, &data);
+            memcpy(data, resource.data, (size_t)size);
+            vkUnmapMemory(device, memory);
+        };
+        for (const auto& resource : replayReader.getResources())
+        {
+            switch (resource.resource)
+            {
+            case CaptureResource::SceneVertices:
+                upload(vertexBufferMemory, sizeof(Vertex) * vertices.size(), resource);
+                break;
+            case CaptureResource::BindPose:
+                //CPU蒙皮时绑定姿势只在动画系统里，上传的是蒙皮后的顶点
+                if (gpuSkinning)
+                {
+                    upload(bindPoseBufferMemory, sizeof(SkinnedVertex) * animation.getVertexCount(), resource);
+                }
+                break;
+            case CaptureResource::Camera:
+                upload(cameraBufferMemory, sizeof(CameraBufferObject), resource);
+                break;
+            default:
+                throw std::runtime_error("unknown capture resource!");
+            }
+        }
+
+        replayDrawStreams.clear();
+        for (const auto& frame : replayReader.getFrames())
+        {
+            if (frame.particles != nullptr && frame.particlesSize != sizeof(ParticlePushConstants))
+            {
+                throw std::runtime_error("capture particle parameters size mismatch!");
+            }
+            for (const auto& upload : frame.uploads)
+            {
+                bool fits = upload.resource == CaptureResource::JointMatrices ? gpuSkinning && upload.offset + upload.size <= jointMatrixStride
+                    : upload.resource == CaptureResource::SkinnedVertices ? !gpuSkinning && upload.offset + upload.size <= sizeof(SkinnedOutputVertex) * animation.getVertexCount() * characterCount
+                    : false;
+                if (!fits)
+                {
+                    throw std::runtime_error("capture upload does not match the renderer!");
+                }
+            }
+            for (const auto& stream : frame.drawStreams)
+            {
+                if (stream.bucket >= sceneSegments.size())
+                {
+                    throw std::runtime_error("capture draw stream bucket out of range!");
+                }
+                std::vector<DrawItem> draws;
+                for (uint32_t i = 0; i < stream.count; i++)
+                {
+                    const CapturedDraw& captured = stream.draws[i];
+                    if (captured.pipeline >= scenePipelines.size() || captured.material >= sceneMaterials.size() || captured.mesh >= sceneMeshes.size())
+                    {
+                        throw std::runtime_error("capture draw references a missing pipeline, material or mesh!");
+                    }
+                    DrawItem draw = { stream.bucket, captured.sortKey, scenePipelines[captured.pipeline], sceneMaterials[captured.material], sceneMeshes[captured.mesh], captured.vertexCount, captured.instanceCount, captured.firstVertex, captured.firstInstance };
+                    if ((CaptureResource)captured.indirectBuffer == CaptureResource::ParticleState && particleCapacity > 0)
+                    {
+                        draw.indirectBuffer = particleStateBuffer;
+                        draw.indirectOffset = captured.indirectOffset;
+                    }
+                    draws.push_back(draw);
+                }
+                replayDrawStreams.push_back(std::move(draws));
+            }
+        }
+
+        size_t frameCount = replayReader.getFrames().size();
+        replayCpuMs.assign(frameCount, 0.0f);
+        replayGpuMs.assign(frameCount, -1.0f);
+        frameReplayIndex.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        replayFrameIndex = 0;
+        replayStreamIndex = 0;
+    }
+
+    //把日志中的一帧应用到渲染器
+    void applyReplayFrame(size_t frame)
+    {
+        const CapturedFrame& captured = replayReader.getFrames()[replayFrameIndex];
+        frameReplayIndex[frame] = replayFrameIndex;
+        replayFrameIndex++;
+
+        renderExtent.width = std::clamp(captured.renderWidth, 1u, sceneExtent.width);
+        renderExtent.height = std::clamp(captured.renderHeight, 1u, sceneExtent.height);
+
+        for (const auto& upload : captured.uploads)
+        {
+            if (upload.resource == CaptureResource::JointMatrices)
+            {
+                memcpy((char*)jointMatrixMapped + jointMatrixStride * frame + upload.offset, upload.data, (size_t)upload.size);
+            }
+            else
+            {
+                size_t slotSize = sizeof(SkinnedOutputVertex) * animation.getVertexCount() * characterCount;
+                memcpy((char*)skinningUploadMapped + slotSize * frame + upload.offset, upload.data, (size_t)upload.size);
+            }
+        }
+
+        for (const auto& stream : captured.drawStreams)
+        {
+            updateSceneSegment(stream.bucket, replayDrawStreams[replayStreamIndex++]);
+        }
+
+        replayParticles = captured.particles;
+    }
+
+    //输出回放的统计，每一帧的耗时写入日志同名的csv，用作性能回归测试的基线
+    void printReplayResult()
+    {
+        //最后几帧的GPU时间还没有被帧循环读取
+        for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+        {
+            float gpuFrameMs;
+            if (readGpuFrameMs(frame, gpuFrameMs))
+            {
+                replayGpuMs[frameReplayIndex[frame]] = gpuFrameMs;
+            }
+        }
+
+        const auto& frames = replayReader.getFrames();
+        std::vector<float> sortedGpuMs;
+        size_t slowestFrame = 0;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            if (replayGpuMs[i] >= 0.0f)
+            {
+                sortedGpuMs.push_back(replayGpuMs[i]);
+                if (replayGpuMs[i] > replayGpuMs[slowestFrame])
+                {
+                    slowestFrame = i;
+                }
+            }
+        }
+        std::sort(sortedGpuMs.begin(), sortedGpuMs.end());
+
+        std::cout << "replay: " << frames.size() << " frames from " << replayPath << std::endl;
+        if (!sortedGpuMs.empty())
+        {
+            std::cout << "  gpu frame time: median " << sortedGpuMs[sortedGpuMs.size() / 2] << " ms, p95 " << sortedGpuMs[sortedGpuMs.size() * 95 / 100] << " ms, max " << sortedGpuMs.back() << " ms (frame " << slowestFrame << ")" << std::endl;
+        }
+
+        std::string reportPath = replayPath + ".csv";
+        std::ofstream report(reportPath);
+        report << "frame,render_width,render_height,cpu_ms,gpu_ms" << std::endl;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            report << i << "," << frames[i].renderWidth << "," << frames[i].renderHeight << "," << replayCpuMs[i] << "," << replayGpuMs[i] << std::endl;
+        }
+        std::cout << "  per-frame timings written to " << reportPath << std::endl;
+    }
+
+    //--------------命令流捕获和回放---------------
+
+    //--------------渲染任务服务---------------
+
+    //读取上次保存的管线缓存，数据与设备不匹配时驱动会忽略
+    void createPipelineCache()
+    {
+        //文件由启动的依赖图在工作线程上读取
+        std::vector<char> cacheData = std::move(pipelineCacheData);
+
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = cacheData.size();
+        cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    //把管线缓存写回文件，失败时只是下次启动慢一些
+    void savePipelineCache()
+    {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+        {
+            return;
+        }
+        std::vector<char> cacheData(dataSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS)
+        {
+            return;
+        }
+
+        std::ofstream file(PIPELINE_CACHE_FILE, std::ios::binary);
+        file.write(cacheData.data(), dataSize);
+    }
+
+    //启动任务服务，为每个并发任务创建渲染上下文。任务的分辨率与窗口相同，使用场景pass和场景管线
+    void createRenderContexts()
+    {
+        if (jobServerPath.empty())
+        {
+            return;
+        }
+        jobServer.start(jobServerPath, jobOutputDirectory);
+
+        renderContexts.resize(MAX_RENDER_CONTEXTS);
+        for (size_t i = 0; i < renderContexts.size(); i++)
+        {
+            RenderContext& context = renderContexts[i];
+            context.busy = false;
+            context.resident = false;
+
+            //空闲的上下文可以被逐出，下次分到任务时重新创建
+            context.residencyGroup = residency.addGroup("render context " + std::to_string(i), [this, i]()
+            {
+                RenderContext& evicted = renderContexts[i];
+                if (evicted.busy)
+                {
+                    return false;
+                }
+                destroyRenderContextTargets(evicted);
+                return true;
+            });
+
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = descriptorPool;
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &sceneDescriptorSetLayout;
+
+            if (vkAllocateDescriptorSets(device, &allocInfo, &context.descriptorSet) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate descriptor sets!");
+            }
+
+            VkCommandBufferAllocateInfo commandBufferInfo = {};
+            commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferInfo.commandPool = commandPool;
+            commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            commandBufferInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &commandBufferInfo, &context.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+
+            VkFenceCreateInfo fenceInfo = {};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(device, &fenceInfo, nullptr, &context.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render context fence!");
+            }
+
+            createRenderContextTargets(context);
+        }
+    }
+
+    //创建上下文占用显存的部分：颜色目标、相机缓冲和回读缓冲，都属于上下文的驻留组
+    void createRenderContextTargets(RenderContext& context)
+    {
+        //任务只有一个相机，目标只有一层，用单视图的pass和管线渲染，不受窗口的视图数影响
+        createImage(swapChainExtent.width, swapChainExtent.height, SCENE_COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, context.colorImage, context.colorImageMemory, 1, context.residencyGroup);
+        context.colorImageView = createImageView(context.colorImage, SCENE_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 1);
+        createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTarget, context.readbackImage, context.readbackImageMemory, 1, context.residencyGroup);
+
+        context.framebuffer = VK_NULL_HANDLE;//动态渲染时不需要
+        if (!dynamicRendering)
+        {
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = jobRenderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &context.colorImageView;
+            framebufferInfo.width = swapChainExtent.width;
+            framebufferInfo.height = swapChainExtent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &context.framebuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render context framebuffer!");
+            }
+        }
+
+        createBuffer(sizeof(CameraBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Uniform, context.cameraBuffer, context.cameraBufferMemory, context.residencyGroup);
+        vkMapMemory(device, context.cameraBufferMemory, 0, sizeof(CameraBufferObject), 0, &context.cameraMapped);
+
+        VkDeviceSize readbackSize = (VkDeviceSize)swapChainExtent.width * swapChainExtent.height * 4;
+        createBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Readback, context.readbackBuffer, context.readbackBufferMemory, context.residencyGroup);
+        vkMapMemory(device, context.readbackBufferMemory, 0, readbackSize, 0, &context.readbackMapped);
+
+        //相机缓冲是新建的，描述符要重新指向它
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = context.cameraBuffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(CameraBufferObject);
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = context.descriptorSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+        context.resident = true;
+    }
+
+    //销毁上下文占用显存的部分，调用时上下文不能有正在执行的任务
+    void destroyRenderContextTargets(RenderContext& context)
+    {
+        if (!context.resident)
+        {
+            return;
+        }
+        vkDestroyBuffer(device, context.readbackBuffer, nullptr);
+        residency.free(context.readbackBufferMemory);
+        vkDestroyBuffer(device, context.cameraBuffer, nullptr);
+        residency.free(context.cameraBufferMemory);
+        if (context.framebuffer != VK_NULL_HANDLE)
+        {
+            vkDestroyFramebuffer(device, context.framebuffer, nullptr);
+        }
+        vkDestroyImageView(device, context.colorImageView, nullptr);
+        vkDestroyImage(device, context.colorImage, nullptr);
+        residency.free(context.colorImageMemory);
+        vkDestroyImage(device, context.readbackImage, nullptr);
+        residency.free(context.readbackImageMemory);
+        context.resident = false;
+    }
+
+    //每帧调用：收取新任务，回收完成的上下文，把优先级最高的任务分给空闲的上下文。不会等待GPU
+    void serviceRenderJobs()
+    {
+        jobServer.poll();
+
+        uint32_t running = 0;
+        for (auto& context : renderContexts)
+        {
+            if (context.busy && vkGetFenceStatus(device, context.fence) == VK_SUCCESS)
+            {
+                finishRenderJob(context);
+            }
+            if (!context.busy && jobServer.popJob(context.job))
+            {
+                startRenderJob(context);
+            }
+            if (context.busy)
+            {
+                running++;
+            }
+        }
+        jobServer.setRunningJobs(running);
+    }
+
+    //录制并提交一个任务：按任务的相机渲染场景，再把第0层拷贝到回读缓冲
+    void startRenderJob(RenderContext& context)
+    {
+        context.job.startedTime = std::chrono::steady_clock::now();
+
+        //被逐出的上下文先重新创建
+        residency.touch(context.residencyGroup);
+        if (!context.resident)
+        {
+            createRenderContextTargets(context);
+        }
+
+        CameraBufferObject cameras = {};
+        buildCameraMatrix(context.job.cameraAngle * 3.14159265f / 180.0f, context.job.cameraZoom, cameras.viewProj[0]);
+        memcpy(context.cameraMapped, &cameras, sizeof(CameraBufferObject));
+
+        VkCommandBuffer commandBuffer = context.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        beginSceneRendering(commandBuffer, context.colorImage, context.colorImageView, context.framebuffer, swapChainExtent, false, 1);
+
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapChainExtent.width;
+        viewport.height = (float)swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0,0 };
+        scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[] = { vertexBuffer };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, jobPipeline);
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &context.descriptorSet, 0, nullptr);
+        for (const auto& draw : sceneDraws)
+        {
+            vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+        }
+        endSceneRendering(commandBuffer, context.colorImage, 1);
+
+        //HDR的第0层用blit转换成交换链格式（超过1的部分截断），回读的像素格式与之前相同
+        VkImageMemoryBarrier barriers[2] = {};
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barriers[i].subresourceRange.baseMipLevel = 0;
+            barriers[i].subresourceRange.levelCount = 1;
+            barriers[i].subresourceRange.baseArrayLayer = 0;
+            barriers[i].subresourceRange.layerCount = 1;
+        }
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].image = context.colorImage;
+        barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].image = context.readbackImage;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = 0;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = { (int32_t)swapChainExtent.width, (int32_t)swapChainExtent.height, 1 };
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstOffsets[1] = blit.srcOffsets[1];
+        vkCmdBlitImage(commandBuffer, context.colorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, context.readbackImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer, context.readbackImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, context.readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = context.readbackBuffer;
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        vkResetFences(device, 1, &context.fence);
+        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, context.fence) != VK_SUCCESS)
+        {
+            jobServer.failJob(context.job, "submit failed");
+            return;
+        }
+        context.busy = true;
+    }
+
+    //任务已经在GPU上完成，保存图片并回复客户端
+    void finishRenderJob(RenderContext& context)
+    {
+        context.busy = false;
+        if (!writeImagePPM(context.job.outputPath, (const uint8_t*)context.readbackMapped, swapChainExtent.width, swapChainExtent.height))
+        {
+            jobServer.failJob(context.job, "failed to write " + context.job.outputPath);
+            return;
+        }
+        jobServer.completeJob(context.job);
+    }
+
+    //--------------渲染任务服务---------------
+
+    //--------------资源创建-----------------
+
+    //创建缓冲并分配绑定显存，group为所属的驻留组（见ResidencyManager.h）
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkBuffer& buffer, VkDeviceMemory& bufferMemory, uint32_t group = ResidencyManager::NOT_EVICTABLE)
+    {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+        bufferMemory = residency.allocate(memRequirements, properties, category, group);
+
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    }
+
+    //创建顶点缓冲，数据量很小，直接放在主机可见的内存里
+    void createVertexBuffer()
+    {
+        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+        createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Geometry, vertexBuffer, vertexBufferMemory);
+
+        void* data;
+        vkMapMemory(device, vertexBufferMemory, 0, bufferSize, 0, &data);
+        memcpy(data, vertices.data(), (size_t)bufferSize);
+        vkUnmapMemory(device, vertexBufferMemory);
+    }
+
+    //创建帧导出的共享内存环，能导入主机内存时把环槽导入为拷贝目标，否则为每个帧槽创建回读缓冲
+    void createExportResources()
+    {
+        if (frameExportName.empty())
+        {
+            return;
+        }
+
+        //交换链格式都是每像素4字节；导入时槽的起点和大小要满足设备的对齐
+        uint32_t rowPitch = swapChainExtent.width * 4;
+        VkDeviceSize bufferSize = (VkDeviceSize)rowPitch * swapChainExtent.height;
+        frameRing.create(frameExportName, swapChainExtent.width, swapChainExtent.height, rowPitch, (uint32_t)swapChainImageFormat, FRAME_EXPORT_SLOTS, exportHostMemorySupported ? exportImportAlignment : 0);
+
+        exportPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+        exportFrameNumbers.assign(MAX_FRAMES_IN_FLIGHT, 0);
+        if (importExportSlots())
+        {
+            return;
+        }
+
+        exportBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+        exportBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        exportBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Readback, exportBuffers[i], exportBuffersMemory[i]);
+            vkMapMemory(device, exportBuffersMemory[i], 0, bufferSize, 0, &exportBuffersMapped[i]);
+        }
+    }
+
+    //把环的每个槽导入为缓冲，任何一步不支持时清理并返回false，由调用者退回回读缓冲
+    bool importExportSlots()
+    {
+        if (!exportHostMemorySupported)
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        exportZeroCopy = true;
+        uint32_t slotCount = frameRing.getSlotCount();
+        VkDeviceSize slotSize = frameRing.getSlotStride();
+        exportBuffers.assign(slotCount, VK_NULL_HANDLE);
+        exportBuffersMemory.assign(slotCount, VK_NULL_HANDLE);
+        for (uint32_t i = 0; i < slotCount; i++)
+        {
+            uint8_t* slot = frameRing.getSlot(i);
+            VkMemoryHostPointerPropertiesEXT pointerProperties = {};
+            pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+            if ((uintptr_t)slot % exportImportAlignment != 0 || getMemoryHostPointerProperties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, slot, &pointerProperties) != VK_SUCCESS)
+            {
+                break;
+            }
+
+            VkExternalMemoryBufferCreateInfo externalInfo = {};
+            externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+            externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.pNext = &externalInfo;
+            bufferInfo.size = slotSize;
+            bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(device, &bufferInfo, nullptr, &exportBuffers[i]) != VK_SUCCESS)
+            {
+                exportBuffers[i] = VK_NULL_HANDLE;
+                break;
+            }
+
+            //消费者在另一个进程里直接读，不能刷新缓存，只接受主机一致的内存类型
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(device, exportBuffers[i], &memRequirements);
+            uint32_t typeFilter = memRequirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            int32_t memoryType = -1;
+            for (uint32_t type = 0; type < memoryProperties.memoryTypeCount && memoryType < 0; type++)
+            {
+                if ((typeFilter & (1 << type)) && (memoryProperties.memoryTypes[type].propertyFlags & properties) == properties)
+                {
+                    memoryType = (int32_t)type;
+                }
+            }
+            if (memoryType < 0)
+            {
+                break;
+            }
+
+            VkImportMemoryHostPointerInfoEXT importInfo = {};
+            importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+            importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+            importInfo.pHostPointer = slot;
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.pNext = &importInfo;
+            allocInfo.allocationSize = slotSize;
+            allocInfo.memoryTypeIndex = (uint32_t)memoryType;
+            if (vkAllocateMemory(device, &allocInfo, nullptr, &exportBuffersMemory[i]) != VK_SUCCESS)
+            {
+                exportBuffersMemory[i] = VK_NULL_HANDLE;
+                break;
+            }
+            vkBindBufferMemory(device, exportBuffers[i], exportBuffersMemory[i], 0);
+            if (i + 1 == slotCount)
+            {
+                return true;
+            }
+        }
+
+        destroyExportBuffers();
+        return false;
+    }
+
+    //导入的内存不经过驻留管理，直接释放
+    void destroyExportBuffers()
+    {
+        for (size_t i = 0; i < exportBuffers.size(); i++)
+        {
+            if (exportBuffers[i] != VK_NULL_HANDLE)
+            {
+                vkDestroyBuffer(device, exportBuffers[i], nullptr);
+            }
+            if (exportBuffersMemory[i] != VK_NULL_HANDLE)
+            {
+                if (exportZeroCopy)
+                {
+                    vkFreeMemory(device, exportBuffersMemory[i], nullptr);
+                }
+                else
+                {
+                    residency.free(exportBuffersMemory[i]);
+                }
+            }
+        }
+        exportBuffers.clear();
+        exportBuffersMemory.clear();
+        exportBuffersMapped.clear();
+        exportZeroCopy = false;
+    }
+
+    //在放大pass之后把交换链图像拷贝到环槽（直接写入）或这个帧槽的回读缓冲，再还原为显示用的布局
+    void recordFrameExport(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    {
+        //直接写入时在录制时预留环槽，环满时这一帧不拷贝，计为丢帧
+        VkBuffer destination = VK_NULL_HANDLE;
+        if (exportZeroCopy)
+        {
+            uint32_t slot;
+            if (frameRing.beginWrite(&slot) == nullptr)
+            {
+                return;
+            }
+            destination = exportBuffers[slot];
+        }
+        else
+        {
+            destination = exportBuffers[currentFrame];
+        }
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;//紧密排列，与环中的rowPitch一致
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, 1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = 0;
+
+        //拷贝结果要对主机可见
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = destination;
+        bufferBarrier.offset = 0;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 1, &barrier);
+
+        exportPending[currentFrame] = true;
+        exportFrameNumbers[currentFrame] = frameNumber;
+    }
+
+    //帧槽的栅栏已经触发，发布直接写入的环槽，或把回读缓冲中的帧写入共享内存环。消费者跟不上时这一帧被丢弃，渲染不会等待
+    void publishExportedFrame(size_t frame)
+    {
+        if (!frameRing.isOpen() || !exportPending[frame])
+        {
+            return;
+        }
+        exportPending[frame] = false;
+
+        if (exportZeroCopy)
+        {
+            frameRing.endWrite(exportFrameNumbers[frame]);
+            return;
+        }
+
+        uint8_t* slot = frameRing.beginWrite();
+        if (slot == nullptr)
+        {
+            return;
+        }
+        memcpy(slot, exportBuffersMapped[frame], (size_t)frameRing.getRowPitch() * swapChainExtent.height);
+        frameRing.endWrite(exportFrameNumbers[frame]);
+    }
+
+    //创建二维图像并分配绑定显存，group为所属的驻留组
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, VkImage& image, VkDeviceMemory& imageMemory, uint32_t arrayLayers = 1, uint32_t group = ResidencyManager::NOT_EVICTABLE, uint32_t mipLevels = 1)
+    {
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width;
+        imageInfo.extent.height = height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = arrayLayers;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+        imageMemory = residency.allocate(memRequirements, properties, category, group);
+
+        vkBindImageMemory(device, image, imageMemory, 0);
+    }
+
+    //创建二维图像视图，layerCount大于1时使用VK_IMAGE_VIEW_TYPE_2D_ARRAY，从baseLayer层、baseMip级开始
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t layerCount = 1, uint32_t baseLayer = 0, uint32_t baseMip = 0, uint32_t levelCount = 1)
+    {
+        VkImageViewCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = image;
+        createInfo.viewType = viewType;
+        createInfo.format = format;
+
+        createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+        createInfo.subresourceRange.aspectMask = aspectFlags;
+        createInfo.subresourceRange.baseMipLevel = baseMip;
+        createInfo.subresourceRange.levelCount = levelCount;
+        createInfo.subresourceRange.baseArrayLayer = baseLayer;
+        createInfo.subresourceRange.layerCount = layerCount;
+
+        VkImageView imageView;
+        if (vkCreateImageView(device, &createInfo, nullptr, &imageView) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create image view!");
+        }
+        return imageView;
+    }
+
+    //--------------资源创建-----------------
+
+    //--------------着色器部分代码-------------
+
+    //创建着色器模块
+    VkShaderModule createShaderModule(const std::vector<char>& code)
+    {
+        VkShaderModuleCreateInfo creatInfo = {};
+        creatInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        creatInfo.codeSize = code.size();
+        creatInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &creatInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shader module!");
+        }
+        return shaderModule;
+    }
+
+    //--------------着色器部分代码-------------
+};
+
+
+//用软件光栅化后端渲染场景，与Vulkan后端使用相同的顶点数据和绘制列表
+//只画基础场景，对比时Vulkan后端要关闭角色、粒子、阴影、后处理和HUD
+static void runSoftwareRasterizer(const std::string& outputPath, uint32_t benchmarkFrames)
+{
+    SoftRasterizer rasterizer(WIDTH, HEIGHT);
+
+    SoftRasterizer::VertexLayout layout = {};
+    layout.data = vertices.data();
+    layout.stride = sizeof(Vertex);
+    layout.positionOffset = offsetof(Vertex, pos);
+    layout.colorOffset = offsetof(Vertex, color);
+
+    std::vector<SoftRasterizer::Draw> draws;
+    for (const auto& draw : sceneDraws)
+    {
+        draws.push_back({ draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance });
+    }
+
+    uint32_t frameCount = std::max(1u, benchmarkFrames);
+    auto startTime = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        rasterizer.clear(SCENE_CLEAR_COLOR);
+        rasterizer.drawList(layout, (uint32_t)vertices.size(), draws);
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    if (benchmarkFrames > 0)
+    {
+        const SoftRasterizer::Stats& stats = rasterizer.getStats();
+        std::cout << "software benchmark: " << WIDTH << "x" << HEIGHT << ", " << frameCount << " frames, " << rasterizer.getThreadCount() << " threads, avx2 " << (rasterizer.isAVX2Enabled() ? "on" : "off") << std::endl;
+        std::cout << "  features: base scene only (no characters, particles, shadows, post or hud)" << std::endl;
+        std::cout << "  frame time: " << totalMs / frameCount << " ms" << std::endl;
+        std::cout << "  triangles: " << stats.trianglesSubmitted << " (culled " << stats.trianglesCulled << "), pixels written: " << stats.pixelsWritten << std::endl;
+    }
+
+    if (!outputPath.empty() && !rasterizer.writePPM(outputPath))
+    {
+        throw std::runtime_error("failed to write image!");
+    }
+}
+
+//场景BVH的基准测试：随机分布的物体，与逐个测试比较构建、更新和各种查询的耗时，不创建Vulkan
+static void runBvhBenchmark(uint32_t objectCount)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> extent(0.0005f, 0.003f);
+    std::vector<Aabb> bounds(objectCount);
+    for (auto& box : bounds)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float center = position(random);
+            float halfSize = extent(random);
+            box.min[axis] = center - halfSize;
+            box.max[axis] = center + halfSize;
+        }
+    }
+
+    auto elapsedMs = [](std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    SceneBvh bvh;
+    auto startTime = std::chrono::steady_clock::now();
+    bvh.build(bounds);
+    double buildMs = elapsedMs(startTime);
+
+    //平截头体看到场景的大约1/9：x、y放大3倍并平移，z在0到1之间
+    const float viewProj[16] = { 3.0f, 0.0f, 0.0f, 0.0f, 0.0f, 3.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.2f, 0.0f, 0.5f, 1.0f };
+    float planes[6][4];
+    for (int c = 0; c < 4; c++)
+    {
+        planes[0][c] = viewProj[c * 4 + 3] + viewProj[c * 4 + 0];
+        planes[1][c] = viewProj[c * 4 + 3] - viewProj[c * 4 + 0];
+        planes[2][c] = viewProj[c * 4 + 3] + viewProj[c * 4 + 1];
+        planes[3][c] = viewProj[c * 4 + 3] - viewProj[c * 4 + 1];
+        planes[4][c] = viewProj[c * 4 + 2];
+        planes[5][c] = viewProj[c * 4 + 3] - viewProj[c * 4 + 2];
+    }
+    auto linearCull = [&]()
+    {
+        uint32_t count = 0;
+        for (const auto& box : bounds)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                float d = planes[p][3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    d += planes[p][axis] * (planes[p][axis] > 0.0f ? box.max[axis] : box.min[axis]);
+                }
+                inside = d >= 0.0f;
+            }
+            count += inside ? 1 : 0;
+        }
+        return count;
+    };
+
+    const uint32_t cullRuns = 20;
+    std::vector<uint32_t> visible;
+    startTime = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < cullRuns; i++)
+    {
+        bvh.cullFrustum(viewProj, visible);
+    }
+    double cullMs = elapsedMs(startTime) / cullRuns;
+    startTime = std::chrono::steady_clock::now();
+    uint32_t linearVisible = linearCull();
+    double linearCullMs = elapsedMs(startTime);
+
+    //沿z方向的射线，和半径0.02的球
+    const uint32_t queryCount = 1000;
+    std::vector<std::array<float, 3>> points(queryCount);
+    for (auto& point : points)
+    {
+        point = { position(random), position(random), position(random) };
+    }
+    uint32_t hits = 0;
+    startTime = std::chrono::steady_clock::now();
+    for (const auto& point : points)
+    {
+        float origin[3] = { point[0], point[1], -2.0f };
+        float direction[3] = { 0.0f, 0.0f, 1.0f };
+        uint32_t object;
+        float distance;
+        hits += bvh.pick(origin, direction, 4.0f, object, distance) ? 1 : 0;
+    }
+    double pickUs = elapsedMs(startTime) * 1000.0 / queryCount;
+
+    const float radius = 0.02f;
+    std::vector<uint32_t> nearby;
+    size_t nearbyTotal = 0;
+    startTime = std::chrono::steady_clock::now();
+    for (const auto& point : points)
+    {
+        bvh.queryProximity(point.data(), radius, nearby);
+        nearbyTotal += nearby.size();
+    }
+    double proximityUs = elapsedMs(startTime) * 1000.0 / queryCount;
+
+    //每帧1%的物体移动，refit并增量重建
+    const uint32_t updateFrames = 20;
+    std::uniform_int_distribution<uint32_t> pickObject(0, objectCount - 1);
+    std::uniform_real_distribution<float> offset(-0.05f, 0.05f);
+    double updateMs = 0.0;
+    uint32_t rebuilds = 0;
+    for (uint32_t frame = 0; frame < updateFrames; frame++)
+    {
+        for (uint32_t i = 0; i < objectCount / 100; i++)
+        {
+            uint32_t object = pickObject(random);
+            Aabb box = bvh.getBounds(object);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float delta = offset(random);
+                box.min[axis] += delta;
+                box.max[axis] += delta;
+            }
+            bounds[object] = box;
+            bvh.setBounds(object, box);
+        }
+        startTime = std::chrono::steady_clock::now();
+        bvh.update();
+        updateMs += elapsedMs(startTime);
+        rebuilds += bvh.getLastRebuildCount();
+    }
+    bvh.cullFrustum(viewProj, visible);
+    bool matches = visible.size() == linearCull();
+
+    std::cout << "bvh benchmark: " << objectCount << " objects, " << bvh.getTreeletCount() << " treelets, " << bvh.getNodeCount() << " nodes, " << bvh.getThreadCount() << " threads" << std::endl;
+    std::cout << "  build: " << buildMs << " ms" << std::endl;
+    std::cout << "  frustum cull: " << cullMs << " ms (linear " << linearCullMs << " ms), " << linearVisible << " visible" << std::endl;
+    std::cout << "  pick: " << pickUs << " us per ray, " << hits << " / " << queryCount << " hit" << std::endl;
+    std::cout << "  proximity: " << proximityUs << " us per query, " << (double)nearbyTotal / queryCount << " objects within " << radius << std::endl;
+    std::cout << "  update (1% moved): " << updateMs / updateFrames << " ms per frame, " << rebuilds << " treelets rebuilt in " << updateFrames << " frames, " << bvh.getRepartitionCount() << " top-level repartitions" << std::endl;
+    std::cout << "  cull after update matches linear: " << (matches ? "yes" : "no") << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    //命令行参数：
+    //--soft <输出.ppm>     不创建Vulkan，用软件光栅化后端渲染一帧并保存为图片
+    //--soft-bench <帧数>   软件光栅化后端的基准测试
+    //--bvh-bench <物体数>  场景BVH的基准测试，与逐个测试比较
+    //--bench <帧数>        Vulkan后端的基准测试，设置VK_ICD_FILENAMES指向lavapipe，并关闭基础场景以外的功能，即可与软件光栅化后端对比
+    //--export <名字>       把每一帧写入同名的共享内存环（见FrameRing.h），供其他进程读取
+    //--views <相机数>      在一个pass中从多个相机渲染（最多MAX_CAMERA_VIEWS个），窗口中按网格显示所有视图
+    //--serve <套接字路径>   同时作为渲染任务服务运行，协议见RenderJobServer.h
+    //--serve-output <目录>  渲染任务的图片只能写到这个目录下（默认jobs）
+    //--memory-report <秒>  定期输出显存预算、用量和逐出统计
+    //--characters <数量>   场景中的动画角色数（默认DEFAULT_ANIMATED_CHARACTERS，0为关闭）
+    //--skinning <gpu|cpu>  蒙皮方式，默认在支持计算的图形队列上用计算着色器
+    //--culling <on|off>    按相机剔除动画角色，默认打开
+    //--shadows <on|off>    带级联阴影的地面，默认打开（overdraw视图下关闭）
+    //--light-rotation <度每秒>  光源绕竖直轴旋转，静态阴影的缓存每帧失效，默认0
+    //--post <on|off>       HDR场景的计算后处理（泛光、自动曝光、色调映射），默认打开（overdraw视图下关闭）
+    //--render-path <dynamic|renderpass>  设备支持时默认用动态渲染和synchronization2，renderpass强制使用pass和帧缓存
+    //--hud <on|off>        启动时显示性能HUD（帧时间曲线、GPU时间、绘制数、显存），默认关闭，运行中按F1切换
+    //--particles <数量>    GPU粒子的容量（默认DEFAULT_PARTICLES，0为关闭），bench_particles.bat按数量扫描基准测试
+    //--debug-view <normal|overdraw>  overdraw显示每个像素的片段数热力图（蓝、绿、黄、红、白依次增多）
+    //--capture <日志>      把每一帧交给GPU的输入写入日志（见CommandCapture.h）
+    //--replay <日志>       不显示窗口，按日志的配置和输入尽快渲染所有帧，输出每一帧的耗时，其他渲染参数被忽略
+    std::string softOutput;
+    uint32_t softBenchFrames = 0;
+    uint32_t bvhBenchObjects = 0;
+    uint32_t benchFrames = 0;
+    std::string exportName;
+    uint32_t viewCount = 1;
+    std::string servePath;
+    std::string serveOutput = "jobs";
+    float memoryReportSeconds = 0.0f;
+    uint32_t characterCount = DEFAULT_ANIMATED_CHARACTERS;
+    bool cpuSkinning = false;
+    bool characterCulling = true;
+    bool shadows = true;
+    float lightRotation = 0.0f;
+    bool postProcessing = true;
+    bool dynamicRendering = true;
+    bool hud = false;
+    uint32_t particleCapacity = DEFAULT_PARTICLES;
+    DebugView debugView = DebugView::Normal;
+    std::string capturePath;
+    std::string replayPath;
+
+    //整体工作对象
+    HelloTriangleApplication app;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("missing value for argument " + arg);
+            }
+            if (arg == "--soft")
+            {
+                softOutput = argv[++i];
+            }
+            else if (arg == "--soft-bench")
+            {
+                softBenchFrames = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--bvh-bench")
+            {
+                bvhBenchObjects = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--bench")
+            {
+                benchFrames = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--export")
+            {
+                exportName = argv[++i];
+            }
+            else if (arg == "--views")
+            {
+                viewCount = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--serve")
+            {
+                servePath = argv[++i];
+            }
+            else if (arg == "--serve-output")
+            {
+                serveOutput = argv[++i];
+            }
+            else if (arg == "--memory-report")
+            {
+                memoryReportSeconds = std::stof(argv[++i]);
+            }
+            else if (arg == "--characters")
+            {
+                characterCount = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--skinning")
+            {
+                std::string mode = argv[++i];
+                if (mode != "gpu" && mode != "cpu")
+                {
+                    throw std::runtime_error("unknown skinning mode " + mode);
+                }
+                cpuSkinning = mode == "cpu";
+            }
+            else if (arg == "--culling")
+            {
+                std::string mode = argv[++i];
+                if (mode != "on" && mode != "off")
+                {
+                    throw std::runtime_error("unknown culling mode " + mode);
+                }
+                characterCulling = mode == "on";
+            }
+            else if (arg == "--shadows")
+            {
+                std::string mode = argv[++i];
+                if (mode != "on" && mode != "off")
+                {
+                    throw std::runtime_error("unknown shadows mode " + mode);
+                }
+                shadows = mode == "on";
+            }
+            else if (arg == "--light-rotation")
+            {
+                lightRotation = std::stof(argv[++i]);
+            }
+            else if (arg == "--post")
+            {
+                std::string mode = argv[++i];
+                if (mode != "on" && mode != "off")
+                {
+                    throw std::runtime_error("unknown post mode " + mode);
+                }
+                postProcessing = mode == "on";
+            }
+            else if (arg == "--render-path")
+            {
+                std::string path = argv[++i];
+                if (path != "dynamic" && path != "renderpass")
+                {
+                    throw std::runtime_error("unknown render path " + path);
+                }
+                dynamicRendering = path == "dynamic";
+            }
+            else if (arg == "--hud")
+            {
+                std::string mode = argv[++i];
+                if (mode != "on" && mode != "off")
+                {
+                    throw std::runtime_error("unknown hud mode " + mode);
+                }
+                hud = mode == "on";
+            }
+            else if (arg == "--particles")
+            {
+                particleCapacity = (uint32_t)std::stoul(argv[++i]);
+            }
+            else if (arg == "--debug-view")
+            {
+                std::string view = argv[++i];
+                if (view != "normal" && view != "overdraw")
+                {
+                    throw std::runtime_error("unknown debug view " + view);
+                }
+                debugView = view == "overdraw" ? DebugView::Overdraw : DebugView::Normal;
+            }
+            else if (arg == "--capture")
+            {
+                capturePath = argv[++i];
+            }
+            else if (arg == "--replay")
+            {
+                replayPath = argv[++i];
+            }
+            else
+            {
+                throw std::runtime_error("unknown argument " + arg);
+            }
+        }
+
+        if (!softOutput.empty() || softBenchFrames > 0)
+        {
+            runSoftwareRasterizer(softOutput, softBenchFrames);
+            return EXIT_SUCCESS;
+        }
+        if (bvhBenchObjects > 0)
+        {
+            runBvhBenchmark(bvhBenchObjects);
+            return EXIT_SUCCESS;
+        }
+
+        app.setBenchmarkFrames(benchFrames);
+        app.setFrameExport(exportName);
+        app.setViewCount(viewCount);
+        app.setJobServer(servePath, serveOutput);
+        app.setMemoryReportInterval(memoryReportSeconds);
+        app.setAnimatedCharacters(characterCount);
+        app.setCpuSkinning(cpuSkinning);
+        app.setCharacterCulling(characterCulling);
+        app.setShadows(shadows);
+        app.setLightRotation(lightRotation);
+        app.setPostProcessing(postProcessing);
+        app.setDynamicRendering(dynamicRendering);
+        app.setHudVisible(hud);
+        app.setParticleCapacity(particleCapacity);
+        app.setDebugView(debugView);
+        app.setCapture(capturePath);
+        app.setReplay(replayPath);
+        app.run();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
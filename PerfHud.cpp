@@ -0,0 +1,183 @@
+﻿#include "PerfHud.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    //点阵的一个点画成2x2像素
+    const float PIXEL_SIZE = 2.0f;
+    const float GLYPH_ADVANCE = (PerfHud::GLYPH_WIDTH + 1) * PIXEL_SIZE;
+    const float LINE_HEIGHT = (PerfHud::GLYPH_HEIGHT + 2) * PIXEL_SIZE;
+    const float MARGIN = 8.0f;//面板到窗口边缘
+    const float PADDING = 6.0f;//内容到面板边缘
+    const float GRAPH_HEIGHT = 64.0f;
+    const float GRAPH_SAMPLE_WIDTH = 2.0f;//每帧一列帧间隔、一列GPU时间，各1像素
+
+    const uint32_t PANEL_COLOR = PerfHud::rgba(0, 0, 0, 176);
+    const uint32_t GRAPH_COLOR = PerfHud::rgba(255, 255, 255, 24);
+    const uint32_t TEXT_COLOR = PerfHud::rgba(230, 230, 230, 255);
+    const uint32_t FRAME_COLOR = PerfHud::rgba(110, 170, 255, 255);
+    const uint32_t GPU_COLOR = PerfHud::rgba(255, 170, 60, 255);
+    const uint32_t TARGET_COLOR = PerfHud::rgba(90, 220, 90, 255);
+
+    void writeQuad(HudVertex* vertices, float x0, float y0, float x1, float y1, uint32_t glyph, uint32_t color)
+    {
+        const float cellWidth = (float)PerfHud::GLYPH_WIDTH;
+        const float cellHeight = (float)PerfHud::GLYPH_HEIGHT;
+        vertices[0] = { { x0, y0 }, { 0.0f, 0.0f }, glyph, color };
+        vertices[1] = { { x1, y0 }, { cellWidth, 0.0f }, glyph, color };
+        vertices[2] = { { x1, y1 }, { cellWidth, cellHeight }, glyph, color };
+        vertices[3] = vertices[0];
+        vertices[4] = vertices[2];
+        vertices[5] = { { x0, y1 }, { 0.0f, cellHeight }, glyph, color };
+    }
+}
+
+void PerfHud::addFrame(float frameMs, float gpuMs)
+{
+    frameHistory[historyNext] = frameMs;
+    gpuHistory[historyNext] = gpuMs;
+    historyNext = (historyNext + 1) % HISTORY;
+    historyCount = std::min(historyCount + 1, HISTORY);
+}
+
+uint32_t PerfHud::build(const HudStats& stats, float targetMs, HudVertex* vertices, uint32_t capacity)
+{
+    output = vertices;
+    outputCount = 0;
+    outputCapacity = capacity;
+
+    //背景要最先画，它的大小在文字和曲线排好之后才知道，先占住第一个四边形
+    addQuad(0.0f, 0.0f, 0.0f, 0.0f, PANEL_COLOR);
+
+    //历史中的平均值和最大值；队列占用只统计读到了GPU时间的帧
+    float frameSum = 0.0f;
+    float frameMax = 0.0f;
+    float gpuSum = 0.0f;
+    float gpuFrameSum = 0.0f;
+    uint32_t gpuSamples = 0;
+    for (uint32_t i = 0; i < historyCount; i++)
+    {
+        frameSum += frameHistory[i];
+        frameMax = std::max(frameMax, frameHistory[i]);
+        if (gpuHistory[i] >= 0.0f)
+        {
+            gpuSum += gpuHistory[i];
+            gpuFrameSum += frameHistory[i];
+            gpuSamples++;
+        }
+    }
+    uint32_t latest = (historyNext + HISTORY - 1) % HISTORY;
+    float frameAverage = historyCount > 0 ? frameSum / historyCount : 0.0f;
+
+    char line[96];
+    float x = MARGIN + PADDING;
+    float y = MARGIN + PADDING;
+    float width = 0.0f;
+
+    snprintf(line, sizeof(line), "FRAME %6.2f MS  AVG %6.2f  MAX %6.2f", frameHistory[latest], frameAverage, frameMax);
+    width = std::max(width, addText(x, y, FRAME_COLOR, line));
+    y += LINE_HEIGHT;
+
+    if (gpuSamples > 0)
+    {
+        float gpuAverage = gpuSum / gpuSamples;
+        float queueBusy = gpuFrameSum > 0.0f ? std::min(gpuSum / gpuFrameSum, 1.0f) : 0.0f;
+        snprintf(line, sizeof(line), "GPU   %6.2f MS  AVG %6.2f  QUEUE %3.0f%%", gpuHistory[latest] >= 0.0f ? gpuHistory[latest] : gpuAverage, gpuAverage, queueBusy * 100.0f);
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "GPU   -- (NO TIMESTAMPS)");
+    }
+    width = std::max(width, addText(x, y, GPU_COLOR, line));
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "CPU   %6.2f MS  HUD %5.3f MS", stats.cpuMs, stats.hudMs);
+    width = std::max(width, addText(x, y, TEXT_COLOR, line));
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "RENDER %ux%u  SCALE %.2f", stats.renderWidth, stats.renderHeight, stats.renderScale);
+    width = std::max(width, addText(x, y, TEXT_COLOR, line));
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "DRAWS %u  BINDS %u  SEGMENTS %u/%u", stats.drawCount, stats.stateChanges, stats.segmentsRecorded, stats.segmentCount);
+    width = std::max(width, addText(x, y, TEXT_COLOR, line));
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), stats.trianglesMeasured ? "TRIANGLES %llu" : "TRIANGLES ~%llu (DIRECT DRAWS)", (unsigned long long)stats.triangles);
+    width = std::max(width, addText(x, y, TEXT_COLOR, line));
+    y += LINE_HEIGHT;
+
+    snprintf(line, sizeof(line), "VRAM %.0f / %.0f MIB", stats.memoryUsage / (1024.0 * 1024.0), stats.memoryBudget / (1024.0 * 1024.0));
+    width = std::max(width, addText(x, y, TEXT_COLOR, line));
+    y += LINE_HEIGHT;
+
+    //帧时间曲线：最新的帧在最右边，纵轴是0到两倍预算，超出的截断
+    float graphWidth = HISTORY * GRAPH_SAMPLE_WIDTH;
+    float graphBottom = y + GRAPH_HEIGHT;
+    float msToPixels = GRAPH_HEIGHT / (targetMs * 2.0f);
+    addQuad(x, y, graphWidth, GRAPH_HEIGHT, GRAPH_COLOR);
+    for (uint32_t i = 0; i < historyCount; i++)
+    {
+        uint32_t index = (historyNext + HISTORY - historyCount + i) % HISTORY;
+        float sampleX = x + (HISTORY - historyCount + i) * GRAPH_SAMPLE_WIDTH;
+        float frameHeight = std::min(frameHistory[index] * msToPixels, GRAPH_HEIGHT);
+        addQuad(sampleX, graphBottom - frameHeight, 1.0f, frameHeight, FRAME_COLOR);
+        if (gpuHistory[index] >= 0.0f)
+        {
+            float gpuHeight = std::min(gpuHistory[index] * msToPixels, GRAPH_HEIGHT);
+            addQuad(sampleX + 1.0f, graphBottom - gpuHeight, 1.0f, gpuHeight, GPU_COLOR);
+        }
+    }
+    addQuad(x, graphBottom - targetMs * msToPixels, graphWidth, 1.0f, TARGET_COLOR);
+    width = std::max(width, graphWidth);
+    y = graphBottom + PADDING;
+
+    snprintf(line, sizeof(line), "TARGET %.1f MS", targetMs);
+    width = std::max(width, addText(x, y, TARGET_COLOR, line));
+    y += LINE_HEIGHT;
+
+    //回到第一个四边形写入背景
+    uint32_t count = outputCount;
+    outputCount = 0;
+    addQuad(MARGIN, MARGIN, width + PADDING * 2.0f, y - MARGIN, PANEL_COLOR);
+    outputCount = count;
+
+    output = nullptr;
+    return outputCount;
+}
+
+void PerfHud::addQuad(float x, float y, float width, float height, uint32_t color)
+{
+    if (outputCount + VERTICES_PER_QUAD > outputCapacity)
+    {
+        return;
+    }
+    writeQuad(output + outputCount, x, y, x + width, y + height, SOLID, color);
+    outputCount += VERTICES_PER_QUAD;
+}
+
+float PerfHud::addText(float x, float y, uint32_t color, const char* text)
+{
+    float penX = x;
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        uint32_t code = (uint8_t)*c;
+        if (code >= 'a' && code <= 'z')
+        {
+            code -= 'a' - 'A';
+        }
+        if (code < 32 || code > 95)
+        {
+            code = '?';
+        }
+        if (code != ' ' && outputCount + VERTICES_PER_QUAD <= outputCapacity)
+        {
+            writeQuad(output + outputCount, penX, y, penX + GLYPH_WIDTH * PIXEL_SIZE, y + GLYPH_HEIGHT * PIXEL_SIZE, code - 32, color);
+            outputCount += VERTICES_PER_QUAD;
+        }
+        penX += GLYPH_ADVANCE;
+    }
+    return penX - x - PIXEL_SIZE;
+}
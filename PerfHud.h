@@ -0,0 +1,77 @@
+﻿#pragma once
+
+/*
+性能HUD：帧时间曲线、CPU和GPU时间、队列占用、渲染分辨率、绘制数和三角形数、显存用量
+
+1. 文字和矩形都是带颜色的四边形，每个四边形6个顶点，依次写入调用者给的顶点数组（渲染器为每个帧槽准备一个持久映射的顶点缓冲），
+   在放大pass的最后用一次vkCmdDraw画出，没有索引缓冲、纹理和描述符
+2. 字形是5x7的点阵，覆盖ASCII 32~95（小写字母按大写显示），点阵表在HudShader.frag中；
+   顶点只带字符编码和点阵中的坐标，片段着色器查表决定是否着色，空格不生成四边形
+3. 帧循环中不分配内存：帧时间的历史是固定长度的环，文字用snprintf写到栈上的缓冲；超出容量的四边形直接丢弃
+*/
+
+#include <cstdint>
+
+//与HudShader.vert的输入一致
+struct HudVertex
+{
+    float position[2];//像素坐标，左上角为原点
+    float cell[2];//点阵中的坐标（x为0~5，y为0~7），纯色矩形不使用
+    uint32_t glyph;//字符编码减32，纯色矩形为PerfHud::SOLID
+    uint32_t color;//RGBA8，R在最低字节
+};
+
+//一帧显示的统计，由渲染器收集
+struct HudStats
+{
+    float cpuMs;//上一帧录制和提交的CPU时间，不包括等待栅栏
+    float hudMs;//上一帧生成HUD顶点的时间
+    uint32_t renderWidth;
+    uint32_t renderHeight;
+    float renderScale;
+    uint32_t drawCount;
+    uint32_t stateChanges;
+    uint32_t segmentsRecorded;//上一帧重新录制的指令片段数
+    uint32_t segmentCount;
+    uint64_t triangles;
+    bool trianglesMeasured;//来自管线统计；否则是直接绘制的顶点数估计的，不包括间接绘制
+    uint64_t memoryUsage;//设备本地堆的用量和预算
+    uint64_t memoryBudget;
+};
+
+class PerfHud
+{
+public:
+    static const uint32_t HISTORY = 128;//帧时间曲线的帧数
+    static const uint32_t GLYPH_WIDTH = 5;
+    static const uint32_t GLYPH_HEIGHT = 7;
+    static const uint32_t SOLID = 0xffff;//与HudShader.frag一致
+    static const uint32_t VERTICES_PER_QUAD = 6;
+
+    //RGBA8，与顶点属性的VK_FORMAT_R8G8B8A8_UNORM一致
+    static constexpr uint32_t rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+    {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    //每帧调用：帧间隔（包括等待栅栏和垂直同步）和最近读到的GPU帧时间，读不到时为负数
+    void addFrame(float frameMs, float gpuMs);
+
+    //写入最多capacity个顶点，返回写入的顶点数；targetMs是曲线上标出的帧时间预算
+    uint32_t build(const HudStats& stats, float targetMs, HudVertex* vertices, uint32_t capacity);
+
+private:
+    void addQuad(float x, float y, float width, float height, uint32_t color);
+    //返回文字的宽度
+    float addText(float x, float y, uint32_t color, const char* text);
+
+    float frameHistory[HISTORY] = {};
+    float gpuHistory[HISTORY] = {};
+    uint32_t historyNext = 0;
+    uint32_t historyCount = 0;
+
+    //build期间的输出
+    HudVertex* output = nullptr;
+    uint32_t outputCount = 0;
+    uint32_t outputCapacity = 0;
+};
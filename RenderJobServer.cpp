@@ -0,0 +1,333 @@
+﻿#include "RenderJobServer.h"
+
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    //一个连接上未成行的数据上限，超过说明客户端不是按协议发送
+    const size_t MAX_LINE_LENGTH = 4096;
+
+    //排队任务的上限，一个客户端不能让队列无限增长，也不能占满队列让其他客户端排不进来
+    const size_t MAX_QUEUED_JOBS = 256;
+    const uint32_t MAX_QUEUED_JOBS_PER_CLIENT = 32;
+
+    //客户端断开后写入不能触发SIGPIPE结束整个服务
+#if defined(MSG_NOSIGNAL)
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    //客户端给的输出路径只能是输出目录下的.ppm文件：不能是绝对路径或带盘符，每一级都不能是空、.或..
+    bool isSafeOutputPath(const std::string& path)
+    {
+        const std::string extension = ".ppm";
+        if (path.size() <= extension.size() || path.compare(path.size() - extension.size(), extension.size(), extension) != 0)
+        {
+            return false;
+        }
+        if (path[0] == '/' || path[0] == '\\' || path.find(':') != std::string::npos)
+        {
+            return false;
+        }
+
+        size_t start = 0;
+        while (start <= path.size())
+        {
+            size_t end = path.find_first_of("/\\", start);
+            if (end == std::string::npos)
+            {
+                end = path.size();
+            }
+            std::string part = path.substr(start, end - start);
+            if (part.empty() || part == "." || part == "..")
+            {
+                return false;
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    bool wouldBlock()
+    {
+#if defined(_WIN32)
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    template <typename Socket>
+    bool setNonBlocking(Socket socket)
+    {
+#if defined(_WIN32)
+        u_long mode = 1;
+        return ioctlsocket((SOCKET)socket, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(socket, F_GETFL, 0);
+        return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+    }
+}
+
+RenderJobServer::~RenderJobServer()
+{
+    stop();
+}
+
+void RenderJobServer::start(const std::string& socketPath, const std::string& outputDirectory)
+{
+    stop();
+
+    std::error_code error;
+    std::filesystem::create_directories(outputDirectory, error);
+    if (!std::filesystem::is_directory(outputDirectory, error))
+    {
+        throw std::runtime_error("failed to create job output directory!");
+    }
+    this->outputDirectory = outputDirectory;
+
+#if defined(_WIN32)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        throw std::runtime_error("failed to initialize winsock!");
+    }
+#endif
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("job server socket path is too long!");
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    //上次异常退出留下的套接字文件
+#if defined(_WIN32)
+    DeleteFileA(socketPath.c_str());
+#else
+    unlink(socketPath.c_str());
+#endif
+
+    listenSocket = (SocketHandle)socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenSocket == INVALID_SOCKET_HANDLE)
+    {
+        throw std::runtime_error("failed to create job server socket!");
+    }
+    if (bind(listenSocket, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 16) != 0 || !setNonBlocking(listenSocket))
+    {
+        closeSocket(listenSocket);
+        listenSocket = INVALID_SOCKET_HANDLE;
+        throw std::runtime_error("failed to listen on job server socket!");
+    }
+    path = socketPath;
+}
+
+void RenderJobServer::stop()
+{
+    if (listenSocket == INVALID_SOCKET_HANDLE)
+    {
+        return;
+    }
+
+    for (auto& client : clients)
+    {
+        closeSocket(client.socket);
+    }
+    clients.clear();
+    closeSocket(listenSocket);
+    listenSocket = INVALID_SOCKET_HANDLE;
+
+#if defined(_WIN32)
+    DeleteFileA(path.c_str());
+    WSACleanup();
+#else
+    unlink(path.c_str());
+#endif
+}
+
+void RenderJobServer::poll()
+{
+    if (listenSocket == INVALID_SOCKET_HANDLE)
+    {
+        return;
+    }
+
+    //接受所有等待中的连接
+    while (true)
+    {
+        SocketHandle socket = (SocketHandle)accept(listenSocket, nullptr, nullptr);
+        if (socket == INVALID_SOCKET_HANDLE)
+        {
+            break;
+        }
+        if (!setNonBlocking(socket))
+        {
+            closeSocket(socket);
+            continue;
+        }
+        clients.push_back({ nextClientId++, socket, std::string() });
+    }
+
+    //读取每个连接上已经到达的数据，按行处理
+    for (size_t i = 0; i < clients.size();)
+    {
+        Client& client = clients[i];
+        bool closed = false;
+        char buffer[1024];
+        while (true)
+        {
+            int received = (int)recv(client.socket, buffer, sizeof(buffer), 0);
+            if (received > 0)
+            {
+                client.input.append(buffer, (size_t)received);
+                continue;
+            }
+            closed = received == 0 || !wouldBlock();
+            break;
+        }
+
+        size_t lineEnd;
+        while ((lineEnd = client.input.find('\n')) != std::string::npos)
+        {
+            std::string line = client.input.substr(0, lineEnd);
+            client.input.erase(0, lineEnd + 1);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            handleLine(client, line);
+        }
+
+        if (closed || client.input.size() > MAX_LINE_LENGTH)
+        {
+            //断开的连接上排队的任务仍然会执行，只是结果不再回复
+            closeSocket(client.socket);
+            clients.erase(clients.begin() + i);
+            continue;
+        }
+        i++;
+    }
+}
+
+void RenderJobServer::handleLine(Client& client, const std::string& line)
+{
+    std::istringstream stream(line);
+    std::string command;
+    stream >> command;
+
+    if (command == "render")
+    {
+        RenderJob job;
+        if (!(stream >> job.id >> job.priority >> job.cameraAngle >> job.cameraZoom >> job.outputPath))
+        {
+            send(client.id, "error " + (job.id.empty() ? std::string("-") : job.id) + " malformed render request");
+            return;
+        }
+        if (!isSafeOutputPath(job.outputPath))
+        {
+            send(client.id, "error " + job.id + " output must be a relative .ppm path inside the output directory");
+            return;
+        }
+        if (jobs.size() >= MAX_QUEUED_JOBS || client.queuedJobs >= MAX_QUEUED_JOBS_PER_CLIENT)
+        {
+            send(client.id, "error " + job.id + " queue full");
+            return;
+        }
+        job.outputPath = outputDirectory + "/" + job.outputPath;
+        job.client = client.id;
+        job.sequence = nextSequence++;
+        job.queuedTime = std::chrono::steady_clock::now();
+        jobs.push(job);
+        client.queuedJobs++;
+        jobsReceived++;
+        send(client.id, "queued " + job.id + " " + std::to_string(jobs.size()));
+    }
+    else if (command == "stats")
+    {
+        send(client.id, "stats " + std::to_string(jobsReceived) + " " + std::to_string(jobsCompleted) + " " + std::to_string(jobsFailed) + " " + std::to_string(jobs.size()) + " " + std::to_string(runningJobs));
+    }
+    else if (!command.empty())
+    {
+        send(client.id, "error - unknown command " + command);
+    }
+}
+
+bool RenderJobServer::popJob(RenderJob& job)
+{
+    if (jobs.empty())
+    {
+        return false;
+    }
+    job = jobs.top();
+    jobs.pop();
+    //连接已经断开时它的计数也随之消失
+    for (auto& client : clients)
+    {
+        if (client.id == job.client)
+        {
+            client.queuedJobs--;
+            break;
+        }
+    }
+    return true;
+}
+
+void RenderJobServer::completeJob(const RenderJob& job)
+{
+    jobsCompleted++;
+    double queuedMs = std::chrono::duration<double, std::milli>(job.startedTime - job.queuedTime).count();
+    double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.startedTime).count();
+    send(job.client, "done " + job.id + " " + std::to_string(queuedMs) + " " + std::to_string(renderMs));
+}
+
+void RenderJobServer::failJob(const RenderJob& job, const std::string& reason)
+{
+    jobsFailed++;
+    send(job.client, "error " + job.id + " " + reason);
+}
+
+void RenderJobServer::send(uint64_t clientId, const std::string& line)
+{
+    for (auto& client : clients)
+    {
+        if (client.id != clientId)
+        {
+            continue;
+        }
+
+        //回复很短，写不进去说明客户端长时间不读，直接丢弃这条回复
+        std::string data = line + "\n";
+        ::send(client.socket, data.c_str(), (int)data.size(), SEND_FLAGS);
+        return;
+    }
+}
+
+void RenderJobServer::closeSocket(SocketHandle socket)
+{
+#if defined(_WIN32)
+    closesocket((SOCKET)socket);
+#else
+    close(socket);
+#endif
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+
+/*
+渲染任务服务：常驻进程通过本地套接字（AF_UNIX，Windows 10 1803之后也支持）接收渲染任务，
+多个客户端可以同时连接，任务按优先级排队，由渲染器分给共享同一个VkDevice的渲染上下文执行
+
+协议是一行一条的文本：
+    客户端 -> 服务： render <任务id> <优先级> <相机角度（度）> <相机缩放> <输出.ppm>
+                    stats
+    服务 -> 客户端： queued <任务id> <队列长度>
+                    done <任务id> <排队ms> <渲染ms>
+                    error <任务id> <原因>
+                    stats <已接收> <已完成> <失败> <排队中> <执行中>
+优先级数值越大越先执行，相同优先级按到达顺序执行
+排队的任务总数和每个连接排队的任务数都有上限，超过时直接回复error，不进入队列
+任务只画静态场景（场景桶中的绘制），不包括角色、粒子、阴影和后处理
+输出路径是相对于服务的输出目录的.ppm文件，绝对路径、盘符和..都会被拒绝，客户端不能写到输出目录之外
+*/
+
+#include <cstdint>
+#include <chrono>
+#include <queue>
+#include <string>
+#include <vector>
+
+//一个渲染任务：场景固定，任务决定相机和输出
+struct RenderJob
+{
+    std::string id;//客户端给的任务id，回复时原样带回
+    int32_t priority = 0;
+    float cameraAngle = 0.0f;//绕场景中心旋转的角度（度）
+    float cameraZoom = 1.0f;
+    std::string outputPath;//已经拼接上服务的输出目录
+
+    uint64_t client = 0;//提交任务的连接
+    uint64_t sequence = 0;//到达顺序
+    std::chrono::steady_clock::time_point queuedTime;
+    std::chrono::steady_clock::time_point startedTime;//渲染器开始执行的时间
+};
+
+class RenderJobServer
+{
+public:
+    RenderJobServer() = default;
+    ~RenderJobServer();
+
+    RenderJobServer(const RenderJobServer&) = delete;
+    RenderJobServer& operator=(const RenderJobServer&) = delete;
+
+    //在指定路径上监听，任务的图片都写到outputDirectory下（不存在时创建），失败时抛出异常
+    void start(const std::string& socketPath, const std::string& outputDirectory);
+    void stop();
+    bool isRunning() const { return listenSocket != INVALID_SOCKET_HANDLE; }
+
+    //接受新连接、读取请求，不会阻塞。每帧调用一次
+    void poll();
+
+    //取出优先级最高的任务，没有任务时返回false
+    bool popJob(RenderJob& job);
+
+    //回复任务结果，连接已经断开时忽略
+    void completeJob(const RenderJob& job);
+    void failJob(const RenderJob& job, const std::string& reason);
+
+    //渲染器当前正在执行的任务数，只用于stats回复
+    void setRunningJobs(uint32_t count) { runningJobs = count; }
+
+private:
+#if defined(_WIN32)
+    typedef uintptr_t SocketHandle;
+#else
+    typedef int SocketHandle;
+#endif
+    static const SocketHandle INVALID_SOCKET_HANDLE = (SocketHandle)-1;
+
+    struct Client
+    {
+        uint64_t id;
+        SocketHandle socket;
+        std::string input;//还没有凑成一行的数据
+        uint32_t queuedJobs = 0;//这个连接排队中的任务数
+    };
+
+    //按优先级排序，同优先级先到先执行
+    struct JobOrder
+    {
+        bool operator()(const RenderJob& a, const RenderJob& b) const
+        {
+            if (a.priority != b.priority)
+            {
+                return a.priority < b.priority;
+            }
+            return a.sequence > b.sequence;
+        }
+    };
+
+    void handleLine(Client& client, const std::string& line);
+    void send(uint64_t clientId, const std::string& line);
+    void closeSocket(SocketHandle socket);
+
+    SocketHandle listenSocket = INVALID_SOCKET_HANDLE;
+    std::string path;
+    std::string outputDirectory;
+    std::vector<Client> clients;
+    std::priority_queue<RenderJob, std::vector<RenderJob>, JobOrder> jobs;
+    uint64_t nextClientId = 1;
+    uint64_t nextSequence = 0;
+
+    uint64_t jobsReceived = 0;
+    uint64_t jobsCompleted = 0;
+    uint64_t jobsFailed = 0;
+    uint32_t runningJobs = 0;
+};
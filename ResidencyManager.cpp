@@ -0,0 +1,346 @@
+﻿#include "ResidencyManager.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+const char* getMemoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+    case MemoryCategory::Geometry:
+        return "geometry";
+    case MemoryCategory::Uniform:
+        return "uniform";
+    case MemoryCategory::RenderTarget:
+        return "render target";
+    case MemoryCategory::Readback:
+        return "readback";
+    default:
+        return "unknown";
+    }
+}
+
+namespace
+{
+    double toMiB(VkDeviceSize bytes)
+    {
+        return (double)bytes / (1024.0 * 1024.0);
+    }
+}
+
+void ResidencyManager::init(VkPhysicalDevice physicalDevice, VkDevice device, bool budgetExtension)
+{
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    budgetSupported = budgetExtension;
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    heaps.assign(memoryProperties.memoryHeapCount, HeapState());
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+    {
+        heaps[i].size = memoryProperties.memoryHeaps[i].size;
+        heaps[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+    refreshBudget();
+}
+
+void ResidencyManager::refreshBudget()
+{
+    lastBudgetRefresh = currentFrame;
+    if (!budgetSupported)
+    {
+        for (auto& heap : heaps)
+        {
+            heap.budget = (VkDeviceSize)(heap.size * DEFAULT_BUDGET_FRACTION);
+        }
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+    for (uint32_t i = 0; i < (uint32_t)heaps.size(); i++)
+    {
+        heaps[i].budget = budgetProperties.heapBudget[i];
+        heaps[i].driverUsage = budgetProperties.heapUsage[i];
+    }
+}
+
+VkDeviceSize ResidencyManager::heapUsage(uint32_t heap) const
+{
+    //驱动的用量在两次刷新之间不会变化，这期间新增的分配由trackedUsage补上
+    return std::max(heaps[heap].driverUsage, heaps[heap].trackedUsage);
+}
+
+int32_t ResidencyManager::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+VkDeviceMemory ResidencyManager::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category, uint32_t group)
+{
+    int32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    if (memoryType < 0)
+    {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+
+    //依次尝试：直接分配；逐出后分配；降级到不要求设备本地的内存类型
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    for (uint32_t attempt = 0; attempt < 3; attempt++)
+    {
+        if (attempt == 2)
+        {
+            if ((properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
+            {
+                break;
+            }
+            memoryType = findMemoryType(requirements.memoryTypeBits, properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if (memoryType < 0)
+            {
+                break;
+            }
+        }
+
+        uint32_t heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+        if (attempt == 1)
+        {
+            evictUntil(heap, requirements.size, heaps[heap].budget);
+        }
+        else if (attempt == 0 && heapUsage(heap) + requirements.size > heaps[heap].budget)
+        {
+            //明知超出预算时不去碰驱动，直接进入逐出
+            continue;
+        }
+
+        allocInfo.memoryTypeIndex = (uint32_t)memoryType;
+        VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+        if (result == VK_SUCCESS)
+        {
+            if (attempt == 2)
+            {
+                demotionCount++;
+            }
+            break;
+        }
+        memory = VK_NULL_HANDLE;
+        if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY && result != VK_ERROR_OUT_OF_HOST_MEMORY)
+        {
+            break;
+        }
+    }
+
+    if (memory == VK_NULL_HANDLE)
+    {
+        failedAllocations++;
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    Allocation allocation = {};
+    allocation.heap = memoryProperties.memoryTypes[memoryType].heapIndex;
+    allocation.size = requirements.size;
+    allocation.category = category;
+    allocation.group = group;
+    allocations[memory] = allocation;
+
+    HeapState& heap = heaps[allocation.heap];
+    heap.trackedUsage += allocation.size;
+    heap.categoryUsage[(size_t)category] += allocation.size;
+    if (group != NOT_EVICTABLE)
+    {
+        groups[group].heapBytes[allocation.heap] += allocation.size;
+        groups[group].lastUsedFrame = currentFrame;
+    }
+    return memory;
+}
+
+void ResidencyManager::free(VkDeviceMemory memory)
+{
+    if (memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    auto found = allocations.find(memory);
+    if (found != allocations.end())
+    {
+        const Allocation& allocation = found->second;
+        HeapState& heap = heaps[allocation.heap];
+        heap.trackedUsage -= allocation.size;
+        heap.categoryUsage[(size_t)allocation.category] -= allocation.size;
+        if (allocation.group != NOT_EVICTABLE)
+        {
+            groups[allocation.group].heapBytes[allocation.heap] -= allocation.size;
+        }
+        allocations.erase(found);
+    }
+    vkFreeMemory(device, memory, nullptr);
+}
+
+uint32_t ResidencyManager::addGroup(const std::string& name, std::function<bool()> evict)
+{
+    Group group;
+    group.name = name;
+    group.evict = std::move(evict);
+    group.lastUsedFrame = currentFrame;
+    group.active = true;
+
+    //复用已经移除的组的位置
+    for (uint32_t i = 0; i < (uint32_t)groups.size(); i++)
+    {
+        if (!groups[i].active)
+        {
+            groups[i] = std::move(group);
+            return i;
+        }
+    }
+    groups.push_back(std::move(group));
+    //逐出时的候选数组只在这里增长，帧循环里的update()不分配
+    evictionCandidates.reserve(groups.size());
+    return (uint32_t)groups.size() - 1;
+}
+
+void ResidencyManager::removeGroup(uint32_t group)
+{
+    groups[group] = Group();
+}
+
+void ResidencyManager::touch(uint32_t group)
+{
+    groups[group].lastUsedFrame = currentFrame;
+}
+
+void ResidencyManager::update(uint64_t frameNumber)
+{
+    currentFrame = frameNumber;
+    if (currentFrame - lastBudgetRefresh < BUDGET_REFRESH_FRAMES)
+    {
+        return;
+    }
+    refreshBudget();
+
+    for (uint32_t heap = 0; heap < (uint32_t)heaps.size(); heap++)
+    {
+        VkDeviceSize budget = heaps[heap].budget;
+        if (heapUsage(heap) > (VkDeviceSize)(budget * EVICT_HIGH_WATERMARK))
+        {
+            evictUntil(heap, 0, (VkDeviceSize)(budget * EVICT_LOW_WATERMARK));
+        }
+    }
+}
+
+bool ResidencyManager::evictUntil(uint32_t heap, VkDeviceSize extraBytes, VkDeviceSize target)
+{
+    //候选：在这个堆上有分配、最近没有用过的组，最久未使用的先逐出
+    std::vector<uint32_t>& candidates = evictionCandidates;
+    candidates.clear();
+    for (uint32_t i = 0; i < (uint32_t)groups.size(); i++)
+    {
+        const Group& group = groups[i];
+        if (group.active && group.heapBytes[heap] > 0 && currentFrame - group.lastUsedFrame >= MIN_IDLE_FRAMES)
+        {
+            candidates.push_back(i);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+    {
+        return groups[a].lastUsedFrame < groups[b].lastUsedFrame;
+    });
+
+    for (uint32_t candidate : candidates)
+    {
+        if (heapUsage(heap) + extraBytes <= target)
+        {
+            break;
+        }
+
+        //逐出回调会对组里的每个分配调用free
+        Group& group = groups[candidate];
+        VkDeviceSize before = group.heapBytes[heap];
+        if (group.evict())
+        {
+            evictionCount++;
+            evictedBytes += before - group.heapBytes[heap];
+            //驱动的用量要到下次刷新才会下降，先按逐出的大小扣掉
+            heaps[heap].driverUsage -= std::min(heaps[heap].driverUsage, before - group.heapBytes[heap]);
+        }
+    }
+    return heapUsage(heap) + extraBytes <= target;
+}
+
+void ResidencyManager::printReport(std::ostream& out)
+{
+    refreshBudget();
+
+    //调用者的流（通常是std::cout）之后还要输出别的数字，格式在返回前还原
+    std::ios::fmtflags savedFlags = out.flags();
+    std::streamsize savedPrecision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    out << "memory report (" << (budgetSupported ? "VK_EXT_memory_budget" : "estimated budget") << "):" << std::endl;
+    for (uint32_t i = 0; i < (uint32_t)heaps.size(); i++)
+    {
+        const HeapState& heap = heaps[i];
+        out << "  heap " << i << (heap.deviceLocal ? " (device local)" : " (host)") << ": "
+            << toMiB(heapUsage(i)) << " / " << toMiB(heap.budget) << " MiB budget, " << toMiB(heap.size) << " MiB total" << std::endl;
+        for (size_t category = 0; category < (size_t)MemoryCategory::Count; category++)
+        {
+            if (heap.categoryUsage[category] > 0)
+            {
+                out << "    " << std::left << std::setw(14) << getMemoryCategoryName((MemoryCategory)category) << std::right << toMiB(heap.categoryUsage[category]) << " MiB" << std::endl;
+            }
+        }
+    }
+
+    uint32_t residentGroups = 0;
+    uint32_t activeGroups = 0;
+    for (const auto& group : groups)
+    {
+        if (!group.active)
+        {
+            continue;
+        }
+        activeGroups++;
+        for (uint32_t heap = 0; heap < (uint32_t)heaps.size(); heap++)
+        {
+            if (group.heapBytes[heap] > 0)
+            {
+                residentGroups++;
+                break;
+            }
+        }
+    }
+    out << "  allocations: " << allocations.size() << ", evictable groups resident: " << residentGroups << "/" << activeGroups << std::endl;
+    out << "  evictions: " << evictionCount << " (" << toMiB(evictedBytes) << " MiB), demotions: " << demotionCount << ", failed allocations: " << failedAllocations << std::endl;
+    out.flags(savedFlags);
+    out.precision(savedPrecision);
+}
+
+void ResidencyManager::getDeviceLocalUsage(VkDeviceSize& usage, VkDeviceSize& budget) const
+{
+    usage = 0;
+    budget = 0;
+    for (uint32_t i = 0; i < (uint32_t)heaps.size(); i++)
+    {
+        if (heaps[i].deviceLocal)
+        {
+            usage += heapUsage(i);
+            budget += heaps[i].budget;
+        }
+    }
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+
+/*
+显存预算和驻留管理：所有vkAllocateMemory都经过这里
+
+1. 预算：设备支持VK_EXT_memory_budget时读取驱动给出的每个堆的预算和用量（包括本进程中不经过这里的用量），
+   否则预算按堆大小的DEFAULT_BUDGET_FRACTION估计，用量为这里记录的分配之和
+2. 每个分配记录所在的堆和资源类别，报告中按堆、按类别列出
+3. 可逐出资源：拥有者把一组分配注册为一个驻留组，提供逐出回调，每次使用时touch。某个堆的用量超过预算的
+   EVICT_HIGH_WATERMARK时，按最久未使用的顺序逐出使用这个堆的组，直到低于EVICT_LOW_WATERMARK；
+   逐出只是回调拥有者销毁资源，之后再用到时由拥有者重新创建
+4. 分配失败（超出预算或驱动返回显存不足）时先逐出再重试，仍然失败且要求的是设备本地内存时降级到其他可用的内存类型，
+   都不行才抛出异常
+*/
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//资源类别，只用于统计
+enum class MemoryCategory : uint32_t
+{
+    Geometry,//顶点、索引
+    Uniform,//相机等常量
+    RenderTarget,//颜色附件
+    Readback,//回读缓冲
+    Count
+};
+
+const char* getMemoryCategoryName(MemoryCategory category);
+
+class ResidencyManager
+{
+public:
+    //不属于任何驻留组的分配，不会被逐出
+    static const uint32_t NOT_EVICTABLE = UINT32_MAX;
+
+    //未启用VK_EXT_memory_budget时，预算占堆大小的比例
+    static constexpr float DEFAULT_BUDGET_FRACTION = 0.8f;
+    static constexpr float EVICT_HIGH_WATERMARK = 0.9f;
+    static constexpr float EVICT_LOW_WATERMARK = 0.75f;
+    //最近这么多帧内用过的组不逐出，避免正在使用的资源来回创建
+    static const uint64_t MIN_IDLE_FRAMES = 8;
+    //每隔这么多帧重新读取一次预算
+    static const uint64_t BUDGET_REFRESH_FRAMES = 30;
+
+    //budgetExtension：创建设备时是否启用了VK_EXT_memory_budget
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, bool budgetExtension);
+
+    //分配显存，group为所属的驻留组。失败时抛出异常
+    VkDeviceMemory allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, MemoryCategory category, uint32_t group = NOT_EVICTABLE);
+    void free(VkDeviceMemory memory);
+
+    //注册驻留组。evict回调销毁组里的资源（对每个分配调用free），返回false表示现在不能逐出（例如GPU还在使用）
+    uint32_t addGroup(const std::string& name, std::function<bool()> evict);
+    void removeGroup(uint32_t group);
+    //组里的资源在这一帧被使用
+    void touch(uint32_t group);
+
+    //每帧调用：定期刷新预算，超过高水位时逐出
+    void update(uint64_t frameNumber);
+
+    //当前的预算、用量、各类别的分配和逐出统计
+    void printReport(std::ostream& out);
+
+    //所有设备本地堆的用量和预算之和，不刷新预算，可以每帧调用
+    void getDeviceLocalUsage(VkDeviceSize& usage, VkDeviceSize& budget) const;
+
+private:
+    struct Allocation
+    {
+        uint32_t heap;
+        VkDeviceSize size;
+        MemoryCategory category;
+        uint32_t group;
+    };
+
+    struct Group
+    {
+        std::string name;
+        std::function<bool()> evict;
+        uint64_t lastUsedFrame = 0;
+        VkDeviceSize heapBytes[VK_MAX_MEMORY_HEAPS] = {};//组在每个堆上的分配大小
+        bool active = false;
+    };
+
+    struct HeapState
+    {
+        VkDeviceSize size = 0;
+        VkDeviceSize budget = 0;
+        VkDeviceSize driverUsage = 0;//VK_EXT_memory_budget给出的用量，未启用时为0
+        VkDeviceSize trackedUsage = 0;//经过这里的分配之和
+        VkDeviceSize categoryUsage[(size_t)MemoryCategory::Count] = {};
+        bool deviceLocal = false;
+    };
+
+    void refreshBudget();
+    VkDeviceSize heapUsage(uint32_t heap) const;
+    int32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    //逐出使用这个堆的最久未使用的组，直到用量加上extraBytes不超过target，返回是否达到
+    bool evictUntil(uint32_t heap, VkDeviceSize extraBytes, VkDeviceSize target);
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    bool budgetSupported = false;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    std::vector<HeapState> heaps;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    std::vector<Group> groups;
+    std::vector<uint32_t> evictionCandidates;//evictUntil的临时数组，容量与groups一致
+    uint64_t currentFrame = 0;
+    uint64_t lastBudgetRefresh = 0;
+
+    //统计
+    uint64_t evictionCount = 0;
+    VkDeviceSize evictedBytes = 0;
+    uint64_t demotionCount = 0;
+    uint64_t failedAllocations = 0;
+};
@@ -0,0 +1,992 @@
+﻿#include "SceneBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BVH_SSE 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t BIN_COUNT = 16;
+    const uint32_t MAX_DEPTH = 64;//超过这个深度的节点直接成为叶子，遍历栈的大小由它决定
+    const uint32_t STACK_SIZE = 4 * MAX_DEPTH;
+    const uint32_t INVALID = 0xffffffff;
+    const float TRAVERSAL_COST = 1.0f;
+    const float INTERSECTION_COST = 1.0f;
+
+    Aabb emptyAabb()
+    {
+        Aabb box;
+        for (int i = 0; i < 3; i++)
+        {
+            box.min[i] = FLT_MAX;
+            box.max[i] = -FLT_MAX;
+        }
+        return box;
+    }
+
+    void grow(Aabb& box, const Aabb& other)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            box.min[i] = std::min(box.min[i], other.min[i]);
+            box.max[i] = std::max(box.max[i], other.max[i]);
+        }
+    }
+
+    //表面积的一半，SAH只用到比值
+    float halfArea(const Aabb& box)
+    {
+        float dx = std::max(0.0f, box.max[0] - box.min[0]);
+        float dy = std::max(0.0f, box.max[1] - box.min[1]);
+        float dz = std::max(0.0f, box.max[2] - box.min[2]);
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    float centroid(const Aabb& box, int axis)
+    {
+        return 0.5f * (box.min[axis] + box.max[axis]);
+    }
+
+    //plane为(a, b, c, d)，包围盒完全在平面负侧时返回true
+    bool boxOutsidePlane(const Aabb& box, const float* plane)
+    {
+        float d = plane[3];
+        for (int i = 0; i < 3; i++)
+        {
+            d += plane[i] * (plane[i] > 0.0f ? box.max[i] : box.min[i]);
+        }
+        return d < 0.0f;
+    }
+
+    bool boxInFrustum(const Aabb& box, const float planes[6][4])
+    {
+        for (int p = 0; p < 6; p++)
+        {
+            if (boxOutsidePlane(box, planes[p]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool boxInsideFrustum(const Aabb& box, const float planes[6][4])
+    {
+        for (int p = 0; p < 6; p++)
+        {
+            float d = planes[p][3];
+            for (int i = 0; i < 3; i++)
+            {
+                d += planes[p][i] * (planes[p][i] > 0.0f ? box.min[i] : box.max[i]);
+            }
+            if (d < 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //射线与包围盒相交时返回进入的距离（起点在盒内为0），不相交时返回-1
+    float rayBox(const Aabb& box, const float* origin, const float* inverseDirection, float maxDistance)
+    {
+        float tNear = 0.0f;
+        float tFar = maxDistance;
+        for (int i = 0; i < 3; i++)
+        {
+            float t0 = (box.min[i] - origin[i]) * inverseDirection[i];
+            float t1 = (box.max[i] - origin[i]) * inverseDirection[i];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        return tNear <= tFar ? tNear : -1.0f;
+    }
+
+    float boxDistanceSquared(const Aabb& box, const float* center)
+    {
+        float distance = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            float d = std::max(0.0f, std::max(box.min[i] - center[i], center[i] - box.max[i]));
+            distance += d * d;
+        }
+        return distance;
+    }
+
+    //射线方向为0的分量用很大的倒数代替，避免0 * inf
+    void inverseDirection(const float* direction, float* out)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            float d = direction[i];
+            out[i] = std::fabs(d) > 1e-20f ? 1.0f / d : (d < 0.0f ? -1e30f : 1e30f);
+        }
+    }
+}
+
+//------------------------------4路节点测试------------------------------
+//返回4位掩码，第i位对应节点的第i个子包围盒，空位置总是0
+
+namespace
+{
+    template <typename Node>
+    Aabb slotBounds(const Node& node, int slot)
+    {
+        Aabb box;
+        box.min[0] = node.minX[slot];
+        box.min[1] = node.minY[slot];
+        box.min[2] = node.minZ[slot];
+        box.max[0] = node.maxX[slot];
+        box.max[1] = node.maxY[slot];
+        box.max[2] = node.maxZ[slot];
+        return box;
+    }
+
+    template <typename Node>
+    void setSlotBounds(Node& node, int slot, const Aabb& box)
+    {
+        node.minX[slot] = box.min[0];
+        node.minY[slot] = box.min[1];
+        node.minZ[slot] = box.min[2];
+        node.maxX[slot] = box.max[0];
+        node.maxY[slot] = box.max[1];
+        node.maxZ[slot] = box.max[2];
+    }
+
+    template <typename Node>
+    uint32_t validMask(const Node& node)
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (node.child[i] != INVALID)
+            {
+                mask |= 1u << i;
+            }
+        }
+        return mask;
+    }
+
+    //与平截头体相交的子包围盒，inside为完全在平截头体内的子包围盒
+    template <typename Node>
+    uint32_t frustumMask(const Node& node, const float planes[6][4], uint32_t& inside)
+    {
+        uint32_t valid = validMask(node);
+#if defined(BVH_SSE)
+        __m128 minX = _mm_load_ps(node.minX);
+        __m128 minY = _mm_load_ps(node.minY);
+        __m128 minZ = _mm_load_ps(node.minZ);
+        __m128 maxX = _mm_load_ps(node.maxX);
+        __m128 maxY = _mm_load_ps(node.maxY);
+        __m128 maxZ = _mm_load_ps(node.maxZ);
+        __m128 zero = _mm_setzero_ps();
+        __m128 outsideAny = zero;
+        __m128 insideAll = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 a = _mm_set1_ps(planes[p][0]);
+            __m128 b = _mm_set1_ps(planes[p][1]);
+            __m128 c = _mm_set1_ps(planes[p][2]);
+            __m128 d = _mm_set1_ps(planes[p][3]);
+            __m128 ax0 = _mm_mul_ps(a, minX), ax1 = _mm_mul_ps(a, maxX);
+            __m128 by0 = _mm_mul_ps(b, minY), by1 = _mm_mul_ps(b, maxY);
+            __m128 cz0 = _mm_mul_ps(c, minZ), cz1 = _mm_mul_ps(c, maxZ);
+            //离平面最远和最近的顶点
+            __m128 farthest = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax0, ax1), _mm_max_ps(by0, by1)), _mm_add_ps(_mm_max_ps(cz0, cz1), d));
+            __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax0, ax1), _mm_min_ps(by0, by1)), _mm_add_ps(_mm_min_ps(cz0, cz1), d));
+            outsideAny = _mm_or_ps(outsideAny, _mm_cmplt_ps(farthest, zero));
+            insideAll = _mm_and_ps(insideAll, _mm_cmpge_ps(nearest, zero));
+        }
+        uint32_t visible = ~(uint32_t)_mm_movemask_ps(outsideAny) & valid;
+        inside = (uint32_t)_mm_movemask_ps(insideAll) & visible;
+        return visible;
+#else
+        uint32_t visible = 0;
+        inside = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if ((valid & (1u << i)) == 0)
+            {
+                continue;
+            }
+            Aabb box = slotBounds(node, i);
+            if (boxInFrustum(box, planes))
+            {
+                visible |= 1u << i;
+                if (boxInsideFrustum(box, planes))
+                {
+                    inside |= 1u << i;
+                }
+            }
+        }
+        return visible;
+#endif
+    }
+
+    //与射线在maxDistance之内相交的子包围盒，entry为进入的距离
+    template <typename Node>
+    uint32_t rayMask(const Node& node, const float* origin, const float* inverse, float maxDistance, float* entry)
+    {
+        uint32_t valid = validMask(node);
+#if defined(BVH_SSE)
+        __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+        __m128 ix = _mm_set1_ps(inverse[0]), iy = _mm_set1_ps(inverse[1]), iz = _mm_set1_ps(inverse[2]);
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), ox), ix);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), ox), ix);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), oy), iy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), oy), iy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), oz), iz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), oz), iz);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(maxDistance)));
+        _mm_storeu_ps(entry, tNear);
+        return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & valid;
+#else
+        uint32_t hit = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if ((valid & (1u << i)) == 0)
+            {
+                continue;
+            }
+            entry[i] = rayBox(slotBounds(node, i), origin, inverse, maxDistance);
+            if (entry[i] >= 0.0f)
+            {
+                hit |= 1u << i;
+            }
+        }
+        return hit;
+#endif
+    }
+
+    //与球相交的子包围盒
+    template <typename Node>
+    uint32_t sphereMask(const Node& node, const float* center, float radiusSquared)
+    {
+        uint32_t valid = validMask(node);
+#if defined(BVH_SSE)
+        __m128 zero = _mm_setzero_ps();
+        __m128 cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]), cz = _mm_set1_ps(center[2]);
+        __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minX), cx), _mm_sub_ps(cx, _mm_load_ps(node.maxX))));
+        __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minY), cy), _mm_sub_ps(cy, _mm_load_ps(node.maxY))));
+        __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minZ), cz), _mm_sub_ps(cz, _mm_load_ps(node.maxZ))));
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(distance, _mm_set1_ps(radiusSquared))) & valid;
+#else
+        uint32_t hit = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if ((valid & (1u << i)) != 0 && boxDistanceSquared(slotBounds(node, i), center) <= radiusSquared)
+            {
+                hit |= 1u << i;
+            }
+        }
+        return hit;
+#endif
+    }
+}
+
+//------------------------------构建------------------------------
+
+SceneBvh::SceneBvh(uint32_t threadCount)
+    : nextTask(0)
+{
+    if (threadCount == 0)
+    {
+        threadCount = WorkerPool::shared().getThreadCount();
+    }
+    this->threadCount = threadCount;
+    threadBinary.resize(threadCount);
+    runTasksTask = [this](uint32_t threadIndex) { runTasks(threadIndex); };
+}
+
+void SceneBvh::build(const std::vector<Aabb>& bounds)
+{
+    objectBounds = bounds;
+    uint32_t objectCount = (uint32_t)objectBounds.size();
+    objectOrder.resize(objectCount);
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        objectOrder[i] = i;
+    }
+    objectTreelet.resize(objectCount);
+    lastRebuildCount = 0;
+    repartitionCount = 0;
+    buildTopLevel();
+}
+
+void SceneBvh::buildTopLevel()
+{
+    uint32_t objectCount = (uint32_t)objectOrder.size();
+    treelets.clear();
+    if (objectCount == 0)
+    {
+        return;
+    }
+
+    partitionTreelets(0, objectCount);
+    treeletVisible.resize(treelets.size());
+
+    buildList.clear();
+    for (uint32_t t = 0; t < (uint32_t)treelets.size(); t++)
+    {
+        const Treelet& treelet = treelets[t];
+        for (uint32_t i = treelet.first; i < treelet.first + treelet.count; i++)
+        {
+            objectTreelet[objectOrder[i]] = t;
+        }
+        buildList.push_back(t);
+    }
+
+    runJob(Job::Build, (uint32_t)buildList.size());
+    topBuiltCost = topLevelCost();
+}
+
+//用子树内相同的划分把物体分成不超过TREELET_SIZE个的子树
+void SceneBvh::partitionTreelets(uint32_t first, uint32_t count)
+{
+    if (count <= TREELET_SIZE)
+    {
+        Treelet treelet = {};
+        treelet.first = first;
+        treelet.count = count;
+        treelets.push_back(std::move(treelet));
+        return;
+    }
+    Aabb nodeBounds;
+    uint32_t mid = splitRange(first, count, true, nodeBounds);
+    partitionTreelets(first, mid);
+    partitionTreelets(first + mid, count - mid);
+}
+
+//在[first, first + count)上做分箱SAH划分，原地分区并返回左边的物体数；成为叶子更好时返回0（forceSplit时总是划分）
+uint32_t SceneBvh::splitRange(uint32_t first, uint32_t count, bool forceSplit, Aabb& nodeBounds)
+{
+    nodeBounds = emptyAabb();
+    Aabb centroidBounds = emptyAabb();
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const Aabb& box = objectBounds[objectOrder[i]];
+        grow(nodeBounds, box);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float c = centroid(box, axis);
+            centroidBounds.min[axis] = std::min(centroidBounds.min[axis], c);
+            centroidBounds.max[axis] = std::max(centroidBounds.max[axis], c);
+        }
+    }
+    if (count <= LEAF_SIZE && !forceSplit)
+    {
+        return 0;
+    }
+
+    int axis = 0;
+    for (int i = 1; i < 3; i++)
+    {
+        if (centroidBounds.max[i] - centroidBounds.min[i] > centroidBounds.max[axis] - centroidBounds.min[axis])
+        {
+            axis = i;
+        }
+    }
+    float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+
+    uint32_t mid = 0;
+    if (extent > 0.0f)
+    {
+        //按质心分箱，在箱的边界中选SAH代价最小的划分
+        uint32_t binCount[BIN_COUNT] = {};
+        Aabb binBounds[BIN_COUNT];
+        for (uint32_t b = 0; b < BIN_COUNT; b++)
+        {
+            binBounds[b] = emptyAabb();
+        }
+        float scale = BIN_COUNT * (1.0f - 1e-5f) / extent;
+        float axisMin = centroidBounds.min[axis];
+        auto binOf = [&](uint32_t object)
+        {
+            uint32_t b = (uint32_t)((centroid(objectBounds[object], axis) - axisMin) * scale);
+            return std::min(b, BIN_COUNT - 1);
+        };
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            uint32_t b = binOf(objectOrder[i]);
+            binCount[b]++;
+            grow(binBounds[b], objectBounds[objectOrder[i]]);
+        }
+
+        float rightArea[BIN_COUNT];
+        uint32_t rightCount[BIN_COUNT];
+        Aabb accumulated = emptyAabb();
+        uint32_t accumulatedCount = 0;
+        for (uint32_t b = BIN_COUNT - 1; b > 0; b--)
+        {
+            grow(accumulated, binBounds[b]);
+            accumulatedCount += binCount[b];
+            rightArea[b] = halfArea(accumulated);
+            rightCount[b] = accumulatedCount;
+        }
+
+        float bestCost = FLT_MAX;
+        uint32_t bestSplit = 0;
+        accumulated = emptyAabb();
+        accumulatedCount = 0;
+        for (uint32_t b = 0; b + 1 < BIN_COUNT; b++)
+        {
+            grow(accumulated, binBounds[b]);
+            accumulatedCount += binCount[b];
+            if (accumulatedCount == 0 || rightCount[b + 1] == 0)
+            {
+                continue;
+            }
+            float cost = halfArea(accumulated) * accumulatedCount + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        if (bestCost != FLT_MAX)
+        {
+            float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / std::max(halfArea(nodeBounds), 1e-20f);
+            if (!forceSplit && count <= MAX_LEAF_SIZE && splitCost >= INTERSECTION_COST * count)
+            {
+                return 0;
+            }
+            uint32_t* begin = objectOrder.data() + first;
+            uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t object) { return binOf(object) <= bestSplit; });
+            mid = (uint32_t)(middle - begin);
+        }
+    }
+
+    //质心重合或者分箱没有分开：按质心的中位数对半分
+    if (mid == 0 || mid == count)
+    {
+        if (!forceSplit && count <= MAX_LEAF_SIZE)
+        {
+            return 0;
+        }
+        mid = count / 2;
+        uint32_t* begin = objectOrder.data() + first;
+        std::nth_element(begin, begin + mid, begin + count,
+            [&](uint32_t a, uint32_t b) { return centroid(objectBounds[a], axis) < centroid(objectBounds[b], axis); });
+    }
+    return mid;
+}
+
+//构建[first, first + count)的二叉树，返回根的下标；子节点在父节点之后
+uint32_t SceneBvh::buildBinary(uint32_t first, uint32_t count, uint32_t depth, std::vector<BinaryNode>& binary)
+{
+    Aabb nodeBounds;
+    uint32_t mid = depth < MAX_DEPTH ? splitRange(first, count, false, nodeBounds) : 0;
+    if (depth >= MAX_DEPTH)
+    {
+        nodeBounds = emptyAabb();
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            grow(nodeBounds, objectBounds[objectOrder[i]]);
+        }
+    }
+
+    uint32_t index = (uint32_t)binary.size();
+    binary.push_back({ nodeBounds, INVALID, INVALID, first, count });
+    if (mid == 0)
+    {
+        return index;
+    }
+    uint32_t left = buildBinary(first, mid, depth + 1, binary);
+    uint32_t right = buildBinary(first + mid, count - mid, depth + 1, binary);
+    binary[index].left = left;
+    binary[index].right = right;
+    binary[index].count = 0;
+    return index;
+}
+
+//把二叉树合并成4叉树：反复展开面积最大的内部子节点，直到有4个子节点
+uint32_t SceneBvh::collapse(const std::vector<BinaryNode>& binary, uint32_t root, std::vector<Node4>& nodes)
+{
+    uint32_t children[4] = { binary[root].left, binary[root].right, INVALID, INVALID };
+    uint32_t childCount = 2;
+    if (binary[root].count > 0)
+    {
+        children[0] = root;
+        childCount = 1;
+    }
+    while (childCount < 4)
+    {
+        uint32_t expand = INVALID;
+        float largest = -1.0f;
+        for (uint32_t i = 0; i < childCount; i++)
+        {
+            const BinaryNode& child = binary[children[i]];
+            if (child.count == 0 && halfArea(child.bounds) > largest)
+            {
+                largest = halfArea(child.bounds);
+                expand = i;
+            }
+        }
+        if (expand == INVALID)
+        {
+            break;
+        }
+        uint32_t node = children[expand];
+        children[expand] = binary[node].left;
+        children[childCount++] = binary[node].right;
+    }
+
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.emplace_back();
+    for (int i = 0; i < 4; i++)
+    {
+        setSlotBounds(nodes[index], i, emptyAabb());
+        nodes[index].child[i] = INVALID;
+        nodes[index].count[i] = 0;
+    }
+    for (uint32_t i = 0; i < childCount; i++)
+    {
+        const BinaryNode& child = binary[children[i]];
+        uint32_t target = child.first;
+        if (child.count == 0)
+        {
+            target = collapse(binary, children[i], nodes);
+        }
+        Node4& node = nodes[index];//递归之后nodes可能重新分配
+        setSlotBounds(node, i, child.bounds);
+        node.child[i] = target;
+        node.count[i] = child.count;
+    }
+    return index;
+}
+
+void SceneBvh::buildTreelet(Treelet& treelet, uint32_t threadIndex)
+{
+    std::vector<BinaryNode>& binary = threadBinary[threadIndex];
+    binary.clear();
+    uint32_t root = buildBinary(treelet.first, treelet.count, 0, binary);
+
+    treelet.nodes.clear();
+    collapse(binary, root, treelet.nodes);
+    treelet.bounds = binary[root].bounds;
+    treelet.builtCost = treeletCost(treelet);
+    treelet.cost = treelet.builtCost;
+    treelet.dirty = false;
+}
+
+//SAH代价：每个节点的遍历代价和每个叶子的相交代价按面积加权，除以子树的面积
+float SceneBvh::treeletCost(const Treelet& treelet) const
+{
+    float cost = 0.0f;
+    for (const Node4& node : treelet.nodes)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (node.child[i] == INVALID)
+            {
+                continue;
+            }
+            float area = halfArea(slotBounds(node, i));
+            cost += node.count[i] > 0 ? area * INTERSECTION_COST * node.count[i] : area * TRAVERSAL_COST;
+        }
+    }
+    return TRAVERSAL_COST + cost / std::max(halfArea(treelet.bounds), 1e-20f);
+}
+
+//顶层的SAH代价：查询要逐个测试子树，进入一棵子树的概率与它的面积成正比，代价与它的物体数成正比
+float SceneBvh::topLevelCost() const
+{
+    Aabb sceneBounds = emptyAabb();
+    float cost = 0.0f;
+    for (const Treelet& treelet : treelets)
+    {
+        grow(sceneBounds, treelet.bounds);
+        cost += halfArea(treelet.bounds) * treelet.count;
+    }
+    return cost / std::max(halfArea(sceneBounds), 1e-20f);
+}
+
+//------------------------------更新------------------------------
+
+void SceneBvh::setBounds(uint32_t object, const Aabb& bounds)
+{
+    objectBounds[object] = bounds;
+    treelets[objectTreelet[object]].dirty = true;
+}
+
+void SceneBvh::refitTreelet(Treelet& treelet)
+{
+    //父节点总在子节点之前，倒序遍历即自底向上
+    for (size_t n = treelet.nodes.size(); n-- > 0;)
+    {
+        Node4& node = treelet.nodes[n];
+        for (int i = 0; i < 4; i++)
+        {
+            if (node.child[i] == INVALID)
+            {
+                continue;
+            }
+            Aabb box = emptyAabb();
+            if (node.count[i] > 0)
+            {
+                for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i]; j++)
+                {
+                    grow(box, objectBounds[objectOrder[j]]);
+                }
+            }
+            else
+            {
+                const Node4& child = treelet.nodes[node.child[i]];
+                for (int k = 0; k < 4; k++)
+                {
+                    if (child.child[k] != INVALID)
+                    {
+                        grow(box, slotBounds(child, k));
+                    }
+                }
+            }
+            setSlotBounds(node, i, box);
+        }
+    }
+
+    treelet.bounds = emptyAabb();
+    const Node4& root = treelet.nodes[0];
+    for (int i = 0; i < 4; i++)
+    {
+        if (root.child[i] != INVALID)
+        {
+            grow(treelet.bounds, slotBounds(root, i));
+        }
+    }
+    treelet.cost = treeletCost(treelet);
+    treelet.dirty = false;
+}
+
+void SceneBvh::update()
+{
+    lastRebuildCount = 0;
+    refitList.clear();
+    for (uint32_t t = 0; t < (uint32_t)treelets.size(); t++)
+    {
+        if (treelets[t].dirty)
+        {
+            refitList.push_back(t);
+        }
+    }
+    if (refitList.empty())
+    {
+        return;
+    }
+    runJob(Job::Refit, (uint32_t)refitList.size());
+
+    //物体跑出了原来的子树所在的区域，子树之间重叠变多，只能重新划分顶层
+    if (topLevelCost() > topBuiltCost * REBUILD_RATIO)
+    {
+        buildTopLevel();
+        lastRebuildCount = (uint32_t)treelets.size();
+        repartitionCount++;
+        return;
+    }
+
+    //refit之后代价增长最多的子树重新构建，每次最多MAX_REBUILDS_PER_UPDATE棵
+    buildList.clear();
+    for (uint32_t t : refitList)
+    {
+        if (treelets[t].cost > treelets[t].builtCost * REBUILD_RATIO)
+        {
+            buildList.push_back(t);
+        }
+    }
+    if (buildList.size() > MAX_REBUILDS_PER_UPDATE)
+    {
+        std::partial_sort(buildList.begin(), buildList.begin() + MAX_REBUILDS_PER_UPDATE, buildList.end(), [this](uint32_t a, uint32_t b)
+            {
+                return treelets[a].cost / treelets[a].builtCost > treelets[b].cost / treelets[b].builtCost;
+            });
+        buildList.resize(MAX_REBUILDS_PER_UPDATE);
+    }
+    lastRebuildCount = (uint32_t)buildList.size();
+    if (!buildList.empty())
+    {
+        runJob(Job::Build, (uint32_t)buildList.size());
+    }
+}
+
+uint32_t SceneBvh::getNodeCount() const
+{
+    uint32_t count = 0;
+    for (const auto& treelet : treelets)
+    {
+        count += (uint32_t)treelet.nodes.size();
+    }
+    return count;
+}
+
+//------------------------------查询------------------------------
+
+void SceneBvh::cullFrustum(const float viewProj[16], std::vector<uint32_t>& visible)
+{
+    //Gribb-Hartmann：裁剪空间的-w <= x, y <= w和0 <= z <= w，row(i)是矩阵的第i行
+    auto row = [viewProj](int i, int component) { return viewProj[component * 4 + i]; };
+    for (int c = 0; c < 4; c++)
+    {
+        cullPlanes[0][c] = row(3, c) + row(0, c);
+        cullPlanes[1][c] = row(3, c) - row(0, c);
+        cullPlanes[2][c] = row(3, c) + row(1, c);
+        cullPlanes[3][c] = row(3, c) - row(1, c);
+        cullPlanes[4][c] = row(2, c);
+        cullPlanes[5][c] = row(3, c) - row(2, c);
+    }
+
+    visible.clear();
+    if (treelets.empty())
+    {
+        return;
+    }
+    runJob(Job::Cull, (uint32_t)treelets.size());
+    for (const auto& treeletResult : treeletVisible)
+    {
+        visible.insert(visible.end(), treeletResult.begin(), treeletResult.end());
+    }
+}
+
+void SceneBvh::cullTreelet(uint32_t treeletIndex)
+{
+    const Treelet& treelet = treelets[treeletIndex];
+    std::vector<uint32_t>& out = treeletVisible[treeletIndex];
+    out.clear();
+    if (!boxInFrustum(treelet.bounds, cullPlanes))
+    {
+        return;
+    }
+    if (boxInsideFrustum(treelet.bounds, cullPlanes))
+    {
+        out.insert(out.end(), objectOrder.begin() + treelet.first, objectOrder.begin() + treelet.first + treelet.count);
+        return;
+    }
+
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node4& node = treelet.nodes[stack[--stackSize]];
+        uint32_t inside;
+        uint32_t mask = frustumMask(node, cullPlanes, inside);
+        for (int i = 0; i < 4; i++)
+        {
+            if ((mask & (1u << i)) == 0)
+            {
+                continue;
+            }
+            if ((inside & (1u << i)) != 0)
+            {
+                appendSubtree(treelet, node.child[i], node.count[i], out);
+            }
+            else if (node.count[i] > 0)
+            {
+                for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i]; j++)
+                {
+                    if (boxInFrustum(objectBounds[objectOrder[j]], cullPlanes))
+                    {
+                        out.push_back(objectOrder[j]);
+                    }
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.child[i];
+            }
+        }
+    }
+}
+
+//子树完全在平截头体内，不再测试，直接输出所有物体
+void SceneBvh::appendSubtree(const Treelet& treelet, uint32_t child, uint32_t count, std::vector<uint32_t>& out) const
+{
+    if (count > 0)
+    {
+        out.insert(out.end(), objectOrder.begin() + child, objectOrder.begin() + child + count);
+        return;
+    }
+    uint32_t stack[STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = child;
+    while (stackSize > 0)
+    {
+        const Node4& node = treelet.nodes[stack[--stackSize]];
+        for (int i = 0; i < 4; i++)
+        {
+            if (node.child[i] == INVALID)
+            {
+                continue;
+            }
+            if (node.count[i] > 0)
+            {
+                out.insert(out.end(), objectOrder.begin() + node.child[i], objectOrder.begin() + node.child[i] + node.count[i]);
+            }
+            else
+            {
+                stack[stackSize++] = node.child[i];
+            }
+        }
+    }
+}
+
+bool SceneBvh::pick(const float origin[3], const float direction[3], float maxDistance, uint32_t& object, float& distance) const
+{
+    float inverse[3];
+    inverseDirection(direction, inverse);
+    float best = maxDistance;
+    uint32_t bestObject = INVALID;
+
+    for (const Treelet& treelet : treelets)
+    {
+        float treeletEntry = rayBox(treelet.bounds, origin, inverse, best);
+        if (treeletEntry < 0.0f)
+        {
+            continue;
+        }
+
+        uint32_t stack[STACK_SIZE];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const Node4& node = treelet.nodes[stack[--stackSize]];
+            alignas(16) float entry[4];
+            uint32_t mask = rayMask(node, origin, inverse, best, entry);
+            //近的子节点后入栈、先遍历，更早缩短best
+            uint32_t order[4];
+            uint32_t orderCount = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if ((mask & (1u << i)) != 0)
+                {
+                    order[orderCount++] = i;
+                }
+            }
+            for (uint32_t k = 1; k < orderCount; k++)
+            {
+                for (uint32_t j = k; j > 0 && entry[order[j - 1]] < entry[order[j]]; j--)
+                {
+                    std::swap(order[j - 1], order[j]);
+                }
+            }
+            for (uint32_t k = 0; k < orderCount; k++)
+            {
+                uint32_t i = order[k];
+                if (entry[i] > best)
+                {
+                    continue;
+                }
+                if (node.count[i] == 0)
+                {
+                    stack[stackSize++] = node.child[i];
+                    continue;
+                }
+                for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i]; j++)
+                {
+                    float t = rayBox(objectBounds[objectOrder[j]], origin, inverse, best);
+                    if (t >= 0.0f && (t < best || bestObject == INVALID))
+                    {
+                        best = t;
+                        bestObject = objectOrder[j];
+                    }
+                }
+            }
+        }
+    }
+
+    if (bestObject == INVALID)
+    {
+        return false;
+    }
+    object = bestObject;
+    distance = best;
+    return true;
+}
+
+void SceneBvh::queryProximity(const float center[3], float radius, std::vector<uint32_t>& objects) const
+{
+    objects.clear();
+    float radiusSquared = radius * radius;
+    for (const Treelet& treelet : treelets)
+    {
+        if (boxDistanceSquared(treelet.bounds, center) > radiusSquared)
+        {
+            continue;
+        }
+
+        uint32_t stack[STACK_SIZE];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const Node4& node = treelet.nodes[stack[--stackSize]];
+            uint32_t mask = sphereMask(node, center, radiusSquared);
+            for (int i = 0; i < 4; i++)
+            {
+                if ((mask & (1u << i)) == 0)
+                {
+                    continue;
+                }
+                if (node.count[i] == 0)
+                {
+                    stack[stackSize++] = node.child[i];
+                    continue;
+                }
+                for (uint32_t j = node.child[i]; j < node.child[i] + node.count[i]; j++)
+                {
+                    if (boxDistanceSquared(objectBounds[objectOrder[j]], center) <= radiusSquared)
+                    {
+                        objects.push_back(objectOrder[j]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+//------------------------------并行任务------------------------------
+
+void SceneBvh::runTasks(uint32_t threadIndex)
+{
+    for (;;)
+    {
+        uint32_t task = nextTask.fetch_add(1);
+        if (task >= taskCount)
+        {
+            return;
+        }
+        switch (currentJob)
+        {
+        case Job::Build:
+            buildTreelet(treelets[buildList[task]], threadIndex);
+            break;
+        case Job::Refit:
+            refitTreelet(treelets[refitList[task]]);
+            break;
+        case Job::Cull:
+            cullTreelet(task);
+            break;
+        }
+    }
+}
+
+void SceneBvh::runJob(Job job, uint32_t taskCount)
+{
+    currentJob = job;
+    this->taskCount = taskCount;
+    nextTask.store(0);
+    //只有一个任务时（例如物体少到只有一棵子树）在调用线程上执行
+    if (taskCount < 2)
+    {
+        runTasks(0);
+        return;
+    }
+    WorkerPool::shared().parallelFor(std::min(threadCount, taskCount), runTasksTask);
+}
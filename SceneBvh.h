@@ -0,0 +1,151 @@
+﻿#pragma once
+
+/*
+场景包围体层次（BVH）：平截头体剔除、射线拾取和邻近查询
+
+1. 物体用轴对齐包围盒表示。构建是自顶向下的分箱SAH：质心在最长轴上分成16个箱，在箱的边界中选表面积代价最小的划分，
+   物体不多于LEAF_SIZE个，或者划分不比不划分更好时成为叶子（叶子最多MAX_LEAF_SIZE个物体）
+2. 树分两层：先用同样的划分把所有物体分成若干子树（treelet），每棵子树是物体顺序表中连续的一段，大约TREELET_SIZE个物体，
+   独立构建、独立存放，可以在多个线程上同时构建；顶层就是子树包围盒的数组，子树只有几百棵，直接逐个测试
+3. 子树的二叉树构建完之后合并成4叉树，节点的4个子包围盒按SoA存放，x86上用SSE一次测试4个（平截头体、射线、球）
+4. 移动的物体调用setBounds，之后update：包含它们的子树自底向上refit。refit会让包围盒变松，每棵子树记录构建时的SAH代价，
+   代价增长超过REBUILD_RATIO倍的子树重新构建，每次update最多重建MAX_REBUILDS_PER_UPDATE棵，最差的先重建，开销分摊到多帧。
+   子树内重建不能让物体换到别的子树，所以顶层也记录划分时的SAH代价（子树面积按物体数加权），
+   物体离开原来的区域使它增长超过REBUILD_RATIO倍时重新划分所有物体并重建所有子树
+5. 构建、refit和剔除按子树分给WorkerPool（与AnimationSystem、DrawListSorter共用同一个线程池），剔除结果按子树顺序合并，与单线程的结果相同；
+   查询不分配内存（输出数组的容量稳定之后）
+*/
+
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct Aabb
+{
+    float min[3];
+    float max[3];
+};
+
+class SceneBvh
+{
+public:
+    static const uint32_t LEAF_SIZE = 4;
+    static const uint32_t MAX_LEAF_SIZE = 16;
+    static const uint32_t TREELET_SIZE = 4096;
+    static constexpr float REBUILD_RATIO = 1.5f;
+    static const uint32_t MAX_REBUILDS_PER_UPDATE = 2;
+
+    //threadCount是并行的份数，为0时与WorkerPool的线程数相同
+    explicit SceneBvh(uint32_t threadCount = 0);
+
+    SceneBvh(const SceneBvh&) = delete;
+    SceneBvh& operator=(const SceneBvh&) = delete;
+
+    //按物体的包围盒重新构建整棵树，物体的编号是bounds中的下标
+    void build(const std::vector<Aabb>& bounds);
+
+    //物体移动之后更新它的包围盒，update时生效
+    void setBounds(uint32_t object, const Aabb& bounds);
+    const Aabb& getBounds(uint32_t object) const { return objectBounds[object]; }
+
+    //refit包含移动物体的子树，并增量重建变差最多的子树
+    void update();
+
+    //与viewProj（列主序，裁剪空间深度0到1）的平截头体相交的物体，按子树顺序输出
+    void cullFrustum(const float viewProj[16], std::vector<uint32_t>& visible);
+
+    //射线与物体包围盒的最近交点，起点在包围盒内时距离为0；没有相交时返回false
+    bool pick(const float origin[3], const float direction[3], float maxDistance, uint32_t& object, float& distance) const;
+
+    //包围盒与球相交的物体
+    void queryProximity(const float center[3], float radius, std::vector<uint32_t>& objects) const;
+
+    uint32_t getObjectCount() const { return (uint32_t)objectBounds.size(); }
+    uint32_t getTreeletCount() const { return (uint32_t)treelets.size(); }
+    uint32_t getNodeCount() const;
+    uint32_t getThreadCount() const { return threadCount; }
+    uint32_t getLastRebuildCount() const { return lastRebuildCount; }//最近一次update重建的子树数
+    uint32_t getRepartitionCount() const { return repartitionCount; }//build之后update重新划分顶层的次数
+
+private:
+    //4叉树节点，4个子包围盒按SoA存放；child为INVALID的位置是空的
+    struct alignas(16) Node4
+    {
+        float minX[4];
+        float minY[4];
+        float minZ[4];
+        float maxX[4];
+        float maxY[4];
+        float maxZ[4];
+        uint32_t child[4];//内部节点：子节点下标；叶子：物体顺序表中的起点
+        uint32_t count[4];//叶子的物体数，内部节点为0
+    };
+
+    struct Treelet
+    {
+        uint32_t first;//物体顺序表中的范围
+        uint32_t count;
+        std::vector<Node4> nodes;//第0个是根，父节点总在子节点之前
+        Aabb bounds;
+        float builtCost = 0.0f;//构建时的SAH代价
+        float cost = 0.0f;//refit之后的SAH代价
+        bool dirty = false;//有物体移动，需要refit
+    };
+
+    //构建二叉树时的节点，叶子的count大于0
+    struct BinaryNode
+    {
+        Aabb bounds;
+        uint32_t left;
+        uint32_t right;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    enum class Job
+    {
+        Build,//重建buildList中的子树
+        Refit,//refit refitList中的子树
+        Cull,//剔除所有子树
+    };
+
+    void buildTreelet(Treelet& treelet, uint32_t threadIndex);
+    uint32_t splitRange(uint32_t first, uint32_t count, bool forceSplit, Aabb& nodeBounds);
+    uint32_t buildBinary(uint32_t first, uint32_t count, uint32_t depth, std::vector<BinaryNode>& binary);
+    uint32_t collapse(const std::vector<BinaryNode>& binary, uint32_t root, std::vector<Node4>& nodes);
+    void refitTreelet(Treelet& treelet);
+    float treeletCost(const Treelet& treelet) const;
+    void partitionTreelets(uint32_t first, uint32_t count);
+    //按当前的包围盒把物体顺序表重新划分成子树并全部构建
+    void buildTopLevel();
+    float topLevelCost() const;
+
+    void cullTreelet(uint32_t treeletIndex);
+    void appendSubtree(const Treelet& treelet, uint32_t child, uint32_t count, std::vector<uint32_t>& out) const;
+
+    //在WorkerPool上分threadCount份执行taskCount个任务，返回时所有任务都已完成
+    void runJob(Job job, uint32_t taskCount);
+    void runTasks(uint32_t threadIndex);
+
+    std::vector<Aabb> objectBounds;
+    std::vector<uint32_t> objectOrder;//子树和叶子引用的物体顺序表
+    std::vector<uint32_t> objectTreelet;//每个物体所在的子树
+    std::vector<Treelet> treelets;
+    std::vector<std::vector<BinaryNode>> threadBinary;//每个线程构建二叉树的临时空间
+    std::vector<uint32_t> buildList;
+    std::vector<uint32_t> refitList;
+    std::vector<std::vector<uint32_t>> treeletVisible;//剔除时每棵子树的结果
+    float cullPlanes[6][4];
+    uint32_t threadCount;
+    uint32_t lastRebuildCount = 0;
+    float topBuiltCost = 0.0f;//划分子树时顶层的SAH代价
+    uint32_t repartitionCount = 0;
+
+    //当前任务
+    Job currentJob = Job::Build;
+    uint32_t taskCount = 0;
+    std::atomic<uint32_t> nextTask;
+    WorkerPool::Task runTasksTask;//构造时创建，每次任务不再构造std::function
+};
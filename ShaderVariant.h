@@ -0,0 +1,54 @@
+﻿#pragma once
+
+/*
+着色器变体（特化常量）：
+
+1. 着色器中的开关和循环上限写成layout(constant_id = N) const，创建管线时才给出具体的值，
+   驱动按给定的值编译，用不到的分支和循环在编译时就被去掉，不需要为每种组合维护一份GLSL
+2. 每种变体用一个C++结构体描述，成员只能是4字节的类型（int32_t、uint32_t、float、VkBool32），
+   第i个成员对应constant_id = i，结构体和着色器中的声明必须保持同样的顺序
+3. SpecializationConstants<变体>按结构体生成VkSpecializationMapEntry和VkSpecializationInfo，不需要手写偏移；
+   同一个VkSpecializationInfo可以给管线的多个阶段共用，着色器中没有声明的constant_id会被忽略
+*/
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+template <typename Variant>
+class SpecializationConstants
+{
+public:
+    static_assert(std::is_trivially_copyable<Variant>::value, "shader variant must be trivially copyable");
+    static_assert(sizeof(Variant) % 4 == 0 && alignof(Variant) == 4, "shader variant members must all be 4 bytes");
+
+    static constexpr uint32_t CONSTANT_COUNT = sizeof(Variant) / 4;
+
+    explicit SpecializationConstants(const Variant& variant) : variant(variant)
+    {
+        for (uint32_t i = 0; i < CONSTANT_COUNT; i++)
+        {
+            entries[i].constantID = i;
+            entries[i].offset = i * 4;
+            entries[i].size = 4;
+        }
+
+        info.mapEntryCount = CONSTANT_COUNT;
+        info.pMapEntries = entries.data();
+        info.dataSize = sizeof(Variant);
+        info.pData = &this->variant;
+    }
+
+    //info指向自己的成员，不能复制
+    SpecializationConstants(const SpecializationConstants&) = delete;
+    SpecializationConstants& operator=(const SpecializationConstants&) = delete;
+
+    const VkSpecializationInfo* get() const { return &info; }
+
+private:
+    Variant variant;
+    std::array<VkSpecializationMapEntry, CONSTANT_COUNT> entries = {};
+    VkSpecializationInfo info = {};
+};
@@ -0,0 +1,484 @@
+﻿#include "SoftRasterizer.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SOFT_RASTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+//MSVC不需要/arch:AVX2也可以使用AVX2指令，gcc和clang需要为单个函数打开
+#if defined(SOFT_RASTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SOFT_RASTER_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define SOFT_RASTER_AVX2_TARGET
+#endif
+
+namespace
+{
+    //定点数的小数位数：28.4
+    const int SUBPIXEL_BITS = 4;
+    const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+    //保护带（像素），超出的三角形直接剔除。限制坐标范围后，一个块内的边函数值不会超出int32
+    const float GUARD_BAND = 8192.0f;
+
+    //运行时检测CPU和系统是否支持AVX2
+    bool cpuSupportsAVX2()
+    {
+#if defined(SOFT_RASTER_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, 0, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+        __cpuidex(info, 1, 0);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif defined(SOFT_RASTER_X86)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+
+    //与片段着色器输出到B8G8R8A8_UNORM时的转换一致
+    uint32_t packColor(float r, float g, float b, float a)
+    {
+        auto toUnorm = [](float c)
+        {
+            return (uint32_t)(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+        };
+        return (toUnorm(a) << 24) | (toUnorm(r) << 16) | (toUnorm(g) << 8) | toUnorm(b);
+    }
+}
+
+SoftRasterizer::SoftRasterizer(uint32_t width, uint32_t height, uint32_t threadCount)
+    : width(width), height(height), nextTile(0)
+{
+    if (width == 0 || height == 0 || width > (uint32_t)GUARD_BAND || height > (uint32_t)GUARD_BAND)
+    {
+        throw std::runtime_error("unsupported software rasterizer resolution!");
+    }
+
+    tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    if (threadCount == 0)
+    {
+        threadCount = WorkerPool::shared().getThreadCount();
+    }
+    this->threadCount = threadCount;
+    useAVX2 = cpuSupportsAVX2();
+
+    pixels.resize((size_t)width * height);
+    bins.resize((size_t)threadCount * tilesX * tilesY);
+    threadStats.resize(threadCount);
+}
+
+void SoftRasterizer::clear(const float color[4])
+{
+    std::fill(pixels.begin(), pixels.end(), packColor(color[0], color[1], color[2], color[3]));
+}
+
+void SoftRasterizer::drawList(const VertexLayout& layout, uint32_t vertexCount, const std::vector<Draw>& draws)
+{
+    //展开绘制列表，保持提交顺序
+    triangleIndices.clear();
+    for (const auto& draw : draws)
+    {
+        if ((uint64_t)draw.firstVertex + draw.vertexCount > vertexCount)
+        {
+            throw std::runtime_error("software rasterizer draw exceeds vertex data!");
+        }
+        //着色器没有使用gl_InstanceIndex，每个实例的结果相同，仍然按实例数绘制以保持与GPU一致的工作量
+        for (uint32_t instance = 0; instance < draw.instanceCount; instance++)
+        {
+            for (uint32_t v = 0; v + 2 < draw.vertexCount; v += 3)
+            {
+                triangleIndices.push_back(draw.firstVertex + v);
+                triangleIndices.push_back(draw.firstVertex + v + 1);
+                triangleIndices.push_back(draw.firstVertex + v + 2);
+            }
+        }
+    }
+
+    triangles.resize(triangleIndices.size() / 3);
+    for (auto& bin : bins)
+    {
+        bin.clear();
+    }
+    for (auto& threadStat : threadStats)
+    {
+        threadStat = ThreadStats();
+    }
+
+    //第一步：并行设置三角形并分到块中
+    currentLayout = &layout;
+    parallelRun([this](uint32_t threadIndex)
+    {
+        binTriangles(threadIndex);
+    });
+
+    //第二步：各线程从原子计数器领取块，块之间没有重叠，不需要同步
+    nextTile = 0;
+    uint32_t tileCount = tilesX * tilesY;
+    parallelRun([this, tileCount](uint32_t threadIndex)
+    {
+        for (uint32_t tile = nextTile++; tile < tileCount; tile = nextTile++)
+        {
+            rasterizeTile(tile, threadStats[threadIndex]);
+        }
+    });
+    currentLayout = nullptr;
+
+    stats = Stats();
+    stats.trianglesSubmitted = triangles.size();
+    for (const auto& threadStat : threadStats)
+    {
+        stats.trianglesCulled += threadStat.culled;
+        stats.binEntries += threadStat.binEntries;
+        stats.pixelsWritten += threadStat.pixelsWritten;
+    }
+}
+
+bool SoftRasterizer::setupTriangle(const VertexLayout& layout, uint32_t i0, uint32_t i1, uint32_t i2, Triangle& triangle) const
+{
+    const uint32_t indices[3] = { i0, i1, i2 };
+    const char* base = static_cast<const char*>(layout.data);
+
+    //视口变换：与Vulkan一致，y轴向下
+    float screenX[3];
+    float screenY[3];
+    const float* colors[3];
+    int32_t x[3];
+    int32_t y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const float* position = reinterpret_cast<const float*>(base + indices[i] * layout.stride + layout.positionOffset);
+        colors[i] = reinterpret_cast<const float*>(base + indices[i] * layout.stride + layout.colorOffset);
+        screenX[i] = (position[0] * 0.5f + 0.5f) * width;
+        screenY[i] = (position[1] * 0.5f + 0.5f) * height;
+        if (!(std::fabs(screenX[i]) <= GUARD_BAND && std::fabs(screenY[i]) <= GUARD_BAND))
+        {
+            return false;
+        }
+        x[i] = (int32_t)std::lround(screenX[i] * SUBPIXEL_ONE);
+        y[i] = (int32_t)std::lround(screenY[i] * SUBPIXEL_ONE);
+    }
+
+    //y轴向下时顺时针的三角形面积为正，面积不为正的是背面或退化三角形
+    int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area <= 0)
+    {
+        return false;
+    }
+
+    //覆盖的像素范围：像素中心 px * 16 + 8 落在定点包围盒内
+    int32_t minFx = std::min({ x[0], x[1], x[2] });
+    int32_t maxFx = std::max({ x[0], x[1], x[2] });
+    int32_t minFy = std::min({ y[0], y[1], y[2] });
+    int32_t maxFy = std::max({ y[0], y[1], y[2] });
+    const int32_t half = SUBPIXEL_ONE / 2;
+    triangle.minX = std::max(0, (minFx - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+    triangle.minY = std::max(0, (minFy - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+    triangle.maxX = std::min((int32_t)width - 1, (maxFx - half) >> SUBPIXEL_BITS);
+    triangle.maxY = std::min((int32_t)height - 1, (maxFy - half) >> SUBPIXEL_BITS);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+    {
+        return false;
+    }
+
+    //边a->b的边函数，第三个顶点一侧为正。左上边上的像素算在内，其余边上的不算（C减一）
+    for (int e = 0; e < 3; e++)
+    {
+        int a = e;
+        int b = (e + 1) % 3;
+        int32_t edgeA = y[a] - y[b];
+        int32_t edgeB = x[b] - x[a];
+        bool topLeft = edgeA > 0 || (edgeA == 0 && edgeB > 0);
+        triangle.edgeA[e] = edgeA;
+        triangle.edgeB[e] = edgeB;
+        triangle.edgeC[e] = -((int64_t)edgeA * x[a] + (int64_t)edgeB * y[a]) - (topLeft ? 0 : 1);
+    }
+
+    //颜色的平面方程，用吸附后的顶点位置求解，保证与边函数一致
+    double fx[3];
+    double fy[3];
+    for (int i = 0; i < 3; i++)
+    {
+        fx[i] = (double)x[i] / SUBPIXEL_ONE;
+        fy[i] = (double)y[i] / SUBPIXEL_ONE;
+    }
+    double denominator = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+    for (int c = 0; c < 3; c++)
+    {
+        double dc1 = (double)colors[1][c] - colors[0][c];
+        double dc2 = (double)colors[2][c] - colors[0][c];
+        double dx = (dc1 * (fy[2] - fy[0]) - dc2 * (fy[1] - fy[0])) / denominator;
+        double dy = (dc2 * (fx[1] - fx[0]) - dc1 * (fx[2] - fx[0])) / denominator;
+        triangle.colorDx[c] = (float)dx;
+        triangle.colorDy[c] = (float)dy;
+        triangle.colorBase[c] = (float)(colors[0][c] - dx * fx[0] - dy * fy[0]);
+    }
+    return true;
+}
+
+void SoftRasterizer::binTriangles(uint32_t threadIndex)
+{
+    //每个线程处理连续的一段三角形，写入自己的分组，光栅化时按线程顺序读取即保持提交顺序
+    size_t triangleCount = triangles.size();
+    size_t begin = triangleCount * threadIndex / threadCount;
+    size_t end = triangleCount * (threadIndex + 1) / threadCount;
+    size_t tileCount = (size_t)tilesX * tilesY;
+    ThreadStats& threadStat = threadStats[threadIndex];
+
+    for (size_t i = begin; i < end; i++)
+    {
+        Triangle& triangle = triangles[i];
+        if (!setupTriangle(*currentLayout, triangleIndices[i * 3], triangleIndices[i * 3 + 1], triangleIndices[i * 3 + 2], triangle))
+        {
+            triangle.minX = 1;
+            triangle.maxX = 0;
+            threadStat.culled++;
+            continue;
+        }
+
+        uint32_t tileMinX = triangle.minX / TILE_SIZE;
+        uint32_t tileMaxX = triangle.maxX / TILE_SIZE;
+        uint32_t tileMinY = triangle.minY / TILE_SIZE;
+        uint32_t tileMaxY = triangle.maxY / TILE_SIZE;
+        for (uint32_t ty = tileMinY; ty <= tileMaxY; ty++)
+        {
+            for (uint32_t tx = tileMinX; tx <= tileMaxX; tx++)
+            {
+                bins[threadIndex * tileCount + ty * tilesX + tx].push_back((uint32_t)i);
+                threadStat.binEntries++;
+            }
+        }
+    }
+}
+
+void SoftRasterizer::rasterizeTile(uint32_t tileIndex, ThreadStats& threadStat)
+{
+    size_t tileCount = (size_t)tilesX * tilesY;
+    int32_t tileMinX = (int32_t)((tileIndex % tilesX) * TILE_SIZE);
+    int32_t tileMinY = (int32_t)((tileIndex / tilesX) * TILE_SIZE);
+    int32_t tileMaxX = std::min(tileMinX + (int32_t)TILE_SIZE, (int32_t)width) - 1;
+    int32_t tileMaxY = std::min(tileMinY + (int32_t)TILE_SIZE, (int32_t)height) - 1;
+
+    for (uint32_t thread = 0; thread < threadCount; thread++)
+    {
+        for (uint32_t triangleIndex : bins[thread * tileCount + tileIndex])
+        {
+            const Triangle& triangle = triangles[triangleIndex];
+            int32_t x0 = std::max(triangle.minX, tileMinX);
+            int32_t x1 = std::min(triangle.maxX, tileMaxX);
+            int32_t y0 = std::max(triangle.minY, tileMinY);
+            int32_t y1 = std::min(triangle.maxY, tileMaxY);
+            if (x0 > x1 || y0 > y1)
+            {
+                continue;
+            }
+
+            //用矩形四个角的像素中心给每条边分类：整块在外侧则跳过三角形，整块在内侧则不用再测试这条边。
+            //剩下与矩形相交的边，矩形内的边函数值受矩形大小限制，可以用int32逐像素递增
+            int64_t cornerX[2] = { (int64_t)x0 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2, (int64_t)x1 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2 };
+            int64_t cornerY[2] = { (int64_t)y0 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2, (int64_t)y1 * SUBPIXEL_ONE + SUBPIXEL_ONE / 2 };
+            int32_t rowEdge[3];
+            int32_t stepX[3];
+            int32_t stepY[3];
+            bool rejected = false;
+            for (int e = 0; e < 3 && !rejected; e++)
+            {
+                int64_t minValue = INT64_MAX;
+                int64_t maxValue = INT64_MIN;
+                for (int cy = 0; cy < 2; cy++)
+                {
+                    for (int cx = 0; cx < 2; cx++)
+                    {
+                        int64_t value = triangle.edgeA[e] * cornerX[cx] + triangle.edgeB[e] * cornerY[cy] + triangle.edgeC[e];
+                        minValue = std::min(minValue, value);
+                        maxValue = std::max(maxValue, value);
+                    }
+                }
+
+                if (maxValue < 0)
+                {
+                    rejected = true;
+                }
+                else if (minValue >= 0)
+                {
+                    rowEdge[e] = 0;
+                    stepX[e] = 0;
+                    stepY[e] = 0;
+                }
+                else
+                {
+                    rowEdge[e] = (int32_t)(triangle.edgeA[e] * cornerX[0] + triangle.edgeB[e] * cornerY[0] + triangle.edgeC[e]);
+                    stepX[e] = triangle.edgeA[e] * SUBPIXEL_ONE;
+                    stepY[e] = triangle.edgeB[e] * SUBPIXEL_ONE;
+                }
+            }
+            if (rejected)
+            {
+                continue;
+            }
+
+            for (int32_t py = y0; py <= y1; py++)
+            {
+                uint32_t* dst = &pixels[(size_t)py * width + x0];
+                if (useAVX2)
+                {
+                    shadeSpanAVX2(dst, x1 - x0 + 1, rowEdge, stepX, triangle, x0 + 0.5f, py + 0.5f, threadStat);
+                }
+                else
+                {
+                    shadeSpanScalar(dst, x1 - x0 + 1, rowEdge, stepX, triangle, x0 + 0.5f, py + 0.5f, threadStat);
+                }
+                for (int e = 0; e < 3; e++)
+                {
+                    rowEdge[e] += stepY[e];
+                }
+            }
+        }
+    }
+}
+
+void SoftRasterizer::shadeSpanScalar(uint32_t* dst, int32_t count, const int32_t edge[3], const int32_t step[3], const Triangle& triangle, float px, float py, ThreadStats& threadStat) const
+{
+    int32_t e0 = edge[0];
+    int32_t e1 = edge[1];
+    int32_t e2 = edge[2];
+    float r = triangle.colorBase[0] + triangle.colorDx[0] * px + triangle.colorDy[0] * py;
+    float g = triangle.colorBase[1] + triangle.colorDx[1] * px + triangle.colorDy[1] * py;
+    float b = triangle.colorBase[2] + triangle.colorDx[2] * px + triangle.colorDy[2] * py;
+
+    for (int32_t i = 0; i < count; i++)
+    {
+        //三个值都不为负时符号位都是0
+        if ((e0 | e1 | e2) >= 0)
+        {
+            dst[i] = packColor(r, g, b, 1.0f);
+            threadStat.pixelsWritten++;
+        }
+        e0 += step[0];
+        e1 += step[1];
+        e2 += step[2];
+        r += triangle.colorDx[0];
+        g += triangle.colorDx[1];
+        b += triangle.colorDx[2];
+    }
+}
+
+#if defined(SOFT_RASTER_X86)
+
+SOFT_RASTER_AVX2_TARGET
+void SoftRasterizer::shadeSpanAVX2(uint32_t* dst, int32_t count, const int32_t edge[3], const int32_t step[3], const Triangle& triangle, float px, float py, ThreadStats& threadStat) const
+{
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 unormScale = _mm256_set1_ps(255.0f);
+    const __m256 roundHalf = _mm256_set1_ps(0.5f);
+
+    //8个像素的边函数值，之后每次前进8个像素
+    __m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(edge[0]), _mm256_mullo_epi32(laneIndex, _mm256_set1_epi32(step[0])));
+    __m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(edge[1]), _mm256_mullo_epi32(laneIndex, _mm256_set1_epi32(step[1])));
+    __m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(edge[2]), _mm256_mullo_epi32(laneIndex, _mm256_set1_epi32(step[2])));
+    const __m256i blockStep0 = _mm256_set1_epi32(step[0] * 8);
+    const __m256i blockStep1 = _mm256_set1_epi32(step[1] * 8);
+    const __m256i blockStep2 = _mm256_set1_epi32(step[2] * 8);
+
+    //颜色平面方程，这一行的起点加上每个像素的增量
+    __m256 x = _mm256_add_ps(_mm256_set1_ps(px), _mm256_cvtepi32_ps(laneIndex));
+    const __m256 eight = _mm256_set1_ps(8.0f);
+    const __m256 rowR = _mm256_set1_ps(triangle.colorBase[0] + triangle.colorDy[0] * py);
+    const __m256 rowG = _mm256_set1_ps(triangle.colorBase[1] + triangle.colorDy[1] * py);
+    const __m256 rowB = _mm256_set1_ps(triangle.colorBase[2] + triangle.colorDy[2] * py);
+    const __m256 dxR = _mm256_set1_ps(triangle.colorDx[0]);
+    const __m256 dxG = _mm256_set1_ps(triangle.colorDx[1]);
+    const __m256 dxB = _mm256_set1_ps(triangle.colorDx[2]);
+
+    for (int32_t i = 0; i < count; i += 8)
+    {
+        __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(e0, minusOne), _mm256_cmpgt_epi32(e1, minusOne)), _mm256_cmpgt_epi32(e2, minusOne));
+        __m256i inRange = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), laneIndex);
+        __m256i mask = _mm256_and_si256(inside, inRange);
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+
+        if (bits != 0)
+        {
+            __m256 r = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(rowR, _mm256_mul_ps(dxR, x)), zero), one);
+            __m256 g = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(rowG, _mm256_mul_ps(dxG, x)), zero), one);
+            __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(rowB, _mm256_mul_ps(dxB, x)), zero), one);
+            __m256i ri = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(r, unormScale), roundHalf));
+            __m256i gi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(g, unormScale), roundHalf));
+            __m256i bi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(b, unormScale), roundHalf));
+            __m256i color = _mm256_or_si256(_mm256_or_si256(alpha, _mm256_slli_epi32(ri, 16)), _mm256_or_si256(_mm256_slli_epi32(gi, 8), bi));
+
+            _mm256_maskstore_epi32(reinterpret_cast<int*>(dst + i), mask, color);
+            threadStat.pixelsWritten += std::bitset<8>((unsigned)bits).count();
+        }
+
+        e0 = _mm256_add_epi32(e0, blockStep0);
+        e1 = _mm256_add_epi32(e1, blockStep1);
+        e2 = _mm256_add_epi32(e2, blockStep2);
+        x = _mm256_add_ps(x, eight);
+    }
+}
+
+#else
+
+void SoftRasterizer::shadeSpanAVX2(uint32_t* dst, int32_t count, const int32_t edge[3], const int32_t step[3], const Triangle& triangle, float px, float py, ThreadStats& threadStat) const
+{
+    shadeSpanScalar(dst, count, edge, step, triangle, px, py, threadStat);
+}
+
+#endif
+
+bool SoftRasterizer::writePPM(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row((size_t)width * 3);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint32_t pixel = pixels[(size_t)y * width + x];
+            row[x * 3 + 0] = (char)((pixel >> 16) & 0xFF);
+            row[x * 3 + 1] = (char)((pixel >> 8) & 0xFF);
+            row[x * 3 + 2] = (char)(pixel & 0xFF);
+        }
+        file.write(row.data(), row.size());
+    }
+    return file.good();
+}
+
+void SoftRasterizer::parallelRun(const std::function<void(uint32_t)>& job)
+{
+    WorkerPool::shared().parallelFor(threadCount, job);
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+
+/*
+软件光栅化后端：
+
+1. 与Vulkan管线使用相同的顶点数据和绘制列表，作为参考实现，也用于不需要Vulkan的小分辨率离线渲染
+2. 屏幕划分为TILE_SIZE大小的块，三角形先按包围盒分到块中（binning），再按块并行光栅化
+3. 顶点坐标转为28.4定点数，边函数用整数计算，遵循左上填充规则，共享边不会重复或漏掉像素
+4. 支持AVX2时一次计算一行中8个像素的边函数和颜色，否则使用标量路径
+
+与VertexShader.vert一致：顶点位置是裁剪空间的二维坐标（z = 0, w = 1），颜色在屏幕空间线性插值，
+与createGraphicsPipline一致：顺时针为正面，剔除背面。输出格式与交换链相同，为B8G8R8A8_UNORM。
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class SoftRasterizer
+{
+public:
+    //块的边长（像素）
+    static const uint32_t TILE_SIZE = 64;
+
+    //顶点数据的布局，offset的含义与VkVertexInputAttributeDescription相同
+    struct VertexLayout
+    {
+        const void* data;
+        size_t stride;
+        size_t positionOffset;//vec2
+        size_t colorOffset;//vec3
+    };
+
+    //一次绘制，参数与vkCmdDraw相同
+    struct Draw
+    {
+        uint32_t vertexCount;
+        uint32_t instanceCount;
+        uint32_t firstVertex;
+        uint32_t firstInstance;
+    };
+
+    //最近一次drawList的统计
+    struct Stats
+    {
+        uint64_t trianglesSubmitted = 0;
+        uint64_t trianglesCulled = 0;//背面、退化或超出保护带的三角形
+        uint64_t binEntries = 0;//三角形被分到块中的总次数
+        uint64_t pixelsWritten = 0;
+    };
+
+    //threadCount是分箱和光栅化的并行份数，为0时与WorkerPool的线程数相同
+    SoftRasterizer(uint32_t width, uint32_t height, uint32_t threadCount = 0);
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+    //用指定颜色清除整个颜色缓冲
+    void clear(const float color[4]);
+
+    //按顺序绘制一个绘制列表，后绘制的三角形覆盖先绘制的
+    void drawList(const VertexLayout& layout, uint32_t vertexCount, const std::vector<Draw>& draws);
+
+    //B8G8R8A8格式的颜色缓冲，按行存储
+    const std::vector<uint32_t>& colorBuffer() const { return pixels; }
+
+    //保存为PPM图片
+    bool writePPM(const std::string& path) const;
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    uint32_t getThreadCount() const { return threadCount; }
+    bool isAVX2Enabled() const { return useAVX2; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    //完成设置的三角形：三条边的边函数E(x, y) = A * x + B * y + C（定点像素中心坐标，C已包含填充规则的偏移，
+    //E >= 0 表示在边的内侧）、像素包围盒、颜色的平面方程。minX > maxX 表示已被剔除
+    struct Triangle
+    {
+        int32_t edgeA[3];
+        int32_t edgeB[3];
+        int64_t edgeC[3];
+        int32_t minX, minY, maxX, maxY;
+        float colorBase[3];//颜色在像素(0,0)处的值
+        float colorDx[3];//沿x每个像素的变化
+        float colorDy[3];//沿y每个像素的变化
+    };
+
+    //每个线程的统计，最后汇总
+    struct ThreadStats
+    {
+        uint64_t culled = 0;
+        uint64_t binEntries = 0;
+        uint64_t pixelsWritten = 0;
+    };
+
+    bool setupTriangle(const VertexLayout& layout, uint32_t i0, uint32_t i1, uint32_t i2, Triangle& triangle) const;
+    void binTriangles(uint32_t threadIndex);
+    void rasterizeTile(uint32_t tileIndex, ThreadStats& threadStats);
+    void shadeSpanScalar(uint32_t* dst, int32_t count, const int32_t edge[3], const int32_t step[3], const Triangle& triangle, float px, float py, ThreadStats& threadStats) const;
+    void shadeSpanAVX2(uint32_t* dst, int32_t count, const int32_t edge[3], const int32_t step[3], const Triangle& triangle, float px, float py, ThreadStats& threadStats) const;
+
+    //在WorkerPool上把同一个任务运行threadCount份，返回时都已完成
+    void parallelRun(const std::function<void(uint32_t)>& job);
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t threadCount;
+    bool useAVX2;
+
+    std::vector<uint32_t> pixels;
+    std::vector<uint32_t> triangleIndices;//当前绘制列表展开后的顶点索引，每三个一个三角形
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;//bins[线程 * 块数 + 块]，每个线程按三角形顺序写入自己的分组
+    std::vector<ThreadStats> threadStats;
+    const VertexLayout* currentLayout = nullptr;
+    std::atomic<uint32_t> nextTile;
+    Stats stats;
+};
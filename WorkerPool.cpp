@@ -0,0 +1,293 @@
+﻿#include "WorkerPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+WorkerPool& WorkerPool::shared()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (uint32_t i = 1; i < threadCount; i++)
+    {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskCondition.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void WorkerPool::run(Batch& batch, uint32_t count, Task task)
+{
+    batch.ownedTask = std::move(task);
+    submit(batch, count, &batch.ownedTask);
+}
+
+void WorkerPool::parallelFor(uint32_t count, const Task& task)
+{
+    //只有一个任务或者没有工作线程时不经过队列
+    if (count == 1 || workers.empty())
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    Batch batch;
+    submit(batch, count, &task);
+    wait(batch);
+}
+
+void WorkerPool::submit(Batch& batch, uint32_t count, const Task* task)
+{
+    if (!batch.isDone())
+    {
+        throw std::logic_error("worker pool batch submitted again before it finished!");
+    }
+    batch.task = task;
+    batch.count = count;
+    batch.next = 0;
+    batch.finished = 0;
+    batch.error = nullptr;
+    batch.nextBatch = nullptr;
+    if (count == 0)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queueTail != nullptr)
+        {
+            queueTail->nextBatch = &batch;
+        }
+        else
+        {
+            queueHead = &batch;
+        }
+        queueTail = &batch;
+    }
+    if (count == 1)
+    {
+        taskCondition.notify_one();
+    }
+    else
+    {
+        taskCondition.notify_all();
+    }
+}
+
+void WorkerPool::wait(Batch& batch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (runOne(batch, lock))
+    {
+    }
+    //剩下的任务已经被工作线程领走
+    doneCondition.wait(lock, [&batch] { return batch.isDone(); });
+
+    if (batch.error)
+    {
+        std::exception_ptr error = batch.error;
+        batch.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+bool WorkerPool::runOne(Batch& batch, std::unique_lock<std::mutex>& lock)
+{
+    if (batch.next == batch.count)
+    {
+        return false;
+    }
+
+    uint32_t index = batch.next++;
+    if (batch.next == batch.count)
+    {
+        //最后一个任务被领取，批次离开队列
+        Batch** link = &queueHead;
+        Batch* previous = nullptr;
+        while (*link != &batch)
+        {
+            previous = *link;
+            link = &(*link)->nextBatch;
+        }
+        *link = batch.nextBatch;
+        if (queueTail == &batch)
+        {
+            queueTail = previous;
+        }
+        batch.nextBatch = nullptr;
+    }
+
+    lock.unlock();
+    std::exception_ptr error;
+    try
+    {
+        (*batch.task)(index);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    lock.lock();
+
+    if (error && !batch.error)
+    {
+        batch.error = error;
+    }
+    if (++batch.finished == batch.count)
+    {
+        doneCondition.notify_all();
+    }
+    return true;
+}
+
+void WorkerPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        taskCondition.wait(lock, [this] { return stopping || queueHead != nullptr; });
+        if (stopping)
+        {
+            return;
+        }
+        runOne(*queueHead, lock);
+    }
+}
+
+//------------------------------依赖图------------------------------
+
+TaskGraph::~TaskGraph()
+{
+    //按添加的顺序等待：等到一个节点时它的前置都已完成，需要提交的已经提交
+    for (auto& node : nodes)
+    {
+        try
+        {
+            pool.wait(node.batch);
+        }
+        catch (...)
+        {
+        }
+    }
+}
+
+TaskGraph::Node TaskGraph::add(std::function<void()> task, const std::vector<Node>& prerequisites)
+{
+    if (started)
+    {
+        throw std::logic_error("task graph node added after start!");
+    }
+    Node node = (Node)nodes.size();
+    for (Node prerequisite : prerequisites)
+    {
+        if (prerequisite >= node)
+        {
+            throw std::logic_error("task graph prerequisite must be added first!");
+        }
+        nodes[prerequisite].dependents.push_back(node);
+    }
+    nodes.emplace_back();
+    NodeState& state = nodes.back();
+    state.task = std::move(task);
+    state.remaining.store((uint32_t)prerequisites.size() + (state.task ? 1 : 2));
+    return node;
+}
+
+void TaskGraph::start()
+{
+    started = true;
+    for (Node node = 0; node < (Node)nodes.size(); node++)
+    {
+        release(node);
+    }
+}
+
+void TaskGraph::complete(Node event)
+{
+    if (nodes[event].task)
+    {
+        throw std::logic_error("only events can be completed by the caller!");
+    }
+    release(event);
+}
+
+void TaskGraph::wait()
+{
+    std::exception_ptr error;
+    for (auto& node : nodes)
+    {
+        try
+        {
+            pool.wait(node.batch);
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    for (auto& node : nodes)
+    {
+        if (!node.finished.load())
+        {
+            throw std::logic_error("task graph waited before all of its events completed!");
+        }
+    }
+}
+
+void TaskGraph::release(Node node)
+{
+    NodeState& state = nodes[node];
+    if (state.remaining.fetch_sub(1) != 1)
+    {
+        return;
+    }
+    if (!state.task)
+    {
+        finish(node);
+        return;
+    }
+    //依赖它的节点在任务中提交，所以wait(batch)返回时它们已经在池上
+    pool.run(state.batch, 1, [this, node](uint32_t)
+    {
+        nodes[node].task();
+        finish(node);
+    });
+}
+
+void TaskGraph::finish(Node node)
+{
+    nodes[node].finished.store(true);
+    for (Node dependent : nodes[node].dependents)
+    {
+        release(dependent);
+    }
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+/*
+进程共享的工作线程池：
+
+1. 常驻hardware_concurrency() - 1个工作线程，软件光栅化、动画、场景BVH、绘制排序和启动时的任务都用这一个池，
+   线程数不会随着系统的数量成倍增加
+2. 一批任务是task(0) ... task(count - 1)，任务的下标可以用来选择每个任务自己的临时数据。工作线程按提交的先后领取任务，
+   多个线程可以同时提交各自的批次
+3. wait等待一批任务完成，等待的线程也领取这一批中还没开始的任务，所以在任务中再提交、等待新的批次也不会死锁
+4. parallelFor是同步的run + wait：批次放在调用者的栈上，任务按引用传入，帧循环中调用不分配内存
+5. 任务抛出的第一个异常保存在批次中，由wait重新抛出
+6. TaskGraph在池上运行一组有依赖关系的任务（启动时读文件、创建着色器模块、编译管线），依赖都写在图里，不依赖等待的先后
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+    typedef std::function<void(uint32_t)> Task;
+
+    //一批任务，由提交者持有，wait返回之前不能销毁
+    class Batch
+    {
+    public:
+        Batch() = default;
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        //已经完成（或者还没有提交过）
+        bool isDone() const { return finished == count; }
+
+    private:
+        friend class WorkerPool;
+
+        Task ownedTask;//run按值传入的任务
+        const Task* task = nullptr;
+        uint32_t count = 0;
+        uint32_t next = 0;//下一个要领取的任务
+        uint32_t finished = 0;
+        std::exception_ptr error;
+        Batch* nextBatch = nullptr;//还有任务没被领取的批次组成的队列
+    };
+
+    //整个进程共用的池，第一次调用时启动
+    static WorkerPool& shared();
+
+    //threadCount包括提交任务的线程，为0时使用硬件线程数
+    explicit WorkerPool(uint32_t threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    //工作线程数加上调用线程，适合用作一次并行划分的份数
+    uint32_t getThreadCount() const { return (uint32_t)workers.size() + 1; }
+
+    //提交count个任务后立即返回
+    void run(Batch& batch, uint32_t count, Task task);
+
+    //等待batch的所有任务完成，调用线程也参与执行
+    void wait(Batch& batch);
+
+    //执行count个任务，返回时全部完成
+    void parallelFor(uint32_t count, const Task& task);
+
+private:
+    void submit(Batch& batch, uint32_t count, const Task* task);
+    //从batch领取一个任务并执行，lock在执行期间释放；batch没有剩余任务时返回false
+    bool runOne(Batch& batch, std::unique_lock<std::mutex>& lock);
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable taskCondition;//有新的批次或者要退出
+    std::condition_variable doneCondition;//有批次完成
+    Batch* queueHead = nullptr;
+    Batch* queueTail = nullptr;
+    bool stopping = false;
+};
+
+//依赖图：一个节点的前置节点全部完成后，它的任务作为一批提交到池上；没有任务的节点是外部事件，由调用者complete。
+//前置节点必须先添加，所以图中没有环
+class TaskGraph
+{
+public:
+    typedef uint32_t Node;
+
+    explicit TaskGraph(WorkerPool& pool) : pool(pool) {}
+    //等待已经提交的任务，异常退出时任务不会在图销毁之后继续运行
+    ~TaskGraph();
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    Node add(std::function<void()> task, const std::vector<Node>& prerequisites = {});
+    Node addEvent(const std::vector<Node>& prerequisites = {}) { return add(nullptr, prerequisites); }
+
+    //提交没有前置的节点，之后不能再添加
+    void start();
+    //外部事件发生
+    void complete(Node event);
+
+    //等待所有节点完成，重新抛出第一个异常；有节点因为事件没有发生而无法运行时也抛出
+    void wait();
+
+private:
+    struct NodeState
+    {
+        std::function<void()> task;
+        std::vector<Node> dependents;
+        std::atomic<uint32_t> remaining{ 0 };//还没完成的前置，加上start和complete各占一个
+        std::atomic<bool> finished{ false };
+        WorkerPool::Batch batch;
+    };
+
+    void release(Node node);
+    void finish(Node node);
+
+    WorkerPool& pool;
+    std::deque<NodeState> nodes;//deque扩展时不移动已有的节点
+    bool started = false;
+};
@@ -0,0 +1,8 @@
+@echo off
+rem GPU粒子的基准测试：按粒子数量扫描，第一个参数是lavapipe的ICD json（不给时使用系统的驱动）
+rem 用法：bench_particles.bat C:\mesa\x64\lvp_icd.x86_64.json
+if not "%~1"=="" set VK_ICD_FILENAMES=%~1
+for %%n in (1000 10000 100000 1000000) do (
+    echo particles %%n
+    x64\Release\MyRender.exe --bench 300 --characters 0 --particles %%n
+)
@@ -1,10 +1,27 @@
 #version 450
 
+//特化常量，与MyRender.cpp中的SceneShaderVariant一致
+layout(constant_id = 1) const uint FEATURE_BITS = 1u;
+
+//与MyRender.cpp中的SCENE_FEATURE_*一致
+const uint FEATURE_VERTEX_COLOR = 1u << 0;
+const uint FEATURE_OVERDRAW = 1u << 1;
+
+//Overdraw视图：每个片段加上的增量，UpscaleShader.frag按同样的步长还原片段数
+const float OVERDRAW_STEP = 1.0 / 16.0;
+
 layout(location = 0) in vec3 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
 void main() 
 {
-    outColor = vec4(fragColor, 1.0);
+    if ((FEATURE_BITS & FEATURE_OVERDRAW) != 0u)
+    {
+        outColor = vec4(OVERDRAW_STEP, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    vec3 color = (FEATURE_BITS & FEATURE_VERTEX_COLOR) != 0u ? fragColor : vec3(1.0);
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
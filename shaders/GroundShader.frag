@@ -0,0 +1,57 @@
+#version 450
+
+//级联数，与MyRender.cpp中的SHADOW_CASCADES一致
+#define SHADOW_CASCADES 3
+
+//与MyRender.cpp中的ShadowBufferObject一致
+layout(binding = 1) uniform ShadowBuffer
+{
+    mat4 lightViewProj[SHADOW_CASCADES];
+    vec4 cascadeRadius;//每个级联覆盖的半径，按从近到远排列
+    vec4 groundColor;
+    vec4 focus;//级联的中心
+} shadow;
+
+//深度图数组：前SHADOW_CASCADES层是静态几何的缓存，后SHADOW_CASCADES层是每帧重画的动态物体
+layout(binding = 2) uniform sampler2DArrayShadow shadowMap;
+
+//阴影中地面颜色的比例
+const float SHADOW_DARKNESS = 0.45;
+//比较前减去的深度，避免地面自己遮挡自己
+const float DEPTH_BIAS = 0.002;
+
+layout(location = 0) in vec2 worldPosition;
+
+layout(location = 0) out vec4 outColor;
+
+//2x2 PCF，返回被照亮的比例
+float sampleLayer(vec3 coord, uint layer)
+{
+    vec4 p = vec4(coord.xy, float(layer), coord.z);
+    float lit = texture(shadowMap, p);
+    lit += textureOffset(shadowMap, p, ivec2(1, 0));
+    lit += textureOffset(shadowMap, p, ivec2(0, 1));
+    lit += textureOffset(shadowMap, p, ivec2(1, 1));
+    return lit * 0.25;
+}
+
+void main() 
+{
+    float focusDistance = length(worldPosition - shadow.focus.xy);
+    uint cascade = 0u;
+    while (cascade < SHADOW_CASCADES && focusDistance >= shadow.cascadeRadius[cascade])
+    {
+        cascade++;
+    }
+
+    //最远的级联之外没有阴影
+    float lit = 1.0;
+    if (cascade < SHADOW_CASCADES)
+    {
+        vec4 light = shadow.lightViewProj[cascade] * vec4(worldPosition, 0.0, 1.0);
+        vec3 coord = vec3(light.xy * 0.5 + 0.5, light.z - DEPTH_BIAS);
+        //静态层和动态层分别比较，取遮挡多的一个，相当于把动态物体的阴影叠加在缓存的静态阴影上
+        lit = min(sampleLayer(coord, cascade), sampleLayer(coord, cascade + SHADOW_CASCADES));
+    }
+    outColor = vec4(shadow.groundColor.rgb * mix(1.0 - SHADOW_DARKNESS, 1.0, lit), shadow.groundColor.a);
+}
\ No newline at end of file
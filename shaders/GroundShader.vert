@@ -0,0 +1,25 @@
+#version 450
+#extension GL_EXT_multiview : enable
+
+//一个pass中最多的相机数，与MyRender.cpp中的MAX_CAMERA_VIEWS一致
+#define MAX_VIEWS 8
+
+//特化常量，与MyRender.cpp中的SceneShaderVariant一致
+layout(constant_id = 0) const uint VIEW_COUNT = 1u;
+
+layout(binding = 0) uniform CameraBuffer
+{
+    mat4 viewProj[MAX_VIEWS];
+} cameras;
+
+layout(location = 0) out vec2 worldPosition;
+
+//全屏三角形，每个像素反投影回地面（z=0）上的位置
+void main() 
+{
+    vec2 clip = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2) * 2.0 - 1.0;
+    int view = VIEW_COUNT > 1u ? gl_ViewIndex : 0;
+    //相机矩阵不改变z和w，地面上的点反投影之后仍在地面上
+    worldPosition = (inverse(cameras.viewProj[view]) * vec4(clip, 0.0, 1.0)).xy;
+    gl_Position = vec4(clip, 0.0, 1.0);
+}
\ No newline at end of file
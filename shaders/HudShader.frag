@@ -0,0 +1,45 @@
+#version 450
+
+//性能HUD：纯色矩形直接输出顶点颜色；字形按5x7点阵查表，点阵外的片段透明，与交换链图像按alpha混合
+
+//与PerfHud.h一致
+const uint SOLID = 0xffffu;
+
+//ASCII 32~95的点阵，每个字形两个uint：第一个是第0~3行，第二个是第4~6行，每行一个字节，最高的第4位是最左边的点
+const uint FONT[128] = uint[](
+    0x00000000u, 0x00000000u, 0x04040404u, 0x00040004u, 0x00000a0au, 0x00000000u, 0x0a1f0a0au, 0x000a0a1fu, //32~35: 空格 ! " #
+    0x0e140f04u, 0x00041e05u, 0x04021918u, 0x00031308u, 0x0814120cu, 0x000d1215u, 0x00000404u, 0x00000000u, //36~39: $ % & '
+    0x08080402u, 0x00020408u, 0x02020408u, 0x00080402u, 0x0e150400u, 0x00000415u, 0x1f040400u, 0x00000404u, //40~43: ( ) * +
+    0x00000000u, 0x0008040cu, 0x1f000000u, 0x00000000u, 0x00000000u, 0x000c0c00u, 0x04020100u, 0x00001008u, //44~47: , - . /
+    0x1513110eu, 0x000e1119u, 0x04040c04u, 0x000e0404u, 0x0201110eu, 0x001f0804u, 0x0204021fu, 0x000e1101u, //48~51: 0 1 2 3
+    0x120a0602u, 0x0002021fu, 0x011e101fu, 0x000e1101u, 0x1e100806u, 0x000e1111u, 0x0402011fu, 0x00080808u, //52~55: 4 5 6 7
+    0x0e11110eu, 0x000e1111u, 0x0f11110eu, 0x000c0201u, 0x000c0c00u, 0x00000c0cu, 0x000c0c00u, 0x0008040cu, //56~59: 8 9 : ;
+    0x10080402u, 0x00020408u, 0x001f0000u, 0x0000001fu, 0x01020408u, 0x00080402u, 0x0201110eu, 0x00040004u, //60~63: < = > ?
+    0x0d01110eu, 0x000e1515u, 0x1f11110eu, 0x00111111u, 0x1e11111eu, 0x001e1111u, 0x1010110eu, 0x000e1110u, //64~67: @ A B C
+    0x1111121cu, 0x001c1211u, 0x1e10101fu, 0x001f1010u, 0x1e10101fu, 0x00101010u, 0x1710110eu, 0x000f1111u, //68~71: D E F G
+    0x1f111111u, 0x00111111u, 0x0404040eu, 0x000e0404u, 0x02020207u, 0x000c1202u, 0x18141211u, 0x00111214u, //72~75: H I J K
+    0x10101010u, 0x001f1010u, 0x15151b11u, 0x00111111u, 0x15191111u, 0x00111113u, 0x1111110eu, 0x000e1111u, //76~79: L M N O
+    0x1e11111eu, 0x00101010u, 0x1111110eu, 0x000d1215u, 0x1e11111eu, 0x00111214u, 0x0e10100fu, 0x001e0101u, //80~83: P Q R S
+    0x0404041fu, 0x00040404u, 0x11111111u, 0x000e1111u, 0x11111111u, 0x00040a11u, 0x15111111u, 0x000a1515u, //84~87: T U V W
+    0x040a1111u, 0x0011110au, 0x040a1111u, 0x00040404u, 0x0402011fu, 0x001f1008u, 0x0808080eu, 0x000e0808u, //88~91: X Y Z [
+    0x04081000u, 0x00000102u, 0x0202020eu, 0x000e0202u, 0x00110a04u, 0x00000000u, 0x00000000u, 0x001f0000u //92~95: 反斜杠 ] ^ _
+);
+
+layout(location = 0) in vec2 fragCell;
+layout(location = 1) flat in uint fragGlyph;
+layout(location = 2) in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() 
+{
+    float coverage = 1.0;
+    if (fragGlyph != SOLID)
+    {
+        ivec2 cell = clamp(ivec2(fragCell), ivec2(0), ivec2(4, 6));
+        uint rows = FONT[fragGlyph * 2u + uint(cell.y >> 2)];
+        uint bits = (rows >> (uint(cell.y & 3) * 8u)) & 0xffu;
+        coverage = float((bits >> uint(4 - cell.x)) & 1u);
+    }
+    outColor = vec4(fragColor.rgb, fragColor.a * coverage);
+}
\ No newline at end of file
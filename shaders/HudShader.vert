@@ -0,0 +1,25 @@
+#version 450
+
+//性能HUD：文字和矩形的四边形，位置是左上角为原点的像素坐标
+
+layout(push_constant) uniform HudParams
+{
+    vec2 pixelToClip;//2 / 交换链大小
+} params;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inCell;
+layout(location = 2) in uint inGlyph;
+layout(location = 3) in vec4 inColor;
+
+layout(location = 0) out vec2 fragCell;
+layout(location = 1) flat out uint fragGlyph;
+layout(location = 2) out vec4 fragColor;
+
+void main() 
+{
+    fragCell = inCell;
+    fragGlyph = inGlyph;
+    fragColor = inColor;
+    gl_Position = vec4(inPosition * params.pixelToClip - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
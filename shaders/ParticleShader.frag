@@ -0,0 +1,27 @@
+#version 450
+
+//粒子：圆形的柔和衰减，与离屏目标相加混合，绘制顺序不影响结果
+
+//特化常量，与MyRender.cpp中的SceneShaderVariant一致
+layout(constant_id = 1) const uint FEATURE_BITS = 1u;
+
+//与FragmentShader.frag一致
+const uint FEATURE_OVERDRAW = 1u << 1;
+const float OVERDRAW_STEP = 1.0 / 16.0;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragOffset;
+
+layout(location = 0) out vec4 outColor;
+
+void main() 
+{
+    if ((FEATURE_BITS & FEATURE_OVERDRAW) != 0u)
+    {
+        outColor = vec4(OVERDRAW_STEP, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    float falloff = max(1.0 - dot(fragOffset, fragOffset), 0.0);
+    outColor = vec4(fragColor * falloff * falloff, 0.0);
+}
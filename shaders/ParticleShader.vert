@@ -0,0 +1,38 @@
+#version 450
+#extension GL_EXT_multiview : enable
+
+//粒子：每个实例是一个粒子，6个顶点组成一个面向屏幕的方块，大小随剩余寿命缩小
+
+//一个pass中最多的相机数，与MyRender.cpp中的MAX_CAMERA_VIEWS一致
+#define MAX_VIEWS 8
+
+//特化常量，与MyRender.cpp中的SceneShaderVariant一致
+layout(constant_id = 0) const uint VIEW_COUNT = 1u;
+
+const float PARTICLE_SIZE = 0.012;
+
+const vec2 CORNERS[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(-1.0, 1.0), vec2(1.0, -1.0), vec2(1.0, 1.0));
+
+layout(binding = 0) uniform CameraBuffer
+{
+    mat4 viewProj[MAX_VIEWS];
+} cameras;
+
+//实例属性，与粒子缓冲中的Particle一致
+layout(location = 0) in vec4 inPositionVelocity;
+layout(location = 1) in vec4 inColorLife;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragOffset;
+
+void main() 
+{
+    int view = VIEW_COUNT > 1u ? gl_ViewIndex : 0;
+    float fade = clamp(inColorLife.a, 0.0, 1.0);
+    vec2 corner = CORNERS[gl_VertexIndex];
+    vec2 position = inPositionVelocity.xy + corner * PARTICLE_SIZE * (0.5 + 0.5 * fade);
+
+    gl_Position = cameras.viewProj[view] * vec4(position, 0.0, 1.0);
+    fragColor = inColorLife.rgb * fade;
+    fragOffset = corner;
+}
@@ -0,0 +1,28 @@
+#version 450
+
+//级联数，与MyRender.cpp中的SHADOW_CASCADES一致
+#define SHADOW_CASCADES 3
+
+//与MyRender.cpp中的ShadowBufferObject一致
+layout(binding = 1) uniform ShadowBuffer
+{
+    mat4 lightViewProj[SHADOW_CASCADES];
+    vec4 cascadeRadius;
+    vec4 groundColor;
+    vec4 focus;
+} shadow;
+
+//与MyRender.cpp中的ShadowPushConstants一致
+layout(push_constant) uniform ShadowPushConstants
+{
+    uint cascade;
+    float height;//投影物离地面的高度
+} caster;
+
+layout(location = 0) in vec2 inPosition;
+
+//只写深度的管线，没有片段着色器
+void main() 
+{
+    gl_Position = shadow.lightViewProj[caster.cascade] * vec4(inPosition, caster.height, 1.0);
+}
\ No newline at end of file
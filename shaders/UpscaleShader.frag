@@ -0,0 +1,112 @@
+#version 450
+
+//把动态分辨率渲染的离屏目标放大到交换链，并做对比度自适应的锐化
+//离屏目标的每一层是一个相机的视图，多视图时按网格排列
+
+layout(location = 0) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2DArray sceneColor;
+
+//特化常量，与MyRender.cpp中的UpscaleShaderVariant一致，运行期间不变的参数由驱动在编译时代入
+layout(constant_id = 0) const int VIEW_COUNT = 1;   //离屏目标的层数
+layout(constant_id = 1) const int GRID_COLUMNS = 1; //显示所有视图的网格
+layout(constant_id = 2) const int GRID_ROWS = 1;
+layout(constant_id = 3) const bool SHARPEN = true;  //为false时只做双线性放大
+layout(constant_id = 4) const bool OVERDRAW_HEATMAP = false; //离屏目标的r是片段数乘以OVERDRAW_STEP，按热力图显示
+
+//与FragmentShader.frag一致
+const float OVERDRAW_STEP = 1.0 / 16.0;
+
+layout(push_constant) uniform UpscaleParams
+{
+    vec2 uvScale;    //有效区域占离屏目标的比例
+    vec2 texelSize;  //离屏目标一个像素的uv大小
+    vec2 footprint;  //输出的一个像素覆盖离屏目标的像素数，超采样时大于1
+    float sharpness; //锐化强度
+} params;
+
+vec3 fetch(vec2 uv, float layer)
+{
+    //只在有效区域内采样，避免读到上一帧更大分辨率时留下的内容
+    //最后一个有效像素的中心是(renderExtent - 0.5) / 离屏目标大小，即uvScale - texelSize * 0.5
+    vec2 maxUV = params.uvScale - params.texelSize * 0.5;
+    return texture(sceneColor, vec3(clamp(uv, params.texelSize * 0.5, maxUV), layer)).rgb;
+}
+
+//超采样时一个输出像素覆盖多个离屏像素，单次双线性采样会漏掉其中一部分而产生走样
+//在覆盖范围的四个象限中心各做一次双线性采样取平均，近似整个范围的盒式滤波
+vec3 resolve(vec2 uv, float layer)
+{
+    vec2 offset = params.footprint * params.texelSize * 0.25;
+    vec3 sum = fetch(uv + vec2(-offset.x, -offset.y), layer);
+    sum += fetch(uv + vec2(offset.x, -offset.y), layer);
+    sum += fetch(uv + vec2(-offset.x, offset.y), layer);
+    sum += fetch(uv + vec2(offset.x, offset.y), layer);
+    return sum * 0.25;
+}
+
+//片段数的热力图：0黑，1蓝，2绿，3黄，4红，之后逐渐变白
+vec3 heatmap(float count)
+{
+    const vec3 RAMP[6] = vec3[6](vec3(0.0), vec3(0.0, 0.2, 1.0), vec3(0.0, 0.9, 0.2), vec3(1.0, 0.9, 0.0), vec3(1.0, 0.1, 0.0), vec3(1.0));
+    float position = clamp(count, 0.0, 4.0) + clamp((count - 4.0) / 12.0, 0.0, 1.0);
+    int index = min(int(position), 4);
+    return mix(RAMP[index], RAMP[index + 1], position - float(index));
+}
+
+void main() 
+{
+    float layer = 0.0;
+    vec2 uv = fragUV * params.uvScale;
+    if (VIEW_COUNT > 1)
+    {
+        //找到这个像素所在的网格和对应的视图
+        vec2 grid = vec2(GRID_COLUMNS, GRID_ROWS);
+        vec2 cell = min(floor(fragUV * grid), grid - 1.0);
+        int view = int(cell.y) * GRID_COLUMNS + int(cell.x);
+        if (view >= VIEW_COUNT)
+        {
+            outColor = vec4(0.0, 0.0, 0.0, 1.0);
+            return;
+        }
+        layer = float(view);
+        uv = (fragUV * grid - cell) * params.uvScale;
+    }
+
+    if (OVERDRAW_HEATMAP)
+    {
+        outColor = vec4(heatmap(floor(fetch(uv, layer).r / OVERDRAW_STEP + 0.5)), 1.0);
+        return;
+    }
+    if (max(params.footprint.x, params.footprint.y) > 1.0)
+    {
+        //缩小时不需要锐化
+        outColor = vec4(resolve(uv, layer), 1.0);
+        return;
+    }
+
+    vec3 center = fetch(uv, layer);
+    if (!SHARPEN)
+    {
+        outColor = vec4(center, 1.0);
+        return;
+    }
+
+    vec3 north = fetch(uv + vec2(0.0, -params.texelSize.y), layer);
+    vec3 south = fetch(uv + vec2(0.0, params.texelSize.y), layer);
+    vec3 west = fetch(uv + vec2(-params.texelSize.x, 0.0), layer);
+    vec3 east = fetch(uv + vec2(params.texelSize.x, 0.0), layer);
+
+    //邻域的最小最大值，用来限制锐化后的结果，防止出现光晕
+    vec3 minColor = min(center, min(min(north, south), min(west, east)));
+    vec3 maxColor = max(center, max(max(north, south), max(west, east)));
+
+    //高对比度的区域降低锐化强度
+    vec3 contrast = maxColor - minColor;
+    vec3 amount = params.sharpness * (1.0 - clamp(contrast, 0.0, 1.0));
+
+    vec3 sharpened = center + (4.0 * center - north - south - west - east) * amount * 0.25;
+    outColor = vec4(clamp(sharpened, minColor, maxColor), 1.0);
+}
@@ -0,0 +1,10 @@
+#version 450
+
+//全屏三角形，覆盖整个交换链图像
+layout(location = 0) out vec2 fragUV;
+
+void main() 
+{
+    fragUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(fragUV * 2.0 - 1.0, 0.0, 1.0);
+}
\ No newline at end of file
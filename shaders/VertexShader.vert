@@ -1,24 +1,26 @@
-
 #version 450
+#extension GL_EXT_multiview : enable
 
-layout(location = 0) out vec3 fragColor;
+//一个pass中最多的相机数，与MyRender.cpp中的MAX_CAMERA_VIEWS一致
+#define MAX_VIEWS 8
+
+//特化常量，与MyRender.cpp中的SceneShaderVariant一致
+layout(constant_id = 0) const uint VIEW_COUNT = 1u;
 
-vec2 positions[3] = vec2[]
-(
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(binding = 0) uniform CameraBuffer
+{
+    mat4 viewProj[MAX_VIEWS];
+} cameras;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
 
-vec3 colors[3] = vec3[]
-(
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 fragColor;
 
 void main() 
 {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    //multiview时每个视图各执行一次，gl_ViewIndex选择对应的相机；只有一个视图时这个分支在编译时被去掉
+    int view = VIEW_COUNT > 1u ? gl_ViewIndex : 0;
+    gl_Position = cameras.viewProj[view] * vec4(inPosition, 0.0, 1.0);
+    fragColor = inColor;
+}
@@ -1,2 +1,14 @@
 F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V VertexShader.vert
-F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V FragmentShader.frag
\ No newline at end of file
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V FragmentShader.frag
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V UpscaleShader.vert -o upscale_vert.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V UpscaleShader.frag -o upscale_frag.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V SkinningShader.comp -o skinning_comp.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V ParticleShader.comp -o particle_comp.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V ParticleShader.vert -o particle_vert.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V ParticleShader.frag -o particle_frag.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V ShadowShader.vert -o shadow_vert.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V GroundShader.vert -o ground_vert.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V GroundShader.frag -o ground_frag.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V PostProcess.comp -o post_comp.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V HudShader.vert -o hud_vert.spv
+F:\MyRender\vulkanSDK\vulkan\Bin\glslangValidator.exe -V HudShader.frag -o hud_frag.spv
\ No newline at end of file